@@ -26,11 +26,20 @@
 #include <linux/workqueue.h>
 #include <linux/kthread.h>
 #include <linux/mutex.h>
+#include <linux/input.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
 
 #include <asm/cputime.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/cpufreq_interactive.h>
+
 static atomic_t active_count = ATOMIC_INIT(0);
 
+/* Number of recent load samples kept per CPU, see load_history in sysfs */
+#define LOAD_HISTORY_LEN 8
+
 struct cpufreq_interactive_cpuinfo {
 	struct timer_list cpu_timer;
 	int timer_idlecancel;
@@ -43,7 +52,10 @@ struct cpufreq_interactive_cpuinfo {
 	struct cpufreq_policy *policy;
 	struct cpufreq_frequency_table *freq_table;
 	unsigned int target_freq;
+	u64 hispeed_validate_time;
 	int governor_enabled;
+	unsigned int load_history[LOAD_HISTORY_LEN];
+	unsigned int load_history_idx;
 };
 
 static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, cpuinfo);
@@ -58,10 +70,45 @@ static cpumask_t down_cpumask;
 static spinlock_t down_cpumask_lock;
 static struct mutex set_speed_lock;
 
-/* Go to max speed when CPU load at or above this value. */
+/*
+ * Go to hispeed_freq when CPU load at or above this value, and to max speed
+ * if the load stays there for above_hispeed_delay once at hispeed_freq.
+ */
 #define DEFAULT_GO_MAXSPEED_LOAD 95
 static unsigned long go_maxspeed_load;
 
+/* Intermediate speed to jump to on a load spike, 0 until set to max speed */
+static unsigned int hispeed_freq;
+
+/* Time to stay at hispeed_freq or above before going higher */
+#define DEFAULT_ABOVE_HISPEED_DELAY 20000
+static unsigned long above_hispeed_delay;
+
+/*
+ * Target load per frequency range: load [freq:load]..., each load applies
+ * from the frequency before it up to the next frequency.  Below
+ * go_maxspeed_load the lowest speed that keeps the load at or under its
+ * target is chosen.
+ */
+#define DEFAULT_TARGET_LOAD 90
+static unsigned int default_target_loads[] = {DEFAULT_TARGET_LOAD};
+static spinlock_t target_loads_lock;
+static unsigned int *target_loads = default_target_loads;
+static int ntarget_loads = ARRAY_SIZE(default_target_loads);
+
+/*
+ * Input events raise every CPU to input_boost_freq (hispeed_freq when 0)
+ * and keep them at least there for input_boost_duration, so the first
+ * frames after a touch don't wait for the timer to notice the load.
+ * A duration of 0 disables the boost.
+ */
+#define DEFAULT_INPUT_BOOST_DURATION 80000
+static unsigned int input_boost_freq;
+static unsigned long input_boost_duration;
+static spinlock_t boost_lock;
+static u64 boost_until;
+static bool input_handler_registered;
+
 /*
  * The minimum amount of time to spend at a frequency before we can ramp down.
  */
@@ -87,6 +134,135 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 	.owner = THIS_MODULE,
 };
 
+static unsigned int freq_to_targetload(unsigned int freq)
+{
+	int i;
+	unsigned int ret;
+	unsigned long flags;
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+
+	for (i = 0; i < ntarget_loads - 1 && freq >= target_loads[i+1]; i += 2)
+		;
+
+	ret = target_loads[i];
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+	return ret;
+}
+
+/*
+ * If increasing frequencies never map to a lower target load then
+ * choose_freq() will find the minimum frequency that does not exceed its
+ * target load given the current load, scaled by the current speed, in
+ * @loadadjfreq.
+ */
+static unsigned int choose_freq(struct cpufreq_interactive_cpuinfo *pcpu,
+				unsigned int loadadjfreq)
+{
+	unsigned int freq = pcpu->policy->cur;
+	unsigned int prevfreq, freqmin, freqmax;
+	unsigned int tl;
+	unsigned int index;
+
+	freqmin = 0;
+	freqmax = UINT_MAX;
+
+	do {
+		prevfreq = freq;
+		tl = freq_to_targetload(freq);
+
+		/*
+		 * Find the lowest frequency where the computed load is less
+		 * than or equal to the target load.
+		 */
+		if (cpufreq_frequency_table_target(pcpu->policy,
+						   pcpu->freq_table,
+						   loadadjfreq / tl,
+						   CPUFREQ_RELATION_L, &index))
+			break;
+		freq = pcpu->freq_table[index].frequency;
+
+		if (freq > prevfreq) {
+			/* The previous frequency is too low. */
+			freqmin = prevfreq;
+
+			if (freq >= freqmax) {
+				/*
+				 * Find the highest frequency that is less
+				 * than freqmax.
+				 */
+				if (cpufreq_frequency_table_target(
+					    pcpu->policy, pcpu->freq_table,
+					    freqmax - 1, CPUFREQ_RELATION_H,
+					    &index))
+					break;
+				freq = pcpu->freq_table[index].frequency;
+
+				if (freq == freqmin) {
+					/*
+					 * The first frequency below freqmax
+					 * has already been found to be too
+					 * low.  freqmax is the lowest speed
+					 * we found that is fast enough.
+					 */
+					freq = freqmax;
+					break;
+				}
+			}
+		} else if (freq < prevfreq) {
+			/* The previous frequency is high enough. */
+			freqmax = prevfreq;
+
+			if (freq <= freqmin) {
+				/*
+				 * Find the lowest frequency that is higher
+				 * than freqmin.
+				 */
+				if (cpufreq_frequency_table_target(
+					    pcpu->policy, pcpu->freq_table,
+					    freqmin + 1, CPUFREQ_RELATION_L,
+					    &index))
+					break;
+				freq = pcpu->freq_table[index].frequency;
+
+				/*
+				 * If freqmax is the first frequency above
+				 * freqmin then we have already found that
+				 * this speed is fast enough.
+				 */
+				if (freq == freqmax)
+					break;
+			}
+		}
+
+		/* If same frequency chosen as previous then done. */
+	} while (freq != prevfreq);
+
+	return freq;
+}
+
+static unsigned int boost_freq(struct cpufreq_policy *policy)
+{
+	unsigned int freq = input_boost_freq ? input_boost_freq : hispeed_freq;
+
+	return min(freq, policy->max);
+}
+
+/* the frequency an input boost still holds this CPU at, or 0 */
+static unsigned int boost_floor(struct cpufreq_interactive_cpuinfo *pcpu)
+{
+	unsigned long flags;
+	u64 until;
+
+	spin_lock_irqsave(&boost_lock, flags);
+	until = boost_until;
+	spin_unlock_irqrestore(&boost_lock, flags);
+
+	if (ktime_to_us(ktime_get()) >= until)
+		return 0;
+	return boost_freq(pcpu->policy);
+}
+
 static void cpufreq_interactive_timer(unsigned long data)
 {
 	unsigned int delta_idle;
@@ -99,6 +275,8 @@ static void cpufreq_interactive_timer(unsigned long data)
 		&per_cpu(cpuinfo, data);
 	u64 now_idle;
 	unsigned int new_freq;
+	unsigned int floor_freq;
+	unsigned int reason;
 	unsigned int index;
 	unsigned long flags;
 
@@ -159,10 +337,39 @@ static void cpufreq_interactive_timer(unsigned long data)
 	if (load_since_change > cpu_load)
 		cpu_load = load_since_change;
 
-	if (cpu_load >= go_maxspeed_load)
-		new_freq = pcpu->policy->max;
-	else
-		new_freq = pcpu->policy->max * cpu_load / 100;
+	pcpu->load_history[pcpu->load_history_idx] = cpu_load;
+	pcpu->load_history_idx = (pcpu->load_history_idx + 1) %
+		LOAD_HISTORY_LEN;
+
+	if (cpu_load >= go_maxspeed_load) {
+		if (pcpu->target_freq < hispeed_freq) {
+			new_freq = hispeed_freq;
+			reason = INTERACTIVE_REASON_HISPEED;
+		} else {
+			new_freq = pcpu->policy->max;
+			reason = INTERACTIVE_REASON_MAXSPEED;
+		}
+	} else {
+		new_freq = choose_freq(pcpu, cpu_load * pcpu->policy->cur);
+		reason = INTERACTIVE_REASON_LOAD;
+	}
+
+	if (pcpu->target_freq >= hispeed_freq &&
+	    new_freq > pcpu->target_freq &&
+	    cputime64_sub(pcpu->timer_run_time, pcpu->hispeed_validate_time)
+	    < above_hispeed_delay) {
+		trace_cpufreq_interactive_notyet(data, cpu_load,
+				pcpu->policy->cur, pcpu->target_freq,
+				new_freq, INTERACTIVE_REASON_HISPEED_DELAY);
+		goto rearm;
+	}
+	pcpu->hispeed_validate_time = pcpu->timer_run_time;
+
+	floor_freq = boost_floor(pcpu);
+	if (floor_freq > new_freq) {
+		new_freq = floor_freq;
+		reason = INTERACTIVE_REASON_BOOST;
+	}
 
 	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
 					   new_freq, CPUFREQ_RELATION_H,
@@ -174,8 +381,12 @@ static void cpufreq_interactive_timer(unsigned long data)
 
 	new_freq = pcpu->freq_table[index].frequency;
 
-	if (pcpu->target_freq == new_freq)
+	if (pcpu->target_freq == new_freq) {
+		trace_cpufreq_interactive_already(data, cpu_load,
+				pcpu->policy->cur, pcpu->target_freq,
+				new_freq, reason);
 		goto rearm_if_notmax;
+	}
 
 	/*
 	 * Do not scale down unless we have been at this frequency for the
@@ -183,10 +394,17 @@ static void cpufreq_interactive_timer(unsigned long data)
 	 */
 	if (new_freq < pcpu->target_freq) {
 		if (cputime64_sub(pcpu->timer_run_time, pcpu->freq_change_time)
-		    < min_sample_time)
+		    < min_sample_time) {
+			trace_cpufreq_interactive_notyet(data, cpu_load,
+				pcpu->policy->cur, pcpu->target_freq,
+				new_freq, INTERACTIVE_REASON_MIN_SAMPLE_TIME);
 			goto rearm;
+		}
 	}
 
+	trace_cpufreq_interactive_target(data, cpu_load, pcpu->policy->cur,
+					 pcpu->target_freq, new_freq, reason);
+
 	if (new_freq < pcpu->target_freq) {
 		pcpu->target_freq = new_freq;
 		spin_lock_irqsave(&down_cpumask_lock, flags);
@@ -370,6 +588,8 @@ static int cpufreq_interactive_up_task(void *data)
 							max_freq,
 							CPUFREQ_RELATION_H);
 			mutex_unlock(&set_speed_lock);
+			trace_cpufreq_interactive_up(cpu, max_freq,
+						     pcpu->policy->cur);
 
 			pcpu->freq_change_time_in_idle =
 				get_cpu_idle_time_us(cpu,
@@ -417,12 +637,135 @@ static void cpufreq_interactive_freq_down(struct work_struct *work)
 						CPUFREQ_RELATION_H);
 
 		mutex_unlock(&set_speed_lock);
+		trace_cpufreq_interactive_down(cpu, max_freq,
+					       pcpu->policy->cur);
 		pcpu->freq_change_time_in_idle =
 			get_cpu_idle_time_us(cpu,
 					     &pcpu->freq_change_time);
 	}
 }
 
+static void cpufreq_interactive_boost(void)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu;
+	unsigned long flags;
+	unsigned int freq = 0;
+	int anyboost = 0;
+	u64 now;
+	int i;
+
+	now = ktime_to_us(ktime_get());
+	spin_lock_irqsave(&boost_lock, flags);
+	/* touches arrive in bursts, only act once half the boost is gone */
+	if (boost_until > now &&
+	    boost_until - now > input_boost_duration / 2) {
+		spin_unlock_irqrestore(&boost_lock, flags);
+		return;
+	}
+	boost_until = now + input_boost_duration;
+	spin_unlock_irqrestore(&boost_lock, flags);
+
+	spin_lock_irqsave(&up_cpumask_lock, flags);
+	for_each_online_cpu(i) {
+		pcpu = &per_cpu(cpuinfo, i);
+		if (!pcpu->governor_enabled)
+			continue;
+
+		freq = boost_freq(pcpu->policy);
+		if (pcpu->target_freq < freq) {
+			pcpu->target_freq = freq;
+			cpumask_set_cpu(i, &up_cpumask);
+			anyboost = 1;
+		}
+	}
+	spin_unlock_irqrestore(&up_cpumask_lock, flags);
+
+	if (anyboost)
+		wake_up_process(up_task);
+	trace_cpufreq_interactive_boost(freq, input_boost_duration);
+}
+
+static void cpufreq_interactive_input_event(struct input_handle *handle,
+					    unsigned int type,
+					    unsigned int code, int value)
+{
+	if (input_boost_duration && atomic_read(&active_count))
+		cpufreq_interactive_boost();
+}
+
+static int cpufreq_interactive_input_connect(struct input_handler *handler,
+					     struct input_dev *dev,
+					     const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_interactive";
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_register;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_open;
+
+	return 0;
+
+err_open:
+	input_unregister_handle(handle);
+err_register:
+	kfree(handle);
+	return error;
+}
+
+static void cpufreq_interactive_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+static const struct input_device_id cpufreq_interactive_ids[] = {
+	/* multi-touch touchscreens */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+			    BIT_MASK(ABS_MT_POSITION_X) |
+			    BIT_MASK(ABS_MT_POSITION_Y) },
+	},
+	/* single-touch touchscreens */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_KEYBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+		.absbit = { [BIT_WORD(ABS_X)] =
+			    BIT_MASK(ABS_X) | BIT_MASK(ABS_Y) },
+	},
+	/* keypads */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT,
+		.evbit = { BIT_MASK(EV_KEY) },
+	},
+	{ },
+};
+
+static struct input_handler cpufreq_interactive_input_handler = {
+	.event		= cpufreq_interactive_input_event,
+	.connect	= cpufreq_interactive_input_connect,
+	.disconnect	= cpufreq_interactive_input_disconnect,
+	.name		= "cpufreq_interactive",
+	.id_table	= cpufreq_interactive_ids,
+};
+
 static ssize_t show_go_maxspeed_load(struct kobject *kobj,
 				     struct attribute *attr, char *buf)
 {
@@ -489,10 +832,214 @@ static ssize_t store_timer_rate(struct kobject *kobj,
 static struct global_attr timer_rate_attr = __ATTR(timer_rate, 0644,
 		show_timer_rate, store_timer_rate);
 
+static ssize_t show_hispeed_freq(struct kobject *kobj,
+				 struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", hispeed_freq);
+}
+
+static ssize_t store_hispeed_freq(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	hispeed_freq = val;
+	return count;
+}
+
+static struct global_attr hispeed_freq_attr = __ATTR(hispeed_freq, 0644,
+		show_hispeed_freq, store_hispeed_freq);
+
+static ssize_t show_above_hispeed_delay(struct kobject *kobj,
+					struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", above_hispeed_delay);
+}
+
+static ssize_t store_above_hispeed_delay(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	above_hispeed_delay = val;
+	return count;
+}
+
+static struct global_attr above_hispeed_delay_attr =
+		__ATTR(above_hispeed_delay, 0644,
+		       show_above_hispeed_delay, store_above_hispeed_delay);
+
+static ssize_t show_target_loads(struct kobject *kobj,
+				 struct attribute *attr, char *buf)
+{
+	int i;
+	ssize_t ret = 0;
+	unsigned long flags;
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+
+	for (i = 0; i < ntarget_loads; i++)
+		ret += sprintf(buf + ret, "%u%s", target_loads[i],
+			       i & 0x1 ? ":" : " ");
+
+	/* replace the trailing separator */
+	ret--;
+	ret += sprintf(buf + ret, "\n");
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+	return ret;
+}
+
+static ssize_t store_target_loads(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	const char *cp;
+	unsigned int *new_target_loads = NULL;
+	int ntokens = 1;
+	int i;
+	unsigned long flags;
+
+	cp = buf;
+	while ((cp = strpbrk(cp + 1, " :")))
+		ntokens++;
+
+	/* load [freq:load]... */
+	if (!(ntokens & 0x1))
+		return -EINVAL;
+
+	new_target_loads = kmalloc(ntokens * sizeof(unsigned int), GFP_KERNEL);
+	if (!new_target_loads)
+		return -ENOMEM;
+
+	cp = buf;
+	i = 0;
+	while (i < ntokens) {
+		if (sscanf(cp, "%u", &new_target_loads[i++]) != 1) {
+			ret = -EINVAL;
+			goto err;
+		}
+
+		cp = strpbrk(cp, " :");
+		if (!cp)
+			break;
+		cp++;
+	}
+
+	if (i != ntokens) {
+		ret = -EINVAL;
+		goto err;
+	}
+
+	/* a load of 0 would divide by zero in choose_freq() */
+	for (i = 0; i < ntokens; i += 2) {
+		if (!new_target_loads[i]) {
+			ret = -EINVAL;
+			goto err;
+		}
+	}
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+	if (target_loads != default_target_loads)
+		kfree(target_loads);
+	target_loads = new_target_loads;
+	ntarget_loads = ntokens;
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+	return count;
+
+err:
+	kfree(new_target_loads);
+	return ret;
+}
+
+static struct global_attr target_loads_attr = __ATTR(target_loads, 0644,
+		show_target_loads, store_target_loads);
+
+static ssize_t show_input_boost_freq(struct kobject *kobj,
+				     struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", input_boost_freq);
+}
+
+static ssize_t store_input_boost_freq(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	input_boost_freq = val;
+	return count;
+}
+
+static struct global_attr input_boost_freq_attr = __ATTR(input_boost_freq,
+		0644, show_input_boost_freq, store_input_boost_freq);
+
+static ssize_t show_input_boost_duration(struct kobject *kobj,
+					 struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", input_boost_duration);
+}
+
+static ssize_t store_input_boost_duration(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	input_boost_duration = val;
+	return count;
+}
+
+static struct global_attr input_boost_duration_attr =
+		__ATTR(input_boost_duration, 0644,
+		       show_input_boost_duration, store_input_boost_duration);
+
+/* one line per CPU with its last LOAD_HISTORY_LEN loads, oldest first */
+static ssize_t show_load_history(struct kobject *kobj,
+				 struct attribute *attr, char *buf)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu;
+	ssize_t ret = 0;
+	unsigned int cpu, i;
+
+	for_each_online_cpu(cpu) {
+		pcpu = &per_cpu(cpuinfo, cpu);
+		ret += sprintf(buf + ret, "cpu%u:", cpu);
+		for (i = 0; i < LOAD_HISTORY_LEN; i++)
+			ret += sprintf(buf + ret, " %u", pcpu->load_history[
+				(pcpu->load_history_idx + i) %
+				LOAD_HISTORY_LEN]);
+		ret += sprintf(buf + ret, "\n");
+	}
+	return ret;
+}
+
+static struct global_attr load_history_attr = __ATTR(load_history, 0444,
+		show_load_history, NULL);
+
 static struct attribute *interactive_attributes[] = {
 	&go_maxspeed_load_attr.attr,
 	&min_sample_time_attr.attr,
 	&timer_rate_attr.attr,
+	&hispeed_freq_attr.attr,
+	&above_hispeed_delay_attr.attr,
+	&target_loads_attr.attr,
+	&input_boost_freq_attr.attr,
+	&input_boost_duration_attr.attr,
+	&load_history_attr.attr,
 	NULL,
 };
 
@@ -525,10 +1072,14 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			pcpu->freq_change_time_in_idle =
 				get_cpu_idle_time_us(j,
 					     &pcpu->freq_change_time);
+			pcpu->hispeed_validate_time = pcpu->freq_change_time;
 			pcpu->governor_enabled = 1;
 			smp_wmb();
 		}
 
+		if (!hispeed_freq)
+			hispeed_freq = policy->max;
+
 		/*
 		 * Do not register the idle hook and create sysfs
 		 * entries if we have already done so.
@@ -609,6 +1160,8 @@ static int __init cpufreq_interactive_init(void)
 	go_maxspeed_load = DEFAULT_GO_MAXSPEED_LOAD;
 	min_sample_time = DEFAULT_MIN_SAMPLE_TIME;
 	timer_rate = DEFAULT_TIMER_RATE;
+	above_hispeed_delay = DEFAULT_ABOVE_HISPEED_DELAY;
+	input_boost_duration = DEFAULT_INPUT_BOOST_DURATION;
 
 	/* Initalize per-cpu timers */
 	for_each_possible_cpu(i) {
@@ -638,9 +1191,15 @@ static int __init cpufreq_interactive_init(void)
 
 	spin_lock_init(&up_cpumask_lock);
 	spin_lock_init(&down_cpumask_lock);
+	spin_lock_init(&target_loads_lock);
+	spin_lock_init(&boost_lock);
 	mutex_init(&set_speed_lock);
 
 	idle_notifier_register(&cpufreq_interactive_idle_nb);
+	input_handler_registered =
+		!input_register_handler(&cpufreq_interactive_input_handler);
+	if (!input_handler_registered)
+		pr_warn("cpufreq_interactive: input boost unavailable\n");
 
 	return cpufreq_register_governor(&cpufreq_gov_interactive);
 
@@ -658,6 +1217,8 @@ module_init(cpufreq_interactive_init);
 static void __exit cpufreq_interactive_exit(void)
 {
 	cpufreq_unregister_governor(&cpufreq_gov_interactive);
+	if (input_handler_registered)
+		input_unregister_handler(&cpufreq_interactive_input_handler);
 	kthread_stop(up_task);
 	put_task_struct(up_task);
 	destroy_workqueue(down_wq);
@@ -26,6 +26,9 @@
 #include <linux/workqueue.h>
 #include <linux/slab.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/cpufreq_ondemand.h>
+
 /*
  * dbs is used in this file as a shortform for demandbased switching
  * It helps to keep variable names smaller, simpler
@@ -439,6 +442,7 @@ static void dbs_freq_increase(struct cpufreq_policy *p, unsigned int freq)
 static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 {
 	unsigned int max_load_freq;
+	unsigned int cur_load;
 
 	struct cpufreq_policy *policy;
 	unsigned int j;
@@ -542,8 +546,13 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 			max_load_freq = load_freq;
 	}
 
+	/* load as a percentage of the current frequency, for tracing */
+	cur_load = max_load_freq / policy->cur;
+
 	/* Check for frequency increase */
 	if (max_load_freq > dbs_tuners_ins.up_threshold * policy->cur) {
+		trace_cpufreq_ondemand_sample(policy->cpu, cur_load, policy->cur,
+					      policy->max, ONDEMAND_REASON_UP);
 		/* If switching to max speed, apply sampling_down_factor */
 		if (policy->cur < policy->max)
 			this_dbs_info->rate_mult =
@@ -554,8 +563,11 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 
 	/* Check for frequency decrease */
 	/* if we cannot reduce the frequency anymore, break out early */
-	if (policy->cur == policy->min)
+	if (policy->cur == policy->min) {
+		trace_cpufreq_ondemand_sample(policy->cpu, cur_load, policy->cur,
+					      policy->cur, ONDEMAND_REASON_MIN);
 		return;
+	}
 
 	/*
 	 * The optimal frequency is the frequency that is the lowest that
@@ -577,15 +589,25 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 			freq_next = policy->min;
 
 		if (!dbs_tuners_ins.powersave_bias) {
+			trace_cpufreq_ondemand_sample(policy->cpu, cur_load,
+					policy->cur, freq_next,
+					ONDEMAND_REASON_DOWN);
 			__cpufreq_driver_target(policy, freq_next,
 					CPUFREQ_RELATION_L);
 		} else {
 			int freq = powersave_bias_target(policy, freq_next,
 					CPUFREQ_RELATION_L);
+			trace_cpufreq_ondemand_sample(policy->cpu, cur_load,
+					policy->cur, freq,
+					ONDEMAND_REASON_DOWN);
 			__cpufreq_driver_target(policy, freq,
 				CPUFREQ_RELATION_L);
 		}
+		return;
 	}
+
+	trace_cpufreq_ondemand_sample(policy->cpu, cur_load, policy->cur,
+				      policy->cur, ONDEMAND_REASON_HOLD);
 }
 
 static void do_dbs_timer(struct work_struct *work)
@@ -17,6 +17,7 @@
 #include <linux/device.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/highmem.h>
 #include <linux/anon_inodes.h>
 #include <linux/ion.h>
 #include <linux/list.h>
@@ -25,10 +26,13 @@
 #include <linux/mm_types.h>
 #include <linux/rbtree.h>
 #include <linux/sched.h>
+#include <linux/scatterlist.h>
 #include <linux/slab.h>
 #include <linux/seq_file.h>
 #include <linux/uaccess.h>
 #include <linux/debugfs.h>
+#include <linux/vmalloc.h>
+#include <asm/cacheflush.h>
 
 #include "ion_priv.h"
 #define DEBUG
@@ -130,6 +134,68 @@ static void ion_buffer_add(struct ion_device *dev,
 	rb_insert_color(&buffer->node, &dev->buffers);
 }
 
+/*
+ * The low bit of each ion_buffer->pages entry marks a page the CPU touched
+ * through a userspace mapping since the buffer was last synced for the
+ * device.
+ */
+#define ION_PAGE_DIRTY	1UL
+
+static inline struct page *ion_buffer_page(struct page *page)
+{
+	return (struct page *)((unsigned long)page & ~ION_PAGE_DIRTY);
+}
+
+static inline bool ion_buffer_page_is_dirty(struct page *page)
+{
+	return (unsigned long)page & ION_PAGE_DIRTY;
+}
+
+static inline void ion_buffer_page_dirty(struct page **page)
+{
+	*page = (struct page *)((unsigned long)(*page) | ION_PAGE_DIRTY);
+}
+
+static inline void ion_buffer_page_clean(struct page **page)
+{
+	*page = ion_buffer_page(*page);
+}
+
+/* cached buffers need to know their pages, which only map_dma tells us */
+static int ion_buffer_init_pages(struct ion_heap *heap,
+				 struct ion_buffer *buffer)
+{
+	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
+	struct scatterlist *sglist, *sg;
+	int i = 0, j;
+	int ret = 0;
+
+	if (!heap->ops->map_dma)
+		return -EINVAL;
+	sglist = heap->ops->map_dma(heap, buffer);
+	if (IS_ERR_OR_NULL(sglist))
+		return -EINVAL;
+
+	buffer->pages = vmalloc(npages * sizeof(struct page *));
+	if (!buffer->pages) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (sg = sglist; sg && i < npages; sg = sg_next(sg))
+		for (j = 0; j < sg->length / PAGE_SIZE && i < npages; j++)
+			buffer->pages[i++] = sg_page(sg) + j;
+	if (i < npages) {
+		vfree(buffer->pages);
+		buffer->pages = NULL;
+		ret = -EINVAL;
+	}
+out:
+	buffer->sglist = sglist;
+	heap->ops->unmap_dma(heap, buffer);
+	buffer->sglist = NULL;
+	return ret;
+}
+
 /* this function should only be called while dev->lock is held */
 static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 				     struct ion_device *dev,
@@ -154,6 +220,16 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	}
 	buffer->dev = dev;
 	buffer->size = len;
+	buffer->flags = flags;
+	INIT_LIST_HEAD(&buffer->vmas);
+	if (flags & ION_FLAG_CACHED) {
+		ret = ion_buffer_init_pages(heap, buffer);
+		if (ret) {
+			heap->ops->free(buffer);
+			kfree(buffer);
+			return ERR_PTR(ret);
+		}
+	}
 	mutex_init(&buffer->lock);
 	ion_buffer_add(dev, buffer);
 	return buffer;
@@ -168,6 +244,7 @@ static void ion_buffer_destroy(struct kref *kref)
 	mutex_lock(&dev->lock);
 	rb_erase(&buffer->node, &dev->buffers);
 	mutex_unlock(&dev->lock);
+	vfree(buffer->pages);
 	kfree(buffer);
 }
 
@@ -301,7 +378,7 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 		if (!((1 << heap->type) & client->heap_mask))
 			continue;
 		/* if the caller didn't specify this heap type */
-		if (!((1 << heap->id) & flags))
+		if (!((1U << heap->id) & flags & ION_HEAP_ID_MASK))
 			continue;
 		buffer = ion_buffer_create(heap, dev, len, align, flags);
 		if (!IS_ERR_OR_NULL(buffer))
@@ -793,6 +870,145 @@ static int ion_share_release(struct inode *inode, struct file* file)
 	return 0;
 }
 
+struct ion_vma_list {
+	struct list_head list;
+	struct vm_area_struct *vma;
+	bool unzapped;
+};
+
+static int ion_buffer_add_vma(struct ion_buffer *buffer,
+			      struct vm_area_struct *vma)
+{
+	struct ion_vma_list *vma_list;
+
+	vma_list = kmalloc(sizeof(struct ion_vma_list), GFP_KERNEL);
+	if (!vma_list)
+		return -ENOMEM;
+	vma_list->vma = vma;
+	vma_list->unzapped = false;
+	mutex_lock(&buffer->lock);
+	list_add(&vma_list->list, &buffer->vmas);
+	mutex_unlock(&buffer->lock);
+	return 0;
+}
+
+static void ion_buffer_remove_vma(struct ion_buffer *buffer,
+				  struct vm_area_struct *vma)
+{
+	struct ion_vma_list *vma_list, *tmp;
+
+	mutex_lock(&buffer->lock);
+	list_for_each_entry_safe(vma_list, tmp, &buffer->vmas, list) {
+		if (vma_list->vma != vma)
+			continue;
+		list_del(&vma_list->list);
+		kfree(vma_list);
+		break;
+	}
+	mutex_unlock(&buffer->lock);
+}
+
+static void ion_flush_page(struct page *page)
+{
+	void *vaddr = kmap_atomic(page);
+
+#ifdef CONFIG_X86
+	clflush_cache_range(vaddr, PAGE_SIZE);
+#else
+	dmac_flush_range(vaddr, vaddr + PAGE_SIZE);
+#endif
+	kunmap_atomic(vaddr);
+}
+
+/*
+ * Unmaps pages [start, end) of the buffer from @vma so that the next CPU
+ * access faults and marks them dirty again.  mmap_sem is only tried, it
+ * nests outside buffer->lock on the mmap and fault paths; returns false
+ * if the pages had to be left mapped.
+ *
+ * Called with buffer->lock held, which keeps @vma on buffer->vmas and its
+ * mm allocated, but exit_mmap() tears the page tables down before it
+ * closes the vma: an mm without users is left alone.
+ */
+static bool ion_buffer_zap_vma(struct vm_area_struct *vma,
+			       unsigned long start, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long first = max(start, vma->vm_pgoff);
+	unsigned long last = min(end, vma->vm_pgoff + vma_pages(vma));
+
+	if (first >= last)
+		return true;
+	if (!atomic_inc_not_zero(&mm->mm_users))
+		return false;
+	if (!down_read_trylock(&mm->mmap_sem)) {
+		mmput(mm);
+		return false;
+	}
+	zap_page_range(vma, vma->vm_start +
+		       ((first - vma->vm_pgoff) << PAGE_SHIFT),
+		       (last - first) << PAGE_SHIFT, NULL);
+	up_read(&mm->mmap_sem);
+	mmput(mm);
+	return true;
+}
+
+/* pages still mapped writable by @vma can't be considered clean */
+static void ion_buffer_redirty_vma(struct ion_buffer *buffer,
+				   struct vm_area_struct *vma,
+				   unsigned long start, unsigned long end)
+{
+	unsigned long first = max(start, vma->vm_pgoff);
+	unsigned long last = min(end, vma->vm_pgoff + vma_pages(vma));
+	unsigned long i;
+
+	for (i = first; i < last; i++)
+		ion_buffer_page_dirty(&buffer->pages[i]);
+}
+
+static int ion_buffer_sync(struct ion_buffer *buffer, size_t offset,
+			   size_t len, unsigned int dir)
+{
+	struct ion_vma_list *vma_list;
+	unsigned long start, end, i;
+	struct page **pages;
+
+	if (offset > buffer->size || len > buffer->size - offset)
+		return -EINVAL;
+	if (dir != ION_SYNC_FOR_DEVICE && dir != ION_SYNC_FOR_CPU)
+		return -EINVAL;
+	if (!(buffer->flags & ION_FLAG_CACHED))
+		return 0;
+
+	start = offset >> PAGE_SHIFT;
+	end = PAGE_ALIGN(offset + len) >> PAGE_SHIFT;
+	pages = buffer->pages;
+
+	mutex_lock(&buffer->lock);
+	if (dir == ION_SYNC_FOR_DEVICE) {
+		/* unmap first so nothing gets dirtied behind the flush */
+		list_for_each_entry(vma_list, &buffer->vmas, list)
+			vma_list->unzapped = !ion_buffer_zap_vma(vma_list->vma,
+								 start, end);
+	}
+	for (i = start; i < end; i++) {
+		if (dir == ION_SYNC_FOR_DEVICE &&
+		    !ion_buffer_page_is_dirty(pages[i]))
+			continue;
+		ion_flush_page(ion_buffer_page(pages[i]));
+		if (dir == ION_SYNC_FOR_DEVICE)
+			ion_buffer_page_clean(&pages[i]);
+	}
+	if (dir == ION_SYNC_FOR_DEVICE) {
+		list_for_each_entry(vma_list, &buffer->vmas, list)
+			if (vma_list->unzapped)
+				ion_buffer_redirty_vma(buffer, vma_list->vma,
+						       start, end);
+	}
+	mutex_unlock(&buffer->lock);
+	return 0;
+}
+
 static void ion_vma_open(struct vm_area_struct *vma)
 {
 
@@ -801,6 +1017,9 @@ static void ion_vma_open(struct vm_area_struct *vma)
 	struct ion_client *client;
 
 	pr_debug("%s: %d\n", __func__, __LINE__);
+	/* vm_ops->open can't fail, CPU writes through this vma may be missed */
+	if (buffer->flags & ION_FLAG_CACHED && ion_buffer_add_vma(buffer, vma))
+		pr_err("%s: untracked mapping of cached buffer\n", __func__);
 	/* check that the client still exists and take a reference so
 	   it can't go away until this vma is closed */
 	client = ion_client_lookup(buffer->dev, current->group_leader);
@@ -822,6 +1041,8 @@ static void ion_vma_close(struct vm_area_struct *vma)
 	struct ion_client *client;
 
 	pr_debug("%s: %d\n", __func__, __LINE__);
+	if (buffer->flags & ION_FLAG_CACHED)
+		ion_buffer_remove_vma(buffer, vma);
 	/* this indicates the client is gone, nothing to do here */
 	if (!handle)
 		return;
@@ -840,9 +1061,33 @@ static void ion_vma_close(struct vm_area_struct *vma)
 		 atomic_read(&buffer->ref.refcount));
 }
 
+/* only cached buffers are mapped on demand, see ion_share_mmap */
+static int ion_vma_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct ion_buffer *buffer = vma->vm_file->private_data;
+	struct page *page;
+	int ret;
+
+	if (vmf->pgoff >= PAGE_ALIGN(buffer->size) / PAGE_SIZE)
+		return VM_FAULT_SIGBUS;
+
+	mutex_lock(&buffer->lock);
+	ion_buffer_page_dirty(&buffer->pages[vmf->pgoff]);
+	page = ion_buffer_page(buffer->pages[vmf->pgoff]);
+	ret = vm_insert_pfn(vma, (unsigned long)vmf->virtual_address,
+			    page_to_pfn(page));
+	mutex_unlock(&buffer->lock);
+
+	/* -EBUSY means a racing fault got there first */
+	if (ret && ret != -EBUSY)
+		return VM_FAULT_SIGBUS;
+	return VM_FAULT_NOPAGE;
+}
+
 static struct vm_operations_struct ion_vm_ops = {
 	.open = ion_vma_open,
 	.close = ion_vma_close,
+	.fault = ion_vma_fault,
 };
 
 static int ion_share_mmap(struct file *file, struct vm_area_struct *vma)
@@ -879,21 +1124,35 @@ static int ion_share_mmap(struct file *file, struct vm_area_struct *vma)
 		goto err;
 	}
 
-	if (!handle->buffer->heap->ops->map_user) {
-		pr_err("%s: this heap does not define a method for mapping "
-		       "to userspace\n", __func__);
-		ret = -EINVAL;
-		goto err1;
-	}
+	if (buffer->flags & ION_FLAG_CACHED) {
+		/* vm_insert_pfn can't back a private writable mapping */
+		if ((vma->vm_flags & (VM_SHARED | VM_MAYWRITE)) ==
+		    VM_MAYWRITE) {
+			ret = -EINVAL;
+			goto err1;
+		}
+		/* pages are inserted by ion_vma_fault so writes are seen */
+		vma->vm_flags |= VM_PFNMAP | VM_DONTEXPAND | VM_RESERVED;
+		ret = ion_buffer_add_vma(buffer, vma);
+		if (ret)
+			goto err1;
+	} else {
+		if (!handle->buffer->heap->ops->map_user) {
+			pr_err("%s: this heap does not define a method for "
+			       "mapping to userspace\n", __func__);
+			ret = -EINVAL;
+			goto err1;
+		}
 
-	mutex_lock(&buffer->lock);
-	/* now map it to userspace */
-	ret = buffer->heap->ops->map_user(buffer->heap, buffer, vma);
-	mutex_unlock(&buffer->lock);
-	if (ret) {
-		pr_err("%s: failure mapping buffer to userspace\n",
-		       __func__);
-		goto err1;
+		mutex_lock(&buffer->lock);
+		/* now map it to userspace */
+		ret = buffer->heap->ops->map_user(buffer->heap, buffer, vma);
+		mutex_unlock(&buffer->lock);
+		if (ret) {
+			pr_err("%s: failure mapping buffer to userspace\n",
+			       __func__);
+			goto err1;
+		}
 	}
 
 	vma->vm_ops = &ion_vm_ops;
@@ -1025,6 +1284,27 @@ static long ion_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 			return -EFAULT;
 		return dev->custom_ioctl(client, data.cmd, data.arg);
 	}
+	case ION_IOC_SYNC:
+	{
+		struct ion_sync_data data;
+		struct file *file;
+		int ret;
+
+		if (copy_from_user(&data, (void __user *)arg,
+				   sizeof(struct ion_sync_data)))
+			return -EFAULT;
+		file = fget(data.fd);
+		if (!file)
+			return -EBADF;
+		if (file->f_op != &ion_share_fops) {
+			fput(file);
+			return -EINVAL;
+		}
+		ret = ion_buffer_sync(file->private_data, data.offset,
+				      data.len, data.dir);
+		fput(file);
+		return ret;
+	}
 	default:
 		return -ENOTTY;
 	}
@@ -1109,6 +1389,9 @@ static int ion_debug_heap_show(struct seq_file *s, void *unused)
 		seq_printf(s, "%16.s %16u %16u\n", client->name, client->pid,
 			   size);
 	}
+
+	if (heap->ops->debug_show)
+		heap->ops->debug_show(heap, s);
 	return 0;
 }
 
@@ -1130,6 +1413,13 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 	struct rb_node *parent = NULL;
 	struct ion_heap *entry;
 
+	if (heap->id < 0 || heap->id >= 32 ||
+	    !((1U << heap->id) & ION_HEAP_ID_MASK)) {
+		pr_err("%s: heap id %d does not fit the heap id mask\n",
+			__func__, heap->id);
+		return;
+	}
+
 	heap->dev = dev;
 	mutex_lock(&dev->lock);
 	while (*p) {
@@ -15,36 +15,103 @@
  */
 #include <linux/spinlock.h>
 
+#include <linux/bitmap.h>
 #include <linux/err.h>
-#include <linux/genalloc.h>
 #include <linux/io.h>
+#include <linux/log2.h>
 #include <linux/ion.h>
 #include <linux/mm.h>
 #include <linux/scatterlist.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include "ion_priv.h"
 
 #include <asm/mach/map.h>
 
+/**
+ * struct ion_carveout_heap - carveout heap
+ * @heap:		the generic heap
+ * @lock:		protects @bitmap and the counters below
+ * @bitmap:		one bit per page of the carveout, set when allocated
+ * @npages:		size of the carveout in pages
+ * @base:		physical address of the start of the carveout
+ * @free_pages:		number of clear bits in @bitmap
+ * @failed:		allocations that failed
+ * @failed_frag:	allocations that failed although enough pages were
+ *			free, ie. because the free space was fragmented
+ *
+ * Allocation is best fit: the smallest free run that holds the request
+ * at the requested alignment is used, which keeps the large runs intact
+ * for the camera and video buffers that need them.
+ */
 struct ion_carveout_heap {
 	struct ion_heap heap;
-	struct gen_pool *pool;
+	spinlock_t lock;
+	unsigned long *bitmap;
+	unsigned long npages;
 	ion_phys_addr_t base;
+	unsigned long free_pages;
+	unsigned long failed;
+	unsigned long failed_frag;
 };
 
+/* first page index at or after @start whose address is @align aligned */
+static unsigned long ion_carveout_align(struct ion_carveout_heap *heap,
+					unsigned long start,
+					unsigned long align)
+{
+	ion_phys_addr_t addr = heap->base + (start << PAGE_SHIFT);
+
+	return (ALIGN(addr, align) - heap->base) >> PAGE_SHIFT;
+}
+
 ion_phys_addr_t ion_carveout_allocate(struct ion_heap *heap,
 				      unsigned long size,
 				      unsigned long align)
 {
 	struct ion_carveout_heap *carveout_heap =
 		container_of(heap, struct ion_carveout_heap, heap);
-	unsigned long offset = gen_pool_alloc(carveout_heap->pool, size);
+	unsigned long npages = PAGE_ALIGN(size) >> PAGE_SHIFT;
+	unsigned long best = carveout_heap->npages;
+	unsigned long best_len = ULONG_MAX;
+	unsigned long start, end, first;
 
-	if (!offset)
+	if (!npages)
 		return ION_CARVEOUT_ALLOCATE_FAIL;
+	align = max_t(unsigned long, align, PAGE_SIZE);
+	if (!is_power_of_2(align))
+		align = roundup_pow_of_two(align);
+
+	spin_lock(&carveout_heap->lock);
+	start = find_next_zero_bit(carveout_heap->bitmap,
+				   carveout_heap->npages, 0);
+	while (start < carveout_heap->npages) {
+		end = find_next_bit(carveout_heap->bitmap,
+				    carveout_heap->npages, start);
+		first = ion_carveout_align(carveout_heap, start, align);
+		if (first + npages <= end && end - start < best_len) {
+			best = first;
+			best_len = end - start;
+			if (best_len == npages)
+				break;
+		}
+		start = find_next_zero_bit(carveout_heap->bitmap,
+					   carveout_heap->npages, end);
+	}
+
+	if (best == carveout_heap->npages) {
+		carveout_heap->failed++;
+		if (carveout_heap->free_pages >= npages)
+			carveout_heap->failed_frag++;
+		spin_unlock(&carveout_heap->lock);
+		return ION_CARVEOUT_ALLOCATE_FAIL;
+	}
+	bitmap_set(carveout_heap->bitmap, best, npages);
+	carveout_heap->free_pages -= npages;
+	spin_unlock(&carveout_heap->lock);
 
-	return offset;
+	return carveout_heap->base + (best << PAGE_SHIFT);
 }
 
 void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
@@ -52,10 +119,15 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
 {
 	struct ion_carveout_heap *carveout_heap =
 		container_of(heap, struct ion_carveout_heap, heap);
+	unsigned long npages = PAGE_ALIGN(size) >> PAGE_SHIFT;
 
 	if (addr == ION_CARVEOUT_ALLOCATE_FAIL)
 		return;
-	gen_pool_free(carveout_heap->pool, addr, size);
+	spin_lock(&carveout_heap->lock);
+	bitmap_clear(carveout_heap->bitmap,
+		     (addr - carveout_heap->base) >> PAGE_SHIFT, npages);
+	carveout_heap->free_pages += npages;
+	spin_unlock(&carveout_heap->lock);
 }
 
 static int ion_carveout_heap_phys(struct ion_heap *heap,
@@ -111,6 +183,49 @@ void ion_carveout_heap_unmap_kernel(struct ion_heap *heap,
 	return;
 }
 
+/*
+ * The fragmentation index is the share of free memory, in 1/1000ths, that
+ * is not part of the largest free run: 0 when all free memory is one run,
+ * close to 1000 when it is scattered over many small ones.
+ */
+static void ion_carveout_heap_debug_show(struct ion_heap *heap,
+					 struct seq_file *s)
+{
+	struct ion_carveout_heap *carveout_heap =
+		container_of(heap, struct ion_carveout_heap, heap);
+	unsigned long start, end, largest = 0, nruns = 0;
+	unsigned long free_pages, failed, failed_frag;
+	unsigned long frag = 0;
+
+	spin_lock(&carveout_heap->lock);
+	start = find_next_zero_bit(carveout_heap->bitmap,
+				   carveout_heap->npages, 0);
+	while (start < carveout_heap->npages) {
+		end = find_next_bit(carveout_heap->bitmap,
+				    carveout_heap->npages, start);
+		largest = max(largest, end - start);
+		nruns++;
+		start = find_next_zero_bit(carveout_heap->bitmap,
+					   carveout_heap->npages, end);
+	}
+	free_pages = carveout_heap->free_pages;
+	failed = carveout_heap->failed;
+	failed_frag = carveout_heap->failed_frag;
+	spin_unlock(&carveout_heap->lock);
+
+	if (free_pages)
+		frag = 1000 - div_u64((u64)largest * 1000, free_pages);
+
+	seq_printf(s, "\n%16s %16lu\n", "total", carveout_heap->npages
+		   << PAGE_SHIFT);
+	seq_printf(s, "%16s %16lu\n", "free", free_pages << PAGE_SHIFT);
+	seq_printf(s, "%16s %16lu\n", "largest_free", largest << PAGE_SHIFT);
+	seq_printf(s, "%16s %16lu\n", "free_chunks", nruns);
+	seq_printf(s, "%16s %16lu\n", "frag_index", frag);
+	seq_printf(s, "%16s %16lu\n", "failed", failed);
+	seq_printf(s, "%16s %16lu\n", "failed_frag", failed_frag);
+}
+
 int ion_carveout_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 			       struct vm_area_struct *vma)
 {
@@ -127,6 +242,7 @@ static struct ion_heap_ops carveout_heap_ops = {
 	.map_user = ion_carveout_heap_map_user,
 	.map_kernel = ion_carveout_heap_map_kernel,
 	.unmap_kernel = ion_carveout_heap_unmap_kernel,
+	.debug_show = ion_carveout_heap_debug_show,
 };
 
 struct ion_heap *ion_carveout_heap_create(struct ion_platform_heap *heap_data)
@@ -137,14 +253,16 @@ struct ion_heap *ion_carveout_heap_create(struct ion_platform_heap *heap_data)
 	if (!carveout_heap)
 		return ERR_PTR(-ENOMEM);
 
-	carveout_heap->pool = gen_pool_create(12, -1);
-	if (!carveout_heap->pool) {
+	carveout_heap->npages = heap_data->size >> PAGE_SHIFT;
+	carveout_heap->bitmap = vzalloc(BITS_TO_LONGS(carveout_heap->npages) *
+					sizeof(unsigned long));
+	if (!carveout_heap->bitmap) {
 		kfree(carveout_heap);
 		return ERR_PTR(-ENOMEM);
 	}
+	spin_lock_init(&carveout_heap->lock);
 	carveout_heap->base = heap_data->base;
-	gen_pool_add(carveout_heap->pool, carveout_heap->base, heap_data->size,
-		     -1);
+	carveout_heap->free_pages = carveout_heap->npages;
 	carveout_heap->heap.ops = &carveout_heap_ops;
 	carveout_heap->heap.type = ION_HEAP_TYPE_CARVEOUT;
 
@@ -156,7 +274,7 @@ void ion_carveout_heap_destroy(struct ion_heap *heap)
 	struct ion_carveout_heap *carveout_heap =
 	     container_of(heap, struct  ion_carveout_heap, heap);
 
-	gen_pool_destroy(carveout_heap->pool);
+	vfree(carveout_heap->bitmap);
 	kfree(carveout_heap);
 	carveout_heap = NULL;
 }
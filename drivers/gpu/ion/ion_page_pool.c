@@ -0,0 +1,195 @@
+/*
+ * drivers/gpu/ion/ion_page_pool.c
+ *
+ * Copyright (C) 2011 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/err.h>
+#include <linux/highmem.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include "ion_priv.h"
+
+/*
+ * Freed pages are queued dirty and zeroed by a work item before they go
+ * back on the clean list, so that most allocations get pre-zeroed pages
+ * without paying for clear_highpage on the allocating thread.
+ */
+
+static LIST_HEAD(ion_page_pools);
+static DEFINE_MUTEX(ion_page_pools_lock);
+
+static void ion_page_pool_zero(struct page *page, unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < (1 << order); i++)
+		clear_highpage(page + i);
+}
+
+static struct page *ion_page_pool_remove(struct ion_page_pool *pool,
+					 bool dirty)
+{
+	struct list_head *items = dirty ? &pool->dirty_items :
+					  &pool->clean_items;
+	struct page *page;
+
+	page = list_first_entry(items, struct page, lru);
+	list_del(&page->lru);
+	if (dirty)
+		pool->dirty_count--;
+	else
+		pool->clean_count--;
+	return page;
+}
+
+static void ion_page_pool_zero_work(struct work_struct *work)
+{
+	struct ion_page_pool *pool = container_of(work, struct ion_page_pool,
+						  zero_work);
+	struct page *page;
+
+	mutex_lock(&pool->mutex);
+	while (pool->dirty_count) {
+		page = ion_page_pool_remove(pool, true);
+		mutex_unlock(&pool->mutex);
+
+		ion_page_pool_zero(page, pool->order);
+
+		mutex_lock(&pool->mutex);
+		list_add_tail(&page->lru, &pool->clean_items);
+		pool->clean_count++;
+	}
+	mutex_unlock(&pool->mutex);
+}
+
+struct page *ion_page_pool_alloc(struct ion_page_pool *pool)
+{
+	struct page *page = NULL;
+	bool dirty = false;
+
+	mutex_lock(&pool->mutex);
+	if (pool->clean_count) {
+		page = ion_page_pool_remove(pool, false);
+	} else if (pool->dirty_count) {
+		page = ion_page_pool_remove(pool, true);
+		dirty = true;
+	}
+	mutex_unlock(&pool->mutex);
+
+	if (!page)
+		return alloc_pages(pool->gfp_mask | __GFP_ZERO, pool->order);
+	/* the zeroing work hasn't got to this one yet */
+	if (dirty)
+		ion_page_pool_zero(page, pool->order);
+	return page;
+}
+
+void ion_page_pool_free(struct ion_page_pool *pool, struct page *page)
+{
+	mutex_lock(&pool->mutex);
+	list_add_tail(&page->lru, &pool->dirty_items);
+	pool->dirty_count++;
+	mutex_unlock(&pool->mutex);
+	schedule_work(&pool->zero_work);
+}
+
+/* returns the number of order 0 pages held by the pool */
+static int ion_page_pool_total(struct ion_page_pool *pool)
+{
+	return (pool->clean_count + pool->dirty_count) << pool->order;
+}
+
+/*
+ * ion_page_pool_shrink - frees up to nr_to_scan order 0 pages worth of
+ * chunks from the pool, dirty ones first since they still need work
+ * before they are of any use.  Returns the number of pages freed.
+ */
+static int ion_page_pool_shrink(struct ion_page_pool *pool, int nr_to_scan)
+{
+	struct page *page;
+	int freed = 0;
+
+	mutex_lock(&pool->mutex);
+	while (freed < nr_to_scan &&
+	       (pool->dirty_count || pool->clean_count)) {
+		page = ion_page_pool_remove(pool, pool->dirty_count != 0);
+		mutex_unlock(&pool->mutex);
+		__free_pages(page, pool->order);
+		freed += 1 << pool->order;
+		mutex_lock(&pool->mutex);
+	}
+	mutex_unlock(&pool->mutex);
+	return freed;
+}
+
+static int ion_page_pool_shrinker_fn(struct shrinker *shrink,
+				     struct shrink_control *sc)
+{
+	struct ion_page_pool *pool;
+	int nr_to_scan = sc->nr_to_scan;
+	int total = 0;
+
+	if (!mutex_trylock(&ion_page_pools_lock))
+		return nr_to_scan ? -1 : 0;
+	list_for_each_entry(pool, &ion_page_pools, list) {
+		if (nr_to_scan > 0)
+			nr_to_scan -= ion_page_pool_shrink(pool, nr_to_scan);
+		total += ion_page_pool_total(pool);
+	}
+	mutex_unlock(&ion_page_pools_lock);
+	return total;
+}
+
+static struct shrinker ion_page_pool_shrinker = {
+	.shrink = ion_page_pool_shrinker_fn,
+	.seeks = DEFAULT_SEEKS,
+};
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
+{
+	struct ion_page_pool *pool;
+
+	pool = kzalloc(sizeof(struct ion_page_pool), GFP_KERNEL);
+	if (!pool)
+		return ERR_PTR(-ENOMEM);
+	INIT_LIST_HEAD(&pool->clean_items);
+	INIT_LIST_HEAD(&pool->dirty_items);
+	mutex_init(&pool->mutex);
+	INIT_WORK(&pool->zero_work, ion_page_pool_zero_work);
+	pool->gfp_mask = gfp_mask;
+	pool->order = order;
+
+	mutex_lock(&ion_page_pools_lock);
+	if (list_empty(&ion_page_pools))
+		register_shrinker(&ion_page_pool_shrinker);
+	list_add(&pool->list, &ion_page_pools);
+	mutex_unlock(&ion_page_pools_lock);
+	return pool;
+}
+
+void ion_page_pool_destroy(struct ion_page_pool *pool)
+{
+	mutex_lock(&ion_page_pools_lock);
+	list_del(&pool->list);
+	if (list_empty(&ion_page_pools))
+		unregister_shrinker(&ion_page_pool_shrinker);
+	mutex_unlock(&ion_page_pools_lock);
+
+	cancel_work_sync(&pool->zero_work);
+	ion_page_pool_shrink(pool, INT_MAX);
+	kfree(pool);
+}
@@ -21,9 +21,11 @@
 #include <linux/mm_types.h>
 #include <linux/mutex.h>
 #include <linux/rbtree.h>
+#include <linux/workqueue.h>
 #include <linux/ion.h>
 
 struct ion_mapping;
+struct seq_file;
 
 struct ion_dma_mapping {
 	struct kref ref;
@@ -54,6 +56,10 @@ struct ion_buffer *ion_handle_buffer(struct ion_handle *handle);
  * @vaddr:		the kenrel mapping if kmap_cnt is not zero
  * @dmap_cnt:		number of times the buffer is mapped for dma
  * @sglist:		the scatterlist for the buffer is dmap_cnt is not zero
+ * @pages:		for ION_FLAG_CACHED buffers, the buffer's pages, with
+ *			the low bit set on the ones the CPU touched since
+ *			the last sync for the device
+ * @vmas:		for ION_FLAG_CACHED buffers, the userspace mappings
 */
 struct ion_buffer {
 	struct kref ref;
@@ -71,6 +77,8 @@ struct ion_buffer {
 	void *vaddr;
 	int dmap_cnt;
 	struct scatterlist *sglist;
+	struct page **pages;
+	struct list_head vmas;
 };
 
 /**
@@ -84,6 +92,8 @@ struct ion_buffer {
  * @map_kernel		map memory to the kernel
  * @unmap_kernel	unmap memory to the kernel
  * @map_user		map memory to userspace
+ * @debug_show		print heap specific state to the heap's debugfs
+ *			file, optional
  */
 struct ion_heap_ops {
 	int (*allocate) (struct ion_heap *heap,
@@ -99,6 +109,7 @@ struct ion_heap_ops {
 	void (*unmap_kernel) (struct ion_heap *heap, struct ion_buffer *buffer);
 	int (*map_user) (struct ion_heap *mapper, struct ion_buffer *buffer,
 			 struct vm_area_struct *vma);
+	void (*debug_show) (struct ion_heap *heap, struct seq_file *s);
 };
 
 /**
@@ -181,4 +192,38 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
  */
 #define ION_CARVEOUT_ALLOCATE_FAIL -1
 
+/**
+ * struct ion_page_pool - pagepool struct
+ * @clean_count:	number of zeroed chunks in the pool
+ * @dirty_count:	number of chunks still waiting to be zeroed
+ * @clean_items:	list of zeroed chunks
+ * @dirty_items:	list of chunks waiting to be zeroed
+ * @mutex:		protects the lists and counts
+ * @zero_work:		zeroes dirty chunks in the background
+ * @gfp_mask:		gfp_mask to use when allocating from the system
+ * @order:		order of the chunks in the pool
+ * @list:		node in the list of pools seen by the shrinker
+ *
+ * Allows you to keep a pool of pre-zeroed chunks of one order around to
+ * speed up allocation.  Chunks are put back in the pool when freed
+ * instead of being returned to the page allocator, and a shrinker hands
+ * them back when the system is under memory pressure.
+ */
+struct ion_page_pool {
+	int clean_count;
+	int dirty_count;
+	struct list_head clean_items;
+	struct list_head dirty_items;
+	struct mutex mutex;
+	struct work_struct zero_work;
+	gfp_t gfp_mask;
+	unsigned int order;
+	struct list_head list;
+};
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order);
+void ion_page_pool_destroy(struct ion_page_pool *);
+struct page *ion_page_pool_alloc(struct ion_page_pool *);
+void ion_page_pool_free(struct ion_page_pool *, struct page *);
+
 #endif /* _ION_PRIV_H */
@@ -22,48 +22,156 @@
 #include <linux/vmalloc.h>
 #include "ion_priv.h"
 
+/*
+ * Buffers are built from the largest chunks that fit, so a 1080p frame
+ * mostly ends up as a handful of 1M chunks instead of ~2000 pages.
+ */
+static const unsigned int orders[] = {8, 4, 0};
+#define NUM_ORDERS ARRAY_SIZE(orders)
+
+static gfp_t high_order_gfp_flags = (GFP_HIGHUSER | __GFP_NOWARN |
+				     __GFP_NORETRY) & ~__GFP_WAIT;
+static gfp_t low_order_gfp_flags = GFP_HIGHUSER | __GFP_NOWARN;
+
+struct ion_system_heap {
+	struct ion_heap heap;
+	struct ion_page_pool *pools[NUM_ORDERS];
+};
+
+/**
+ * struct ion_system_buffer - what priv_virt points to for system heap buffers
+ * @chunks:	list of page_info, in buffer order
+ * @nchunks:	number of entries on @chunks
+ */
+struct ion_system_buffer {
+	struct list_head chunks;
+	int nchunks;
+};
+
+struct page_info {
+	struct page *page;
+	unsigned int order;
+	struct list_head list;
+};
+
+static int order_to_index(unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		if (order == orders[i])
+			return i;
+	BUG();
+	return -1;
+}
+
+static struct page_info *alloc_largest_available(struct ion_system_heap *heap,
+						 unsigned long size,
+						 unsigned int max_order)
+{
+	struct page_info *info;
+	struct page *page;
+	int i;
+
+	info = kmalloc(sizeof(struct page_info), GFP_KERNEL);
+	if (!info)
+		return NULL;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (size < (PAGE_SIZE << orders[i]))
+			continue;
+		if (max_order < orders[i])
+			continue;
+
+		page = ion_page_pool_alloc(heap->pools[i]);
+		if (!page)
+			continue;
+
+		info->page = page;
+		info->order = orders[i];
+		return info;
+	}
+	kfree(info);
+	return NULL;
+}
+
+static void ion_system_heap_free_chunks(struct ion_system_heap *heap,
+					struct ion_system_buffer *sbuf)
+{
+	struct page_info *info, *tmp;
+
+	list_for_each_entry_safe(info, tmp, &sbuf->chunks, list) {
+		ion_page_pool_free(heap->pools[order_to_index(info->order)],
+				   info->page);
+		list_del(&info->list);
+		kfree(info);
+	}
+	kfree(sbuf);
+}
+
 static int ion_system_heap_allocate(struct ion_heap *heap,
 				     struct ion_buffer *buffer,
 				     unsigned long size, unsigned long align,
 				     unsigned long flags)
 {
-	buffer->priv_virt = vmalloc_user(size);
-	if (!buffer->priv_virt)
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	struct ion_system_buffer *sbuf;
+	struct page_info *info;
+	unsigned long size_remaining = PAGE_ALIGN(size);
+	unsigned int max_order = orders[0];
+
+	sbuf = kzalloc(sizeof(struct ion_system_buffer), GFP_KERNEL);
+	if (!sbuf)
 		return -ENOMEM;
+	INIT_LIST_HEAD(&sbuf->chunks);
+
+	while (size_remaining > 0) {
+		info = alloc_largest_available(sys_heap, size_remaining,
+					       max_order);
+		if (!info) {
+			ion_system_heap_free_chunks(sys_heap, sbuf);
+			return -ENOMEM;
+		}
+		list_add_tail(&info->list, &sbuf->chunks);
+		sbuf->nchunks++;
+		size_remaining -= PAGE_SIZE << info->order;
+		/* don't keep retrying orders the allocator just turned down */
+		max_order = info->order;
+	}
+
+	buffer->priv_virt = sbuf;
 	return 0;
 }
 
 void ion_system_heap_free(struct ion_buffer *buffer)
 {
-	vfree(buffer->priv_virt);
+	struct ion_system_heap *sys_heap = container_of(buffer->heap,
+							struct ion_system_heap,
+							heap);
+
+	ion_system_heap_free_chunks(sys_heap, buffer->priv_virt);
 }
 
 struct scatterlist *ion_system_heap_map_dma(struct ion_heap *heap,
 					    struct ion_buffer *buffer)
 {
-	struct scatterlist *sglist;
-	struct page *page;
-	int i;
-	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
-	void *vaddr = buffer->priv_virt;
+	struct ion_system_buffer *sbuf = buffer->priv_virt;
+	struct scatterlist *sglist, *sg;
+	struct page_info *info;
 
-	sglist = vmalloc(npages * sizeof(struct scatterlist));
+	sglist = vmalloc(sbuf->nchunks * sizeof(struct scatterlist));
 	if (!sglist)
 		return ERR_PTR(-ENOMEM);
-	memset(sglist, 0, npages * sizeof(struct scatterlist));
-	sg_init_table(sglist, npages);
-	for (i = 0; i < npages; i++) {
-		page = vmalloc_to_page(vaddr);
-		if (!page)
-			goto end;
-		sg_set_page(&sglist[i], page, PAGE_SIZE, 0);
-		vaddr += PAGE_SIZE;
+	sg_init_table(sglist, sbuf->nchunks);
+	sg = sglist;
+	list_for_each_entry(info, &sbuf->chunks, list) {
+		sg_set_page(sg, info->page, PAGE_SIZE << info->order, 0);
+		sg = sg_next(sg);
 	}
 	/* XXX do cache maintenance for dma? */
 	return sglist;
-end:
-	vfree(sglist);
-	return NULL;
 }
 
 void ion_system_heap_unmap_dma(struct ion_heap *heap,
@@ -77,21 +185,72 @@ void ion_system_heap_unmap_dma(struct ion_heap *heap,
 void *ion_system_heap_map_kernel(struct ion_heap *heap,
 				 struct ion_buffer *buffer)
 {
-	return buffer->priv_virt;
+	struct ion_system_buffer *sbuf = buffer->priv_virt;
+	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
+	struct page **pages, **tmp;
+	struct page_info *info;
+	void *vaddr;
+	int i;
+
+	pages = vmalloc(npages * sizeof(struct page *));
+	if (!pages)
+		return ERR_PTR(-ENOMEM);
+	tmp = pages;
+	list_for_each_entry(info, &sbuf->chunks, list)
+		for (i = 0; i < (1 << info->order); i++)
+			*(tmp++) = info->page + i;
+
+	vaddr = vmap(pages, npages, VM_MAP, PAGE_KERNEL);
+	vfree(pages);
+	if (!vaddr)
+		return ERR_PTR(-ENOMEM);
+	return vaddr;
 }
 
 void ion_system_heap_unmap_kernel(struct ion_heap *heap,
 				  struct ion_buffer *buffer)
 {
+	vunmap(buffer->vaddr);
 }
 
 int ion_system_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 			     struct vm_area_struct *vma)
 {
-	return remap_vmalloc_range(vma, buffer->priv_virt, vma->vm_pgoff);
+	struct ion_system_buffer *sbuf = buffer->priv_virt;
+	unsigned long addr = vma->vm_start;
+	unsigned long offset = vma->vm_pgoff;
+	unsigned long size = PAGE_ALIGN(buffer->size) >> PAGE_SHIFT;
+	struct page_info *info;
+	int ret;
+
+	/* The vma may not reach past the end of the buffer */
+	if (offset > size || vma_pages(vma) > size - offset)
+		return -EINVAL;
+
+	list_for_each_entry(info, &sbuf->chunks, list) {
+		unsigned long npages = 1 << info->order;
+		unsigned long len;
+
+		if (offset >= npages) {
+			offset -= npages;
+			continue;
+		}
+		len = min((npages - offset) << PAGE_SHIFT,
+			  vma->vm_end - addr);
+		ret = remap_pfn_range(vma, addr,
+				      page_to_pfn(info->page) + offset,
+				      len, vma->vm_page_prot);
+		if (ret)
+			return ret;
+		offset = 0;
+		addr += len;
+		if (addr >= vma->vm_end)
+			break;
+	}
+	return 0;
 }
 
-static struct ion_heap_ops vmalloc_ops = {
+static struct ion_heap_ops system_heap_ops = {
 	.allocate = ion_system_heap_allocate,
 	.free = ion_system_heap_free,
 	.map_dma = ion_system_heap_map_dma,
@@ -103,19 +262,45 @@ static struct ion_heap_ops vmalloc_ops = {
 
 struct ion_heap *ion_system_heap_create(struct ion_platform_heap *unused)
 {
-	struct ion_heap *heap;
+	struct ion_system_heap *heap;
+	int i;
 
-	heap = kzalloc(sizeof(struct ion_heap), GFP_KERNEL);
+	heap = kzalloc(sizeof(struct ion_system_heap), GFP_KERNEL);
 	if (!heap)
 		return ERR_PTR(-ENOMEM);
-	heap->ops = &vmalloc_ops;
-	heap->type = ION_HEAP_TYPE_SYSTEM;
-	return heap;
+	heap->heap.ops = &system_heap_ops;
+	heap->heap.type = ION_HEAP_TYPE_SYSTEM;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		struct ion_page_pool *pool;
+		gfp_t gfp_flags = low_order_gfp_flags;
+
+		if (orders[i] > 0)
+			gfp_flags = high_order_gfp_flags;
+		pool = ion_page_pool_create(gfp_flags, orders[i]);
+		if (IS_ERR(pool))
+			goto err_create_pool;
+		heap->pools[i] = pool;
+	}
+	return &heap->heap;
+
+err_create_pool:
+	while (--i >= 0)
+		ion_page_pool_destroy(heap->pools[i]);
+	kfree(heap);
+	return ERR_PTR(-ENOMEM);
 }
 
 void ion_system_heap_destroy(struct ion_heap *heap)
 {
-	kfree(heap);
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		ion_page_pool_destroy(sys_heap->pools[i]);
+	kfree(sys_heap);
 }
 
 static int ion_system_contig_heap_allocate(struct ion_heap *heap,
@@ -157,6 +342,17 @@ struct scatterlist *ion_system_contig_heap_map_dma(struct ion_heap *heap,
 	return sglist;
 }
 
+void *ion_system_contig_heap_map_kernel(struct ion_heap *heap,
+					struct ion_buffer *buffer)
+{
+	return buffer->priv_virt;
+}
+
+void ion_system_contig_heap_unmap_kernel(struct ion_heap *heap,
+					 struct ion_buffer *buffer)
+{
+}
+
 int ion_system_contig_heap_map_user(struct ion_heap *heap,
 				    struct ion_buffer *buffer,
 				    struct vm_area_struct *vma)
@@ -174,8 +370,8 @@ static struct ion_heap_ops kmalloc_ops = {
 	.phys = ion_system_contig_heap_phys,
 	.map_dma = ion_system_contig_heap_map_dma,
 	.unmap_dma = ion_system_heap_unmap_dma,
-	.map_kernel = ion_system_heap_map_kernel,
-	.unmap_kernel = ion_system_heap_unmap_kernel,
+	.map_kernel = ion_system_contig_heap_map_kernel,
+	.unmap_kernel = ion_system_contig_heap_unmap_kernel,
 	.map_user = ion_system_contig_heap_map_user,
 };
 
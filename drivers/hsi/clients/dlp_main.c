@@ -317,6 +317,78 @@ void dlp_pdu_free(struct hsi_msg *pdu, unsigned int pdu_size)
 	EPILOG();
 }
 
+/**
+ * dlp_pdu_page_alloc - allocate a pdu backed by a single page
+ * @xfer_ctx: a reference to the xfer context the pdu will belong to
+ *
+ * The page is mapped by the controller on each transfer, so that it can be
+ * lent to the network stack as an skb fragment and swapped for another one.
+ *
+ * Returns a reference to the newly created pdu or NULL if an error occured.
+ */
+static struct hsi_msg *dlp_pdu_page_alloc(struct dlp_xfer_ctx *xfer_ctx)
+{
+	struct hsi_msg *new;
+	struct page *page;
+
+	new = hsi_alloc_msg(1, GFP_KERNEL);
+	if (!new) {
+		CRITICAL("No more memory to allocate hsi_msg struct");
+		return NULL;
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		CRITICAL("No more memory to allocate hsi_msg data page");
+		hsi_free_msg(new);
+		return NULL;
+	}
+
+	sg_set_page(new->sgt.sgl, page, xfer_ctx->channel->pdu_size, 0);
+
+	new->cl = dlp_drv.client;
+	new->channel = xfer_ctx->channel->hsi_channel;
+	new->ttype = xfer_ctx->ttype;
+	new->context = xfer_ctx;
+	new->complete = xfer_ctx->complete_cb;
+	new->destructor = dlp_pdu_destructor;
+
+	return new;
+}
+
+/**
+ * dlp_xfer_pdu_alloc - allocate a new pdu for the pool of a xfer context
+ * @xfer_ctx: a reference to the xfer context (RX or TX) to consider
+ */
+static struct hsi_msg *dlp_xfer_pdu_alloc(struct dlp_xfer_ctx *xfer_ctx)
+{
+	if (xfer_ctx->page_pdus)
+		return dlp_pdu_page_alloc(xfer_ctx);
+
+	return dlp_pdu_alloc(xfer_ctx->channel->hsi_channel,
+			     xfer_ctx->ttype,
+			     xfer_ctx->channel->pdu_size,
+			     1,
+			     xfer_ctx,
+			     xfer_ctx->complete_cb, dlp_pdu_destructor);
+}
+
+/**
+ * dlp_xfer_pdu_free - free a pdu of the pool of a xfer context
+ * @xfer_ctx: a reference to the xfer context (RX or TX) to consider
+ * @pdu: a reference to the pdu to free
+ */
+static void dlp_xfer_pdu_free(struct dlp_xfer_ctx *xfer_ctx,
+			      struct hsi_msg *pdu)
+{
+	if (xfer_ctx->page_pdus) {
+		__free_page(sg_page(pdu->sgt.sgl));
+		hsi_free_msg(pdu);
+	} else {
+		dlp_pdu_free(pdu, xfer_ctx->channel->pdu_size);
+	}
+}
+
 /**
  * dlp_pdu_delete - recycle or free a pdu
  * @xfer_ctx: a reference to the xfer context (RX or TX) to consider
@@ -336,7 +408,7 @@ void dlp_pdu_delete(struct dlp_xfer_ctx *xfer_ctx, struct hsi_msg *pdu)
 	full = (xfer_ctx->all_len > xfer_ctx->wait_max + xfer_ctx->ctrl_max);
 
 	if (full) {
-		dlp_pdu_free(pdu, xfer_ctx->channel->pdu_size);
+		dlp_xfer_pdu_free(xfer_ctx, pdu);
 
 		xfer_ctx->all_len--;
 	} else {
@@ -883,7 +955,7 @@ static void dlp_fifo_empty(struct list_head *fifo,
 		list_del_init(&pdu->link);
 
 		/* pdu free */
-		dlp_pdu_free(pdu, xfer_ctx->channel->pdu_size);
+		dlp_xfer_pdu_free(xfer_ctx, pdu);
 	}
 
 	write_unlock_irqrestore(&xfer_ctx->lock, flags);
@@ -1544,12 +1616,7 @@ static void dlp_increase_pdus_pool(struct work_struct *work)
 		read_unlock_irqrestore(&xfer_ctx->lock, flags);
 
 		retry = 0;
-		new = dlp_pdu_alloc(xfer_ctx->channel->hsi_channel,
-				    xfer_ctx->ttype,
-				    xfer_ctx->channel->pdu_size,
-				    1,
-				    xfer_ctx,
-				    xfer_ctx->complete_cb, dlp_pdu_destructor);
+		new = dlp_xfer_pdu_alloc(xfer_ctx);
 
 		while (!new) {
 			++retry;
@@ -1562,13 +1629,7 @@ static void dlp_increase_pdus_pool(struct work_struct *work)
 			/* No memory available: do something more urgent ! */
 			schedule();
 
-			new = dlp_pdu_alloc(xfer_ctx->channel->hsi_channel,
-					    xfer_ctx->ttype,
-					    xfer_ctx->channel->pdu_size,
-					    1,
-					    xfer_ctx,
-					    xfer_ctx->complete_cb,
-					    dlp_pdu_destructor);
+			new = dlp_xfer_pdu_alloc(xfer_ctx);
 		}
 
 		write_lock_irqsave(&xfer_ctx->lock, flags);
@@ -1695,6 +1756,7 @@ void dlp_xfer_ctx_init(struct dlp_channel *ch_ctx,
 	xfer_ctx->payload_len = DLP_TTY_PAYLOAD_LENGTH;
 	xfer_ctx->ttype = ttype;
 	xfer_ctx->complete_cb = complete_cb;
+	xfer_ctx->page_pdus = 0;
 	INIT_WORK(&xfer_ctx->increase_pool, dlp_increase_pdus_pool);
 
 	EPILOG();
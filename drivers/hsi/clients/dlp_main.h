@@ -88,8 +88,9 @@
 #define DLP_TTY_HEADER_LENGTH	16
 #define DLP_TTY_PAYLOAD_LENGTH	(DLP_TTY_PDU_LENGTH - DLP_TTY_HEADER_LENGTH)
 
-/* PDU size for NET channels */
-#define DLP_NET_PDU_SIZE	4096	/* 15360: 15 KBytes */
+/* PDU size for NET channels (default and maximal, see net_pdu_size) */
+#define DLP_NET_PDU_SIZE	4096
+#define DLP_NET_PDU_SIZE_MAX	15360	/* 15 KBytes */
 
 /* PDU size for CTRL channel */
 #define DLP_CTRL_PDU_SIZE	4	/* 4 Bytes */
@@ -189,6 +190,7 @@ typedef void (*hsi_client_cb) (struct hsi_client *cl);
  * @config: current updated HSI configuration
  * @complete_cb: xfer complete callback
  * @ttype: xfer type (RX/TX)
+ * @page_pdus: pdus are single pages that can be lent to the network stack
  * @tty_stats: TTY stats
  */
 struct dlp_xfer_ctx {
@@ -218,6 +220,7 @@ struct dlp_xfer_ctx {
 
 	xfer_complete_cb complete_cb;
 	unsigned int ttype;
+	unsigned int page_pdus;
 
 	unsigned int seq_num;
 
@@ -37,6 +37,10 @@
 #include <linux/etherdevice.h>
 #include <linux/ip.h>
 #include <linux/dma-mapping.h>
+#include <linux/ethtool.h>
+#include <linux/mm.h>
+#include <linux/interrupt.h>
+#include <linux/hrtimer.h>
 #include <net/arp.h>
 
 #include "dlp_main.h"
@@ -47,12 +51,91 @@
 /* Defaut NET stack TX timeout delay (in milliseconds) */
 #define DLP_NET_TX_DELAY		20000	/* 20 sec */
 
+/* NAPI poll weight (packets) */
+#define DLP_NET_NAPI_WEIGHT		64
+
+/* RX packets up to this size are copied, bigger ones reference the pdu page */
+#define DLP_NET_RX_COPYBREAK		256
+
+/* Bytes pulled into the skb linear area when referencing the pdu page */
+#define DLP_NET_RX_PULL_LEN		128
+
+/* Max SG entries of a TX pdu (HSI controller NET channels limit) */
+#define DLP_NET_TX_MAX_SG		64
+
+/* Max packets per TX pdu: one data + one padding entry each, plus header */
+#define DLP_NET_TX_MAX_PACKETS		((DLP_NET_TX_MAX_SG - 1) / 2)
+
+/* NET channels pdu size, advertised to the modem in OPEN_CONN */
+static unsigned int net_pdu_size = DLP_NET_PDU_SIZE;
+module_param(net_pdu_size, uint, S_IRUGO);
+MODULE_PARM_DESC(net_pdu_size, "NET channels pdu size in bytes ("
+		 __stringify(DLP_NET_PDU_SIZE) " to "
+		 __stringify(DLP_NET_PDU_SIZE_MAX) ")");
+
+/* Max time a packet waits for others to share its TX pdu (0: no aggregation) */
+static unsigned int net_tx_aggr_delay = 500;
+module_param(net_tx_aggr_delay, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(net_tx_aggr_delay,
+		 "TX aggregation deadline in usecs (0 to disable)");
+
+/*
+ * struct dlp_net_rx_stats - NET channel RX path counters
+ *
+ * @polls: number of NAPI poll calls that handled at least one packet
+ * @poll_packets: packets handled by those polls
+ * @frag_packets: packets passed up referencing the pdu page
+ * @copy_packets: packets passed up as a full copy
+ * @copy_avoided: payload bytes not copied thanks to page references
+ * @copied: bytes copied into skbs (including the pulled headers)
+ * @page_swaps: pdu pages left to the stack and replaced by a spare
+ */
+struct dlp_net_rx_stats {
+	unsigned long polls;
+	unsigned long poll_packets;
+	unsigned long frag_packets;
+	unsigned long copy_packets;
+	unsigned long copy_avoided;
+	unsigned long copied;
+	unsigned long page_swaps;
+};
+
+/*
+ * struct dlp_net_tx_stats - NET channel TX aggregation counters
+ *
+ * @pdus: number of TX pdus pushed to the controller
+ * @packets: packets carried by those pdus
+ * @payload: packet bytes carried by those pdus
+ * @pdu_bytes: total size of those pdus (payload + descriptors + padding)
+ * @timer_flushes: pdus sent on the aggregation deadline
+ */
+struct dlp_net_tx_stats {
+	unsigned long pdus;
+	unsigned long packets;
+	unsigned long payload;
+	unsigned long pdu_bytes;
+	unsigned long timer_flushes;
+};
+
 /*
  * struct dlp_net_context - NET channel private data
  *
  * @ndev: Registred network device
  * @net_padd: Padding buffer
  * @net_padd_dma: Padding buffer dma address
+ * @napi: RX NAPI context
+ * @rx_lock: protects @rx_pdus
+ * @rx_pdus: completed RX pdus waiting for the NAPI poll
+ * @rx_pdu: RX pdu being parsed (may span several polls)
+ * @rx_desc: last packet descriptor word read from @rx_pdu
+ * @rx_lent: @rx_pdu page is referenced by some skbs
+ * @rx_spare: page to give to @rx_pdu when its own one is still in use
+ * @rx_stats: RX path counters
+ * @tx_lock: protects the TX aggregation context
+ * @tx_queue: packets of the TX pdu being filled
+ * @tx_used: bytes taken by those packets in the pdu (descriptors excluded)
+ * @tx_timer: TX aggregation deadline timer (well below a jiffy, hence hrtimer)
+ * @tx_stats: TX aggregation counters
  */
 struct dlp_net_context {
 	struct net_device *ndev;
@@ -60,11 +143,28 @@ struct dlp_net_context {
 	/* Padding buffer */
 	void *net_padd;
 	dma_addr_t net_padd_dma;
+
+	/* NAPI RX */
+	struct napi_struct napi;
+	spinlock_t rx_lock;
+	struct list_head rx_pdus;
+	struct hsi_msg *rx_pdu;
+	u32 *rx_desc;
+	int rx_lent;
+	struct page *rx_spare;
+	struct dlp_net_rx_stats rx_stats;
+
+	/* TX aggregation */
+	spinlock_t tx_lock;
+	struct sk_buff_head tx_queue;
+	unsigned int tx_used;
+	struct tasklet_hrtimer tx_timer;
+	struct dlp_net_tx_stats tx_stats;
 };
 
 /*
- *
- *
+ * TX pdu context, stored in the cb of its first skb. The skbs of the pdu
+ * are chained through skb->next.
  */
 struct dlp_net_tx_params {
 	struct dlp_channel *ch_ctx;
@@ -77,6 +177,8 @@ struct dlp_net_tx_params {
  *
  **/
 
+static void dlp_net_tx_flush(struct dlp_channel *ch_ctx);
+
 /*
  *
  *
@@ -138,8 +240,15 @@ static void dlp_net_credits_available_cb(struct dlp_channel *ch_ctx)
 {
 	struct dlp_net_context *net_ctx = ch_ctx->ch_data;
 
+	unsigned long flags;
+
 	PROLOG();
 
+	/* Send the pdu that was waiting for credits */
+	spin_lock_irqsave(&net_ctx->tx_lock, flags);
+	dlp_net_tx_flush(ch_ctx);
+	spin_unlock_irqrestore(&net_ctx->tx_lock, flags);
+
 	/* Restart the NET stack if it was stopped */
 	if (netif_queue_stopped(net_ctx->ndev))
 		netif_wake_queue(net_ctx->ndev);
@@ -173,8 +282,8 @@ static __be16 dlp_net_type_trans(const char *buffer)
  * dlp_net_complete_tx - bottom-up flow for the TX side
  * @pdu: a reference to the completed pdu
  *
- * A TX transfer has completed: recycle the completed pdu and kick a new
- * delayed request or enter the IDLE state if nothing else is expected.
+ * A TX transfer has completed: free the pdu and its skbs, then send the
+ * pdu aggregated meanwhile, if any.
  */
 static void dlp_net_complete_tx(struct hsi_msg *pdu)
 {
@@ -183,22 +292,26 @@ static void dlp_net_complete_tx(struct hsi_msg *pdu)
 	struct dlp_channel *ch_ctx = msg_param->ch_ctx;
 	struct dlp_net_context *net_ctx = ch_ctx->ch_data;
 	struct dlp_xfer_ctx *xfer_ctx = &ch_ctx->tx;
+	struct sk_buff *skb, *next;
 
 	PROLOG("%s", net_ctx->ndev->name);
 
 	/* TX xfer done => Reset the "ongoing" flag */
 	dlp_ctrl_set_reset_ongoing(0);
 
-	/* TX done, free the skb */
-	dev_kfree_skb(msg_param->skb);
+	/* TX done, free the skbs and update statistics */
+	for (skb = msg_param->skb; skb; skb = next) {
+		next = skb->next;
+		skb->next = NULL;
+
+		net_ctx->ndev->stats.tx_bytes += skb->len;
+		net_ctx->ndev->stats.tx_packets++;
+		dev_kfree_skb_any(skb);
+	}
 
 	/* Dump the PDU */
 	/* dlp_pdu_dump(pdu, 1); */
 
-	/* Update statistics */
-	net_ctx->ndev->stats.tx_bytes += pdu->actual_len;
-	net_ctx->ndev->stats.tx_packets++;
-
 	/* Free the pdu */
 	dlp_pdu_free(pdu, pdu->sgt.sgl->length);
 
@@ -215,28 +328,31 @@ static void dlp_net_complete_tx(struct hsi_msg *pdu)
 	}
 
 	write_unlock_irqrestore(&xfer_ctx->lock, flags);
+
+	/* Send what was aggregated during this transfer */
+	spin_lock_irqsave(&net_ctx->tx_lock, flags);
+	dlp_net_tx_flush(ch_ctx);
+	spin_unlock_irqrestore(&net_ctx->tx_lock, flags);
+
 	EPILOG();
 }
 
-/*
- * Receive a packet: retrieve, encapsulate and pass over to upper levels
+/**
+ * dlp_net_complete_rx - bottom-up flow for the RX side
+ * @pdu: a reference to the completed pdu
+ *
+ * Queue the pdu for the NAPI poll, where its packets are parsed.
  */
 static void dlp_net_complete_rx(struct hsi_msg *pdu)
 {
-	struct sk_buff *skb;
 	struct dlp_xfer_ctx *xfer_ctx = pdu->context;
 	struct dlp_channel *ch_ctx = xfer_ctx->channel;
 	struct dlp_net_context *net_ctx = ch_ctx->ch_data;
-	unsigned int more_packets, data_size, ret, offset;
-	unsigned char *skb_data, *data_addr, *start_addr;
-	unsigned int *ptr;
 	unsigned long flags;
 
 	PROLOG("%s, pdu [0x%p, actual_len: %d, sgl->len: %d]",
 	       net_ctx->ndev->name, pdu, pdu->actual_len, pdu->sgt.sgl->length);
 
-	ret = 0;
-
 	/* Dump the first 160 bytes */
 	dlp_dbg_dump_pdu(pdu, 16, 160, 0);
 
@@ -245,88 +361,249 @@ static void dlp_net_complete_rx(struct hsi_msg *pdu)
 	dlp_hsi_controller_pop(xfer_ctx);
 	write_unlock_irqrestore(&xfer_ctx->lock, flags);
 
-	/* Get the data pointer */
-	ptr = sg_virt(pdu->sgt.sgl);
+	spin_lock_irqsave(&net_ctx->rx_lock, flags);
+	list_add_tail(&pdu->link, &net_ctx->rx_pdus);
+	spin_unlock_irqrestore(&net_ctx->rx_lock, flags);
 
-	/* Read the header    */
-	/*--------------------*/
-	if (!dlp_pdu_header_valid(pdu)) {
-		CRITICAL("Invalid PDU signature (0x%x)", (*ptr));
-		ret = -EINVAL;
-		goto out;
-	}
+	napi_schedule(&net_ctx->napi);
 
-	/* Read packets desc  */
-	/*---------------------*/
-	start_addr = (unsigned char *)ptr;	/* Skip the header */
+	EPILOG();
+}
 
-	do {
-		/* Get the start offset */
-		ptr++;
-		offset = (*ptr);
+/**
+ * dlp_net_rx_next_pdu - start parsing the next queued RX pdu
+ * @net_ctx: a reference to the NET channel context
+ *
+ * Returns 0 if there is no (valid) pdu to parse.
+ */
+static int dlp_net_rx_next_pdu(struct dlp_net_context *net_ctx)
+{
+	struct dlp_channel *ch_ctx = netdev_priv(net_ctx->ndev);
+	struct hsi_msg *pdu;
+	unsigned long flags;
 
-		/* Get the size & address */
-		ptr++;
-		more_packets = (*ptr) & DLP_HDR_MORE_DESC;
-		data_size = DLP_HDR_DATA_SIZE((*ptr)) - DLP_HDR_SPACE_AP;
-		data_addr = start_addr + offset + DLP_HDR_SPACE_AP;
-
-		PRINT_RX
-		    ("RX: DESC => data_addr: 0x%p, offset: 0x%x, size: %d\n",
-		     data_addr, offset, data_size);
-
-		/* Dump the first 160 bytes */
-		/* dlp_dbg_dump_data_as_byte(data_addr,
-				MIN(data_size, 160), 16, 0); */
-
-		/*
-		 * The packet has been retrieved from the transmission
-		 * medium. Build an skb around it, so upper layers can handle it
-		 */
-		skb = netdev_alloc_skb_ip_align(net_ctx->ndev, data_size);
-		if (!skb) {
-			CRITICAL("No more memory (data_size: %d)"
-				   " - packet dropped\n", data_size);
-
-			net_ctx->ndev->stats.rx_dropped++;
-			goto out;
+	do {
+		spin_lock_irqsave(&net_ctx->rx_lock, flags);
+		if (list_empty(&net_ctx->rx_pdus)) {
+			spin_unlock_irqrestore(&net_ctx->rx_lock, flags);
+			return 0;
 		}
+		pdu = list_first_entry(&net_ctx->rx_pdus, struct hsi_msg, link);
+		list_del_init(&pdu->link);
+		spin_unlock_irqrestore(&net_ctx->rx_lock, flags);
+
+		if (dlp_pdu_header_valid(pdu))
+			break;
+
+		CRITICAL("Invalid PDU signature (0x%x)",
+			 *(u32 *)sg_virt(pdu->sgt.sgl));
+		dlp_pdu_recycle(&ch_ctx->rx, pdu);
+	} while (1);
+
+	net_ctx->rx_pdu = pdu;
+	net_ctx->rx_desc = sg_virt(pdu->sgt.sgl);
+	net_ctx->rx_lent = 0;
+	return 1;
+}
 
-		skb_data = skb_put(skb, data_size);
-		memcpy(skb_data, data_addr, data_size);
+/**
+ * dlp_net_rx_pdu_done - hand the parsed RX pdu back to the controller
+ * @net_ctx: a reference to the NET channel context
+ *
+ * If some skbs still reference the pdu page, the pdu gets the spare page
+ * and the stack keeps the old one until the last skb is freed.
+ */
+static void dlp_net_rx_pdu_done(struct dlp_net_context *net_ctx)
+{
+	struct dlp_channel *ch_ctx = netdev_priv(net_ctx->ndev);
+	struct hsi_msg *pdu = net_ctx->rx_pdu;
+	struct scatterlist *sg = pdu->sgt.sgl;
+
+	if (net_ctx->rx_lent && page_count(sg_page(sg)) > 1) {
+		put_page(sg_page(sg));
+		sg_set_page(sg, net_ctx->rx_spare, sg->length, 0);
+		net_ctx->rx_spare = NULL;
+		net_ctx->rx_stats.page_swaps++;
+	}
 
-		skb->dev = net_ctx->ndev;
-		skb_reset_mac_header(skb);
-		skb->protocol = dlp_net_type_trans(skb_data);
-		skb->ip_summed = CHECKSUM_UNNECESSARY;	/* don't check it */
+	net_ctx->rx_pdu = NULL;
+	dlp_pdu_recycle(&ch_ctx->rx, pdu);
+}
 
-		/* Dump the first 160 bytes */
-		/* dlp_dbg_dump_data_as_byte(skb->data,
-				MIN(skb->len, 160), 16, 0);*/
+/**
+ * dlp_net_rx_packet - build an skb for one received packet and pass it up
+ * @net_ctx: a reference to the NET channel context
+ * @data: packet start address (inside the current RX pdu)
+ * @len: packet size
+ *
+ * Small packets are copied. Bigger ones only have their headers copied,
+ * the payload being attached as a fragment of the pdu page, provided a
+ * spare page is available to replace it once the pdu is parsed.
+ */
+static void dlp_net_rx_packet(struct dlp_net_context *net_ctx,
+			      unsigned char *data, unsigned int len)
+{
+	struct dlp_channel *ch_ctx = netdev_priv(net_ctx->ndev);
+	struct page *page = sg_page(net_ctx->rx_pdu->sgt.sgl);
+	struct sk_buff *skb;
+	unsigned int hlen = len;
+
+	if (len > DLP_NET_RX_COPYBREAK && ch_ctx->rx.page_pdus) {
+		if (!net_ctx->rx_spare)
+			net_ctx->rx_spare = alloc_page(GFP_ATOMIC);
+		if (net_ctx->rx_spare)
+			hlen = DLP_NET_RX_PULL_LEN;
+	}
 
-		/* Push received packet up to the IP networking stack */
-		ret = netif_rx(skb);
+	skb = netdev_alloc_skb_ip_align(net_ctx->ndev, hlen);
+	if (!skb) {
+		CRITICAL("No more memory (data_size: %d) - packet dropped",
+			 len);
+		net_ctx->ndev->stats.rx_dropped++;
+		return;
+	}
 
-		/* Update statistics */
-		if (ret) {
-			WARNING("Packet dropped");
-			net_ctx->ndev->stats.rx_dropped++;
+	memcpy(skb_put(skb, hlen), data, hlen);
+	net_ctx->rx_stats.copied += hlen;
+
+	if (hlen < len) {
+		get_page(page);
+		skb_fill_page_desc(skb, 0, page,
+				   data + hlen - (unsigned char *)page_address(page),
+				   len - hlen);
+		skb->len += len - hlen;
+		skb->data_len += len - hlen;
+		skb->truesize += len - hlen;
+
+		net_ctx->rx_lent = 1;
+		net_ctx->rx_stats.frag_packets++;
+		net_ctx->rx_stats.copy_avoided += len - hlen;
+	} else {
+		net_ctx->rx_stats.copy_packets++;
+	}
 
-			/* Free the allocated skb */
-			/* FIXME : to be freed ???? */
-		} else {
-			net_ctx->ndev->stats.rx_bytes += data_size;
-			net_ctx->ndev->stats.rx_packets++;
+	skb_reset_mac_header(skb);
+	skb->protocol = dlp_net_type_trans(skb->data);
+	skb->ip_summed = CHECKSUM_UNNECESSARY;	/* don't check it */
+
+	net_ctx->ndev->stats.rx_bytes += len;
+	net_ctx->ndev->stats.rx_packets++;
+
+	napi_gro_receive(&net_ctx->napi, skb);
+}
+
+/**
+ * dlp_net_poll - NAPI poll function
+ * @napi: a reference to the NAPI context
+ * @budget: maximal number of packets to handle
+ *
+ * Parse the queued RX pdus, a pdu being resumed on the next poll if the
+ * budget is exhausted in the middle of it.
+ */
+static int dlp_net_poll(struct napi_struct *napi, int budget)
+{
+	struct dlp_net_context *net_ctx =
+	    container_of(napi, struct dlp_net_context, napi);
+	struct hsi_msg *pdu;
+	unsigned char *start_addr;
+	unsigned int offset, size, more_packets;
+	u32 *ptr;
+	int done = 0;
+	unsigned long flags;
+
+	PROLOG("%s, budget: %d", net_ctx->ndev->name, budget);
+
+	while (done < budget) {
+		if (!net_ctx->rx_pdu && !dlp_net_rx_next_pdu(net_ctx))
+			break;
+
+		pdu = net_ctx->rx_pdu;
+		start_addr = sg_virt(pdu->sgt.sgl);
+
+		/* Read the next packet descriptor, if it lies within the pdu */
+		ptr = net_ctx->rx_desc;
+		if ((unsigned char *)(ptr + 3) >
+		    start_addr + pdu->sgt.sgl->length) {
+			CRITICAL("Packet desc beyond the pdu end (%d bytes)",
+				 pdu->sgt.sgl->length);
+			net_ctx->ndev->stats.rx_errors++;
+			dlp_net_rx_pdu_done(net_ctx);
+			continue;
 		}
-	} while (more_packets);
 
-	ret = 0;
+		offset = *(++ptr);
+		size = *(++ptr);
+		net_ctx->rx_desc = ptr;
 
-out:
-	/* Recycle the RX pdu */
-	dlp_pdu_recycle(xfer_ctx, pdu);
+		more_packets = size & DLP_HDR_MORE_DESC;
+		size = DLP_HDR_DATA_SIZE(size);
 
-	EPILOG("%d", ret);
+		PRINT_RX("RX: DESC => offset: 0x%x, size: %d\n", offset, size);
+
+		if (size < DLP_HDR_SPACE_AP ||
+		    offset > pdu->sgt.sgl->length ||
+		    size > pdu->sgt.sgl->length - offset) {
+			CRITICAL("Invalid packet desc (offset: 0x%x, size: %d)",
+				 offset, size);
+			net_ctx->ndev->stats.rx_errors++;
+			dlp_net_rx_pdu_done(net_ctx);
+			continue;
+		}
+
+		dlp_net_rx_packet(net_ctx,
+				  start_addr + offset + DLP_HDR_SPACE_AP,
+				  size - DLP_HDR_SPACE_AP);
+		done++;
+
+		if (!more_packets)
+			dlp_net_rx_pdu_done(net_ctx);
+	}
+
+	if (done) {
+		net_ctx->rx_stats.polls++;
+		net_ctx->rx_stats.poll_packets += done;
+	}
+
+	if (done < budget) {
+		napi_complete(napi);
+
+		/* A pdu may have been queued while napi was still scheduled */
+		spin_lock_irqsave(&net_ctx->rx_lock, flags);
+		if (!list_empty(&net_ctx->rx_pdus))
+			napi_schedule(napi);
+		spin_unlock_irqrestore(&net_ctx->rx_lock, flags);
+	}
+
+	EPILOG("%d", done);
+	return done;
+}
+
+/**
+ * dlp_net_rx_flush - recycle the RX pdus not parsed yet
+ * @net_ctx: a reference to the NET channel context
+ *
+ * Shall be called with the NAPI context disabled.
+ */
+static void dlp_net_rx_flush(struct dlp_net_context *net_ctx)
+{
+	struct dlp_channel *ch_ctx = netdev_priv(net_ctx->ndev);
+	struct hsi_msg *pdu;
+	unsigned long flags;
+
+	if (net_ctx->rx_pdu)
+		dlp_net_rx_pdu_done(net_ctx);
+
+	spin_lock_irqsave(&net_ctx->rx_lock, flags);
+	while (!list_empty(&net_ctx->rx_pdus)) {
+		pdu = list_first_entry(&net_ctx->rx_pdus, struct hsi_msg, link);
+		list_del_init(&pdu->link);
+		spin_unlock_irqrestore(&net_ctx->rx_lock, flags);
+
+		dlp_pdu_recycle(&ch_ctx->rx, pdu);
+
+		spin_lock_irqsave(&net_ctx->rx_lock, flags);
+	}
+	spin_unlock_irqrestore(&net_ctx->rx_lock, flags);
 }
 
 /**
@@ -373,6 +650,7 @@ int dlp_net_open(struct net_device *dev)
 {
 	int ret;
 	struct dlp_channel *ch_ctx = netdev_priv(dev);
+	struct dlp_net_context *net_ctx = ch_ctx->ch_data;
 
 	PROLOG("%s, hsi_ch:%d", dev->name, ch_ctx->hsi_channel);
 
@@ -390,8 +668,18 @@ int dlp_net_open(struct net_device *dev)
 		goto out;
 	}
 
+	napi_enable(&net_ctx->napi);
+
 	/* Push all RX pdus */
 	ret = dlp_pop_recycled_push_ctrl(&ch_ctx->rx);
+	if (ret) {
+		CRITICAL("dlp_pop_recycled_push_ctrl() failed (%d) !", ret);
+		dlp_ctrl_close_channel(ch_ctx);
+		dlp_stop_rx(&ch_ctx->rx, ch_ctx);
+		napi_disable(&net_ctx->napi);
+		dlp_net_rx_flush(net_ctx);
+		goto out;
+	}
 
 	/* Start the netif */
 	netif_wake_queue(dev);
@@ -407,8 +695,10 @@ out:
 int dlp_net_stop(struct net_device *dev)
 {
 	struct dlp_channel *ch_ctx = netdev_priv(dev);
+	struct dlp_net_context *net_ctx = ch_ctx->ch_data;
 	struct dlp_xfer_ctx *tx_ctx;
 	struct dlp_xfer_ctx *rx_ctx;
+	unsigned long flags;
 	int ret;
 
 	PROLOG("%s, hsi_ch:%d", dev->name, ch_ctx->hsi_channel);
@@ -430,7 +720,17 @@ int dlp_net_stop(struct net_device *dev)
 	del_timer_sync(&rx_ctx->timer);
 	dlp_stop_rx(rx_ctx, ch_ctx);
 
+	napi_disable(&net_ctx->napi);
+	dlp_net_rx_flush(net_ctx);
+
 	/* TX */
+	tasklet_hrtimer_cancel(&net_ctx->tx_timer);
+	spin_lock_irqsave(&net_ctx->tx_lock, flags);
+	net_ctx->ndev->stats.tx_dropped += skb_queue_len(&net_ctx->tx_queue);
+	__skb_queue_purge(&net_ctx->tx_queue);
+	net_ctx->tx_used = 0;
+	spin_unlock_irqrestore(&net_ctx->tx_lock, flags);
+
 	del_timer_sync(&tx_ctx->timer);
 	dlp_stop_tx(tx_ctx);
 
@@ -453,121 +753,106 @@ static void dlp_net_pdu_destructor(struct hsi_msg *pdu)
 }
 
 /*
- * Transmit a packet
+ * Size of the descriptors area of a TX pdu (signature + packets offset/size)
  */
-static int dlp_net_start_xmit(struct sk_buff *skb, struct net_device *dev)
+static inline unsigned int dlp_net_tx_desc_size(unsigned int nb_packets)
+{
+	return ALIGN(4 + nb_packets * 8, DLP_PACKET_ALIGN_CP);
+}
+
+/*
+ * Room taken by a packet in a TX pdu (header space + aligned data)
+ */
+static inline unsigned int dlp_net_tx_packet_room(unsigned int len)
+{
+	return DLP_HDR_SPACE_CP + ALIGN(len, DLP_PACKET_ALIGN_CP);
+}
+
+/*
+ * Check if a packet can be added to the TX pdu being filled
+ */
+static int dlp_net_tx_fits(struct dlp_channel *ch_ctx, unsigned int len)
+{
+	struct dlp_net_context *net_ctx = ch_ctx->ch_data;
+	unsigned int nb_packets = skb_queue_len(&net_ctx->tx_queue) + 1;
+
+	return (nb_packets <= DLP_NET_TX_MAX_PACKETS) &&
+	    (dlp_net_tx_desc_size(nb_packets) + net_ctx->tx_used +
+	     dlp_net_tx_packet_room(len) <= ch_ctx->pdu_size);
+}
+
+/**
+ * dlp_net_tx_flush - send the TX pdu being filled
+ * @ch_ctx: a reference to the channel context
+ *
+ * Builds the pdu descriptors and scatter gather table from the aggregated
+ * skbs and pushes it to the controller. Nothing is sent without credits,
+ * the credits callback will call us again.
+ *
+ * Shall be called with the TX aggregation lock held.
+ */
+static void dlp_net_tx_flush(struct dlp_channel *ch_ctx)
 {
-	struct dlp_channel *ch_ctx = netdev_priv(dev);
 	struct dlp_net_context *net_ctx = ch_ctx->ch_data;
 	struct dlp_net_tx_params *msg_param;
-	int i, ret, nb_padding, nb_entries, nb_packets;
-	unsigned char *skb_data;
-	unsigned int *ptr;
-	unsigned int skb_len, padding_len, offset, desc_size, align_size;
+	struct sk_buff *skb, *first, **next;
 	struct hsi_msg *new;
 	struct scatterlist *sg;
-	skb_frag_t *frag;
+	unsigned int nb_packets, nb_entries, desc_size, offset, len, payload;
+	unsigned int *ptr;
+	int ret;
 
-	PROLOG("%s, len:%d, nb_frag: %d",
-	       dev->name, skb->len, skb_shinfo(skb)->nr_frags);
+	nb_packets = skb_queue_len(&net_ctx->tx_queue);
+	if (!nb_packets)
+		return;
 
 	if (!dlp_ctx_have_credits(&ch_ctx->tx, ch_ctx)) {
-		/* Stop the NET if */
 		netif_stop_queue(net_ctx->ndev);
-
-		CRITICAL("No credits available (%d)", ch_ctx->tx.seq_num);
-		ret = NETDEV_TX_BUSY;
-		goto out;
-	}
-
-	/* Dump the first 160 bytes */
-	/* dlp_dbg_dump_data_as_byte(skb->data, MIN(skb->len, 160), 16); */
-
-	if (skb->len < ETH_ZLEN) {
-		/* WARNING("Padding received packet (size: %d)", skb->len); */
-		if (skb_padto(skb, ETH_ZLEN))
-			return NETDEV_TX_OK;
+		return;
 	}
 
-	/* Set msg params */
-	msg_param = (struct dlp_net_tx_params *)skb->cb;
-	msg_param->ch_ctx = ch_ctx;
-	msg_param->skb = skb;
+	hrtimer_try_to_cancel(&net_ctx->tx_timer.timer);
 
-	/* Save the timestamp */
-	dev->trans_start = jiffies;
-
-	/* Compute the number of needed padding entries */
-	nb_padding = 1;
-	if (skb_has_frag_list(skb)) {
-		for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
-			align_size = IS_ALIGNED(skb_shinfo(skb)->frags[i].size,
-						DLP_PACKET_ALIGN_CP);
-			/* Size aligned ? */
-			nb_padding += (align_size ? 0 : 1);
-		}
-	}
-
-	/* Compute the number of needed SGT entries */
-	nb_packets = skb_shinfo(skb)->nr_frags + 1;
-	nb_entries = 1 +	/* Header */
-	    nb_packets +	/* Packets */
-	    nb_padding;		/* Padding */
-
-	/* Allocate the HSI msg */
-	new = hsi_alloc_msg(nb_entries, GFP_ATOMIC);
+	/* Header + packets + inter packets padding + final padding */
+	new = hsi_alloc_msg(2 * nb_packets + 1, GFP_ATOMIC);
 	if (!new) {
 		CRITICAL("No more memory to allocate hsi_msg struct");
-		ret = NETDEV_TX_BUSY;
-		goto out;
+		goto drop;
 	}
 
 	new->cl = dlp_drv.client;
 	new->channel = ch_ctx->hsi_channel;
 	new->ttype = HSI_MSG_WRITE;
-	new->context = msg_param;
 	new->complete = dlp_net_complete_tx;
 	new->destructor = dlp_net_pdu_destructor;
 
-	/* Allocate the header buffer */
+	/* Allocate the header buffer (room for the first packet header too) */
 	sg = new->sgt.sgl;
-
-	desc_size = 1 * 4 +	/* Signature + Seq_num */
-	    nb_packets * 8;	/* Packets Offset+Size */
-
-	desc_size = ALIGN(desc_size, DLP_PACKET_ALIGN_CP);
-	desc_size += DLP_HDR_SPACE_CP;
+	desc_size = dlp_net_tx_desc_size(nb_packets) + DLP_HDR_SPACE_CP;
 
 	ptr = dlp_buffer_alloc(desc_size, &sg_dma_address(sg));
 	if (!ptr) {
 		CRITICAL("No more memory to allocate msg descriptors");
-		goto free_msg;
+		hsi_free_msg(new);
+		goto drop;
 	}
 
-	/* Set the header buffer */
-	/*-----------------------*/
 	sg_set_buf(sg, ptr, desc_size);
+	nb_entries = 1;
 
-	/* Write packets desc  */
-	/*---------------------*/
-	i = 0;
-	offset = desc_size - DLP_HDR_SPACE_CP;
-
-	PRINT_TX("TX: desc_size: 0x%x, nb_entries:%d, nb_packets:%d\n",
-		 desc_size, nb_entries, nb_packets);
-
-	do {
-		if (nb_packets == 1) {
-			skb_data = skb->data;
-			skb_len = skb->len;
-		} else {
-			frag = &skb_shinfo(skb)->frags[i];
+	PRINT_TX("TX: desc_size: 0x%x, nb_packets:%d\n",
+		 desc_size, nb_packets);
 
-			skb_len = frag->size;
-			skb_data = (void *)frag->page;
+	/* Write packets desc (the signature is set when pushing) */
+	/*--------------------------------------------------------*/
+	offset = desc_size - DLP_HDR_SPACE_CP;
+	payload = 0;
+	first = NULL;
+	next = &first;
 
-			CRITICAL("FRAGGGGGGGGGGGGGGGGGGGGG");
-		}
+	while ((skb = __skb_dequeue(&net_ctx->tx_queue))) {
+		*next = skb;
+		next = &skb->next;
 
 		/* Set the start offset */
 		ptr++;
@@ -575,69 +860,177 @@ static int dlp_net_start_xmit(struct sk_buff *skb, struct net_device *dev)
 
 		/* Set the size */
 		ptr++;
-		(*ptr) = (DLP_HDR_NO_MORE_DESC|DLP_HDR_COMPLETE_PACKET|skb_len);
-		(*ptr) += DLP_HDR_SPACE_CP;
+		(*ptr) = DLP_HDR_COMPLETE_PACKET | (skb->len + DLP_HDR_SPACE_CP);
+		if (!skb_queue_empty(&net_ctx->tx_queue))
+			(*ptr) |= DLP_HDR_MORE_DESC;
+
+		PRINT_TX("TX: offset: 0x%x, size:0x%x\n", offset, (*ptr));
 
 		/* Set the packet SG entry */
 		sg = sg_next(sg);
-		sg_set_buf(sg, skb_data, skb_len);
-		sg->dma_address = dma_map_single(dlp_drv.controller,
-						 skb_data,
-						 skb_len, DMA_TO_DEVICE);
-
-		PRINT_TX("TX: Entry %d: offset: 0x%x, size:0x%x\n", i, offset,
-			 (*ptr));
-
-		/* Still have packets ? */
-		i++;
-		if (i < nb_packets) {
-			/* Need padding ? */
-			align_size = ALIGN(skb_len, DLP_PACKET_ALIGN_CP);
-			if (align_size != skb_len) {
-				skb_data = net_ctx->net_padd;
-				skb_len = align_size - skb_len;
-
-				sg = sg_next(sg);
-				sg_set_buf(sg, skb_data, skb_len);
-
-				sg->dma_address =
-				    dma_map_single(dlp_drv.controller, skb_data,
-						   skb_len, DMA_TO_DEVICE);
-			}
-
-			/* Update the offset value */
-			offset += align_size + DLP_HDR_SPACE_CP;
-		} else {
-			/* Update the offset value */
-			offset += skb_len + DLP_HDR_SPACE_CP;
+		sg_set_buf(sg, skb->data, skb->len);
+		nb_entries++;
+		payload += skb->len;
+
+		if (skb_queue_empty(&net_ctx->tx_queue)) {
+			offset += DLP_HDR_SPACE_CP + skb->len;
+			break;
 		}
-	} while (i < nb_packets);
+
+		/* Alignment + next packet header space */
+		len = dlp_net_tx_packet_room(skb->len) - skb->len;
+		sg = sg_next(sg);
+		sg_set_buf(sg, net_ctx->net_padd, len);
+		nb_entries++;
+
+		offset += dlp_net_tx_packet_room(skb->len);
+	}
+	net_ctx->tx_used = 0;
 
 	/* Write the padding entry (Check 4 bytes alignment) */
 	/*---------------------------------------------------*/
-	padding_len = ch_ctx->pdu_size - offset;
-	padding_len = (padding_len / 4) * 4;
-	if (padding_len) {
+	len = ((ch_ctx->pdu_size - offset) / 4) * 4;
+	if (len) {
 		sg = sg_next(sg);
-		sg_set_buf(sg, net_ctx->net_padd, padding_len);
-		sg->dma_address = net_ctx->net_padd_dma;
+		sg_set_buf(sg, net_ctx->net_padd, len);
+		nb_entries++;
 	}
 
-	PRINT_TX("TX: Entry %d (Padding): offset: 0x%x, size:0x%x\n", i, offset,
-		 padding_len);
+	sg_mark_end(sg);
+	new->sgt.nents = nb_entries;
+
+	PRINT_TX("TX: padding: offset: 0x%x, size:0x%x\n", offset, len);
+
+	msg_param = (struct dlp_net_tx_params *)first->cb;
+	msg_param->ch_ctx = ch_ctx;
+	msg_param->skb = first;
+	new->context = msg_param;
 
 	ret = dlp_hsi_controller_push(&ch_ctx->tx, new);
 	if (ret) {
-		ret = NETDEV_TX_BUSY;
-		goto free_msg;
+		dlp_pdu_free(new, desc_size);
+		goto drop_chain;
 	}
 
-	ret = NETDEV_TX_OK;
-	EPILOG("%d", ret);
-	return ret;
+	net_ctx->tx_stats.pdus++;
+	net_ctx->tx_stats.packets += nb_packets;
+	net_ctx->tx_stats.payload += payload;
+	net_ctx->tx_stats.pdu_bytes += ch_ctx->pdu_size;
+	return;
+
+drop_chain:
+	for (skb = first; skb; skb = first) {
+		first = skb->next;
+		skb->next = NULL;
+		net_ctx->ndev->stats.tx_dropped++;
+		dev_kfree_skb_any(skb);
+	}
+	return;
+
+drop:
+	net_ctx->ndev->stats.tx_dropped += nb_packets;
+	__skb_queue_purge(&net_ctx->tx_queue);
+	net_ctx->tx_used = 0;
+}
+
+/**
+ * dlp_net_tx_timer_cb - TX aggregation deadline
+ * @timer: a reference to the hrtimer of the net context tx_timer
+ *
+ * Runs in the tx_timer tasklet, like a timer_list would.
+ */
+static enum hrtimer_restart dlp_net_tx_timer_cb(struct hrtimer *timer)
+{
+	struct dlp_net_context *net_ctx =
+	    container_of(timer, struct dlp_net_context, tx_timer.timer);
+	struct dlp_channel *ch_ctx = netdev_priv(net_ctx->ndev);
+	unsigned long flags;
+
+	spin_lock_irqsave(&net_ctx->tx_lock, flags);
+	if (!skb_queue_empty(&net_ctx->tx_queue)) {
+		net_ctx->tx_stats.timer_flushes++;
+		dlp_net_tx_flush(ch_ctx);
+	}
+	spin_unlock_irqrestore(&net_ctx->tx_lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Transmit a packet
+ *
+ * Packets are aggregated in a pdu while a previous one is being transferred.
+ * The pdu is sent when full, when that transfer completes or on the
+ * aggregation deadline, and right away if the HSI link is idle.
+ */
+static int dlp_net_start_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+	struct dlp_channel *ch_ctx = netdev_priv(dev);
+	struct dlp_net_context *net_ctx = ch_ctx->ch_data;
+	unsigned int delay = net_tx_aggr_delay;
+	unsigned long flags;
+	int ret, idle;
+
+	PROLOG("%s, len:%d, nb_frag: %d",
+	       dev->name, skb->len, skb_shinfo(skb)->nr_frags);
+
+	/* Dump the first 160 bytes */
+	/* dlp_dbg_dump_data_as_byte(skb->data, MIN(skb->len, 160), 16); */
+
+	if (skb->len < ETH_ZLEN) {
+		/* WARNING("Padding received packet (size: %d)", skb->len); */
+		if (skb_padto(skb, ETH_ZLEN))
+			return NETDEV_TX_OK;
+	}
+
+	/* Save the timestamp */
+	dev->trans_start = jiffies;
+
+	spin_lock_irqsave(&net_ctx->tx_lock, flags);
+
+	/* Too big to fit in a pdu on its own */
+	if (skb_queue_empty(&net_ctx->tx_queue) &&
+	    !dlp_net_tx_fits(ch_ctx, skb->len)) {
+		spin_unlock_irqrestore(&net_ctx->tx_lock, flags);
 
-free_msg:
-	hsi_free_msg(new);
+		CRITICAL("Packet too big (size: %d)", skb->len);
+		dev->stats.tx_errors++;
+		dev_kfree_skb_any(skb);
+		ret = NETDEV_TX_OK;
+		goto out;
+	}
+
+	/* Current pdu full: send it */
+	if (!dlp_net_tx_fits(ch_ctx, skb->len)) {
+		dlp_net_tx_flush(ch_ctx);
+
+		/* Still there: waiting for credits */
+		if (!skb_queue_empty(&net_ctx->tx_queue)) {
+			spin_unlock_irqrestore(&net_ctx->tx_lock, flags);
+
+			netif_stop_queue(dev);
+			ret = NETDEV_TX_BUSY;
+			goto out;
+		}
+	}
+
+	__skb_queue_tail(&net_ctx->tx_queue, skb);
+	net_ctx->tx_used += dlp_net_tx_packet_room(skb->len);
+
+	read_lock(&ch_ctx->tx.lock);
+	idle = (ch_ctx->tx.ctrl_len == 0);
+	read_unlock(&ch_ctx->tx.lock);
+
+	if (!delay || idle ||
+	    skb_queue_len(&net_ctx->tx_queue) == DLP_NET_TX_MAX_PACKETS)
+		dlp_net_tx_flush(ch_ctx);
+	else if (!hrtimer_active(&net_ctx->tx_timer.timer))
+		tasklet_hrtimer_start(&net_ctx->tx_timer,
+				      ns_to_ktime((u64)delay * NSEC_PER_USEC),
+				      HRTIMER_MODE_REL);
+
+	spin_unlock_irqrestore(&net_ctx->tx_lock, flags);
+	ret = NETDEV_TX_OK;
 
 out:
 	EPILOG("%d", ret);
@@ -665,18 +1058,98 @@ void dlp_net_tx_timeout(struct net_device *dev)
 }
 
 /*
- *
+ * Biggest packet that fits in a TX pdu on its own, with its descriptor
+ * and header space
+ */
+static unsigned int dlp_net_max_mtu(struct dlp_channel *ch_ctx)
+{
+	return round_down(ch_ctx->pdu_size - dlp_net_tx_desc_size(1) -
+			  DLP_HDR_SPACE_CP, DLP_PACKET_ALIGN_CP);
+}
+
+/*
+ * Change the MTU, anything bigger than a pdu can carry would only be
+ * dropped as a TX error
  */
 int dlp_net_change_mtu(struct net_device *dev, int new_mtu)
 {
-	int ret = -EPERM;
+	struct dlp_channel *ch_ctx = netdev_priv(dev);
+	int ret = 0;
 
-	PROLOG("%s", dev->name);
+	PROLOG("%s, mtu: %d", dev->name, new_mtu);
 
-	EPILOG();
+	if (new_mtu < 68 || new_mtu > dlp_net_max_mtu(ch_ctx))
+		ret = -EINVAL;
+	else
+		dev->mtu = new_mtu;
+
+	EPILOG("%d", ret);
 	return ret;
 }
 
+static const char dlp_net_stats_strings[][ETH_GSTRING_LEN] = {
+	"rx_polls",
+	"rx_poll_packets",
+	"rx_frag_packets",
+	"rx_copy_packets",
+	"rx_copy_avoided_bytes",
+	"rx_copied_bytes",
+	"rx_page_swaps",
+	"tx_pdus",
+	"tx_pdu_packets",
+	"tx_pdu_payload_bytes",
+	"tx_pdu_bytes",
+	"tx_timer_flushes",
+};
+
+#define DLP_NET_STATS_LEN	ARRAY_SIZE(dlp_net_stats_strings)
+
+static int dlp_net_get_sset_count(struct net_device *dev, int sset)
+{
+	switch (sset) {
+	case ETH_SS_STATS:
+		return DLP_NET_STATS_LEN;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static void dlp_net_get_strings(struct net_device *dev, u32 sset, u8 *data)
+{
+	if (sset == ETH_SS_STATS)
+		memcpy(data, dlp_net_stats_strings,
+		       sizeof(dlp_net_stats_strings));
+}
+
+static void dlp_net_get_ethtool_stats(struct net_device *dev,
+				      struct ethtool_stats *stats, u64 *data)
+{
+	struct dlp_channel *ch_ctx = netdev_priv(dev);
+	struct dlp_net_context *net_ctx = ch_ctx->ch_data;
+	struct dlp_net_rx_stats *rx_stats = &net_ctx->rx_stats;
+	struct dlp_net_tx_stats *tx_stats = &net_ctx->tx_stats;
+
+	data[0] = rx_stats->polls;
+	data[1] = rx_stats->poll_packets;
+	data[2] = rx_stats->frag_packets;
+	data[3] = rx_stats->copy_packets;
+	data[4] = rx_stats->copy_avoided;
+	data[5] = rx_stats->copied;
+	data[6] = rx_stats->page_swaps;
+	data[7] = tx_stats->pdus;
+	data[8] = tx_stats->packets;
+	data[9] = tx_stats->payload;
+	data[10] = tx_stats->pdu_bytes;
+	data[11] = tx_stats->timer_flushes;
+}
+
+static const struct ethtool_ops dlp_net_ethtool_ops = {
+	.get_link = ethtool_op_get_link,
+	.get_sset_count = dlp_net_get_sset_count,
+	.get_strings = dlp_net_get_strings,
+	.get_ethtool_stats = dlp_net_get_ethtool_stats,
+};
+
 static const struct net_device_ops dlp_net_netdev_ops = {
 	.ndo_open = dlp_net_open,
 	.ndo_stop = dlp_net_stop,
@@ -695,6 +1168,7 @@ void dlp_net_dev_setup(struct net_device *dev)
 	PROLOG();
 
 	dev->netdev_ops = &dlp_net_netdev_ops;
+	dev->ethtool_ops = &dlp_net_ethtool_ops;
 	dev->watchdog_timeo = DLP_NET_TX_DELAY;
 
 	/* fill in the other fields */
@@ -704,6 +1178,7 @@ void dlp_net_dev_setup(struct net_device *dev)
 	dev->mtu = DLP_NET_PDU_SIZE;	/* FIXME: check wget crash */
 	dev->tx_queue_len = 10;
 	dev->flags = IFF_POINTOPOINT | IFF_NOARP | IFF_MULTICAST;
+	dev->features |= NETIF_F_GRO;
 
 	EPILOG();
 }
@@ -720,6 +1195,7 @@ struct dlp_channel *dlp_net_ctx_create(unsigned int index, struct device *dev)
 	struct dlp_channel *ch_ctx;
 	struct net_device *ndev;
 	struct dlp_net_context *net_ctx;
+	unsigned int pdu_size;
 	int ret;
 
 	PROLOG("%d", index);
@@ -741,8 +1217,9 @@ struct dlp_channel *dlp_net_ctx_create(unsigned int index, struct device *dev)
 	}
 
 	/* Allocate the padding buffer */
-	net_ctx->net_padd = dlp_buffer_alloc(DLP_NET_PDU_SIZE,
-					     &net_ctx->net_padd_dma);
+	pdu_size = clamp_t(unsigned int, ALIGN(net_pdu_size, 4),
+			   DLP_NET_PDU_SIZE, DLP_NET_PDU_SIZE_MAX);
+	net_ctx->net_padd = dlp_buffer_alloc(pdu_size, &net_ctx->net_padd_dma);
 
 	if (!net_ctx->net_padd) {
 		CRITICAL("No more memory to allocate padding buffer");
@@ -750,6 +1227,17 @@ struct dlp_channel *dlp_net_ctx_create(unsigned int index, struct device *dev)
 		goto free_dev;
 	}
 
+	/* NAPI RX */
+	spin_lock_init(&net_ctx->rx_lock);
+	INIT_LIST_HEAD(&net_ctx->rx_pdus);
+	netif_napi_add(ndev, &net_ctx->napi, dlp_net_poll, DLP_NET_NAPI_WEIGHT);
+
+	/* TX aggregation */
+	spin_lock_init(&net_ctx->tx_lock);
+	skb_queue_head_init(&net_ctx->tx_queue);
+	tasklet_hrtimer_init(&net_ctx->tx_timer, dlp_net_tx_timer_cb,
+			     CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+
 	/* Register the net device */
 	ret = register_netdev(ndev);
 	if (ret) {
@@ -764,7 +1252,8 @@ struct dlp_channel *dlp_net_ctx_create(unsigned int index, struct device *dev)
 	ch_ctx->ch_data = net_ctx;
 	ch_ctx->hsi_channel = index;
 	ch_ctx->credits = 0;
-	ch_ctx->pdu_size = DLP_NET_PDU_SIZE;
+	ch_ctx->pdu_size = pdu_size;
+	ndev->mtu = dlp_net_max_mtu(ch_ctx);
 	ch_ctx->rx.config = client->rx_cfg;
 	ch_ctx->tx.config = client->tx_cfg;
 
@@ -791,6 +1280,9 @@ struct dlp_channel *dlp_net_ctx_create(unsigned int index, struct device *dev)
 			  DLP_HSI_RX_WAIT_FIFO, DLP_HSI_RX_CTRL_FIFO,
 			  dlp_net_complete_rx, HSI_MSG_READ);
 
+	/* RX pdu pages are lent to the skbs */
+	ch_ctx->rx.page_pdus = (pdu_size <= PAGE_SIZE);
+
 	/* Allocate RX FIFOs in background */
 	queue_work(dlp_drv.recycle_wq, &ch_ctx->rx.increase_pool);
 
@@ -815,6 +1307,11 @@ int dlp_net_ctx_delete(struct dlp_channel *ch_ctx)
 
 	/* Unregister the net device */
 	unregister_netdev(net_ctx->ndev);
+	netif_napi_del(&net_ctx->napi);
+	tasklet_hrtimer_cancel(&net_ctx->tx_timer);
+
+	if (net_ctx->rx_spare)
+		__free_page(net_ctx->rx_spare);
 
 	/* Delete the xfers context */
 	dlp_xfer_ctx_clear(&ch_ctx->rx);
@@ -822,7 +1319,7 @@ int dlp_net_ctx_delete(struct dlp_channel *ch_ctx)
 
 	/* Free the padding buffer */
 	dlp_buffer_free(net_ctx->net_padd,
-			net_ctx->net_padd_dma, DLP_NET_PDU_SIZE);
+			net_ctx->net_padd_dma, ch_ctx->pdu_size);
 
 	/* Free the ch_ctx */
 	free_netdev(net_ctx->ndev);
@@ -53,6 +53,7 @@
 #include <linux/dma-mapping.h>
 #include <linux/delay.h>
 #include <linux/sched.h>
+#include <linux/ktime.h>
 #include <linux/seq_file.h>
 #include <linux/scatterlist.h>
 #include <linux/interrupt.h>
@@ -188,60 +189,66 @@ struct intel_dma_lli {
 	u32			 ctl_hi;
 };
 
-/**
- * struct intel_dma_lli_xfer - DMA transfer configuration using link listing
- * @blk: reference to the block being transferred
- * @llp_addr: DMA address of the first link list entry
- * @lli: array of DMA link list entries
- */
-struct intel_dma_lli_xfer {
-#ifdef USE_SOFWARE_WORKAROUND_FOR_DMA_LLI
-	struct scatterlist	*blk;
-#endif
-	dma_addr_t		 llp_addr;
-	struct intel_dma_lli	 lli[0];
-};
-
-/**
- * struct intel_dma_plain_xfer - DMA transfer configuration without link list
- * @size: size of the transfer in 32-bit words
- * @src_addr: DMA source address
- * @dst_addr: DMA destination address
- */
-struct intel_dma_plain_xfer {
-	u32			 size;
-	dma_addr_t		 src_addr;
-	dma_addr_t		 dst_addr;
-};
-
-/**
- * struct intel_dma_xfer - Internal DMA transfer context
- * @msg: reference of the message being transferred
- * @mst_enable: master DMA enabling register
- * @slv_enable: slave DMA enabling register
- * @with_link_listing: DMA transfer with link listing context
- * @without_link_listing: DMA transfer without link listing context
- */
-struct intel_dma_xfer {
-	struct hsi_msg				*msg;
-	u32					 mst_enable;
-	u32					 slv_enable;
-	union {
-		struct intel_dma_lli_xfer	 with_link_list;
-		struct intel_dma_plain_xfer	 without_link_list;
-	};
+/* Number of messages a DMA channel descriptor ring can hold */
+#define HSI_DMA_RING_SIZE	4
+
+/**
+ * struct intel_dma_ring_stats - DMA descriptor ring statistics
+ * @runs: number of DMA runs started
+ * @msgs: number of messages transferred through the ring
+ * @max_chain: largest number of messages chained in a single run
+ * @irqs: number of DMA complete interrupts served
+ * @gaps: number of idle gaps between runs while messages were pending
+ * @gap_ns: accumulated duration of these idle gaps
+ * @gap_max_ns: longest of these idle gaps
+ * @stopped: end time of the last run if messages were pending, else 0
+ */
+struct intel_dma_ring_stats {
+	unsigned long		 runs;
+	unsigned long		 msgs;
+	unsigned int		 max_chain;
+	unsigned long		 irqs;
+	unsigned long		 gaps;
+	u64			 gap_ns;
+	u64			 gap_max_ns;
+	ktime_t			 stopped;
 };
 
 /**
  * struct intel_dma_ctx - Internal DMA context
- * @sg_entries: the maximal number of link listing entries for this context
- * @ongoing: reference to ongoing DMA transfer
- * @ready: reference to next ready DMA transfer
+ * @sg_entries: the maximal number of link listing entries per message
+ * @lli: ring of HSI_DMA_RING_SIZE message slots of @sg_entries entries each
+ * @llp_addr: DMA address of the first link list entry of the ring
+ * @msg: reference of the message held in each ring slot
+ * @last: index of the last link list entry used in each ring slot
+ * @frames: size in 32-bit words of the message held in each ring slot
+ * @head: ring slot of the oldest running or prepared message
+ * @running: number of messages chained in the ongoing DMA run
+ * @prepared: number of messages prepared after the running ones
+ * @blk: reference to the block being transferred
+ * @mst_enable: master DMA enabling register
+ * @slv_enable: slave DMA enabling register of the ongoing run
+ * @stats: descriptor ring statistics
+ *
+ * The ring slots [@head, @head + @running + @prepared) always hold, in that
+ * order, the first messages of the matching HSI queue.
  */
 struct intel_dma_ctx {
-	int			 sg_entries;
-	struct intel_dma_xfer	*ongoing;
-	struct intel_dma_xfer	*ready;
+	int				 sg_entries;
+	struct intel_dma_lli		*lli;
+	dma_addr_t			 llp_addr;
+	struct hsi_msg			*msg[HSI_DMA_RING_SIZE];
+	unsigned int			 last[HSI_DMA_RING_SIZE];
+	u32				 frames[HSI_DMA_RING_SIZE];
+	unsigned int			 head;
+	unsigned int			 running;
+	unsigned int			 prepared;
+#ifdef USE_SOFWARE_WORKAROUND_FOR_DMA_LLI
+	struct scatterlist		*blk;
+#endif
+	u32				 mst_enable;
+	u32				 slv_enable;
+	struct intel_dma_ring_stats	 stats;
 };
 
 /**
@@ -378,14 +385,67 @@ struct intel_controller {
  */
 
 /**
- * is_using_link_list - checks if the DMA context is using link listing
+ * dma_ring_slot - gets the ring slot of a running or prepared message
+ * @dma_ctx: a reference to the DMA context to query
+ * @i: rank of the message from the ring head
+ *
+ * Returns the ring slot index.
+ */
+static inline unsigned int dma_ring_slot(struct intel_dma_ctx *dma_ctx,
+					 unsigned int i)
+{
+	return (dma_ctx->head + i) % HSI_DMA_RING_SIZE;
+}
+
+/**
+ * dma_ring_lli - gets the first link list entry of a ring slot
+ * @dma_ctx: a reference to the DMA context to query
+ * @slot: ring slot index
+ *
+ * Returns a reference to the link list entry.
+ */
+static inline struct intel_dma_lli *dma_ring_lli(struct intel_dma_ctx *dma_ctx,
+						 unsigned int slot)
+{
+	return &dma_ctx->lli[slot * dma_ctx->sg_entries];
+}
+
+/**
+ * dma_ring_llp - gets the DMA address of a link list entry of a ring slot
+ * @dma_ctx: a reference to the DMA context to query
+ * @slot: ring slot index
+ * @i: link list entry index in the slot
+ *
+ * Returns the DMA address of the link list entry.
+ */
+static inline u32 dma_ring_llp(struct intel_dma_ctx *dma_ctx,
+			       unsigned int slot, unsigned int i)
+{
+	return (u32) dma_ctx->llp_addr +
+		(slot * dma_ctx->sg_entries + i) * sizeof(struct intel_dma_lli);
+}
+
+/**
+ * dma_ring_size - gets the size in bytes of the link list entries of a ring
+ * @dma_ctx: a reference to the DMA context to query
+ *
+ * Returns the size of the ring.
+ */
+static inline size_t dma_ring_size(struct intel_dma_ctx *dma_ctx)
+{
+	return HSI_DMA_RING_SIZE * dma_ctx->sg_entries *
+		sizeof(struct intel_dma_lli);
+}
+
+/**
+ * dma_ring_current - gets the message currently transferred by a DMA context
  * @dma_ctx: a reference to the DMA context to query
  *
- * Returns 0 if not using link-listing or 1 if using it.
+ * Returns a reference to the message or NULL if no DMA run is ongoing.
  */
-static inline int is_using_link_list(struct intel_dma_ctx *dma_ctx)
+static inline struct hsi_msg *dma_ring_current(struct intel_dma_ctx *dma_ctx)
 {
-	return (dma_ctx->sg_entries > 1);
+	return (dma_ctx->running) ? dma_ctx->msg[dma_ctx->head] : NULL;
 }
 
 /**
@@ -921,7 +981,7 @@ static int hsi_ctrl_set_cfg(struct intel_controller *intel_hsi)
 	void __iomem	*ctrl	= intel_hsi->ctrl_io;
 	void __iomem	*dma	= intel_hsi->dma_io;
 	u32		 status;
-	int		 i, dma_chan, lli_enb;
+	int		 i, dma_chan;
 
 	/* If the reset bit is set then nothing has been configured yet ! */
 	if (intel_hsi->prg_cfg & ARASAN_RESET)
@@ -938,19 +998,18 @@ static int hsi_ctrl_set_cfg(struct intel_controller *intel_hsi)
 	for (i = 0; i < DWAHB_CHAN_CNT; i++)
 		iowrite32(0, ARASAN_HSI_DMA_CONFIG(ctrl, i));
 
+	/* All DMA channels are run from their link list descriptor ring */
 	iowrite32(DWAHB_ENABLE, HSI_DWAHB_DMACFG(dma));
 	for (i = 0; i < HSI_MID_MAX_CHANNELS; i++) {
 		dma_chan = intel_hsi->tx_dma_chan[i];
-		lli_enb = is_using_link_list(&intel_hsi->tx_ctx[i].dma);
 		if (dma_chan >= 0)
-			hsi_set_master_dma_cfg(dma, dma_chan, 1, lli_enb);
+			hsi_set_master_dma_cfg(dma, dma_chan, 1, 1);
 	}
 
 	for (i = 0; i < HSI_MID_MAX_CHANNELS; i++) {
 		dma_chan = intel_hsi->rx_dma_chan[i];
-		lli_enb = is_using_link_list(&intel_hsi->rx_ctx[i].dma);
 		if (dma_chan >= 0)
-			hsi_set_master_dma_cfg(dma, dma_chan, 0, lli_enb);
+			hsi_set_master_dma_cfg(dma, dma_chan, 0, 1);
 	}
 
 	/* Enable the internal HSI clock */
@@ -1100,131 +1159,74 @@ exit_ctrl_suspend:
 }
 
 /**
- * do_free_dma_xfer - do free a single DMA transfer context
- * @dma_xfer: DMA transfer context reference to free
- * @sg_entries: maximal number of supported scatter gather entries
+ * free_dma_ring - free the descriptor ring of a DMA context
+ * @dma_ctx: DMA context reference
  * @intel_hsi: Intel HSI controller reference
  */
-static void do_free_dma_xfer(struct intel_dma_xfer *dma_xfer, int sg_entries,
-			     struct intel_controller *intel_hsi)
+static void free_dma_ring(struct intel_dma_ctx *dma_ctx,
+			  struct intel_controller *intel_hsi)
 {
-	dma_addr_t		 dma_addr;
-	int			 size;
+	dma_ctx->running = 0;
+	dma_ctx->prepared = 0;
 
-	if (!dma_xfer)
+	if (!dma_ctx->lli)
 		return;
 
-	if (sg_entries > 1) {
-		size = sg_entries * sizeof(struct intel_dma_lli);
-		dma_addr = (dma_addr_t) (dma_xfer->with_link_list.llp_addr);
-		dma_unmap_single(intel_hsi->pdev, dma_addr, size,
-				 DMA_TO_DEVICE);
-	}
-
-	kfree(dma_xfer);
+	dma_unmap_single(intel_hsi->pdev, dma_ctx->llp_addr,
+			 dma_ring_size(dma_ctx), DMA_TO_DEVICE);
+	kfree(dma_ctx->lli);
+	dma_ctx->lli = NULL;
 }
 
 /**
- * do_alloc_dma_xfer - allocate and initialise a single DMA transfer context
+ * alloc_dma_ring - allocating and initialising the DMA descriptor ring
  * @tx_not_rx: DMA channel direction (1 for TX, 0 for RX)
  * @hsi_chan: HSI channel number
  * @dma_chan: DMA channel number
- * @sg_entries: maximal number of supported scatter gather entries
  * @intel_hsi: Intel HSI controller reference
  *
- * Returns a pointer to a newly created DMA channel or NULL if not possible
- */
-static
-struct intel_dma_xfer *do_alloc_dma_xfer(int tx_not_rx, int hsi_chan,
-					 int dma_chan, int sg_entries,
-					 struct intel_controller *intel_hsi)
-{
-	struct intel_dma_xfer		*dma_xfer;
-	struct intel_dma_lli_xfer	*lli_xfer;
-	struct intel_dma_plain_xfer	*plain_xfer;
-	int				 size, sg_size, header;
-	dma_addr_t			 dma_addr;
-	int				 i;
-
-	if (sg_entries > 1) {
-		header = offsetof(struct intel_dma_xfer, with_link_list);
-		sg_size = sg_entries * sizeof(struct intel_dma_lli);
-		size = header + offsetof(struct intel_dma_lli_xfer, lli) +
-		       sg_size;
-
-		dma_xfer = kzalloc(size, GFP_ATOMIC);
-		if (!dma_xfer)
-			return NULL;
-		lli_xfer = &dma_xfer->with_link_list;
-
-		dma_addr = dma_map_single(intel_hsi->pdev, lli_xfer->lli,
-					  sg_size, DMA_TO_DEVICE);
-		if (!dma_addr) {
-			kfree(dma_xfer);
-			return NULL;
-		}
-
-		lli_xfer->llp_addr = dma_addr;
-
-		for (i = 0; i < sg_entries; i++) {
-			if (tx_not_rx)
-				lli_xfer->lli[i].dar =
-					HSI_DWAHB_TX_ADDRESS(hsi_chan);
-			else
-				lli_xfer->lli[i].sar =
-					HSI_DWAHB_RX_ADDRESS(hsi_chan);
-
-			lli_xfer->lli[i].ctl_lo =
-					HSI_DWAHB_CTL_LO_CFG(tx_not_rx, 1);
-		}
-	} else {
-		header = offsetof(struct intel_dma_xfer, without_link_list);
-		size = header + sizeof(struct intel_dma_plain_xfer);
-
-		dma_xfer = kzalloc(size, GFP_ATOMIC);
-		if (!dma_xfer)
-			return NULL;
-		plain_xfer = &dma_xfer->without_link_list;
-
-		if (tx_not_rx)
-			plain_xfer->dst_addr = HSI_DWAHB_TX_ADDRESS(hsi_chan);
-		else
-			plain_xfer->src_addr = HSI_DWAHB_RX_ADDRESS(hsi_chan);
-	}
-
-		dma_xfer->mst_enable = DWAHB_CHAN_START(dma_chan);
-
-		return dma_xfer;
-}
-
-/**
- * alloc_dma_xfer - allocating and initialising a single DMA transfer context
- * @tx_not_rx: DMA channel direction (1 for TX, 0 for RX)
- * @hsi_chan: HSI channel number
- * @dma_chan: DMA channel number
- * @intel_hsi: Intel HSI controller reference
+ * The ring is mapped once for all and its link list entries are rewritten
+ * in place for each message, so that consecutive messages can be chained.
  *
  * Returns 0 if successful or an error code
  */
-static int alloc_dma_xfer(int tx_not_rx, int hsi_chan, int dma_chan,
+static int alloc_dma_ring(int tx_not_rx, int hsi_chan, int dma_chan,
 			  struct intel_controller *intel_hsi)
 {
 	struct intel_dma_ctx *dma_ctx	= intel_hsi->dma_ctx[dma_chan];
-	int sg_ents			= dma_ctx->sg_entries;
+	int entries = HSI_DMA_RING_SIZE * dma_ctx->sg_entries;
+	struct intel_dma_lli *lli;
+	dma_addr_t dma_addr;
+	int i;
+
+	lli = kzalloc(dma_ring_size(dma_ctx), GFP_ATOMIC);
+	if (!lli)
+		goto exit_error;
 
-	dma_ctx->ongoing = do_alloc_dma_xfer(tx_not_rx, hsi_chan, dma_chan,
-					     sg_ents, intel_hsi);
+	for (i = 0; i < entries; i++) {
+		if (tx_not_rx)
+			lli[i].dar = HSI_DWAHB_TX_ADDRESS(hsi_chan);
+		else
+			lli[i].sar = HSI_DWAHB_RX_ADDRESS(hsi_chan);
+		lli[i].ctl_lo = HSI_DWAHB_CTL_LO_CFG(tx_not_rx, 1);
+	}
 
-	if (!dma_ctx->ongoing)
+	dma_addr = dma_map_single(intel_hsi->pdev, lli,
+				  dma_ring_size(dma_ctx), DMA_TO_DEVICE);
+	if (!dma_addr) {
+		kfree(lli);
 		goto exit_error;
+	}
 
-	dma_ctx->ready = do_alloc_dma_xfer(tx_not_rx, hsi_chan, dma_chan,
-					   sg_ents, intel_hsi);
+	dma_ctx->lli		= lli;
+	dma_ctx->llp_addr	= dma_addr;
+	dma_ctx->head		= 0;
+	dma_ctx->running	= 0;
+	dma_ctx->prepared	= 0;
+	dma_ctx->mst_enable	= DWAHB_CHAN_START(dma_chan);
 
-	if (dma_ctx->ready)
-		return 0;
+	return 0;
 
-	do_free_dma_xfer(dma_ctx->ongoing, sg_ents, intel_hsi);
 exit_error:
 	intel_hsi->dma_ctx[dma_chan] = NULL;
 
@@ -1238,19 +1240,13 @@ exit_error:
 static void free_xfer_ctx(struct intel_controller *intel_hsi)
 	__acquires(&intel_hsi->sw_lock) __releases(&intel_hsi->sw_lock)
 {
-	struct intel_dma_ctx *dma_ctx;
-	int i, sg_ents;
+	int i;
 	unsigned long flags;
 
 	spin_lock_irqsave(&intel_hsi->sw_lock, flags);
 	for (i = 0; i < DWAHB_CHAN_CNT; i++)
 		if (intel_hsi->dma_ctx[i]) {
-			dma_ctx	= intel_hsi->dma_ctx[i];
-			sg_ents	= dma_ctx->sg_entries;
-			do_free_dma_xfer(dma_ctx->ongoing, sg_ents, intel_hsi);
-			do_free_dma_xfer(dma_ctx->ready, sg_ents, intel_hsi);
-			intel_hsi->dma_ctx[i]->ongoing = NULL;
-			intel_hsi->dma_ctx[i]->ready = NULL;
+			free_dma_ring(intel_hsi->dma_ctx[i], intel_hsi);
 			intel_hsi->dma_ctx[i] = NULL;
 		}
 	spin_unlock_irqrestore(&intel_hsi->sw_lock, flags);
@@ -1274,14 +1270,14 @@ static int alloc_xfer_ctx(struct intel_controller *intel_hsi)
 		lch = intel_hsi->tx_dma_chan[i];
 		if (lch >= 0) {
 			intel_hsi->dma_ctx[lch] = &intel_hsi->tx_ctx[i].dma;
-			err = alloc_dma_xfer(1, i, lch, intel_hsi);
+			err = alloc_dma_ring(1, i, lch, intel_hsi);
 			if (err)
 				break;
 		}
 		lch = intel_hsi->rx_dma_chan[i];
 		if (lch >= 0) {
 			intel_hsi->dma_ctx[lch] = &intel_hsi->rx_ctx[i].dma;
-			err = alloc_dma_xfer(0, i, lch, intel_hsi);
+			err = alloc_dma_ring(0, i, lch, intel_hsi);
 			if (err)
 				break;
 		}
@@ -1510,6 +1506,41 @@ static int hsi_debug_dma_show(struct seq_file *m, void *p)
 	return 0;
 }
 
+static int hsi_debug_dma_ring_show(struct seq_file *m, void *p)
+	__acquires(&intel_hsi->sw_lock) __releases(&intel_hsi->sw_lock)
+{
+	struct hsi_controller *hsi = m->private;
+	struct intel_controller *intel_hsi = hsi_controller_drvdata(hsi);
+	struct intel_dma_ctx *dma_ctx;
+	struct intel_dma_ring_stats stats;
+	unsigned int running, prepared;
+	unsigned long flags;
+	int i;
+
+	seq_printf(m, "ch\trun\tprep\truns\tmsgs\tchain\tirqs\tgaps"
+		      "\tgap_us\tgap_max_us\n");
+	for (i = 0; i < DWAHB_CHAN_CNT; i++) {
+		spin_lock_irqsave(&intel_hsi->sw_lock, flags);
+		dma_ctx = intel_hsi->dma_ctx[i];
+		if (!dma_ctx) {
+			spin_unlock_irqrestore(&intel_hsi->sw_lock, flags);
+			continue;
+		}
+		running = dma_ctx->running;
+		prepared = dma_ctx->prepared;
+		stats = dma_ctx->stats;
+		spin_unlock_irqrestore(&intel_hsi->sw_lock, flags);
+
+		seq_printf(m, "%d\t%u\t%u\t%lu\t%lu\t%u\t%lu\t%lu\t%llu\t%llu\n",
+			   i, running, prepared, stats.runs, stats.msgs,
+			   stats.max_chain, stats.irqs, stats.gaps,
+			   div_u64(stats.gap_ns, NSEC_PER_USEC),
+			   div_u64(stats.gap_max_ns, NSEC_PER_USEC));
+	}
+
+	return 0;
+}
+
 static int hsi_regs_open(struct inode *inode, struct file *file)
 {
 	return single_open(file, hsi_debug_show, inode->i_private);
@@ -1520,6 +1551,11 @@ static int hsi_dma_regs_open(struct inode *inode, struct file *file)
 	return single_open(file, hsi_debug_dma_show, inode->i_private);
 }
 
+static int hsi_dma_ring_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hsi_debug_dma_ring_show, inode->i_private);
+}
+
 static const struct file_operations hsi_regs_fops = {
 	.open		= hsi_regs_open,
 	.read		= seq_read,
@@ -1534,6 +1570,13 @@ static const struct file_operations hsi_dma_regs_fops = {
 	.release	= single_release,
 };
 
+static const struct file_operations hsi_dma_ring_fops = {
+	.open		= hsi_dma_ring_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int __init hsi_debug_add_ctrl(struct hsi_controller *hsi)
 {
 	struct intel_controller *intel_hsi = hsi_controller_drvdata(hsi);
@@ -1551,6 +1594,7 @@ static int __init hsi_debug_add_ctrl(struct hsi_controller *hsi)
 	if (IS_ERR(dir))
 		goto rback;
 	debugfs_create_file("regs", S_IRUGO, dir, hsi, &hsi_dma_regs_fops);
+	debugfs_create_file("ring", S_IRUGO, dir, hsi, &hsi_dma_ring_fops);
 
 	return 0;
 rback:
@@ -1561,109 +1605,131 @@ rback:
 #endif /* CONFIG_DEBUG_FS */
 
 /**
- * do_hsi_prepare_dma - prepare a DMA context
+ * do_hsi_prepare_dma - prepare the link list of a message in a ring slot
  * @msg: reference to the message
- * @lch: DMA channel to consider
- * @intel_hsi: Intel HSI controller reference
+ * @dma_ctx: DMA context to consider
+ * @slot: ring slot to fill
  */
-static void do_hsi_prepare_dma(struct hsi_msg *msg, int lch,
-			       struct intel_controller *intel_hsi)
+static void do_hsi_prepare_dma(struct hsi_msg *msg,
+			       struct intel_dma_ctx *dma_ctx, unsigned int slot)
 {
-	struct intel_dma_ctx *dma_ctx = intel_hsi->dma_ctx[lch];
-	struct intel_dma_xfer *ready_xfer = dma_ctx->ready;
-	struct intel_dma_lli_xfer *lli_xfer;
-	struct intel_dma_plain_xfer *plain_xfer;
+	struct intel_dma_lli *lli = dma_ring_lli(dma_ctx, slot);
 	struct sg_table *sgt = &msg->sgt;
-	struct scatterlist *sgl = sgt->sgl;
 	u32 rx_not_tx = (msg->ttype == HSI_MSG_READ);
-	u32 size;
+	u32 size = 0;
 	struct scatterlist *sg;
-	u32 len, next_llp;
+	u32 len;
 	int i;
 
-	if (is_using_link_list(dma_ctx)) {
-		lli_xfer = &ready_xfer->with_link_list;
-		size = 0;
-		next_llp = (u32) lli_xfer->llp_addr;
-#ifdef USE_SOFWARE_WORKAROUND_FOR_DMA_LLI
-		lli_xfer->blk = sgl;
-#endif
-
-		for_each_sg(sgl, sg, sgt->nents, i) {
-			next_llp	+= sizeof(struct intel_dma_lli);
-			len		 = HSI_BYTES_TO_FRAMES(sg->length);
-			size		+= len;
+	for_each_sg(sgt->sgl, sg, sgt->nents, i) {
+		len	 = HSI_BYTES_TO_FRAMES(sg->length);
+		size	+= len;
 
-			if (rx_not_tx)
-				lli_xfer->lli[i].dar = sg_dma_address(sg);
-			else
-				lli_xfer->lli[i].sar = sg_dma_address(sg);
-			lli_xfer->lli[i].llp = (sg_is_last(sg)) ? 0 : next_llp;
-			lli_xfer->lli[i].ctl_hi = len;
-		}
-
-		msg->actual_len = HSI_FRAMES_TO_BYTES(size);
-#ifdef USE_SOFWARE_WORKAROUND_FOR_DMA_LLI
-		size = 0; /* on slave, size is updated on each block xfer */
-#endif
-	} else {
-		size = HSI_BYTES_TO_FRAMES(sgl->length);
-		plain_xfer = &ready_xfer->without_link_list;
-		plain_xfer->size = size;
 		if (rx_not_tx)
-			plain_xfer->dst_addr = sg_dma_address(msg->sgt.sgl);
+			lli[i].dar = sg_dma_address(sg);
 		else
-			plain_xfer->src_addr = sg_dma_address(msg->sgt.sgl);
-
-		msg->actual_len = HSI_FRAMES_TO_BYTES(size);
+			lli[i].sar = sg_dma_address(sg);
+		/* The last entry is linked to the next message on chaining */
+		lli[i].llp = (sg_is_last(sg)) ? 0 :
+				dma_ring_llp(dma_ctx, slot, i + 1);
+		lli[i].ctl_hi = len;
 	}
 
-	ready_xfer->slv_enable = ARASAN_DMA_DIR(rx_not_tx) |
-				 ARASAN_DMA_CHANNEL(msg->channel) |
-				 ARASAN_DMA_XFER_FRAMES(size) |
-				 ARASAN_DMA_BURST_SIZE(32) | ARASAN_DMA_ENABLE;
+	msg->actual_len = HSI_FRAMES_TO_BYTES(size);
 
-	ready_xfer->msg = msg;
+	dma_ctx->msg[slot] = msg;
+	dma_ctx->last[slot] = sgt->nents - 1;
+	dma_ctx->frames[slot] = size;
 }
 
 /**
- * try_hsi_prepare_dma - try preparing a ready DMA context
- * @queue: reference to queue ready to start transfer
- * @lch: DMA channel to consider
- * @intel_hsi: Intel HSI controller reference
+ * hsi_prepare_dma_ring - fill the free ring slots with queued messages
+ * @queue: reference to the queue served by the DMA context
+ * @dma_ctx: DMA context to consider
+ *
+ * This shall be called with the sw_lock held.
  */
-static void hsi_try_prepare_dma(struct list_head *queue, int lch,
-				struct intel_controller *intel_hsi)
-	__acquires(&intel_hsi->sw_lock) __releases(&intel_hsi->sw_lock)
+static void hsi_prepare_dma_ring(struct list_head *queue,
+				 struct intel_dma_ctx *dma_ctx)
 {
-	unsigned long	 flags;
-	struct hsi_msg	*ongoing_msg, *ready_msg;
+	unsigned int used = dma_ctx->running + dma_ctx->prepared;
+	struct list_head *node;
+	struct hsi_msg *msg;
 
-	spin_lock_irqsave(&intel_hsi->sw_lock, flags);
+	if (used >= HSI_DMA_RING_SIZE)
+		return;
 
-	/* If some DMA context is already ready, we are fine */
-	if (!intel_hsi->dma_ctx[lch] ||
-		intel_hsi->dma_ctx[lch]->ready->msg)
-		goto all_dma_prepared;
+	/* Skip the messages which are already in the ring */
+	if (used) {
+		msg = dma_ctx->msg[dma_ring_slot(dma_ctx, used - 1)];
+		node = msg->link.next;
+	} else
+		node = queue->next;
 
-	ongoing_msg = intel_hsi->dma_ctx[lch]->ongoing->msg;
-	if (ongoing_msg) {
-		ready_msg = list_entry(ongoing_msg->link.next,
-				       struct hsi_msg, link);
-		/* Done if there is a single ongoing message in the queue */
-		if (&(ready_msg->link) == queue)
-			goto all_dma_prepared;
-	} else {
-		if (list_empty(queue))
-			goto all_dma_prepared;
-		ready_msg = list_first_entry(queue, struct hsi_msg, link);
+	while ((node != queue) && (used < HSI_DMA_RING_SIZE)) {
+		msg = list_entry(node, struct hsi_msg, link);
+		if (unlikely(!msg->sgt.nents))
+			break;
+		do_hsi_prepare_dma(msg, dma_ctx, dma_ring_slot(dma_ctx, used));
+		dma_ctx->prepared++;
+		used++;
+		node = node->next;
+	}
+}
+
+/**
+ * hsi_chain_dma_ring - chain all prepared messages into a new DMA run
+ * @dma_ctx: DMA context to consider
+ *
+ * This shall be called with the sw_lock held and no ongoing DMA run.
+ *
+ * Returns the number of messages of the new DMA run.
+ */
+static unsigned int hsi_chain_dma_ring(struct intel_dma_ctx *dma_ctx)
+{
+	struct intel_dma_ring_stats *stats = &dma_ctx->stats;
+	struct hsi_msg *msg;
+	unsigned int i, slot, next;
+	u32 size = 0;
+	u64 gap;
+
+	if (!dma_ctx->prepared)
+		return 0;
+
+	for (i = 0; i < dma_ctx->prepared; i++) {
+		slot = dma_ring_slot(dma_ctx, i);
+		dma_ctx->msg[slot]->status = HSI_STATUS_PROCEEDING;
+		size += dma_ctx->frames[slot];
+		next = dma_ring_slot(dma_ctx, i + 1);
+		dma_ring_lli(dma_ctx, slot)[dma_ctx->last[slot]].llp =
+			(i + 1 < dma_ctx->prepared) ?
+				dma_ring_llp(dma_ctx, next, 0) : 0;
 	}
 
-	if (likely(ready_msg->sgt.nents))
-		do_hsi_prepare_dma(ready_msg, lch, intel_hsi);
+	dma_ctx->running = dma_ctx->prepared;
+	dma_ctx->prepared = 0;
 
-all_dma_prepared:
-	spin_unlock_irqrestore(&intel_hsi->sw_lock, flags);
+	msg = dma_ctx->msg[dma_ctx->head];
+#ifdef USE_SOFWARE_WORKAROUND_FOR_DMA_LLI
+	dma_ctx->blk = msg->sgt.sgl;
+	size = 0; /* on slave, size is updated on each block xfer */
+#endif
+	dma_ctx->slv_enable = ARASAN_DMA_DIR(msg->ttype == HSI_MSG_READ) |
+			      ARASAN_DMA_CHANNEL(msg->channel) |
+			      ARASAN_DMA_XFER_FRAMES(size) |
+			      ARASAN_DMA_BURST_SIZE(32) | ARASAN_DMA_ENABLE;
+
+	stats->runs++;
+	stats->max_chain = max(stats->max_chain, dma_ctx->running);
+	if (stats->stopped.tv64) {
+		gap = ktime_to_ns(ktime_sub(ktime_get(), stats->stopped));
+		stats->gaps++;
+		stats->gap_ns += gap;
+		stats->gap_max_ns = max(stats->gap_max_ns, gap);
+		stats->stopped.tv64 = 0;
+	}
+
+	return dma_ctx->running;
 }
 
 /**
@@ -1710,14 +1776,13 @@ static void do_hsi_start_dma(struct hsi_msg *msg, int lch,
 	__acquires(&intel_hsi->hw_lock) __releases(&intel_hsi->hw_lock)
 {
 	struct intel_dma_ctx *dma_ctx;
-	struct intel_dma_xfer *dma_xfer;
-	struct intel_dma_lli_xfer *lli_xfer;
-	struct intel_dma_plain_xfer *plain_xfer;
 	void __iomem *ctrl		= intel_hsi->ctrl_io;
 	void __iomem *dma		= intel_hsi->dma_io;
 	u32 mask			= DMA_BUSY(lch);
-	u32 blk_length_overwrite	= 0;
+#ifdef USE_SOFWARE_WORKAROUND_FOR_DMA_LLI
+	u32 blk_length_overwrite;
 	unsigned int blk_length;
+#endif
 	unsigned long flags;
 	int nothing_to_do;
 
@@ -1730,7 +1795,6 @@ static void do_hsi_start_dma(struct hsi_msg *msg, int lch,
 		goto do_start_dma_done;
 	}
 
-	dma_xfer = dma_ctx->ongoing;
 	if (resuming)
 		nothing_to_do = ((intel_hsi->dma_resumed & mask) ||
 				 (msg->status != HSI_STATUS_PROCEEDING));
@@ -1741,31 +1805,23 @@ static void do_hsi_start_dma(struct hsi_msg *msg, int lch,
 	if (nothing_to_do)
 		goto do_start_dma_done;
 
-	if (is_using_link_list(dma_ctx)) {
-		/* Set the link list pointer */
-		lli_xfer = &dma_xfer->with_link_list;
-		iowrite32(lli_xfer->llp_addr, HSI_DWAHB_LLP(dma, lch));
+	/* Set the link list pointer to the head of the run */
+	iowrite32(dma_ring_llp(dma_ctx, dma_ctx->head, 0),
+		  HSI_DWAHB_LLP(dma, lch));
 #ifdef USE_SOFWARE_WORKAROUND_FOR_DMA_LLI
-		/* Overwrite the block length */
-		blk_length = HSI_BYTES_TO_FRAMES(lli_xfer->blk->length);
-		blk_length_overwrite = ARASAN_DMA_XFER_FRAMES(blk_length);
+	/* Overwrite the block length */
+	blk_length = HSI_BYTES_TO_FRAMES(dma_ctx->blk->length);
+	blk_length_overwrite = ARASAN_DMA_XFER_FRAMES(blk_length);
 #endif
-	} else {
-		/* Clear 'done' bit and set the transfer size and addresses */
-		plain_xfer = &dma_xfer->without_link_list;
-		iowrite32(plain_xfer->size, HSI_DWAHB_CTL_HI(dma, lch));
-		iowrite32(plain_xfer->src_addr, HSI_DWAHB_SAR(dma, lch));
-		iowrite32(plain_xfer->dst_addr, HSI_DWAHB_DAR(dma, lch));
-	}
 
 	/* Enable slave then master DMA to start the transfer */
 #ifdef USE_SOFWARE_WORKAROUND_FOR_DMA_LLI
-	iowrite32(dma_xfer->slv_enable | blk_length_overwrite,
+	iowrite32(dma_ctx->slv_enable | blk_length_overwrite,
 		  ARASAN_HSI_DMA_CONFIG(ctrl, lch));
 #else
-	iowrite32(dma_xfer->slv_enable, ARASAN_HSI_DMA_CONFIG(ctrl, lch));
+	iowrite32(dma_ctx->slv_enable, ARASAN_HSI_DMA_CONFIG(ctrl, lch));
 #endif
-	iowrite32(dma_xfer->mst_enable, HSI_DWAHB_CHEN(dma));
+	iowrite32(dma_ctx->mst_enable, HSI_DWAHB_CHEN(dma));
 
 	intel_hsi->dma_running |= mask;
 	intel_hsi->dma_resumed |= mask;
@@ -1814,8 +1870,9 @@ static void hsi_transfer(struct intel_controller *intel_hsi, int tx_not_rx,
 	struct list_head		*queue;
 	struct hsi_msg			*msg;
 	unsigned long			 flags;
-	struct intel_dma_xfer		*done_dma_xfer;
+	struct intel_dma_ctx		*dma_ctx;
 	struct intel_pio_ctx		*pio_ctx;
+	unsigned int			 count = 1;
 
 	queue = (tx_not_rx) ?
 			&intel_hsi->tx_queue[hsi_channel] :
@@ -1827,30 +1884,41 @@ static void hsi_transfer(struct intel_controller *intel_hsi, int tx_not_rx,
 		return;
 	}
 
+	dma_ctx = (dma_channel >= 0) ? intel_hsi->dma_ctx[dma_channel] : NULL;
+	if ((dma_channel >= 0) && (!dma_ctx)) {
+		spin_unlock_irqrestore(&intel_hsi->sw_lock, flags);
+		return;
+	}
+
+	/* Get the next messages ready while the DMA run is ongoing */
+	if (dma_ctx)
+		hsi_prepare_dma_ring(queue, dma_ctx);
+
 	msg = list_first_entry(queue, struct hsi_msg, link);
 	if (msg->status != HSI_STATUS_QUEUED) {
 		spin_unlock_irqrestore(&intel_hsi->sw_lock, flags);
 		return;
 	}
 
-	msg->status = HSI_STATUS_PROCEEDING;
+	/* Messages without any scatter-gather entry are always sent in PIO */
+	if (unlikely(!msg->sgt.nents)) {
+		dma_ctx = NULL;
+		dma_channel = -1;
+	}
 
-	if (dma_channel >= 0) {
-		if (intel_hsi->dma_ctx[dma_channel]) {
-			if (intel_hsi->dma_ctx[dma_channel]->ready->msg == NULL)
-				do_hsi_prepare_dma(msg, dma_channel, intel_hsi);
-
-			/* The ongoing DMA is now the ready DMA message */
-			done_dma_xfer =
-				intel_hsi->dma_ctx[dma_channel]->ongoing;
-			intel_hsi->dma_ctx[dma_channel]->ongoing =
-					intel_hsi->dma_ctx[dma_channel]->ready;
-			intel_hsi->dma_ctx[dma_channel]->ready = done_dma_xfer;
-		} else {
+	if (dma_ctx) {
+		/* Chain all prepared messages so that they are transferred
+		 * back-to-back without any CPU intervention */
+		count = hsi_chain_dma_ring(dma_ctx);
+		if (unlikely(!count)) {
 			spin_unlock_irqrestore(&intel_hsi->sw_lock, flags);
 			return;
 		}
+		dma_sync_single_for_device(intel_hsi->pdev, dma_ctx->llp_addr,
+					   dma_ring_size(dma_ctx),
+					   DMA_TO_DEVICE);
 	} else {
+		msg->status = HSI_STATUS_PROCEEDING;
 		msg->actual_len = 0;
 		pio_ctx = (tx_not_rx) ?
 			   &intel_hsi->tx_ctx[hsi_channel].pio :
@@ -1860,18 +1928,18 @@ static void hsi_transfer(struct intel_controller *intel_hsi, int tx_not_rx,
 	}
 	spin_unlock_irqrestore(&intel_hsi->sw_lock, flags);
 
-	/* Assert ACWAKE (deasserted on complete or destruct) */
+	/* Assert ACWAKE for each started message (deasserted on complete or
+	 * destruct) */
 	if (tx_not_rx)
-		assert_acwake(intel_hsi, HSI_PM_ASYNC);
+		while (count--)
+			assert_acwake(intel_hsi, HSI_PM_ASYNC);
 	else
 		unforce_disable_acready(intel_hsi);
 
 	if (dma_channel < 0)
 		hsi_start_pio(msg, intel_hsi);
-	else {
+	else
 		hsi_start_dma(msg, dma_channel, intel_hsi);
-		hsi_try_prepare_dma(queue, dma_channel, intel_hsi);
-	}
 }
 
 /**
@@ -1885,7 +1953,7 @@ static void hsi_resume_dma_transfers(struct intel_controller *intel_hsi)
 
 	for (i = 0; i < DWAHB_CHAN_CNT; i++) {
 		msg = (intel_hsi->dma_ctx[i]) ?
-		      intel_hsi->dma_ctx[i]->ongoing->msg : NULL;
+		      dma_ring_current(intel_hsi->dma_ctx[i]) : NULL;
 		if (msg)
 			hsi_restart_dma(msg, i, intel_hsi);
 	}
@@ -2196,8 +2264,9 @@ static void hsi_destruct_msg(struct hsi_msg *msg, int dma_channel,
 static void hsi_flush_queue(struct list_head *queue, struct hsi_client *cl,
 			    struct intel_controller *intel_hsi)
 {
-	unsigned int hsi_channel;
+	unsigned int hsi_channel, i;
 	int dma_channel;
+	struct intel_dma_ctx *dma_ctx;
 	struct list_head *node;
 	struct hsi_msg *msg;
 	unsigned long flags;
@@ -2217,15 +2286,21 @@ static void hsi_flush_queue(struct list_head *queue, struct hsi_client *cl,
 			if (dma_channel < 0)
 				goto del_node;
 
-			if (intel_hsi->dma_ctx[dma_channel]->ongoing->msg ==
-			    msg) {
+			dma_ctx = intel_hsi->dma_ctx[dma_channel];
+			if (!dma_ctx)
+				goto del_node;
+
+			for (i = 0; i < dma_ctx->running; i++)
+				if (dma_ctx->msg[dma_ring_slot(dma_ctx, i)] ==
+				    msg)
+					break;
+			if (i < dma_ctx->running) {
 				msg->break_frame = 1;
 				goto prev_node;
 			}
 
-			if (intel_hsi->dma_ctx[dma_channel]->ready->msg == msg)
-				intel_hsi->dma_ctx[dma_channel]->ready->msg =
-									  NULL;
+			/* The prepared link lists no longer match the queue */
+			dma_ctx->prepared = 0;
 
 del_node:
 			list_del(node);
@@ -2254,22 +2329,40 @@ static void hsi_cleanup_dma(struct intel_controller *intel_hsi,
 {
 	void __iomem	*ctrl = intel_hsi->ctrl_io;
 	void __iomem	*dma = intel_hsi->dma_io;
-	struct hsi_msg *msg;
-	unsigned int hsi_channel;
+	struct intel_dma_ctx *dma_ctx;
+	struct hsi_msg *msg, *tmp;
+	unsigned int hsi_channel, j;
 	int tx_not_rx, i;
 	unsigned long flags;
+	LIST_HEAD(dropped);
 
 	for (i = 0; i < DWAHB_CHAN_CNT; i++) {
 		spin_lock_irqsave(&intel_hsi->sw_lock, flags);
-		msg = (intel_hsi->dma_ctx[i]) ?
-		      intel_hsi->dma_ctx[i]->ongoing->msg : NULL;
+		dma_ctx = intel_hsi->dma_ctx[i];
+		msg = (dma_ctx) ? dma_ring_current(dma_ctx) : NULL;
 		if ((!msg) || (msg->cl != cl)) {
 			spin_unlock_irqrestore(&intel_hsi->sw_lock, flags);
 			continue;
 		}
-		intel_hsi->dma_ctx[i]->ongoing->msg = NULL;
-		msg->break_frame = 0;
-		msg->status = HSI_STATUS_ERROR;
+		tx_not_rx = (msg->ttype == HSI_MSG_WRITE);
+		hsi_channel = msg->channel;
+
+		/* Drop the whole DMA run: the messages of other clients have
+		 * not started yet and are chained again on the restart */
+		for (j = 0; j < dma_ctx->running; j++) {
+			msg = dma_ctx->msg[dma_ring_slot(dma_ctx, j)];
+			if (msg->cl == cl) {
+				msg->break_frame = 0;
+				msg->status = HSI_STATUS_ERROR;
+				list_move_tail(&msg->link, &dropped);
+			} else {
+				msg->status = HSI_STATUS_QUEUED;
+				if (tx_not_rx)
+					(void) deassert_acwake(intel_hsi);
+			}
+		}
+		dma_ctx->running = 0;
+		dma_ctx->prepared = 0;
 		spin_unlock_irqrestore(&intel_hsi->sw_lock, flags);
 
 		spin_lock_irqsave(&intel_hsi->hw_lock, flags);
@@ -2280,14 +2373,12 @@ static void hsi_cleanup_dma(struct intel_controller *intel_hsi,
 		intel_hsi->dma_running &= ~DMA_BUSY(i);
 		spin_unlock_irqrestore(&intel_hsi->hw_lock, flags);
 
-		spin_lock_irqsave(&intel_hsi->sw_lock, flags);
-		list_del(&msg->link);
-		spin_unlock_irqrestore(&intel_hsi->sw_lock, flags);
+		list_for_each_entry_safe(msg, tmp, &dropped, link) {
+			list_del(&msg->link);
+			hsi_destruct_msg(msg, i, intel_hsi);
+		}
 
 		/* Restart transfers of other clients */
-		tx_not_rx = (msg->ttype == HSI_MSG_WRITE);
-		hsi_channel = msg->channel;
-		hsi_destruct_msg(msg, i, intel_hsi);
 		hsi_transfer(intel_hsi, tx_not_rx, hsi_channel, i);
 	}
 }
@@ -2733,14 +2824,13 @@ static int hsi_dma_complete(struct intel_controller *intel_hsi,
 	__acquires(&intel_hsi->hw_lock) __releases(&intel_hsi->hw_lock)
 {
 	struct intel_dma_ctx *dma_ctx;
-	struct intel_dma_xfer *ongoing_xfer;
 	void __iomem *ctrl = intel_hsi->ctrl_io;
+	struct list_head *queue;
 	struct hsi_msg *msg;
 	int tx_not_rx;
-	unsigned int hsi_channel;
+	unsigned int hsi_channel, running;
 	unsigned long flags;
 #ifdef USE_SOFWARE_WORKAROUND_FOR_DMA_LLI
-	struct intel_dma_lli_xfer *lli_xfer;
 	unsigned int blk_sz = 0;
 #endif
 
@@ -2755,26 +2845,61 @@ static int hsi_dma_complete(struct intel_controller *intel_hsi,
 		return 0;
 	}
 
-	ongoing_xfer = dma_ctx->ongoing;
+	msg = dma_ring_current(dma_ctx);
+	if (unlikely(!msg)) {
+		spin_unlock_irqrestore(&intel_hsi->sw_lock, flags);
+		return 0;
+	}
+	dma_ctx->stats.irqs++;
+	tx_not_rx = (msg->ttype == HSI_MSG_WRITE);
+	hsi_channel = msg->channel;
 
-	msg = ongoing_xfer->msg;
 #ifdef USE_SOFWARE_WORKAROUND_FOR_DMA_LLI
-	lli_xfer = &ongoing_xfer->with_link_list;
-	if ((is_using_link_list(dma_ctx)) && (msg) &&
-	    (!sg_is_last(lli_xfer->blk))) {
-		lli_xfer->blk = sg_next(lli_xfer->blk);
-		blk_sz = HSI_BYTES_TO_FRAMES(lli_xfer->blk->length);
+	/* The slave DMA is stopped after each block: the ongoing message is
+	 * done on its last block, and the run goes on with the next one */
+	if (!sg_is_last(dma_ctx->blk)) {
+		dma_ctx->blk = sg_next(dma_ctx->blk);
+		blk_sz = HSI_BYTES_TO_FRAMES(dma_ctx->blk->length);
 		msg = NULL;
+	} else {
+		if (msg->status != HSI_STATUS_ERROR)
+			msg->status = HSI_STATUS_COMPLETED;
+		list_move_tail(&msg->link, &intel_hsi->fwd_queue);
+		dma_ctx->head = dma_ring_slot(dma_ctx, 1);
+		dma_ctx->running--;
+		dma_ctx->stats.msgs++;
+		if (dma_ctx->running) {
+			dma_ctx->blk = dma_ctx->msg[dma_ctx->head]->sgt.sgl;
+			blk_sz = HSI_BYTES_TO_FRAMES(dma_ctx->blk->length);
+		}
+	}
+#else
+	/* The whole run is completed at once */
+	while (dma_ctx->running) {
+		msg = dma_ctx->msg[dma_ctx->head];
+		if (msg->status != HSI_STATUS_ERROR)
+			msg->status = HSI_STATUS_COMPLETED;
+		list_move_tail(&msg->link, &intel_hsi->fwd_queue);
+		dma_ctx->head = dma_ring_slot(dma_ctx, 1);
+		dma_ctx->running--;
+		dma_ctx->stats.msgs++;
 	}
 #endif
-	if ((msg) && (msg->status != HSI_STATUS_ERROR))
-		msg->status = HSI_STATUS_COMPLETED;
+
+	/* Account for the DMA idle time until the next run if some messages
+	 * are already waiting for it */
+	queue = (tx_not_rx) ?
+			&intel_hsi->tx_queue[hsi_channel] :
+			&intel_hsi->rx_queue[hsi_channel];
+	running = dma_ctx->running;
+	if ((!running) && (!list_empty(queue)))
+		dma_ctx->stats.stopped = ktime_get();
 	spin_unlock_irqrestore(&intel_hsi->sw_lock, flags);
 
 #ifdef USE_SOFWARE_WORKAROUND_FOR_DMA_LLI
 	if (blk_sz) {
 		spin_lock_irqsave(&intel_hsi->hw_lock, flags);
-		iowrite32(ongoing_xfer->slv_enable |
+		iowrite32(dma_ctx->slv_enable |
 			  ARASAN_DMA_XFER_FRAMES(blk_sz),
 			  ARASAN_HSI_DMA_CONFIG(ctrl, lch));
 		spin_unlock_irqrestore(&intel_hsi->hw_lock, flags);
@@ -2784,27 +2909,16 @@ static int hsi_dma_complete(struct intel_controller *intel_hsi,
 	if (unlikely(!msg))
 		return 0;
 
-	/* It is safe to disable the DMA channel right now, as no DMA transfer
-	 * can start on this channel as long as the current message is not
-	 * popped from the list, which happens later on! */
+	if (running)
+		return 1;
+
+	/* It is safe to disable the DMA channel right now, as no DMA run can
+	 * start on this channel as long as it is flagged as running! */
 	spin_lock_irqsave(&intel_hsi->hw_lock, flags);
 	iowrite32(0, ARASAN_HSI_DMA_CONFIG(ctrl, lch));
 	intel_hsi->dma_running &= ~DMA_BUSY(lch);
 	spin_unlock_irqrestore(&intel_hsi->hw_lock, flags);
 
-	tx_not_rx = (msg->ttype == HSI_MSG_WRITE);
-	hsi_channel = msg->channel;
-
-	spin_lock_irqsave(&intel_hsi->sw_lock, flags);
-
-	if (likely(intel_hsi->dma_ctx[lch]->ongoing->msg != NULL)) {
-		intel_hsi->dma_ctx[lch]->ongoing->msg = NULL;
-		list_del(&msg->link);
-		list_add_tail(&msg->link, &intel_hsi->fwd_queue);
-	}
-
-	spin_unlock_irqrestore(&intel_hsi->sw_lock, flags);
-
 	hsi_transfer(intel_hsi, tx_not_rx, hsi_channel, lch);
 
 	return 1;
@@ -126,14 +126,14 @@ static struct logger_log *get_logcat_log(unsigned char *buf_name)
 static size_t get_logcat_head(struct logger_log *log)
 {
 	if (log)
-		return log->head;
+		return get_log_head(log);
 	return 0;
 }
 
 static size_t get_logcat_woff(struct logger_log *log)
 {
 	if (log)
-		return log->w_off;
+		return get_log_tail(log);
 	return 0;
 }
 
@@ -151,28 +151,17 @@ static size_t get_logcat_size(struct logger_log *log)
 	return 0;
 }
 
-static void lock_logcat_mutex(struct logger_log *log)
+static void lock_logcat_writers(struct logger_log *log)
 {
 	if (log)
-		mutex_lock(&log->mutex);
+		logger_restore_begin(log);
 }
 
-static void unlock_logcat_mutex(struct logger_log *log)
+static void unlock_logcat_writers(struct logger_log *log, size_t head,
+				  size_t woff)
 {
 	if (log)
-		mutex_unlock(&log->mutex);
-}
-
-static void set_logcat_head(struct logger_log *log, size_t head)
-{
-	if (log)
-		log->head = head;
-}
-
-static void set_logcat_woff(struct logger_log *log, size_t woff)
-{
-	if (log)
-		log->w_off = woff;
+		logger_restore_end(log, head, woff);
 }
 
 static int emmc_ipanic_write_logcat(struct mmc_emergency_info *emmc,
@@ -528,7 +517,7 @@ static void emmc_panic_notify_add(void)
 
 		offset = emmc->start_block +
 			(ctx->curr.log_offset[log] >> SECTOR_SIZE_SHIFT);
-		lock_logcat_mutex(logcat);
+		lock_logcat_writers(logcat);
 		for (size = 0; size < ctx->curr.log_length[log];
 		     size += SECTOR_SIZE) {
 			int write_size = SECTOR_SIZE;
@@ -540,16 +529,16 @@ static void emmc_panic_notify_add(void)
 				printk(KERN_ERR
 				       "%s: read sector error(%u)!\n",
 				       __func__, offset + sec_count);
-				unlock_logcat_mutex(logcat);
+				/* leave the log empty, not half copied */
+				unlock_logcat_writers(logcat, 0, 0);
 				goto put_sector;
 			}
 			if (ctx->curr.log_length[log] - size < SECTOR_SIZE)
 				write_size = ctx->curr.log_length[log] - size;
 			memcpy(buf + size, ptr, write_size);
 		}
-		set_logcat_head(logcat, ctx->curr.log_head[log]);
-		set_logcat_woff(logcat, ctx->curr.log_woff[log]);
-		unlock_logcat_mutex(logcat);
+		unlock_logcat_writers(logcat, ctx->curr.log_head[log],
+				      ctx->curr.log_woff[log]);
 #endif
 	}
 
@@ -37,7 +37,7 @@
 
 #include "binder.h"
 
-static DEFINE_MUTEX(binder_lock);
+static DEFINE_MUTEX(binder_main_lock);
 static DEFINE_MUTEX(binder_deferred_lock);
 static DEFINE_MUTEX(binder_mmap_lock);
 
@@ -136,6 +136,58 @@ module_param_call(stop_on_user_error, binder_set_stop_on_user_error,
 			binder_stop_on_user_error = 2; \
 	} while (0)
 
+/*
+ * binder_main_lock serializes all binder state except the per-proc
+ * buffer allocators (alloc_lock) and binder_lru (binder_lru_lock);
+ * threads, nodes, refs and work lists have no finer lock yet. Keep
+ * track of how often and for how long it is fought over; see debugfs
+ * "stats".
+ * All fields are protected by binder_main_lock itself.
+ */
+struct binder_lock_stats {
+	u64 acquired;
+	u64 contended;
+	u64 wait_ns;
+	u64 max_wait_ns;
+	u64 hold_ns;
+	u64 max_hold_ns;
+	u64 hold_start;
+};
+
+static struct binder_lock_stats binder_lock_stats;
+
+static void binder_lock(void)
+{
+	u64 start, wait;
+
+	if (mutex_trylock(&binder_main_lock)) {
+		binder_lock_stats.acquired++;
+		binder_lock_stats.hold_start = local_clock();
+		return;
+	}
+
+	start = local_clock();
+	mutex_lock(&binder_main_lock);
+	binder_lock_stats.hold_start = local_clock();
+	wait = binder_lock_stats.hold_start - start;
+
+	binder_lock_stats.acquired++;
+	binder_lock_stats.contended++;
+	binder_lock_stats.wait_ns += wait;
+	if (wait > binder_lock_stats.max_wait_ns)
+		binder_lock_stats.max_wait_ns = wait;
+}
+
+static void binder_unlock(void)
+{
+	u64 hold = local_clock() - binder_lock_stats.hold_start;
+
+	binder_lock_stats.hold_ns += hold;
+	if (hold > binder_lock_stats.max_hold_ns)
+		binder_lock_stats.max_hold_ns = hold;
+	mutex_unlock(&binder_main_lock);
+}
+
 enum binder_stat_types {
 	BINDER_STAT_PROC,
 	BINDER_STAT_THREAD,
@@ -260,8 +312,10 @@ struct binder_ref {
 
 struct binder_buffer {
 	struct list_head entry; /* free and allocated entries by addesss */
-	struct rb_node rb_node; /* free entry by size or allocated entry */
-				/* by address */
+	union {
+		struct list_head free_entry; /* free entry by size bucket */
+		struct rb_node rb_node; /* allocated entry by address */
+	};
 	unsigned free:1;
 	unsigned allow_user_free:1;
 	unsigned async_transaction:1;
@@ -275,6 +329,41 @@ struct binder_buffer {
 	uint8_t data[0];
 };
 
+/*
+ * Free buffers are kept on per-proc lists by power of two size, so
+ * bucket i holds buffers of [2^i, 2^(i+1)) bytes. Any buffer from a
+ * bucket above the one a request maps to is big enough.
+ */
+#define BINDER_FREE_BUCKETS	24
+
+/*
+ * Pages that are mapped but no longer used by any buffer stay mapped
+ * on binder_lru until the shrinker reclaims them, so that the next
+ * allocation in the same place does not have to map them again.
+ */
+struct binder_lru_page {
+	struct list_head lru;
+	struct binder_proc *proc;
+};
+
+struct binder_alloc_stats {
+	unsigned long allocs;
+	u64 alloc_ns;
+	u64 max_alloc_ns;
+	unsigned long pages_mapped;
+	unsigned long pages_reused;
+	unsigned long pages_reclaimed;
+};
+
+/*
+ * binder_lru_lock protects binder_lru and binder_lru_count. It nests
+ * inside a proc's alloc_lock and is never held across an allocation,
+ * so the shrinker can take it and trylock alloc_lock the other way.
+ */
+static DEFINE_MUTEX(binder_lru_lock);
+static LIST_HEAD(binder_lru);
+static unsigned long binder_lru_count;
+
 enum binder_deferred_state {
 	BINDER_DEFERRED_PUT_FILES    = 0x01,
 	BINDER_DEFERRED_FLUSH        = 0x02,
@@ -296,12 +385,22 @@ struct binder_proc {
 	void *buffer;
 	ptrdiff_t user_buffer_offset;
 
+	/*
+	 * Protects the buffer allocator below, from buffers to
+	 * alloc_stats, so the shrinker can reclaim pages without
+	 * binder_main_lock. Taken inside binder_main_lock when both
+	 * are needed.
+	 */
+	struct mutex alloc_lock;
 	struct list_head buffers;
-	struct rb_root free_buffers;
+	struct list_head free_buckets[BINDER_FREE_BUCKETS];
+	DECLARE_BITMAP(free_bucket_map, BINDER_FREE_BUCKETS);
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
 
 	struct page **pages;
+	struct binder_lru_page *lru_pages;
+	struct binder_alloc_stats alloc_stats;
 	size_t buffer_size;
 	uint32_t buffer_free;
 	struct list_head todo;
@@ -546,14 +645,19 @@ static size_t binder_buffer_size(struct binder_proc *proc,
 			struct binder_buffer, entry) - (size_t)buffer->data;
 }
 
+static unsigned int binder_free_bucket(size_t size)
+{
+	if (size == 0)
+		return 0;
+	return min_t(unsigned int, fls_long(size) - 1,
+		     BINDER_FREE_BUCKETS - 1);
+}
+
 static void binder_insert_free_buffer(struct binder_proc *proc,
 				      struct binder_buffer *new_buffer)
 {
-	struct rb_node **p = &proc->free_buffers.rb_node;
-	struct rb_node *parent = NULL;
-	struct binder_buffer *buffer;
-	size_t buffer_size;
 	size_t new_buffer_size;
+	unsigned int bucket;
 
 	BUG_ON(!new_buffer->free);
 
@@ -563,20 +667,24 @@ static void binder_insert_free_buffer(struct binder_proc *proc,
 		     "binder: %d: add free buffer, size %zd, "
 		     "at %p\n", proc->pid, new_buffer_size, new_buffer);
 
-	while (*p) {
-		parent = *p;
-		buffer = rb_entry(parent, struct binder_buffer, rb_node);
-		BUG_ON(!buffer->free);
+	/* Most recently freed first, its pages are likely still mapped */
+	bucket = binder_free_bucket(new_buffer_size);
+	list_add(&new_buffer->free_entry, &proc->free_buckets[bucket]);
+	__set_bit(bucket, proc->free_bucket_map);
+}
 
-		buffer_size = binder_buffer_size(proc, buffer);
+/* Must be called before the size of the buffer changes */
+static void binder_erase_free_buffer(struct binder_proc *proc,
+				     struct binder_buffer *buffer)
+{
+	unsigned int bucket;
 
-		if (new_buffer_size < buffer_size)
-			p = &parent->rb_left;
-		else
-			p = &parent->rb_right;
-	}
-	rb_link_node(&new_buffer->rb_node, parent, p);
-	rb_insert_color(&new_buffer->rb_node, &proc->free_buffers);
+	BUG_ON(!buffer->free);
+
+	bucket = binder_free_bucket(binder_buffer_size(proc, buffer));
+	list_del(&buffer->free_entry);
+	if (list_empty(&proc->free_buckets[bucket]))
+		__clear_bit(bucket, proc->free_bucket_map);
 }
 
 static void binder_insert_allocated_buffer(struct binder_proc *proc,
@@ -628,50 +736,37 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 	return NULL;
 }
 
-static int binder_update_page_range(struct binder_proc *proc, int allocate,
-				    void *start, void *end,
-				    struct vm_area_struct *vma)
+static void binder_free_page(struct binder_proc *proc,
+			     struct vm_area_struct *vma, void *page_addr)
 {
-	void *page_addr;
-	unsigned long user_page_addr;
-	struct vm_struct tmp_area;
 	struct page **page;
-	struct mm_struct *mm;
-
-	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
-		     "binder: %d: %s pages %p-%p\n", proc->pid,
-		     allocate ? "allocate" : "free", start, end);
-
-	if (end <= start)
-		return 0;
 
+	page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
 	if (vma)
-		mm = NULL;
-	else
-		mm = get_task_mm(proc->tsk);
-
-	if (mm) {
-		down_write(&mm->mmap_sem);
-		vma = proc->vma;
-		if (vma && mm != vma->vm_mm) {
-			pr_err("binder: %d: vma mm and task mm mismatch\n",
-				proc->pid);
-			vma = NULL;
-		}
-	}
-
-	if (allocate == 0)
-		goto free_range;
+		zap_page_range(vma, (uintptr_t)page_addr +
+			proc->user_buffer_offset, PAGE_SIZE, NULL);
+	unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+	__free_page(*page);
+	*page = NULL;
+}
 
-	if (vma == NULL) {
-		printk(KERN_ERR "binder: %d: binder_alloc_buf failed to "
-		       "map pages in userspace, no vma\n", proc->pid);
-		goto err_no_vma;
-	}
+/*
+ * Allocate pages for [start, end), none of which may be present, and
+ * map them in the kernel with one map_vm_area() call and then in
+ * userspace. Everything is undone on failure.
+ */
+static int binder_map_page_run(struct binder_proc *proc,
+			       struct vm_area_struct *vma,
+			       void *start, void *end)
+{
+	void *page_addr;
+	unsigned long user_page_addr;
+	struct vm_struct tmp_area;
+	struct page **page;
+	struct page **page_array_ptr;
+	int ret;
 
 	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
-		int ret;
-		struct page **page_array_ptr;
 		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
 
 		BUG_ON(*page);
@@ -681,16 +776,21 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 			       "for page at %p\n", proc->pid, page_addr);
 			goto err_alloc_page_failed;
 		}
-		tmp_area.addr = page_addr;
-		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
-		page_array_ptr = page;
-		ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
-		if (ret) {
-			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
-			       "to map page at %p in kernel\n",
-			       proc->pid, page_addr);
-			goto err_map_kernel_failed;
-		}
+	}
+
+	tmp_area.addr = start;
+	tmp_area.size = end - start + PAGE_SIZE /* guard page? */;
+	page_array_ptr = &proc->pages[(start - proc->buffer) / PAGE_SIZE];
+	ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
+	if (ret) {
+		printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
+		       "to map pages at %p-%p in kernel\n",
+		       proc->pid, start, end);
+		goto err_map_kernel_failed;
+	}
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
 		user_page_addr =
 			(uintptr_t)page_addr + proc->user_buffer_offset;
 		ret = vm_insert_page(vma, user_page_addr, page[0]);
@@ -702,46 +802,247 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		}
 		/* vm_insert_page does not seem to increment the refcount */
 	}
-	if (mm) {
-		up_write(&mm->mmap_sem);
-		mmput(mm);
-	}
 	return 0;
 
-free_range:
-	for (page_addr = end - PAGE_SIZE; page_addr >= start;
-	     page_addr -= PAGE_SIZE) {
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-		if (vma)
-			zap_page_range(vma, (uintptr_t)page_addr +
-				proc->user_buffer_offset, PAGE_SIZE, NULL);
 err_vm_insert_page_failed:
-		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+	if (page_addr > start)
+		zap_page_range(vma, (uintptr_t)start + proc->user_buffer_offset,
+			       page_addr - start, NULL);
 err_map_kernel_failed:
+	unmap_kernel_range((unsigned long)start, end - start);
+	page_addr = end;
+err_alloc_page_failed:
+	while (page_addr > start) {
+		page_addr -= PAGE_SIZE;
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
 		__free_page(*page);
 		*page = NULL;
-err_alloc_page_failed:
-		;
 	}
-err_no_vma:
+	return -ENOMEM;
+}
+
+static int binder_update_page_range(struct binder_proc *proc, int allocate,
+				    void *start, void *end,
+				    struct vm_area_struct *vma)
+{
+	void *page_addr;
+	void *run_start = NULL;
+	struct binder_lru_page *lru_page;
+	struct mm_struct *mm = NULL;
+	int ret = 0;
+
+	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
+		     "binder: %d: %s pages %p-%p\n", proc->pid,
+		     allocate ? "allocate" : "free", start, end);
+
+	if (end <= start)
+		return 0;
+
+	if (allocate == 0) {
+		/* Leave the pages mapped, binder_shrink() reclaims them */
+		mutex_lock(&binder_lru_lock);
+		for (page_addr = start; page_addr < end;
+		     page_addr += PAGE_SIZE) {
+			lru_page = &proc->lru_pages[
+				(page_addr - proc->buffer) / PAGE_SIZE];
+			BUG_ON(!proc->pages[lru_page - proc->lru_pages]);
+			BUG_ON(!list_empty(&lru_page->lru));
+			list_add_tail(&lru_page->lru, &binder_lru);
+			binder_lru_count++;
+		}
+		mutex_unlock(&binder_lru_lock);
+		return 0;
+	}
+
+	/* Only take mmap_sem if something actually has to be mapped */
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		if (!proc->pages[(page_addr - proc->buffer) / PAGE_SIZE])
+			break;
+	}
+	if (page_addr < end) {
+		if (!vma) {
+			mm = get_task_mm(proc->tsk);
+			if (mm) {
+				down_write(&mm->mmap_sem);
+				vma = proc->vma;
+				if (vma && mm != vma->vm_mm) {
+					pr_err("binder: %d: vma mm and task mm mismatch\n",
+						proc->pid);
+					vma = NULL;
+				}
+			}
+		}
+		if (vma == NULL) {
+			printk(KERN_ERR "binder: %d: binder_alloc_buf failed to "
+			       "map pages in userspace, no vma\n", proc->pid);
+			ret = -ENOMEM;
+			goto out;
+		}
+
+		/* Map each run of missing pages in one go */
+		for (page_addr = start; page_addr <= end;
+		     page_addr += PAGE_SIZE) {
+			if (page_addr < end && !proc->pages[
+			    (page_addr - proc->buffer) / PAGE_SIZE]) {
+				if (!run_start)
+					run_start = page_addr;
+				continue;
+			}
+			if (!run_start)
+				continue;
+			ret = binder_map_page_run(proc, vma, run_start,
+						  page_addr);
+			if (ret)
+				goto err_map_failed;
+			proc->alloc_stats.pages_mapped +=
+				(page_addr - run_start) / PAGE_SIZE;
+			run_start = NULL;
+		}
+	}
+
+	mutex_lock(&binder_lru_lock);
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		lru_page = &proc->lru_pages[
+			(page_addr - proc->buffer) / PAGE_SIZE];
+		if (!list_empty(&lru_page->lru)) {
+			list_del_init(&lru_page->lru);
+			binder_lru_count--;
+			proc->alloc_stats.pages_reused++;
+		}
+	}
+	mutex_unlock(&binder_lru_lock);
+out:
 	if (mm) {
 		up_write(&mm->mmap_sem);
 		mmput(mm);
 	}
-	return -ENOMEM;
+	return ret;
+
+err_map_failed:
+	/* Pages mapped by earlier runs are the present ones not on the lru */
+	for (page_addr = start; page_addr < run_start;
+	     page_addr += PAGE_SIZE) {
+		lru_page = &proc->lru_pages[
+			(page_addr - proc->buffer) / PAGE_SIZE];
+		if (proc->pages[lru_page - proc->lru_pages] &&
+		    list_empty(&lru_page->lru))
+			binder_free_page(proc, vma, page_addr);
+	}
+	goto out;
 }
 
-static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
-					      size_t data_size,
-					      size_t offsets_size, int is_async)
+/* Rotate proc's pages at the head of binder_lru to try them later */
+static unsigned long binder_skip_proc_pages(struct binder_proc *proc,
+					    unsigned long nr_to_scan)
+{
+	struct binder_lru_page *lru_page;
+	unsigned long scanned = 0;
+
+	while (scanned < nr_to_scan) {
+		lru_page = list_first_entry(&binder_lru,
+					    struct binder_lru_page, lru);
+		if (lru_page->proc != proc)
+			break;
+		list_move_tail(&lru_page->lru, &binder_lru);
+		scanned++;
+	}
+	return scanned;
+}
+
+/*
+ * Called with binder_lru_lock and proc->alloc_lock held; takes the
+ * target mm's mmap_sem and so only ever trylocks it.
+ */
+static unsigned long binder_reclaim_proc_pages(struct binder_proc *proc,
+					       unsigned long nr_to_scan)
+{
+	struct binder_lru_page *lru_page;
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	unsigned long scanned = 0;
+
+	mm = get_task_mm(proc->tsk);
+	if (mm && !down_read_trylock(&mm->mmap_sem)) {
+		mmput(mm);
+		mm = NULL;
+	}
+	if (!mm) {
+		/* Try again later, release frees them if proc is exiting */
+		return binder_skip_proc_pages(proc, nr_to_scan);
+	}
+	vma = proc->vma;
+	if (vma && vma->vm_mm != mm)
+		vma = NULL;
+
+	while (scanned < nr_to_scan && !list_empty(&binder_lru)) {
+		lru_page = list_first_entry(&binder_lru,
+					    struct binder_lru_page, lru);
+		if (lru_page->proc != proc)
+			break;
+		list_del_init(&lru_page->lru);
+		binder_lru_count--;
+		binder_free_page(proc, vma, proc->buffer +
+			(lru_page - proc->lru_pages) * PAGE_SIZE);
+		proc->alloc_stats.pages_reclaimed++;
+		scanned++;
+	}
+
+	up_read(&mm->mmap_sem);
+	mmput(mm);
+	return scanned;
+}
+
+static int binder_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	unsigned long nr_to_scan = sc->nr_to_scan;
+	unsigned long scanned;
+	int count;
+
+	if (nr_to_scan == 0)
+		return min_t(unsigned long, binder_lru_count, INT_MAX);
+
+	/* Pages are allocated with an alloc_lock held, don't recurse */
+	if (!mutex_trylock(&binder_lru_lock))
+		return -1;
+
+	while (nr_to_scan && !list_empty(&binder_lru)) {
+		struct binder_proc *proc;
+
+		/* proc can't go away while it has pages on binder_lru */
+		proc = list_first_entry(&binder_lru, struct binder_lru_page,
+					lru)->proc;
+		if (mutex_trylock(&proc->alloc_lock)) {
+			scanned = binder_reclaim_proc_pages(proc, nr_to_scan);
+			mutex_unlock(&proc->alloc_lock);
+		} else
+			scanned = binder_skip_proc_pages(proc, nr_to_scan);
+		nr_to_scan -= min(scanned, nr_to_scan);
+	}
+	count = min_t(unsigned long, binder_lru_count, INT_MAX);
+	mutex_unlock(&binder_lru_lock);
+
+	return count;
+}
+
+static struct shrinker binder_shrinker = {
+	.shrink = binder_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static struct binder_buffer *binder_alloc_buf_locked(struct binder_proc *proc,
+						     size_t data_size,
+						     size_t offsets_size,
+						     int is_async)
 {
-	struct rb_node *n = proc->free_buffers.rb_node;
 	struct binder_buffer *buffer;
 	size_t buffer_size;
-	struct rb_node *best_fit = NULL;
+	struct binder_buffer *best_fit = NULL;
+	size_t best_fit_size = 0;
+	unsigned int bucket;
 	void *has_page_addr;
 	void *end_page_addr;
 	size_t size;
+	u64 start_time, alloc_time;
 
 	if (proc->vma == NULL) {
 		printk(KERN_ERR "binder: %d: binder_alloc_buf, no vma\n",
@@ -766,19 +1067,31 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		return NULL;
 	}
 
-	while (n) {
-		buffer = rb_entry(n, struct binder_buffer, rb_node);
+	start_time = local_clock();
+
+	/* Best fit within the request's own bucket ... */
+	bucket = binder_free_bucket(size);
+	list_for_each_entry(buffer, &proc->free_buckets[bucket], free_entry) {
 		BUG_ON(!buffer->free);
 		buffer_size = binder_buffer_size(proc, buffer);
 
-		if (size < buffer_size) {
-			best_fit = n;
-			n = n->rb_left;
-		} else if (size > buffer_size)
-			n = n->rb_right;
-		else {
-			best_fit = n;
+		if (buffer_size < size ||
+		    (best_fit && buffer_size >= best_fit_size))
+			continue;
+		best_fit = buffer;
+		best_fit_size = buffer_size;
+		if (buffer_size == size)
 			break;
+	}
+	/* ... otherwise anything from the next non-empty one fits */
+	if (best_fit == NULL) {
+		bucket = find_next_bit(proc->free_bucket_map,
+				       BINDER_FREE_BUCKETS, bucket + 1);
+		if (bucket < BINDER_FREE_BUCKETS) {
+			best_fit = list_first_entry(&proc->free_buckets[bucket],
+						    struct binder_buffer,
+						    free_entry);
+			best_fit_size = binder_buffer_size(proc, best_fit);
 		}
 	}
 	if (best_fit == NULL) {
@@ -786,10 +1099,8 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		       "no address space\n", proc->pid, size);
 		return NULL;
 	}
-	if (n == NULL) {
-		buffer = rb_entry(best_fit, struct binder_buffer, rb_node);
-		buffer_size = binder_buffer_size(proc, buffer);
-	}
+	buffer = best_fit;
+	buffer_size = best_fit_size;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: binder_alloc_buf size %zd got buff"
@@ -797,7 +1108,7 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 
 	has_page_addr =
 		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK);
-	if (n == NULL) {
+	if (buffer_size != size) {
 		if (size + sizeof(struct binder_buffer) + 4 >= buffer_size)
 			buffer_size = size; /* no room for other buffers */
 		else
@@ -811,7 +1122,7 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	    (void *)PAGE_ALIGN((uintptr_t)buffer->data), end_page_addr, NULL))
 		return NULL;
 
-	rb_erase(best_fit, &proc->free_buffers);
+	binder_erase_free_buffer(proc, buffer);
 	buffer->free = 0;
 	binder_insert_allocated_buffer(proc, buffer);
 	if (buffer_size != size) {
@@ -834,6 +1145,25 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 			     proc->free_async_space);
 	}
 
+	alloc_time = local_clock() - start_time;
+	proc->alloc_stats.allocs++;
+	proc->alloc_stats.alloc_ns += alloc_time;
+	if (alloc_time > proc->alloc_stats.max_alloc_ns)
+		proc->alloc_stats.max_alloc_ns = alloc_time;
+
+	return buffer;
+}
+
+static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
+					      size_t data_size,
+					      size_t offsets_size, int is_async)
+{
+	struct binder_buffer *buffer;
+
+	mutex_lock(&proc->alloc_lock);
+	buffer = binder_alloc_buf_locked(proc, data_size, offsets_size,
+					 is_async);
+	mutex_unlock(&proc->alloc_lock);
 	return buffer;
 }
 
@@ -899,6 +1229,7 @@ static void binder_free_buf(struct binder_proc *proc,
 {
 	size_t size, buffer_size;
 
+	mutex_lock(&proc->alloc_lock);
 	buffer_size = binder_buffer_size(proc, buffer);
 
 	size = ALIGN(buffer->data_size, sizeof(void *)) +
@@ -933,7 +1264,7 @@ static void binder_free_buf(struct binder_proc *proc,
 		struct binder_buffer *next = list_entry(buffer->entry.next,
 						struct binder_buffer, entry);
 		if (next->free) {
-			rb_erase(&next->rb_node, &proc->free_buffers);
+			binder_erase_free_buffer(proc, next);
 			binder_delete_free_buffer(proc, next);
 		}
 	}
@@ -941,12 +1272,13 @@ static void binder_free_buf(struct binder_proc *proc,
 		struct binder_buffer *prev = list_entry(buffer->entry.prev,
 						struct binder_buffer, entry);
 		if (prev->free) {
+			binder_erase_free_buffer(proc, prev);
 			binder_delete_free_buffer(proc, buffer);
-			rb_erase(&prev->rb_node, &proc->free_buffers);
 			buffer = prev;
 		}
 	}
 	binder_insert_free_buffer(proc, buffer);
+	mutex_unlock(&proc->alloc_lock);
 }
 
 static struct binder_node *binder_get_node(struct binder_proc *proc,
@@ -1636,6 +1968,7 @@ static void binder_transaction(struct binder_proc *proc,
 					proc->pid, thread->pid,
 					fp->binder, node->debug_id,
 					fp->cookie, node->cookie);
+				return_error = BR_FAILED_REPLY;
 				goto err_binder_get_ref_for_node_failed;
 			}
 			ref = binder_get_ref_for_node(target_proc, node);
@@ -1959,7 +2292,9 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				return -EFAULT;
 			ptr += sizeof(void *);
 
+			mutex_lock(&proc->alloc_lock);
 			buffer = binder_buffer_lookup(proc, data_ptr);
+			mutex_unlock(&proc->alloc_lock);
 			if (buffer == NULL) {
 				binder_user_error("binder: %d:%d "
 					"BC_FREE_BUFFER u%p no match\n",
@@ -2258,7 +2593,7 @@ retry:
 	thread->looper |= BINDER_LOOPER_STATE_WAITING;
 	if (wait_for_proc_work)
 		proc->ready_threads++;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 	if (wait_for_proc_work) {
 		if (!(thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 					BINDER_LOOPER_STATE_ENTERED))) {
@@ -2282,7 +2617,7 @@ retry:
 		} else
 			ret = wait_event_interruptible(thread->wait, binder_has_thread_work(thread));
 	}
-	mutex_lock(&binder_lock);
+	binder_lock();
 	if (wait_for_proc_work)
 		proc->ready_threads--;
 	thread->looper &= ~BINDER_LOOPER_STATE_WAITING;
@@ -2624,12 +2959,12 @@ static unsigned int binder_poll(struct file *filp,
 	struct binder_thread *thread = NULL;
 	int wait_for_proc_work;
 
-	mutex_lock(&binder_lock);
+	binder_lock();
 	thread = binder_get_thread(proc);
 
 	wait_for_proc_work = thread->transaction_stack == NULL &&
 		list_empty(&thread->todo) && thread->return_error == BR_OK;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 
 	if (wait_for_proc_work) {
 		if (binder_has_proc_work(proc, thread))
@@ -2661,7 +2996,16 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	if (ret)
 		return ret;
 
-	mutex_lock(&binder_lock);
+	/* Does not touch any binder state, skip binder_main_lock */
+	if (cmd == BINDER_VERSION) {
+		if (size != sizeof(struct binder_version))
+			return -EINVAL;
+		if (put_user(BINDER_CURRENT_PROTOCOL_VERSION, &((struct binder_version *)ubuf)->protocol_version))
+			return -EINVAL;
+		return 0;
+	}
+
+	binder_lock();
 	thread = binder_get_thread(proc);
 	if (thread == NULL) {
 		ret = -ENOMEM;
@@ -2752,16 +3096,6 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		binder_free_thread(proc, thread);
 		thread = NULL;
 		break;
-	case BINDER_VERSION:
-		if (size != sizeof(struct binder_version)) {
-			ret = -EINVAL;
-			goto err;
-		}
-		if (put_user(BINDER_CURRENT_PROTOCOL_VERSION, &((struct binder_version *)ubuf)->protocol_version)) {
-			ret = -EINVAL;
-			goto err;
-		}
-		break;
 	default:
 		ret = -EINVAL;
 		goto err;
@@ -2770,7 +3104,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 err:
 	if (thread)
 		thread->looper &= ~BINDER_LOOPER_STATE_NEED_RETURN;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 	wait_event_interruptible(binder_user_error_wait, binder_stop_on_user_error < 2);
 	if (ret && ret != -ERESTARTSYS)
 		printk(KERN_INFO "binder: %d:%d ioctl %x %lx returned %d\n", proc->pid, current->pid, cmd, arg, ret);
@@ -2812,6 +3146,7 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	struct binder_proc *proc = filp->private_data;
 	const char *failure_string;
 	struct binder_buffer *buffer;
+	int i;
 
 	if ((vma->vm_end - vma->vm_start) > SZ_4M)
 		vma->vm_end = vma->vm_start + SZ_4M;
@@ -2860,6 +3195,17 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 		failure_string = "alloc page array";
 		goto err_alloc_pages_failed;
 	}
+	proc->lru_pages = kcalloc((vma->vm_end - vma->vm_start) / PAGE_SIZE,
+				  sizeof(proc->lru_pages[0]), GFP_KERNEL);
+	if (proc->lru_pages == NULL) {
+		ret = -ENOMEM;
+		failure_string = "alloc lru page array";
+		goto err_alloc_lru_pages_failed;
+	}
+	for (i = 0; i < (vma->vm_end - vma->vm_start) / PAGE_SIZE; i++) {
+		INIT_LIST_HEAD(&proc->lru_pages[i].lru);
+		proc->lru_pages[i].proc = proc;
+	}
 	proc->buffer_size = vma->vm_end - vma->vm_start;
 
 	vma->vm_ops = &binder_vm_ops;
@@ -2885,6 +3231,9 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	return 0;
 
 err_alloc_small_buf_failed:
+	kfree(proc->lru_pages);
+	proc->lru_pages = NULL;
+err_alloc_lru_pages_failed:
 	kfree(proc->pages);
 	proc->pages = NULL;
 err_alloc_pages_failed:
@@ -2903,6 +3252,7 @@ err_bad_arg:
 static int binder_open(struct inode *nodp, struct file *filp)
 {
 	struct binder_proc *proc;
+	int i;
 
 	binder_debug(BINDER_DEBUG_OPEN_CLOSE, "binder_open: %d:%d\n",
 		     current->group_leader->pid, current->pid);
@@ -2914,14 +3264,17 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	proc->tsk = current;
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
+	mutex_init(&proc->alloc_lock);
+	for (i = 0; i < BINDER_FREE_BUCKETS; i++)
+		INIT_LIST_HEAD(&proc->free_buckets[i]);
 	proc->default_priority = task_nice(current);
-	mutex_lock(&binder_lock);
+	binder_lock();
 	binder_stats_created(BINDER_STAT_PROC);
 	hlist_add_head(&proc->proc_node, &binder_procs);
 	proc->pid = current->group_leader->pid;
 	INIT_LIST_HEAD(&proc->delivered_death);
 	filp->private_data = proc;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 
 	if (binder_debugfs_dir_entry_proc) {
 		char strbuf[11];
@@ -3064,7 +3417,15 @@ static void binder_deferred_release(struct binder_proc *proc)
 	page_count = 0;
 	if (proc->pages) {
 		int i;
+
+		/* Keep binder_shrink() off the pages while they go */
+		mutex_lock(&proc->alloc_lock);
+		mutex_lock(&binder_lru_lock);
 		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
+			if (!list_empty(&proc->lru_pages[i].lru)) {
+				list_del(&proc->lru_pages[i].lru);
+				binder_lru_count--;
+			}
 			if (proc->pages[i]) {
 				void *page_addr = proc->buffer + i * PAGE_SIZE;
 				binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
@@ -3078,6 +3439,9 @@ static void binder_deferred_release(struct binder_proc *proc)
 				page_count++;
 			}
 		}
+		mutex_unlock(&binder_lru_lock);
+		mutex_unlock(&proc->alloc_lock);
+		kfree(proc->lru_pages);
 		kfree(proc->pages);
 		vfree(proc->buffer);
 	}
@@ -3101,7 +3465,7 @@ static void binder_deferred_func(struct work_struct *work)
 
 	int defer;
 	do {
-		mutex_lock(&binder_lock);
+		binder_lock();
 		mutex_lock(&binder_deferred_lock);
 		if (!hlist_empty(&binder_deferred_list)) {
 			proc = hlist_entry(binder_deferred_list.first,
@@ -3128,7 +3492,7 @@ static void binder_deferred_func(struct work_struct *work)
 		if (defer & BINDER_DEFERRED_RELEASE)
 			binder_deferred_release(proc); /* frees proc */
 
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 		if (files)
 			put_files_struct(files);
 	} while (proc);
@@ -3309,9 +3673,11 @@ static void print_binder_proc(struct seq_file *m,
 			print_binder_ref(m, rb_entry(n, struct binder_ref,
 						     rb_node_desc));
 	}
+	mutex_lock(&proc->alloc_lock);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		print_binder_buffer(m, "  buffer",
 				    rb_entry(n, struct binder_buffer, rb_node));
+	mutex_unlock(&proc->alloc_lock);
 	list_for_each_entry(w, &proc->todo, entry)
 		print_binder_work(m, "  ", "  pending transaction", w);
 	list_for_each_entry(w, &proc->delivered_death, entry) {
@@ -3419,11 +3785,13 @@ static void print_binder_proc_stats(struct seq_file *m,
 	for (n = rb_first(&proc->threads); n != NULL; n = rb_next(n))
 		count++;
 	seq_printf(m, "  threads: %d\n", count);
+	mutex_lock(&proc->alloc_lock);
 	seq_printf(m, "  requested threads: %d+%d/%d\n"
 			"  ready threads %d\n"
 			"  free async space %zd\n", proc->requested_threads,
 			proc->requested_threads_started, proc->max_threads,
 			proc->ready_threads, proc->free_async_space);
+	mutex_unlock(&proc->alloc_lock);
 	count = 0;
 	for (n = rb_first(&proc->nodes); n != NULL; n = rb_next(n))
 		count++;
@@ -3441,9 +3809,21 @@ static void print_binder_proc_stats(struct seq_file *m,
 	seq_printf(m, "  refs: %d s %d w %d\n", count, strong, weak);
 
 	count = 0;
+	mutex_lock(&proc->alloc_lock);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
 	seq_printf(m, "  buffers: %d\n", count);
+	seq_printf(m, "  buffer allocs: %lu avg %llu ns max %llu ns\n",
+		   proc->alloc_stats.allocs,
+		   proc->alloc_stats.allocs ?
+		   div_u64(proc->alloc_stats.alloc_ns,
+			   proc->alloc_stats.allocs) : 0,
+		   proc->alloc_stats.max_alloc_ns);
+	seq_printf(m, "  buffer pages: mapped %lu reused %lu reclaimed %lu\n",
+		   proc->alloc_stats.pages_mapped,
+		   proc->alloc_stats.pages_reused,
+		   proc->alloc_stats.pages_reclaimed);
+	mutex_unlock(&proc->alloc_lock);
 
 	count = 0;
 	list_for_each_entry(w, &proc->todo, entry) {
@@ -3483,7 +3863,7 @@ static void *binder_stats_seq_start(struct seq_file *m, loff_t *pos)
 {
 	struct binder_stats_data *data = m->private;
 	if (data->do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 	return binder_stats_find(m, pos);
 }
 
@@ -3493,9 +3873,24 @@ static void *binder_stats_seq_next(struct seq_file *m, void *v, loff_t *pos)
 	return binder_stats_find(m, pos);
 }
 
+static void print_binder_lock_stats(struct seq_file *m,
+				    struct binder_lock_stats *stats)
+{
+	seq_printf(m, "lock: acquired %llu contended %llu\n",
+		   stats->acquired, stats->contended);
+	seq_printf(m, "lock: wait total %llu us max %llu us\n",
+		   div_u64(stats->wait_ns, NSEC_PER_USEC),
+		   div_u64(stats->max_wait_ns, NSEC_PER_USEC));
+	seq_printf(m, "lock: hold total %llu us max %llu us\n",
+		   div_u64(stats->hold_ns, NSEC_PER_USEC),
+		   div_u64(stats->max_hold_ns, NSEC_PER_USEC));
+}
+
 static int binder_stats_header(struct seq_file *m)
 {
 	seq_puts(m, "binder stats:\n");
+	print_binder_lock_stats(m, &binder_lock_stats);
+	seq_printf(m, "lru pages: %lu\n", binder_lru_count);
 	print_binder_stats(m, "", &binder_stats);
 	return 0;
 }
@@ -3513,7 +3908,7 @@ static void binder_stats_seq_stop(struct seq_file *m, void *v)
 {
 	struct binder_stats_data *data = m->private;
 	if (data->do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 }
 
 
@@ -3581,7 +3976,7 @@ static void *binder_state_seq_start(struct seq_file *m, loff_t *pos)
 {
 	struct binder_state_data *d = m->private;
 	if (d->do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 
 	return binder_state_find(m, pos, 1);
 }
@@ -3663,13 +4058,17 @@ static int print_binder_proc_sub(struct seq_file *m, struct binder_proc *proc,
 			return 0;
 		}
 
+	mutex_lock(&proc->alloc_lock);
 	for (r = rb_first(&proc->allocated_buffers); r; r = rb_next(r))
 		if (cnt-- == 0) {
 			struct binder_buffer *b;
 			b = rb_entry(r, struct binder_buffer, rb_node);
 			print_binder_buffer(m, "  buffer", b);
-			return 0;
+			break;
 		}
+	mutex_unlock(&proc->alloc_lock);
+	if (r)
+		return 0;
 
 	list_for_each_entry(w, &proc->todo, entry)
 		if (cnt-- == 0) {
@@ -3714,7 +4113,7 @@ static void binder_state_seq_stop(struct seq_file *m, void *v)
 {
 	struct binder_state_data *d = m->private;
 	if (d->do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 }
 
 static int binder_transactions_show(struct seq_file *m, void *unused)
@@ -3724,13 +4123,13 @@ static int binder_transactions_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 
 	seq_puts(m, "binder transactions:\n");
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 0);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3740,11 +4139,11 @@ static int binder_proc_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 	seq_puts(m, "binder proc state:\n");
 	print_binder_proc(m, proc, 1);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3890,6 +4289,8 @@ static int __init binder_init(void)
 	if (!binder_deferred_workqueue)
 		return -ENOMEM;
 
+	register_shrinker(&binder_shrinker);
+
 	binder_debugfs_dir_entry_root = debugfs_create_dir("binder", NULL);
 	if (binder_debugfs_dir_entry_root)
 		binder_debugfs_dir_entry_proc = debugfs_create_dir("proc",
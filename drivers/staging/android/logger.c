@@ -18,13 +18,16 @@
  */
 
 #include <linux/console.h>
+#include <linux/device.h>
 #include <linux/sched.h>
 #include <linux/module.h>
 #include <linux/fs.h>
+#include <linux/mm.h>
 #include <linux/uaccess.h>
 #include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/delay.h>
 #include <asm/ioctls.h>
 
 #include "logger.h"
@@ -59,7 +62,8 @@ static inline struct logger_log *file_get_log(struct file *file)
  * get_entry_len - Grabs the length of the payload of the next entry starting
  * from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->mutex, or to otherwise know that the entry is
+ * not being overwritten.
  */
 __u32 get_entry_len(struct logger_log *log, size_t off)
 {
@@ -77,9 +81,97 @@ __u32 get_entry_len(struct logger_log *log, size_t off)
 	return sizeof(struct logger_entry) + val;
 }
 
+/*
+ * The write head and the position of the oldest entry are kept together in
+ * logger_log's 'reserve', so that writers can move both with one cmpxchg.
+ */
+static inline __u32 reserve_w_pos(u64 reserve)
+{
+	return (__u32)reserve;
+}
+
+static inline __u32 reserve_head_pos(u64 reserve)
+{
+	return (__u32)(reserve >> 32);
+}
+
+static inline u64 reserve_make(__u32 w_pos, __u32 head_pos)
+{
+	return ((u64)head_pos << 32) | w_pos;
+}
+
+/*
+ * logger_head_pos - returns the position of the oldest entry. Writers may be
+ * overwriting anything before it.
+ */
+static inline __u32 logger_head_pos(struct logger_log *log)
+{
+	return reserve_head_pos(atomic64_read(&log->reserve));
+}
+
+/*
+ * logger_tail_pos - returns the position following the newest readable
+ * entry. Everything before it is complete.
+ */
+static inline __u32 logger_tail_pos(struct logger_log *log)
+{
+	__u32 pos = ACCESS_ONCE(log->c_pos);
+
+	/* entries are complete before the tail moves over them */
+	smp_rmb();
+	return pos;
+}
+
+/*
+ * logger_lapped - returns whether the entry at 'pos' may have been
+ * overwritten. Readers copy an entry out first and then check this.
+ */
+static inline bool logger_lapped(struct logger_log *log, __u32 pos)
+{
+	/* writers move the head before they overwrite anything */
+	smp_rmb();
+	return (__s32)(logger_head_pos(log) - pos) > 0;
+}
+
+/*
+ * logger_catch_up - pulls 'reader' forward to the oldest entry if writers
+ * lapped it.
+ *
+ * Caller needs to hold log->mutex.
+ */
+static void logger_catch_up(struct logger_log *log,
+			    struct logger_reader *reader)
+{
+	__u32 head = logger_head_pos(log);
+
+	if ((__s32)(head - reader->r_pos) > 0)
+		reader->r_pos = head;
+}
+
+/*
+ * get_next_entry_len - returns the length of the entry 'reader' reads next,
+ * or 0 if it has read every complete entry.
+ *
+ * Caller needs to hold log->mutex.
+ */
+__u32 get_next_entry_len(struct logger_log *log, struct logger_reader *reader)
+{
+	__u32 len;
+
+	do {
+		logger_catch_up(log, reader);
+		if (reader->r_pos == logger_tail_pos(log))
+			return 0;
+		len = get_entry_len(log, logger_offset(reader->r_pos));
+	} while (logger_lapped(log, reader->r_pos));
+
+	return len;
+}
+
 /*
  * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * user-space buffer 'buf'. Returns 'count' on success, or -EAGAIN if the
+ * entry was overwritten meanwhile.
  *
  * Caller must hold log->mutex.
  */
@@ -88,6 +180,7 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 				   char __user *buf,
 				   size_t count)
 {
+	size_t off = logger_offset(reader->r_pos);
 	size_t len;
 
 	/*
@@ -95,8 +188,8 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 	 * the current read head offset up to 'count' bytes or to the end of
 	 * the log, whichever comes first.
 	 */
-	len = min(count, log->size - reader->r_off);
-	if (copy_to_user(buf, log->buffer + reader->r_off, len))
+	len = min(count, log->size - off);
+	if (copy_to_user(buf, log->buffer + off, len))
 		return -EFAULT;
 
 	/*
@@ -107,22 +200,27 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 		if (copy_to_user(buf + len, log->buffer, count - len))
 			return -EFAULT;
 
-	reader->r_off = logger_offset(reader->r_off + count);
+	if (logger_lapped(log, reader->r_pos))
+		return -EAGAIN;
+
+	reader->r_pos += count;
 
 	return count;
 }
 
 /*
  * do_read_log - reads exactly 'count' bytes from 'log' into the
- * kernel buffer 'buf'.
+ * kernel buffer 'buf'. Returns 0 on success, or -EAGAIN if the entry was
+ * overwritten meanwhile.
  *
  * Caller must hold log->mutex.
  */
-void do_read_log(struct logger_log *log,
+int do_read_log(struct logger_log *log,
 			struct logger_reader *reader,
 			char *buf,
 			size_t count)
 {
+	size_t off = logger_offset(reader->r_pos);
 	size_t len;
 
 	/*
@@ -130,8 +228,8 @@ void do_read_log(struct logger_log *log,
 	 * the current read head offset up to 'count' bytes or to the end of
 	 * the log, whichever comes first.
 	 */
-	len = min(count, log->size - reader->r_off);
-	memcpy(buf, log->buffer + reader->r_off, len);
+	len = min(count, log->size - off);
+	memcpy(buf, log->buffer + off, len);
 
 	/*
 	 * Second, we read any remaining bytes, starting back at the head of
@@ -140,7 +238,12 @@ void do_read_log(struct logger_log *log,
 	if (count != len)
 		memcpy(buf + len, log->buffer, count - len);
 
-	reader->r_off = logger_offset(reader->r_off + count);
+	if (logger_lapped(log, reader->r_pos))
+		return -EAGAIN;
+
+	reader->r_pos += count;
+
+	return 0;
 }
 
 /*
@@ -168,7 +271,8 @@ start:
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
 		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
+		logger_catch_up(log, reader);
+		ret = (logger_tail_pos(log) == reader->r_pos);
 		mutex_unlock(&log->mutex);
 		if (!ret)
 			break;
@@ -192,21 +296,22 @@ start:
 
 	mutex_lock(&log->mutex);
 
-	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
-		goto start;
-	}
+	do {
+		/* is there still something to read or did we race? */
+		ret = get_next_entry_len(log, reader);
+		if (unlikely(!ret)) {
+			mutex_unlock(&log->mutex);
+			goto start;
+		}
 
-	/* get the size of the next entry */
-	ret = get_entry_len(log, reader->r_off);
-	if (count < ret) {
-		ret = -EINVAL;
-		goto out;
-	}
+		if (count < ret) {
+			ret = -EINVAL;
+			goto out;
+		}
 
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+		/* get exactly one entry from the log, or try the next one */
+		ret = do_read_log_to_user(log, reader, buf, ret);
+	} while (ret == -EAGAIN);
 
 out:
 	mutex_unlock(&log->mutex);
@@ -215,108 +320,342 @@ out:
 }
 
 /*
- * get_next_entry - return the offset of the first valid entry at least 'len'
- * bytes after 'off'.
- *
- * Caller must hold log->mutex.
+ * logger_publish_pos - moves one of the positions shared with mmap readers
+ * forward to 'pos', unless another writer already moved it further.
  */
-static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
+static void logger_publish_pos(__u32 *field, __u32 pos)
 {
-	size_t count = 0;
+	__u32 old;
 
 	do {
-		size_t nr = get_entry_len(log, off);
-		off = logger_offset(off + nr);
-		count += nr;
-	} while (count < len);
+		old = ACCESS_ONCE(*field);
+		if ((__s32)(pos - old) <= 0)
+			break;
+	} while (cmpxchg(field, old, pos) != old);
+}
+
+/*
+ * logger_publish_head - tells mmap readers that entries before 'head' are
+ * about to be overwritten
+ */
+static void logger_publish_head(struct logger_log *log, __u32 head)
+{
+	struct logger_mmap_header *header = log->mmap_header;
 
-	return off;
+	if (!header)
+		return;
+
+	logger_publish_pos(&header->head_pos, head);
+	/* readers see the head move before anything is overwritten */
+	smp_mb();
 }
 
 /*
- * clock_interval - is a < c < b in mod-space? Put another way, does the line
- * from a to b cross c?
+ * logger_publish_tail - tells mmap readers that entries before 'tail' are
+ * complete
  */
-static inline int clock_interval(size_t a, size_t b, size_t c)
+static void logger_publish_tail(struct logger_log *log, __u32 tail)
 {
-	if (b < a) {
-		if (a < c || b >= c)
-			return 1;
-	} else {
-		if (a < c && b >= c)
-			return 1;
+	struct logger_mmap_header *header = log->mmap_header;
+
+	if (!header)
+		return;
+
+	/* entries are complete before they are published */
+	smp_wmb();
+	logger_publish_pos(&header->tail_pos, tail);
+}
+
+/*
+ * A commit slot is free, reserved by a write in flight, or holds a write
+ * that is done but waits for older ones. The bits above the state count how
+ * often the slot was reserved, so that a slot read while it is reused can be
+ * told apart.
+ */
+#define LOGGER_COMMIT_FREE	0
+#define LOGGER_COMMIT_RESERVED	1
+#define LOGGER_COMMIT_DONE	2
+#define LOGGER_COMMIT_MASK	3
+#define LOGGER_COMMIT_GEN	4
+
+/*
+ * logger_claim_commit - reserves 'commit' if it is free and returns whether
+ * it did. The new state of the slot is stored in 'state'.
+ */
+static bool logger_claim_commit(struct logger_commit *commit, int *state)
+{
+	int old = atomic_read(&commit->state);
+
+	if ((old & LOGGER_COMMIT_MASK) != LOGGER_COMMIT_FREE)
+		return false;
+
+	*state = (old & ~LOGGER_COMMIT_MASK) + LOGGER_COMMIT_GEN +
+		LOGGER_COMMIT_RESERVED;
+	return atomic_cmpxchg(&commit->state, old, *state) == old;
+}
+
+static void logger_free_commit(struct logger_commit *commit, int state)
+{
+	atomic_set(&commit->state,
+		   (state & ~LOGGER_COMMIT_MASK) | LOGGER_COMMIT_FREE);
+}
+
+/*
+ * struct logger_write - a write in flight, from logger_reserve() to
+ * logger_commit(). Lives on the writer's stack.
+ */
+struct logger_write {
+	size_t			off;	/* offset of the claimed space */
+	size_t			end;	/* offset following it */
+	struct logger_commit	*commit; /* slot for logger_commit() */
+	int			state;	/* state of the slot */
+};
+
+/*
+ * logger_reserve - claims 'len' bytes at the write head for 'w' and returns
+ * their offset in w->off. The entries about to be overwritten are dropped
+ * from the log right away, so the space can be filled in without any lock;
+ * it becomes readable once logger_commit() has been called for it and for
+ * every write claimed before it.
+ *
+ * Returns 0 on success, or -ENOSPC if the log is too small for the writes
+ * already in flight, in which case the entry is counted as dropped.
+ */
+static int logger_reserve(struct logger_log *log, struct logger_write *w,
+			  size_t len)
+{
+	struct logger_commit *commit = NULL;
+	unsigned long skipped;
+	u64 old, new;
+	__u32 head, end;
+	int i, state;
+
+	/* the slot is taken first, a full table must not make us wait */
+	for (i = 0; i < LOGGER_WRITES_MAX; i++) {
+		if (logger_claim_commit(&log->commits[i], &state)) {
+			commit = &log->commits[i];
+			break;
+		}
 	}
+	if (!commit)
+		goto err_dropped;
+
+	do {
+		old = atomic64_read(&log->reserve);
+		head = reserve_head_pos(old);
+		end = reserve_w_pos(old) + len;
+
+		/*
+		 * Neither the space to overwrite nor the entries we walk past
+		 * below may still be being written.
+		 */
+		if ((__s32)(end - log->size - logger_tail_pos(log)) > 0) {
+			logger_free_commit(commit, state);
+			goto err_dropped;
+		}
+
+		/*
+		 * Whatever writer moved the head last has overwritten nothing
+		 * after it yet, so the entry lengths read here are only stale
+		 * if 'reserve' changed meanwhile, and then we start over.
+		 */
+		skipped = 0;
+		while ((__s32)(end - log->size - head) > 0) {
+			head += get_entry_len(log, logger_offset(head));
+			skipped++;
+		}
+		new = reserve_make(end, head);
+	} while (atomic64_cmpxchg(&log->reserve, old, new) != old);
+
+	logger_publish_head(log, head);
+	if (skipped)
+		atomic_long_add(skipped, &log->overwritten);
+
+	commit->start = reserve_w_pos(old);
+	commit->end = end;
+	w->off = logger_offset(commit->start);
+	w->end = logger_offset(end);
+	w->commit = commit;
+	w->state = state;
 
 	return 0;
+
+err_dropped:
+	atomic_long_inc(&log->dropped);
+	return -ENOSPC;
+}
+
+/*
+ * logger_advance - moves the commit position over every write done that
+ * directly follows it, and frees their slots.
+ */
+static void logger_advance(struct logger_log *log)
+{
+	struct logger_commit *commit;
+	__u32 tail, end;
+	int i, state;
+
+	for (;;) {
+		tail = ACCESS_ONCE(log->c_pos);
+		smp_rmb();
+
+		for (i = 0; i < LOGGER_WRITES_MAX; i++) {
+			commit = &log->commits[i];
+			state = atomic_read(&commit->state);
+			if ((state & LOGGER_COMMIT_MASK) != LOGGER_COMMIT_DONE)
+				continue;
+			smp_rmb();
+			end = commit->end;
+			if (commit->start != tail)
+				continue;
+			/* a slot freed and reserved again meanwhile */
+			smp_rmb();
+			if (atomic_read(&commit->state) == state)
+				break;
+		}
+		if (i == LOGGER_WRITES_MAX)
+			return;
+
+		/* only the one moving the tail over a slot frees it */
+		if (cmpxchg(&log->c_pos, tail, end) == tail) {
+			logger_free_commit(commit, state);
+			logger_publish_tail(log, end);
+		}
+	}
+}
+
+/*
+ * logger_commit - ends the write 'w' started by logger_reserve(). The commit
+ * position moves over it and over any later writes already done, unless an
+ * older write is still in flight, in which case that one moves it later.
+ */
+static void logger_commit(struct logger_log *log, struct logger_write *w)
+{
+	/* the entry and the slot are filled in before the slot is done */
+	smp_wmb();
+	atomic_set(&w->commit->state,
+		   (w->state & ~LOGGER_COMMIT_MASK) | LOGGER_COMMIT_DONE);
+
+	/*
+	 * Either we see an older write that was done meanwhile, or the
+	 * writer of that one sees ours.
+	 */
+	smp_mb();
+	logger_advance(log);
 }
 
 /*
- * fix_up_readers - walk the list of all readers and "fix up" any who were
- * lapped by the writer; also do the same for the default "start head".
- * We do this by "pulling forward" the readers and start head to the first
- * entry after the new write head.
+ * logger_wake_batch - accounts 'len' freshly written bytes and returns
+ * whether readers should be woken up, i.e. whether enough has accumulated
+ * for the reader with the smallest wake threshold.
+ */
+static bool logger_wake_batch(struct logger_log *log, size_t len)
+{
+	if ((size_t)atomic_add_return(len, &log->wake_pending) <
+	    ACCESS_ONCE(log->wake_batch))
+		return false;
+
+	atomic_set(&log->wake_pending, 0);
+	return true;
+}
+
+/*
+ * update_wake_batch - recomputes the log's wake batch after a reader came,
+ * went or changed its threshold.
  *
  * The caller needs to hold log->mutex.
  */
-static void fix_up_readers(struct logger_log *log, size_t len)
+static void update_wake_batch(struct logger_log *log)
 {
-	size_t old = log->w_off;
-	size_t new = logger_offset(old + len);
 	struct logger_reader *reader;
-
-	if (clock_interval(old, new, log->head))
-		log->head = get_next_entry(log, log->head, len);
+	size_t batch = ~(size_t)0;
 
 	list_for_each_entry(reader, &log->readers, list)
-		if (clock_interval(old, new, reader->r_off))
-			reader->r_off = get_next_entry(log, reader->r_off, len);
+		batch = min(batch, reader->wake_threshold);
+	log->wake_batch = list_empty(&log->readers) ? 0 : batch;
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
+ * logger_cancel - undoes the write 'w' started by logger_reserve() that
+ * failed after filling in up to 'off'. Later writes may already own the
+ * space behind it, so the entry is kept with the rest of its payload zeroed.
  *
- * The caller needs to hold log->mutex.
+ * The caller must still call logger_commit().
+ */
+static void logger_cancel(struct logger_log *log, struct logger_write *w,
+			  size_t off)
+{
+	size_t end = w->end;
+
+	if (off <= end) {
+		memset(log->buffer + off, 0, end - off);
+	} else {
+		memset(log->buffer + off, 0, log->size - off);
+		memset(log->buffer, 0, end);
+	}
+}
+
+/*
+ * do_write_log - writes 'count' bytes from 'buf' to 'log' at offset 'off'
+ *
+ * The caller needs to own the space, see logger_reserve().
+ *
+ * Returns the offset following the written bytes.
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static size_t do_write_log(struct logger_log *log, size_t off,
+			   const void *buf, size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
 
 	if (count != len)
 		memcpy(log->buffer, buf + len, count - len);
 
-	log->w_off = logger_offset(log->w_off + count);
-
+	return logger_offset(off + count);
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
+ * do_write_log_user - writes 'count' bytes from the user-space buffer 'buf'
+ * to the log 'log' at offset 'off'
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to own the space, see logger_reserve().
  *
  * Returns 'count' on success, negative error code on failure.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
+static ssize_t do_write_log_from_user(struct logger_log *log, size_t off,
 				      const void __user *buf, size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
+	len = min(count, log->size - off);
+	if (len && copy_from_user(log->buffer + off, buf, len))
 		return -EFAULT;
 
 	if (count != len)
 		if (copy_from_user(log->buffer, buf + len, count - len))
 			return -EFAULT;
 
-	log->w_off = logger_offset(log->w_off + count);
-
 	return count;
 }
 
+/*
+ * logger_write_to_pti - forwards newly committed entries to PTI, if that is
+ * enabled for 'log'. The PTI reader is only moved under log->mutex.
+ */
+static void logger_write_to_pti(struct logger_log *log)
+{
+#ifdef CONFIG_ANDROID_LOGGER_PTI
+	if (!log->ptienable)
+		return;
+
+	mutex_lock(&log->mutex);
+	log_write_to_pti(log);
+	mutex_unlock(&log->mutex);
+#endif
+}
+
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
@@ -326,9 +665,10 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
+	struct logger_write w;
 	struct timespec now;
+	size_t off;
 	ssize_t len, ret = 0;
 
 	now = current_kernel_time();
@@ -344,17 +684,19 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
-
 	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
+	 * Claim the space for the whole entry. This also drops the entries
+	 * it overwrites, moving readers forward to the first readable entry
+	 * after (what will be) the new write offset. We do this now because
+	 * if we partially fail, we can end up with clobbered log entries that
+	 * encroach on readable buffer.
 	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
+	if (unlikely(logger_reserve(log, &w, sizeof(struct logger_entry) +
+				    header.len)))
+		return header.len;
 
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	/* the space is ours, copy the entry in */
+	off = do_write_log(log, w.off, &header, sizeof(struct logger_entry));
 
 	while (nr_segs-- > 0) {
 		ssize_t nr;
@@ -363,23 +705,26 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 		len = min_t(size_t, iov->iov_len, header.len - ret);
 
 		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
+		nr = do_write_log_from_user(log, off, iov->iov_base, len);
 		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
+			ret = nr;
+			break;
 		}
 
+		off = logger_offset(off + nr);
 		iov++;
 		ret += nr;
 	}
 
-	log_write_to_pti(log);
+	if (unlikely(ret < 0))
+		logger_cancel(log, &w, off);
+	logger_commit(log, &w);
 
-	mutex_unlock(&log->mutex);
+	logger_write_to_pti(log);
 
 	/* wake up any blocked readers */
-	wake_up_interruptible(&log->wq);
+	if (logger_wake_batch(log, sizeof(struct logger_entry) + header.len))
+		wake_up_interruptible(&log->wq);
 
 	return ret;
 }
@@ -410,11 +755,15 @@ static int logger_open(struct inode *inode, struct file *file)
 			return -ENOMEM;
 
 		reader->log = log;
+		reader->wake_threshold = 0;
+		reader->mapped = false;
+		reader->poll_pos = 0;
 		INIT_LIST_HEAD(&reader->list);
 
 		mutex_lock(&log->mutex);
-		reader->r_off = log->head;
+		reader->r_pos = logger_head_pos(log);
 		list_add_tail(&reader->list, &log->readers);
+		update_wake_batch(log);
 		mutex_unlock(&log->mutex);
 
 		file->private_data = reader;
@@ -436,6 +785,7 @@ static int logger_release(struct inode *ignored, struct file *file)
 
 		mutex_lock(&reader->log->mutex);
 		list_del(&reader->list);
+		update_wake_batch(reader->log);
 		mutex_unlock(&reader->log->mutex);
 
 		kfree(reader);
@@ -452,12 +802,19 @@ static int logger_release(struct inode *ignored, struct file *file)
  * guarantee that the log is readable without blocking, as there is a small
  * chance that the writer can lap the reader in the interim between poll()
  * returning and the read() request.
+ *
+ * POLLIN is only returned once at least the reader's wake threshold worth
+ * of bytes is pending. Readers that have the log mapped do not read through
+ * us, so for them that is whatever was written since POLLIN was last
+ * returned to them.
  */
 static unsigned int logger_poll(struct file *file, poll_table *wait)
 {
 	struct logger_reader *reader;
 	struct logger_log *log;
 	unsigned int ret = POLLOUT | POLLWRNORM;
+	size_t pending;
+	__u32 tail;
 
 	if (!(file->f_mode & FMODE_READ))
 		return ret;
@@ -468,13 +825,46 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 	poll_wait(file, &log->wq, wait);
 
 	mutex_lock(&log->mutex);
-	if (log->w_off != reader->r_off)
-		ret |= POLLIN | POLLRDNORM;
+	tail = logger_tail_pos(log);
+	if (reader->mapped) {
+		pending = tail - reader->poll_pos;
+		if (pending && pending >= reader->wake_threshold) {
+			reader->poll_pos = tail;
+			ret |= POLLIN | POLLRDNORM;
+		}
+	} else {
+		logger_catch_up(log, reader);
+		pending = tail - reader->r_pos;
+		if (pending && pending >= reader->wake_threshold)
+			ret |= POLLIN | POLLRDNORM;
+	}
 	mutex_unlock(&log->mutex);
 
 	return ret;
 }
 
+/*
+ * logger_flush - drops every complete entry from 'log'
+ *
+ * The caller needs to hold log->mutex.
+ */
+static void logger_flush(struct logger_log *log)
+{
+	struct logger_reader *reader;
+	u64 old;
+	__u32 tail;
+
+	do {
+		old = atomic64_read(&log->reserve);
+		tail = logger_tail_pos(log);
+	} while (atomic64_cmpxchg(&log->reserve, old,
+				  reserve_make(reserve_w_pos(old), tail)) != old);
+	logger_publish_head(log, tail);
+
+	list_for_each_entry(reader, &log->readers, list)
+		reader->r_pos = tail;
+}
+
 static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
@@ -493,10 +883,8 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
-		else
-			ret = (log->size - reader->r_off) + log->w_off;
+		logger_catch_up(log, reader);
+		ret = logger_tail_pos(log) - reader->r_pos;
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
@@ -504,19 +892,28 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off != reader->r_off)
-			ret = get_entry_len(log, reader->r_off);
-		else
-			ret = 0;
+		ret = get_next_entry_len(log, reader);
 		break;
 	case LOGGER_FLUSH_LOG:
 		if (!(file->f_mode & FMODE_WRITE)) {
 			ret = -EBADF;
 			break;
 		}
-		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+		logger_flush(log);
+		ret = 0;
+		break;
+	case LOGGER_SET_WAKE_THRESHOLD:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		if (arg >= log->size) {
+			ret = -EINVAL;
+			break;
+		}
+		reader = file->private_data;
+		reader->wake_threshold = arg;
+		update_wake_batch(log);
 		ret = 0;
 		break;
 	}
@@ -526,10 +923,61 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	return ret;
 }
 
+/*
+ * logger_mmap - the log's mmap file operation
+ *
+ * Maps the struct logger_mmap_header page followed by the ring buffer,
+ * read-only, so that readers can consume entries without a read() per entry.
+ * The whole thing has to be mapped in one go.
+ */
+static int logger_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct logger_reader *reader;
+	struct logger_log *log;
+	int ret;
+
+	if (!(file->f_mode & FMODE_READ))
+		return -EBADF;
+
+	reader = file->private_data;
+	log = reader->log;
+
+	if (!log->mmap_header)
+		return -ENODEV;
+
+	if (vma->vm_pgoff ||
+	    vma->vm_end - vma->vm_start != PAGE_SIZE + log->size)
+		return -EINVAL;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	ret = remap_pfn_range(vma, vma->vm_start,
+			      virt_to_phys(log->mmap_header) >> PAGE_SHIFT,
+			      PAGE_SIZE, vma->vm_page_prot);
+	if (ret)
+		return ret;
+
+	ret = remap_pfn_range(vma, vma->vm_start + PAGE_SIZE,
+			      virt_to_phys(log->buffer) >> PAGE_SHIFT,
+			      log->size, vma->vm_page_prot);
+	if (ret)
+		return ret;
+
+	mutex_lock(&log->mutex);
+	reader->mapped = true;
+	reader->poll_pos = logger_head_pos(log);
+	mutex_unlock(&log->mutex);
+
+	return 0;
+}
+
 static const struct file_operations logger_fops = {
 	.owner = THIS_MODULE,
 	.read = logger_read,
 	.aio_write = logger_aio_write,
+	.mmap = logger_mmap,
 	.poll = logger_poll,
 	.unlocked_ioctl = logger_ioctl,
 	.compat_ioctl = logger_ioctl,
@@ -539,11 +987,11 @@ static const struct file_operations logger_fops = {
 
 /*
  * Defines a log structure with name 'NAME' and a size of 'SIZE' bytes, which
- * must be a power of two, greater than LOGGER_ENTRY_MAX_LEN, and less than
- * LONG_MAX minus LOGGER_ENTRY_MAX_LEN.
+ * must be a power of two, greater than LOGGER_ENTRY_MAX_LEN and PAGE_SIZE,
+ * and less than LONG_MAX minus LOGGER_ENTRY_MAX_LEN.
  */
 #define DEFINE_LOGGER_DEVICE(VAR, NAME, SIZE) \
-static unsigned char _buf_ ## VAR[SIZE]; \
+static unsigned char _buf_ ## VAR[SIZE] __aligned(PAGE_SIZE); \
 static struct logger_log VAR = { \
 	.buffer = _buf_ ## VAR, \
 	.misc = { \
@@ -555,8 +1003,8 @@ static struct logger_log VAR = { \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
 	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
-	.w_off = 0, \
-	.head = 0, \
+	.reserve = ATOMIC64_INIT(0), \
+	.c_pos = 0, \
 	.size = SIZE, \
 };
 
@@ -581,8 +1029,10 @@ static void flush_to_bottom_log(struct logger_log *log,
 {
 	struct logger_entry header;
 	char extendedtag[8] = "\4KERNEL";
+	struct logger_write w;
 	struct timespec now;
 	unsigned long flags;
+	size_t off;
 
 	now = current_kernel_time();
 
@@ -607,37 +1057,46 @@ static void flush_to_bottom_log(struct logger_log *log,
 
 	spin_lock_irqsave(&log_lock, flags);
 
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
+	/* the reserved space includes the final extra byte */
+	if (logger_reserve(log, &w, sizeof(struct logger_entry) + header.len)) {
+		spin_unlock_irqrestore(&log_lock, flags);
+		return;
+	}
 
-	do_write_log(log, &header, sizeof(struct logger_entry));
-	do_write_log(log, &extendedtag, sizeof(extendedtag));
-	do_write_log(log, buf, header.len - (sizeof(extendedtag)) - 1);
+	off = do_write_log(log, w.off, &header,
+			   sizeof(struct logger_entry));
+	off = do_write_log(log, off, &extendedtag, sizeof(extendedtag));
+	do_write_log(log, off, buf, header.len - (sizeof(extendedtag)) - 1);
 
-	/* the write offset is updated to add the final extra byte */
-	log->w_off = logger_offset(log->w_off + 1);
+	logger_commit(log, &w);
 	spin_unlock_irqrestore(&log_lock, flags);
 };
 
 
 /*
  * update_log_from_bottom - copy bottom log buffer into a log buffer
+ *
+ * The bottom log is only ever read and written under log_lock, so its
+ * entries can't be overwritten while they are copied.
  */
 static void update_log_from_bottom(struct logger_log *log_dst,
 					struct logger_log *log)
 {
 	struct logger_reader *reader;
-	size_t len, ret;
+	struct logger_write w;
+	size_t len, ret, off, r_off;
 	unsigned long flags;
 
-	mutex_lock(&log_dst->mutex);
 	spin_lock_irqsave(&log_lock, flags);
 
 	list_for_each_entry(reader, &log->readers, list)
-		while (log->w_off != reader->r_off) {
+		while ((ret = get_next_entry_len(log, reader))) {
+			r_off = logger_offset(reader->r_pos);
 
-			ret = get_entry_len(log, reader->r_off);
-
-			fix_up_readers(log_dst, ret);
+			if (logger_reserve(log_dst, &w, ret)) {
+				reader->r_pos += ret;
+				continue;
+			}
 
 			/*
 			 * We read from the log in two disjoint operations.
@@ -645,20 +1104,23 @@ static void update_log_from_bottom(struct logger_log *log_dst,
 			 * up to 'count' bytes or to the end of the log,
 			 * whichever comes first.
 			 */
-			len = min(ret, log->size - reader->r_off);
-			do_write_log(log_dst, log->buffer + reader->r_off, len);
+			len = min(ret, log->size - r_off);
+			off = do_write_log(log_dst, w.off,
+					   log->buffer + r_off, len);
 
 			/*
 			 * Second, we read any remaining bytes, starting back at
 			 * the head of the log.
 			 */
 			if (ret != len)
-				do_write_log(log_dst, log->buffer, ret - len);
+				do_write_log(log_dst, off, log->buffer,
+					     ret - len);
+
+			logger_commit(log_dst, &w);
 
-			reader->r_off = logger_offset(reader->r_off + ret);
+			reader->r_pos += ret;
 		}
 	spin_unlock_irqrestore(&log_lock, flags);
-	mutex_unlock(&log_dst->mutex);
 
 	/* wake up any blocked readers */
 	wake_up_interruptible(&log_dst->wq);
@@ -690,6 +1152,75 @@ struct logger_log **get_log_list(void)
 	return log_list;
 }
 
+/*
+ * get_log_head - returns the offset of the oldest entry in 'log'
+ */
+size_t get_log_head(struct logger_log *log)
+{
+	return logger_offset(logger_head_pos(log));
+}
+
+/*
+ * get_log_tail - returns the offset following the newest complete entry
+ * in 'log'
+ */
+size_t get_log_tail(struct logger_log *log)
+{
+	return logger_offset(logger_tail_pos(log));
+}
+
+/*
+ * logger_restore_begin - stops writers so that the contents of 'log' can be
+ * replaced, for instance with a copy saved at panic time. Writes are dropped
+ * until logger_restore_end().
+ *
+ * Takes every commit slot, so writes in flight are waited for and new ones
+ * find none. Might sleep.
+ */
+void logger_restore_begin(struct logger_log *log)
+{
+	int i, state;
+
+	mutex_lock(&log->mutex);
+	for (i = 0; i < LOGGER_WRITES_MAX; i++)
+		while (!logger_claim_commit(&log->commits[i], &state))
+			msleep(1);
+
+	/* mmap readers must not trust anything in the log from now on */
+	logger_flush(log);
+}
+
+/*
+ * logger_restore_end - makes the entries from offset 'head' up to offset
+ * 'tail' the contents of 'log', and lets writers in again
+ */
+void logger_restore_end(struct logger_log *log, size_t head, size_t tail)
+{
+	struct logger_reader *reader;
+	__u32 head_pos, tail_pos;
+	int i;
+
+	/* positions keep moving forward for mmap readers */
+	head_pos = logger_tail_pos(log);
+	head_pos += logger_offset(head - head_pos);
+	tail_pos = head_pos + logger_offset(tail - head);
+
+	atomic64_set(&log->reserve, reserve_make(tail_pos, head_pos));
+	smp_wmb();
+	ACCESS_ONCE(log->c_pos) = tail_pos;
+	logger_publish_head(log, head_pos);
+	logger_publish_tail(log, tail_pos);
+
+	list_for_each_entry(reader, &log->readers, list)
+		reader->r_pos = head_pos;
+
+	smp_mb();
+	for (i = 0; i < LOGGER_WRITES_MAX; i++)
+		logger_free_commit(&log->commits[i],
+				   atomic_read(&log->commits[i].state));
+	mutex_unlock(&log->mutex);
+}
+
 static int init_log_kernel_bottom(void)
 {
 	struct logger_log *log = &log_kernel_bottom;
@@ -703,14 +1234,51 @@ static int init_log_kernel_bottom(void)
 	INIT_LIST_HEAD(&reader->list);
 
 	mutex_lock(&log->mutex);
-	reader->r_off = log->head;
+	reader->r_pos = logger_head_pos(log);
 	list_add_tail(&reader->list, &log->readers);
 	mutex_unlock(&log->mutex);
 	return 0;
 }
 
+static struct logger_log *dev_get_log(struct device *dev)
+{
+	struct miscdevice *misc = dev_get_drvdata(dev);
+
+	return container_of(misc, struct logger_log, misc);
+}
+
+static ssize_t dropped_entries_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n",
+		       atomic_long_read(&dev_get_log(dev)->dropped));
+}
+
+static ssize_t overwritten_entries_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return sprintf(buf, "%lu\n",
+		       atomic_long_read(&dev_get_log(dev)->overwritten));
+}
+
+static DEVICE_ATTR(dropped_entries, S_IRUGO, dropped_entries_show, NULL);
+static DEVICE_ATTR(overwritten_entries, S_IRUGO, overwritten_entries_show,
+		   NULL);
+
+static struct attribute *logger_attrs[] = {
+	&dev_attr_dropped_entries.attr,
+	&dev_attr_overwritten_entries.attr,
+	NULL,
+};
+
+static struct attribute_group logger_attr_group = {
+	.attrs = logger_attrs,
+};
+
 static int init_log(struct logger_log *log)
 {
+	struct logger_mmap_header *header;
 	int ret;
 
 	ret = misc_register(&log->misc);
@@ -720,6 +1288,29 @@ static int init_log(struct logger_log *log)
 		return ret;
 	}
 
+	/* the log can still be read() without the mmap header */
+	header = (void *)get_zeroed_page(GFP_KERNEL);
+	if (header) {
+		header->version = LOGGER_MMAP_VERSION;
+		header->size = log->size;
+		header->data_offset = PAGE_SIZE;
+		/* writers may already be publishing to it */
+		smp_wmb();
+		log->mmap_header = header;
+		smp_mb();
+		logger_publish_head(log, logger_head_pos(log));
+		logger_publish_tail(log, logger_tail_pos(log));
+	} else {
+		printk(KERN_ERR "logger: failed to allocate mmap "
+		       "header for log '%s'\n", log->misc.name);
+	}
+
+	/* the counters are informational, carry on without them */
+	if (sysfs_create_group(&log->misc.this_device->kobj,
+			       &logger_attr_group))
+		printk(KERN_ERR "logger: failed to create sysfs "
+		       "counters for log '%s'\n", log->misc.name);
+
 	printk(KERN_INFO "logger: created %luK log '%s'\n",
 	       (unsigned long) log->size >> 10, log->misc.name);
 
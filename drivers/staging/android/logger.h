@@ -18,25 +18,48 @@
 #define _LINUX_LOGGER_H
 
 #include <linux/types.h>
+#include <linux/atomic.h>
 #include <linux/miscdevice.h>
 #include <linux/ioctl.h>
 
+#define LOGGER_WRITES_MAX	32
+
+/*
+ * struct logger_commit - a slot for a write in flight, see logger_reserve()
+ */
+struct logger_commit {
+	atomic_t		state;	/* generation and LOGGER_COMMIT_* */
+	__u32			start;	/* position of the write */
+	__u32			end;	/* position following it */
+};
+
 /*
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting. Writers do not take any lock, see
+ * logger_reserve() and logger_commit(). Readers are serialized by the mutex
+ * 'mutex', which also protects 'readers' and 'wake_batch'.
+ *
+ * Positions count bytes since the log was created, modulo 2^32, like those in
+ * struct logger_mmap_header; the byte at position 'pos' is at offset
+ * 'logger_offset(pos)'.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
-	size_t			head;	/* new readers start here */
+	struct mutex		mutex;	/* mutex serializing readers */
+	atomic64_t		reserve; /* write head and oldest entry pos */
+	__u32			c_pos;	/* readers may read up to here */
+	struct logger_commit	commits[LOGGER_WRITES_MAX]; /* writes in flight */
 	size_t			size;	/* size of the log */
+	atomic_long_t		dropped; /* entries not written, log full */
+	atomic_long_t		overwritten; /* entries overwritten by newer ones */
+	struct logger_mmap_header *mmap_header; /* shared with mmap readers */
+	size_t			wake_batch; /* smallest reader wake threshold */
+	atomic_t		wake_pending; /* bytes written since last wake */
 #ifdef CONFIG_ANDROID_LOGGER_PTI
 	bool			ptienable;
 	struct pti_reader	*pti_reader;
@@ -52,9 +75,32 @@ struct logger_log {
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
 	struct list_head	list;	/* entry in logger_log's list */
-	size_t			r_off;	/* current read head offset */
+	__u32			r_pos;	/* current read head position */
+	size_t			wake_threshold; /* bytes pending before POLLIN */
+	bool			mapped;	/* reads through mmap, not read() */
+	__u32			poll_pos; /* tail_pos when POLLIN last seen */
 };
 
+/*
+ * struct logger_mmap_header - first page of an mmap of a log device
+ *
+ * The ring buffer follows at 'data_offset'. Positions count bytes since the
+ * log was created, modulo 2^32, and the byte at position 'pos' is at ring
+ * offset 'pos & (size - 1)'. Entries between 'head_pos' and 'tail_pos' are
+ * complete. Writers move 'head_pos' before they overwrite anything, so a
+ * reader that copied an entry starting at 'pos' must re-read 'head_pos'
+ * afterwards and drop the entry if '(__s32)(head_pos - pos) > 0'.
+ */
+struct logger_mmap_header {
+	__u32		version;	/* LOGGER_MMAP_VERSION */
+	__u32		size;		/* size of the ring buffer */
+	__u32		data_offset;	/* offset of the ring buffer */
+	__u32		head_pos;	/* position of the oldest entry */
+	__u32		tail_pos;	/* position after the newest entry */
+};
+
+#define LOGGER_MMAP_VERSION	1
+
 struct logger_entry {
 	__u16		len;	/* length of the payload */
 	__u16		__pad;	/* no matter what, we get 2 bytes of padding */
@@ -65,11 +111,17 @@ struct logger_entry {
 	char		msg[0];	/* the entry's payload */
 };
 
-void do_read_log(struct logger_log *log,
+int do_read_log(struct logger_log *log,
 			struct logger_reader *reader,
 			char *buf,
 			size_t count);
 __u32 get_entry_len(struct logger_log *log, size_t off);
+__u32 get_next_entry_len(struct logger_log *log,
+			 struct logger_reader *reader);
+size_t get_log_head(struct logger_log *log);
+size_t get_log_tail(struct logger_log *log);
+void logger_restore_begin(struct logger_log *log);
+void logger_restore_end(struct logger_log *log, size_t head, size_t tail);
 struct logger_log *get_log_from_minor(int minor);
 struct logger_log **get_log_list(void);
 
@@ -95,5 +147,6 @@ struct logger_log **get_log_list(void);
 #define LOGGER_GET_LOG_LEN		_IO(__LOGGERIO, 2) /* used log len */
 #define LOGGER_GET_NEXT_ENTRY_LEN	_IO(__LOGGERIO, 3) /* next entry len */
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
+#define LOGGER_SET_WAKE_THRESHOLD	_IO(__LOGGERIO, 5) /* poll batching */
 
 #endif /* _LINUX_LOGGER_H */
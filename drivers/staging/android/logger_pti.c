@@ -76,7 +76,7 @@ int init_pti(struct logger_log *log)
 	}
 
 	pti_reader->reader = reader;
-	reader->r_off = log->w_off;
+	reader->r_pos = log->c_pos;
 	mutex_lock(&log->mutex);
 	log->pti_reader = pti_reader;
 	mutex_unlock(&log->mutex);
@@ -126,18 +126,20 @@ void log_write_to_pti(struct logger_log *log)
 
 	reader = pti_reader->reader;
 
-	/* get the size of the next entry */
-	count = get_entry_len(log, reader->r_off);
-
-	if (log->ptienable) {
-		/* copy exactly one entry from the log */
-		do_read_log(log, reader, pti_reader->entry->buf, count);
-
-		pti_writedata(pti_reader->mc,
-				pti_reader->entry->entry.msg,
-				pti_reader->entry->entry.len);
-	} else {
-		reader->r_off = logger_offset(reader->r_off + count);
+	/* several entries may have become readable at once */
+	while ((count = get_next_entry_len(log, reader))) {
+		if (log->ptienable) {
+			/* copy exactly one entry, unless it was overwritten */
+			if (do_read_log(log, reader, pti_reader->entry->buf,
+					count))
+				continue;
+
+			pti_writedata(pti_reader->mc,
+					pti_reader->entry->entry.msg,
+					pti_reader->entry->entry.len);
+		} else {
+			reader->r_pos += count;
+		}
 	}
 }
 
@@ -16,6 +16,15 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * With /sys/module/lowmemorykiller/parameters/pressure_mode set, the kill
+ * level is chosen from reclaim pressure instead of free memory: the share of
+ * pages the VM scanned without reclaiming them over the last pressure_window
+ * scanned pages, in percent. Processes with an oom_adj of adj[i] or higher
+ * are killed once the pressure reaches pressure[i]. The swapfree thresholds
+ * apply in both modes. The current pressure and its level (none, low, medium
+ * or critical) are in /sys/kernel/mm/lowmemorykiller/, and pressure_level can
+ * be poll()ed for level changes.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -36,6 +45,12 @@
 #include <linux/sched.h>
 #include <linux/notifier.h>
 #include <linux/swap.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/vmstat.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/lowmemorykiller.h>
 
 static uint32_t lowmem_debug_level = 2;
 static int lowmem_adj[6] = {
@@ -61,6 +76,15 @@ static size_t lowmem_swapfree[6] = {
 	10 * 1024,	/* 40MB */
 };
 static int lowmem_swapfree_size = 6;
+static int lowmem_pressure_mode;
+static int lowmem_pressure[6] = {
+	100,
+	98,
+	95,
+	90,
+};
+static int lowmem_pressure_size = 4;
+static unsigned long lowmem_pressure_window = SWAP_CLUSTER_MAX * 16;
 
 struct task_struct *lowmem_deathpending;
 static unsigned long lowmem_deathpending_timeout;
@@ -71,6 +95,190 @@ static unsigned long lowmem_deathpending_timeout;
 			printk(x);			\
 	} while (0)
 
+/*
+ * Processes by oom_adj, so that victims can be picked from the highest
+ * populated bucket without walking every task. Protected by tasklist_lock.
+ */
+static struct hlist_head lowmem_adj_index[OOM_ADJUST_MAX - OOM_DISABLE + 1];
+
+static struct hlist_head *lowmem_adj_bucket(int oom_adj)
+{
+	oom_adj = clamp(oom_adj, OOM_DISABLE, OOM_ADJUST_MAX);
+	return &lowmem_adj_index[oom_adj - OOM_DISABLE];
+}
+
+void lowmem_adj_index_add(struct task_struct *p)
+{
+	hlist_add_head(&p->lowmem_adj_node,
+		       lowmem_adj_bucket(p->signal->oom_adj));
+}
+
+void lowmem_adj_index_del(struct task_struct *p)
+{
+	if (!hlist_unhashed(&p->lowmem_adj_node))
+		hlist_del_init(&p->lowmem_adj_node);
+}
+
+/* a non-leader thread exec()ed and took over the process */
+void lowmem_adj_index_replace(struct task_struct *old, struct task_struct *new)
+{
+	if (hlist_unhashed(&old->lowmem_adj_node))
+		return;
+	hlist_del_init(&old->lowmem_adj_node);
+	lowmem_adj_index_add(new);
+}
+
+/* oom_adj of p's process changed, called without tasklist_lock */
+void lowmem_adj_index_update(struct task_struct *p)
+{
+	write_lock_irq(&tasklist_lock);
+	if (pid_alive(p)) {
+		p = p->group_leader;
+		if (!hlist_unhashed(&p->lowmem_adj_node)) {
+			hlist_del(&p->lowmem_adj_node);
+			lowmem_adj_index_add(p);
+		}
+	}
+	write_unlock_irq(&tasklist_lock);
+}
+
+enum lowmem_pressure_level {
+	LOWMEM_PRESSURE_NONE,
+	LOWMEM_PRESSURE_LOW,
+	LOWMEM_PRESSURE_MEDIUM,
+	LOWMEM_PRESSURE_CRITICAL,
+};
+
+static const char * const lowmem_pressure_names[] = {
+	"none",
+	"low",
+	"medium",
+	"critical",
+};
+
+/* same split as the memcg vmpressure levels */
+#define LOWMEM_PRESSURE_MEDIUM_PCT	60
+#define LOWMEM_PRESSURE_CRITICAL_PCT	95
+
+static DEFINE_SPINLOCK(lowmem_pressure_lock);
+static unsigned long lowmem_last_scanned;
+static unsigned long lowmem_last_reclaimed;
+static unsigned long lowmem_pressure_stamp;
+static int lowmem_pressure_pct;
+static enum lowmem_pressure_level lowmem_pressure_level;
+static struct kobject *lowmem_kobj;
+static struct sysfs_dirent *lowmem_level_sd;
+
+/*
+ * Pages scanned and reclaimed by kswapd and direct reclaim so far. Summed
+ * without the cpu hotplug lock, the counters only need to be roughly right.
+ */
+static void lowmem_reclaim_events(unsigned long *scanned,
+				  unsigned long *reclaimed)
+{
+#ifdef CONFIG_VM_EVENT_COUNTERS
+	int cpu, item;
+
+	*scanned = 0;
+	*reclaimed = 0;
+	for_each_online_cpu(cpu) {
+		struct vm_event_state *this = &per_cpu(vm_event_states, cpu);
+
+		for (item = PGREFILL_MOVABLE + 1; item <= PGSTEAL_MOVABLE;
+		     item++)
+			*reclaimed += this->event[item];
+		for (item = PGSTEAL_MOVABLE + 1; item <= PGSCAN_DIRECT_MOVABLE;
+		     item++)
+			*scanned += this->event[item];
+	}
+#else
+	*scanned = 0;
+	*reclaimed = 0;
+#endif
+}
+
+/* pressure is stale when reclaim did not scan a window in a second */
+static bool lowmem_pressure_stale(void)
+{
+	return time_after(jiffies, lowmem_pressure_stamp + HZ);
+}
+
+/*
+ * lowmem_update_pressure - closes the current window if enough pages were
+ * scanned since it was opened and returns the reclaim pressure in percent.
+ */
+static int lowmem_update_pressure(void)
+{
+	unsigned long scanned, reclaimed;
+	enum lowmem_pressure_level level;
+	bool changed;
+	int pct;
+
+	lowmem_reclaim_events(&scanned, &reclaimed);
+
+	spin_lock(&lowmem_pressure_lock);
+	scanned -= lowmem_last_scanned;
+	reclaimed -= lowmem_last_reclaimed;
+	if (scanned >= lowmem_pressure_window) {
+		reclaimed = min(reclaimed, scanned);
+		lowmem_pressure_pct = 100 - reclaimed * 100 / scanned;
+		lowmem_last_scanned += scanned;
+		lowmem_last_reclaimed += reclaimed;
+		lowmem_pressure_stamp = jiffies;
+	} else if (lowmem_pressure_stale()) {
+		lowmem_pressure_pct = 0;
+	}
+	pct = lowmem_pressure_pct;
+
+	if (pct >= LOWMEM_PRESSURE_CRITICAL_PCT)
+		level = LOWMEM_PRESSURE_CRITICAL;
+	else if (pct >= LOWMEM_PRESSURE_MEDIUM_PCT)
+		level = LOWMEM_PRESSURE_MEDIUM;
+	else if (!lowmem_pressure_stale())
+		level = LOWMEM_PRESSURE_LOW;
+	else
+		level = LOWMEM_PRESSURE_NONE;
+	changed = level != lowmem_pressure_level;
+	lowmem_pressure_level = level;
+	spin_unlock(&lowmem_pressure_lock);
+
+	if (changed && lowmem_level_sd)
+		sysfs_notify_dirent(lowmem_level_sd);
+
+	return pct;
+}
+
+static ssize_t pressure_show(struct kobject *kobj,
+			     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n",
+		       lowmem_pressure_stale() ? 0 : lowmem_pressure_pct);
+}
+
+static ssize_t pressure_level_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	enum lowmem_pressure_level level = lowmem_pressure_level;
+
+	/* nothing calls us to notice that reclaim stopped */
+	if (lowmem_pressure_stale())
+		level = LOWMEM_PRESSURE_NONE;
+	return sprintf(buf, "%s\n", lowmem_pressure_names[level]);
+}
+
+static struct kobj_attribute pressure_attr = __ATTR_RO(pressure);
+static struct kobj_attribute pressure_level_attr = __ATTR_RO(pressure_level);
+
+static struct attribute *lowmem_attrs[] = {
+	&pressure_attr.attr,
+	&pressure_level_attr.attr,
+	NULL,
+};
+
+static struct attribute_group lowmem_attr_group = {
+	.attrs = lowmem_attrs,
+};
+
 static int
 task_notify_func(struct notifier_block *self, unsigned long val, void *data);
 
@@ -92,10 +300,14 @@ task_notify_func(struct notifier_block *self, unsigned long val, void *data)
 static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 {
 	struct task_struct *p;
+	struct hlist_node *node;
 	struct task_struct *selected = NULL;
 	int rem = 0;
 	int tasksize;
 	int i;
+	int adj;
+	int scanned = 0;
+	u64 start;
 	int min_adj = OOM_ADJUST_MAX + 1;
 	int selected_tasksize = 0;
 	int selected_oom_adj;
@@ -103,6 +315,7 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	int other_free = global_page_state(NR_FREE_PAGES);
 	int other_file = global_page_state(NR_FILE_PAGES) -
 						global_page_state(NR_SHMEM);
+	int pressure = lowmem_update_pressure();
 
 	/*
 	 * If we already have a death outstanding, then
@@ -117,20 +330,30 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 
 	if (lowmem_adj_size < array_size)
 		array_size = lowmem_adj_size;
-	if (lowmem_minfree_size < array_size)
+	if (lowmem_pressure_mode) {
+		if (lowmem_pressure_size < array_size)
+			array_size = lowmem_pressure_size;
+	} else if (lowmem_minfree_size < array_size)
 		array_size = lowmem_minfree_size;
 	for (i = 0; i < array_size; i++) {
-		if ((other_free < lowmem_minfree[i] &&
-		    other_file < lowmem_minfree[i]) ||
+		bool low;
+
+		if (lowmem_pressure_mode)
+			low = pressure >= lowmem_pressure[i];
+		else
+			low = other_free < lowmem_minfree[i] &&
+			      other_file < lowmem_minfree[i];
+		if (low ||
 		    (total_swap_pages ? nr_swap_pages < lowmem_swapfree[i] : 0)) {
 			min_adj = lowmem_adj[i];
 			break;
 		}
 	}
 	if (sc->nr_to_scan > 0)
-		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, ma %d\n",
+		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, "
+			     "pressure %d, ma %d\n",
 			     sc->nr_to_scan, sc->gfp_mask, other_free, other_file,
-			     min_adj);
+			     pressure, min_adj);
 	rem = global_page_state(NR_ACTIVE_ANON) +
 		global_page_state(NR_ACTIVE_FILE) +
 		global_page_state(NR_INACTIVE_ANON) +
@@ -142,41 +365,56 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	}
 	selected_oom_adj = min_adj;
 
+	start = local_clock();
 	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
-
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
+	/*
+	 * Only the highest bucket with a killable process matters. A
+	 * process whose oom_adj was just changed may still sit in its old
+	 * bucket, so its current oom_adj is what gets compared.
+	 */
+	for (adj = OOM_ADJUST_MAX; adj >= max(min_adj, OOM_DISABLE) && !selected;
+	     adj--) {
+		hlist_for_each_entry(p, node, lowmem_adj_bucket(adj),
+				     lowmem_adj_node) {
+			struct mm_struct *mm;
+			struct signal_struct *sig;
+			int oom_adj;
+
+			scanned++;
+			task_lock(p);
+			mm = p->mm;
+			sig = p->signal;
+			if (!mm || !sig) {
+				task_unlock(p);
 				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
+			}
+			oom_adj = sig->oom_adj;
+			if (oom_adj < min_adj) {
+				task_unlock(p);
 				continue;
+			}
+			tasksize = get_mm_rss(mm);
+			task_unlock(p);
+			if (tasksize <= 0)
+				continue;
+			if (selected) {
+				if (oom_adj < selected_oom_adj)
+					continue;
+				if (oom_adj == selected_oom_adj &&
+				    tasksize <= selected_tasksize)
+					continue;
+			}
+			selected = p;
+			selected_tasksize = tasksize;
+			selected_oom_adj = oom_adj;
+			lowmem_print(2, "select %d (%s), adj %d, size %d, "
+				     "to kill\n",
+				     p->pid, p->comm, oom_adj, tasksize);
 		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
 	}
+	trace_lowmem_select(min_adj, selected ? selected_oom_adj : -1,
+			    selected ? selected->pid : 0, selected_tasksize,
+			    scanned, local_clock() - start);
 	if (selected) {
 		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
 			     selected->pid, selected->comm,
@@ -199,8 +437,24 @@ static struct shrinker lowmem_shrinker = {
 
 static int __init lowmem_init(void)
 {
+	lowmem_reclaim_events(&lowmem_last_scanned, &lowmem_last_reclaimed);
+	lowmem_pressure_stamp = jiffies - HZ - 1;
+
 	task_free_register(&task_nb);
 	register_shrinker(&lowmem_shrinker);
+
+	/* the pressure files are informational, carry on without them */
+	lowmem_kobj = kobject_create_and_add("lowmemorykiller", mm_kobj);
+	if (lowmem_kobj) {
+		if (sysfs_create_group(lowmem_kobj, &lowmem_attr_group)) {
+			kobject_put(lowmem_kobj);
+			lowmem_kobj = NULL;
+		} else {
+			lowmem_level_sd = sysfs_get_dirent(lowmem_kobj->sd,
+							   NULL,
+							   "pressure_level");
+		}
+	}
 	return 0;
 }
 
@@ -208,6 +462,10 @@ static void __exit lowmem_exit(void)
 {
 	unregister_shrinker(&lowmem_shrinker);
 	task_free_unregister(&task_nb);
+	if (lowmem_level_sd)
+		sysfs_put(lowmem_level_sd);
+	if (lowmem_kobj)
+		kobject_put(lowmem_kobj);
 }
 
 module_param_named(cost, lowmem_shrinker.seeks, int, S_IRUGO | S_IWUSR);
@@ -217,6 +475,11 @@ module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_array_named(swapfree, lowmem_swapfree, uint, &lowmem_swapfree_size,
 			 S_IRUGO | S_IWUSR);
+module_param_named(pressure_mode, lowmem_pressure_mode, int, S_IRUGO | S_IWUSR);
+module_param_array_named(pressure, lowmem_pressure, int, &lowmem_pressure_size,
+			 S_IRUGO | S_IWUSR);
+module_param_named(pressure_window, lowmem_pressure_window, ulong,
+		   S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
 
 module_init(lowmem_init);
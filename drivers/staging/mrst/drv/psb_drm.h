@@ -276,7 +276,8 @@ typedef enum {
 	IMG_VIDEO_SET_HDMI_STATE,
 	PNW_VIDEO_QUERY_ENTRY,
 	IMG_DISPLAY_SET_WIDI_EXT_STATE,
-	IMG_VIDEO_IED_STATE
+	IMG_VIDEO_IED_STATE,
+	IMG_VIDEO_SET_PRIORITY
 } lnc_getparam_key_t;
 
 struct drm_lnc_video_getparam_arg {
@@ -285,6 +286,18 @@ struct drm_lnc_video_getparam_arg {
 	uint64_t value;	/* feed back pointer */
 };
 
+/* MSVDX scheduling classes of a decode context, most urgent first */
+#define PSB_VIDEO_PRIORITY_REALTIME	0
+#define PSB_VIDEO_PRIORITY_NORMAL	1
+#define PSB_VIDEO_PRIORITY_BACKGROUND	2
+#define PSB_VIDEO_PRIORITY_NUM		3
+
+/* IMG_VIDEO_SET_PRIORITY argument */
+struct drm_video_priority_arg {
+	uint32_t priority;
+	uint32_t frame_period_us; /* 0 when frames have no deadline */
+};
+
 struct drm_video_displaying_frameinfo {
 	uint32_t buf_handle;
 	uint32_t width;
@@ -3772,6 +3772,21 @@ static const struct file_operations psb_blc_proc_fops = {
 	.release	= single_release,
 };
 
+#ifdef CONFIG_MDFD_VIDEO_DECODE
+static int psb_msvdx_sched_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, psb_msvdx_sched_show, PDE(inode)->data);
+}
+
+static const struct file_operations psb_msvdx_sched_proc_fops = {
+	.owner		= THIS_MODULE,
+	.open		= psb_msvdx_sched_proc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
+
 static int psb_rtpm_read(char *buf, char **start, off_t offset, int request,
 			 int *eof, void *data)
 {
@@ -4131,6 +4146,11 @@ static int psb_proc_init(struct drm_minor *minor)
 	ent_display_status->write_proc = psb_display_register_write;
 	ent_display_status->read_proc = psb_display_register_read;
 	ent_display_status->data = (void *)minor;
+#ifdef CONFIG_MDFD_VIDEO_DECODE
+	if (!proc_create_data(MSVDX_SCHED_PROC_ENTRY, 0, minor->proc_root,
+			      &psb_msvdx_sched_proc_fops, minor))
+		return -1;
+#endif
 	return 0;
 }
 
@@ -4139,6 +4159,9 @@ static void psb_proc_cleanup(struct drm_minor *minor)
 	remove_proc_entry(OSPM_PROC_ENTRY, minor->proc_root);
 	remove_proc_entry(RTPM_PROC_ENTRY, minor->proc_root);
 	remove_proc_entry(BLC_PROC_ENTRY, minor->proc_root);
+#ifdef CONFIG_MDFD_VIDEO_DECODE
+	remove_proc_entry(MSVDX_SCHED_PROC_ENTRY, minor->proc_root);
+#endif
 	return;
 }
 
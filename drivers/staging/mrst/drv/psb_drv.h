@@ -121,6 +121,7 @@ enum panel_type {
 #define RTPM_PROC_ENTRY "rtpm"
 #define BLC_PROC_ENTRY "mrst_blc"
 #define DISPLAY_PROC_ENTRY "display_status"
+#define MSVDX_SCHED_PROC_ENTRY "msvdx_sched"
 
 #define PSB_DRM_DRIVER_DATE "2009-03-10"
 #define PSB_DRM_DRIVER_MAJOR 8
@@ -387,6 +388,10 @@ struct psb_msvdx_cmd_queue {
 	void *cmd;
 	unsigned long cmd_size;
 	uint32_t sequence;
+	struct psb_video_ctx *ctx; /* NULL once the context is removed */
+	int priority;
+	u64 queue_ns;
+	u64 deadline_ns;
 };
 
 
@@ -421,11 +426,28 @@ enum VAEntrypoint {
 
 #define VA_RT_FORMAT_PROTECTED	0x80000000
 
+struct psb_video_ctx_stats {
+	uint32_t submitted;
+	uint32_t completed;
+	uint32_t deadline_misses;
+	u64 queue_ns;
+	u64 max_queue_ns;
+	u64 decode_ns;
+	u64 max_decode_ns;
+};
+
 struct psb_video_ctx {
 	struct list_head head;
 	struct file *filp; /* DRM device file pointer */
 	int ctx_type; /* protect_flag | (profile<<8) & 0xff |entrypoint */
-	/* todo: more context specific data for multi-context support */
+
+	/* MSVDX scheduling, protected by msvdx_lock */
+	int priority;
+	uint32_t frame_period_us;
+	uint32_t queued;
+	int last_priority;
+	u64 last_deadline_ns;
+	struct psb_video_ctx_stats stats;
 };
 
 typedef int (*pfn_vsync_handler)(struct drm_device* dev, int pipe);
@@ -1305,6 +1327,9 @@ extern int psb_fence_emit_sequence(struct ttm_fence_device *fdev,
 extern void psb_fence_error(struct drm_device *dev,
 			    uint32_t class,
 			    uint32_t sequence, uint32_t type, int error);
+extern void psb_fence_signal_sequence(struct drm_device *dev,
+				      uint32_t class, uint32_t sequence,
+				      uint32_t type, int error);
 extern int psb_ttm_fence_device_init(struct ttm_fence_device *fdev);
 
 /* MSVDX/Topaz stuff */
@@ -76,6 +76,8 @@ void psb_msvdx_flush_cmd_queue(struct drm_device *dev)
 		list_del(list);
 		PSB_DEBUG_GENERAL("MSVDXQUE: flushing sequence:0x%08x\n",
 				  msvdx_cmd->sequence);
+		if (msvdx_cmd->ctx)
+			msvdx_cmd->ctx->queued--;
 		msvdx_priv->msvdx_current_sequence = msvdx_cmd->sequence;
 		psb_fence_error(dev, PSB_ENGINE_VIDEO,
 				msvdx_cmd->sequence,
@@ -94,6 +96,7 @@ static void psb_msvdx_reset_wq(struct work_struct *work)
 
 	struct psb_scheduler *scheduler = &dev_priv->scheduler;
 	unsigned long irq_flags;
+	uint32_t sequence;
 
 	mutex_lock(&msvdx_priv->msvdx_mutex);
 	if (IS_D0(dev_priv->dev))
@@ -101,14 +104,14 @@ static void psb_msvdx_reset_wq(struct work_struct *work)
 			MSVDX_RESET_NEEDS_INIT_FW;
 	else
 		msvdx_priv->msvdx_needs_reset = 1;
-	msvdx_priv->msvdx_current_sequence++;
-	PSB_DEBUG_GENERAL
-	("MSVDXFENCE: incremented msvdx_current_sequence to :%d\n",
-	 msvdx_priv->msvdx_current_sequence);
-
-	psb_fence_error(scheduler->dev, PSB_ENGINE_VIDEO,
-			msvdx_priv->msvdx_current_sequence,
-			_PSB_FENCE_TYPE_EXE, DRM_CMD_HANG);
+	/* the hung command is the oldest one, unless it overtook the queue */
+	if (msvdx_priv->msvdx_sent_ooo)
+		sequence = msvdx_priv->msvdx_sent_sequence;
+	else
+		sequence = msvdx_priv->msvdx_current_sequence + 1;
+	PSB_DEBUG_GENERAL("MSVDXFENCE: failing sequence :%d\n", sequence);
+
+	psb_msvdx_fence_error(scheduler->dev, sequence, DRM_CMD_HANG);
 
 	spin_lock_irqsave(&dev_priv->watchdog_lock, irq_flags);
 	dev_priv->timer_available = 1;
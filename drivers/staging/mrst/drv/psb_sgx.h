@@ -25,7 +25,8 @@ extern int psb_submit_video_cmdbuf(struct drm_device *dev,
 				   struct ttm_buffer_object *cmd_buffer,
 				   unsigned long cmd_offset,
 				   unsigned long cmd_size,
-				   struct ttm_fence_object *fence);
+				   struct ttm_fence_object *fence,
+				   struct psb_video_ctx *video_ctx);
 
 extern int drm_idle_check_interval;
 
@@ -75,6 +75,22 @@ void psb_fence_error(struct drm_device *dev,
 	write_unlock_irqrestore(&fc->lock, irq_flags);
 }
 
+void psb_fence_signal_sequence(struct drm_device *dev,
+			       uint32_t fence_class,
+			       uint32_t sequence, uint32_t type, int error)
+{
+	struct drm_psb_private *dev_priv = psb_priv(dev);
+	struct ttm_fence_device *fdev = &dev_priv->fdev;
+	unsigned long irq_flags;
+	struct ttm_fence_class_manager *fc =
+				&fdev->fence_class[fence_class];
+
+	BUG_ON(fence_class >= PSB_NUM_ENGINES);
+	write_lock_irqsave(&fc->lock, irq_flags);
+	ttm_fence_signal_sequence(fdev, fence_class, sequence, type, error);
+	write_unlock_irqrestore(&fc->lock, irq_flags);
+}
+
 int psb_fence_emit_sequence(struct ttm_fence_device *fdev,
 			    uint32_t fence_class,
 			    uint32_t flags, uint32_t *sequence,
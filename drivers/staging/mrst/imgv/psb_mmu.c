@@ -64,8 +64,7 @@ struct psb_mmu_driver {
 	struct psb_mmu_pd *default_pd;
 	/*uint32_t bif_ctrl;*/
 	int has_clflush;
-	int clflush_add;
-	unsigned long clflush_mask;
+	unsigned long clflush_size;
 
 	struct drm_psb_private *dev_priv;
 };
@@ -119,21 +118,29 @@ static inline void psb_mmu_clflush(struct psb_mmu_driver *driver,
 	mb();
 }
 
-static void psb_page_clflush(struct psb_mmu_driver *driver, struct page* page)
+/*
+ * Flush every cache line overlapping [start, end), fenced once for the
+ * whole range.
+ */
+static void psb_clflush_range(struct psb_mmu_driver *driver,
+			      void *start, void *end)
 {
-	uint32_t clflush_add = driver->clflush_add >> PAGE_SHIFT;
-	uint32_t clflush_count = PAGE_SIZE / clflush_add;
-	int i;
-	uint8_t *clf;
+	uint8_t *clf = (uint8_t *)
+		((unsigned long) start & ~(driver->clflush_size - 1));
 
-	clf = kmap_atomic(page, KM_USER0);
 	mb();
-	for (i = 0; i < clflush_count; ++i) {
+	for (; clf < (uint8_t *) end; clf += driver->clflush_size)
 		psb_clflush(clf);
-		clf += clflush_add;
-	}
 	mb();
-	kunmap_atomic(clf, KM_USER0);
+}
+
+static void psb_page_clflush(struct psb_mmu_driver *driver, struct page* page)
+{
+	uint8_t *v;
+
+	v = kmap_atomic(page, KM_USER0);
+	psb_clflush_range(driver, v, v + PAGE_SIZE);
+	kunmap_atomic(v, KM_USER0);
 }
 
 static void psb_pages_clflush(struct psb_mmu_driver *driver, struct page *page[], unsigned long num_pages)
@@ -339,10 +346,7 @@ void psb_mmu_free_pagedir(struct psb_mmu_pd *pd)
 static struct psb_mmu_pt *psb_mmu_alloc_pt(struct psb_mmu_pd *pd) {
 	struct psb_mmu_pt *pt = kmalloc(sizeof(*pt), GFP_KERNEL);
 	void *v;
-	uint32_t clflush_add = pd->driver->clflush_add >> PAGE_SHIFT;
-	uint32_t clflush_count = PAGE_SIZE / clflush_add;
 	spinlock_t *lock = &pd->driver->lock;
-	uint8_t *clf;
 	uint32_t *ptes;
 	int i;
 
@@ -358,21 +362,14 @@ static struct psb_mmu_pt *psb_mmu_alloc_pt(struct psb_mmu_pd *pd) {
 	spin_lock(lock);
 
 	v = kmap_atomic(pt->p, KM_USER0);
-	clf = (uint8_t *) v;
 	ptes = (uint32_t *) v;
 	for (i = 0; i < (PAGE_SIZE / sizeof(uint32_t)); ++i)
 		*ptes++ = pd->invalid_pte;
 
 
 #if defined(CONFIG_X86)
-	if (pd->driver->has_clflush && pd->hw_context != -1) {
-		mb();
-		for (i = 0; i < clflush_count; ++i) {
-			psb_clflush(clf);
-			clf += clflush_add;
-		}
-		mb();
-	}
+	if (pd->driver->has_clflush && pd->hw_context != -1)
+		psb_clflush_range(pd->driver, v, (uint8_t *) v + PAGE_SIZE);
 #endif
 	kunmap_atomic(v, KM_USER0);
 	spin_unlock(lock);
@@ -475,6 +472,26 @@ static inline void psb_mmu_invalidate_pte(struct psb_mmu_pt *pt,
 	pt->v[psb_mmu_pt_index(addr)] = pt->pd->invalid_pte;
 }
 
+/*
+ * Write back the PTEs for [addr, end) of a mapped page table. Callers
+ * update the whole run first so that each cache line is flushed once,
+ * while the table is still mapped, instead of walking the tables again
+ * afterwards.
+ */
+static void psb_mmu_flush_pt_range(struct psb_mmu_pt *pt,
+				   unsigned long addr, unsigned long end)
+{
+#if defined(CONFIG_X86)
+	struct psb_mmu_pd *pd = pt->pd;
+
+	if (!pd->driver->has_clflush || pd->hw_context == -1 || addr >= end)
+		return;
+
+	psb_clflush_range(pd->driver, &pt->v[psb_mmu_pt_index(addr)],
+			  &pt->v[psb_mmu_pt_index(end - 1)] + 1);
+#endif
+}
+
 #if 0
 static uint32_t psb_mmu_check_pte_locked(struct psb_mmu_pd *pd,
 		uint32_t mmu_offset)
@@ -631,10 +648,7 @@ struct psb_mmu_driver *psb_mmu_driver_init(uint8_t __iomem * registers,
 		cpuid(0x00000001, &tfms, &misc, &cap0, &cap4);
 		clflush_size = ((misc >> 8) & 0xff) * 8;
 		driver->has_clflush = 1;
-		driver->clflush_add =
-			PAGE_SIZE * clflush_size / sizeof(uint32_t);
-		driver->clflush_mask = driver->clflush_add - 1;
-		driver->clflush_mask = ~driver->clflush_mask;
+		driver->clflush_size = clflush_size;
 	}
 #endif
 
@@ -646,70 +660,6 @@ out_err1:
 	return NULL;
 }
 
-#if defined(CONFIG_X86)
-static void psb_mmu_flush_ptes(struct psb_mmu_pd *pd,
-			       unsigned long address, uint32_t num_pages,
-			       uint32_t desired_tile_stride,
-			       uint32_t hw_tile_stride)
-{
-	struct psb_mmu_pt *pt;
-	uint32_t rows = 1;
-	uint32_t i;
-	unsigned long addr;
-	unsigned long end;
-	unsigned long next;
-	unsigned long add;
-	unsigned long row_add;
-	unsigned long clflush_add = pd->driver->clflush_add;
-	unsigned long clflush_mask = pd->driver->clflush_mask;
-
-	if (!pd->driver->has_clflush) {
-		/*ttm_tt_cache_flush(&pd->p, num_pages);*/
-		psb_pages_clflush(pd->driver, &pd->p, num_pages);
-		return;
-	}
-
-	if (hw_tile_stride)
-		rows = num_pages / desired_tile_stride;
-	else
-		desired_tile_stride = num_pages;
-
-	add = desired_tile_stride << PAGE_SHIFT;
-	row_add = hw_tile_stride << PAGE_SHIFT;
-	mb();
-	for (i = 0; i < rows; ++i) {
-
-		addr = address;
-		end = addr + add;
-
-		do {
-			next = psb_pd_addr_end(addr, end);
-			pt = psb_mmu_pt_map_lock(pd, addr);
-			if (!pt)
-				continue;
-			do {
-				psb_clflush(&pt->v
-					    [psb_mmu_pt_index(addr)]);
-			} while (addr +=
-					 clflush_add,
-				 (addr & clflush_mask) < next);
-
-			psb_mmu_pt_unmap_unlock(pt);
-		} while (addr = next, next != end);
-		address += row_add;
-	}
-	mb();
-}
-#else
-static void psb_mmu_flush_ptes(struct psb_mmu_pd *pd,
-			       unsigned long address, uint32_t num_pages,
-			       uint32_t desired_tile_stride,
-			       uint32_t hw_tile_stride)
-{
-	drm_ttm_cache_flush(&pd->p, num_pages);
-}
-#endif
-
 void psb_mmu_remove_pfn_sequence(struct psb_mmu_pd *pd,
 				 unsigned long address, uint32_t num_pages)
 {
@@ -717,7 +667,7 @@ void psb_mmu_remove_pfn_sequence(struct psb_mmu_pd *pd,
 	unsigned long addr;
 	unsigned long end;
 	unsigned long next;
-	unsigned long f_address = address;
+	unsigned long start;
 
 	down_read(&pd->driver->sem);
 
@@ -729,18 +679,18 @@ void psb_mmu_remove_pfn_sequence(struct psb_mmu_pd *pd,
 		pt = psb_mmu_pt_alloc_map_lock(pd, addr);
 		if (!pt)
 			goto out;
+		start = addr;
 		do {
 			psb_mmu_invalidate_pte(pt, addr);
 			--pt->count;
 		} while (addr += PAGE_SIZE, addr < next);
+		if (pt->count)
+			psb_mmu_flush_pt_range(pt, start, next);
 		psb_mmu_pt_unmap_unlock(pt);
 
 	} while (addr = next, next != end);
 
 out:
-	if (pd->hw_context != -1)
-		psb_mmu_flush_ptes(pd, f_address, num_pages, 1, 1);
-
 	up_read(&pd->driver->sem);
 
 	if (pd->hw_context != -1)
@@ -761,7 +711,7 @@ void psb_mmu_remove_pages(struct psb_mmu_pd *pd, unsigned long address,
 	unsigned long next;
 	unsigned long add;
 	unsigned long row_add;
-	unsigned long f_address = address;
+	unsigned long start;
 
 	if (hw_tile_stride)
 		rows = num_pages / desired_tile_stride;
@@ -785,19 +735,19 @@ void psb_mmu_remove_pages(struct psb_mmu_pd *pd, unsigned long address,
 			pt = psb_mmu_pt_map_lock(pd, addr);
 			if (!pt)
 				continue;
+			start = addr;
 			do {
 				psb_mmu_invalidate_pte(pt, addr);
 				--pt->count;
 
 			} while (addr += PAGE_SIZE, addr < next);
+			if (pt->count)
+				psb_mmu_flush_pt_range(pt, start, next);
 			psb_mmu_pt_unmap_unlock(pt);
 
 		} while (addr = next, next != end);
 		address += row_add;
 	}
-	if (pd->hw_context != -1)
-		psb_mmu_flush_ptes(pd, f_address, num_pages,
-				   desired_tile_stride, hw_tile_stride);
 
 	/* up_read(&pd->driver->sem); */
 
@@ -814,7 +764,7 @@ int psb_mmu_insert_pfn_sequence(struct psb_mmu_pd *pd, uint32_t start_pfn,
 	unsigned long addr;
 	unsigned long end;
 	unsigned long next;
-	unsigned long f_address = address;
+	unsigned long start;
 	int ret = 0;
 
 	down_read(&pd->driver->sem);
@@ -829,19 +779,18 @@ int psb_mmu_insert_pfn_sequence(struct psb_mmu_pd *pd, uint32_t start_pfn,
 			ret = -ENOMEM;
 			goto out;
 		}
+		start = addr;
 		do {
 			pte = psb_mmu_mask_pte(start_pfn++, type);
 			psb_mmu_set_pte(pt, addr, pte);
 			pt->count++;
 		} while (addr += PAGE_SIZE, addr < next);
+		psb_mmu_flush_pt_range(pt, start, next);
 		psb_mmu_pt_unmap_unlock(pt);
 
 	} while (addr = next, next != end);
 
 out:
-	if (pd->hw_context != -1)
-		psb_mmu_flush_ptes(pd, f_address, num_pages, 1, 1);
-
 	up_read(&pd->driver->sem);
 
 	if (pd->hw_context != -1)
@@ -864,7 +813,7 @@ int psb_mmu_insert_pages(struct psb_mmu_pd *pd, struct page **pages,
 	unsigned long next;
 	unsigned long add;
 	unsigned long row_add;
-	unsigned long f_address = address;
+	unsigned long start;
 	int ret = 0;
 
 	if (hw_tile_stride) {
@@ -892,6 +841,7 @@ int psb_mmu_insert_pages(struct psb_mmu_pd *pd, struct page **pages,
 				ret = -ENOMEM;
 				goto out;
 			}
+			start = addr;
 			do {
 				pte =
 					psb_mmu_mask_pte(page_to_pfn(*pages++),
@@ -899,6 +849,7 @@ int psb_mmu_insert_pages(struct psb_mmu_pd *pd, struct page **pages,
 				psb_mmu_set_pte(pt, addr, pte);
 				pt->count++;
 			} while (addr += PAGE_SIZE, addr < next);
+			psb_mmu_flush_pt_range(pt, start, next);
 			psb_mmu_pt_unmap_unlock(pt);
 
 		} while (addr = next, next != end);
@@ -906,10 +857,6 @@ int psb_mmu_insert_pages(struct psb_mmu_pd *pd, struct page **pages,
 		address += row_add;
 	}
 out:
-	if (pd->hw_context != -1)
-		psb_mmu_flush_ptes(pd, f_address, num_pages,
-				   desired_tile_stride, hw_tile_stride);
-
 	up_read(&pd->driver->sem);
 
 	if (pd->hw_context != -1)
@@ -27,26 +27,122 @@
 #include "psb_powermgmt.h"
 #include <linux/io.h>
 #include <linux/delay.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
 
 #ifndef list_first_entry
 #define list_first_entry(ptr, type, member) \
 	list_entry((ptr)->next, type, member)
 #endif
 
+/* queued commands older than this go ahead of any priority class */
+#define PSB_MSVDX_AGING_NS	(100 * NSEC_PER_MSEC)
+
 static int ied_enabled;
 
 static int psb_msvdx_send(struct drm_device *dev, void *cmd,
 			  unsigned long cmd_size);
 
+static inline u64 psb_msvdx_now_ns(void)
+{
+	return ktime_to_ns(ktime_get());
+}
+
+/* called with msvdx_lock held */
+static void psb_msvdx_mark_sent(struct msvdx_private *msvdx_priv,
+				struct psb_video_ctx *ctx, uint32_t sequence,
+				u64 deadline_ns, u64 now)
+{
+	msvdx_priv->msvdx_sent_ctx = ctx;
+	msvdx_priv->msvdx_sent_sequence = sequence;
+	msvdx_priv->msvdx_sent_ns = now;
+	msvdx_priv->msvdx_sent_deadline_ns = deadline_ns;
+}
+
+/*
+ * Queue a command behind the h/w, called with msvdx_lock held. A
+ * command sorts by its context's priority class, then by its frame
+ * deadline, or by queue time when the context has no frame period.
+ * Its key is never allowed to sort ahead of the context's earlier
+ * queued commands, so each context still decodes in order.
+ */
+static void psb_msvdx_queue_cmd(struct msvdx_private *msvdx_priv,
+				struct psb_msvdx_cmd_queue *msvdx_cmd,
+				struct psb_video_ctx *ctx)
+{
+	u64 now = psb_msvdx_now_ns();
+
+	msvdx_cmd->ctx = ctx;
+	msvdx_cmd->queue_ns = now;
+	msvdx_cmd->priority = PSB_VIDEO_PRIORITY_NORMAL;
+	msvdx_cmd->deadline_ns = now;
+
+	if (ctx) {
+		msvdx_cmd->priority = ctx->priority;
+		msvdx_cmd->deadline_ns +=
+			(u64) ctx->frame_period_us * NSEC_PER_USEC;
+
+		if (ctx->queued) {
+			if (msvdx_cmd->priority < ctx->last_priority)
+				msvdx_cmd->priority = ctx->last_priority;
+			if (msvdx_cmd->deadline_ns < ctx->last_deadline_ns)
+				msvdx_cmd->deadline_ns = ctx->last_deadline_ns;
+		}
+		ctx->last_priority = msvdx_cmd->priority;
+		ctx->last_deadline_ns = msvdx_cmd->deadline_ns;
+		ctx->queued++;
+		ctx->stats.submitted++;
+	}
+
+	list_add_tail(&msvdx_cmd->head, &msvdx_priv->msvdx_queue);
+}
+
+/*
+ * Most urgent class first, earliest deadline within a class. Commands
+ * that have waited too long go ahead of everything else, oldest first,
+ * so background work can't starve whatever deadline the others claim.
+ * With every context at the default class this is plain FIFO.
+ */
+static struct psb_msvdx_cmd_queue *psb_msvdx_pick_cmd(
+	struct msvdx_private *msvdx_priv, u64 now)
+{
+	struct psb_msvdx_cmd_queue *msvdx_cmd, *best = NULL;
+	int aged, best_aged = 0;
+
+	list_for_each_entry(msvdx_cmd, &msvdx_priv->msvdx_queue, head) {
+		aged = now - msvdx_cmd->queue_ns > PSB_MSVDX_AGING_NS;
+
+		if (!best || aged > best_aged ||
+		    (aged && best_aged &&
+		     msvdx_cmd->queue_ns < best->queue_ns) ||
+		    (!aged && !best_aged &&
+		     (msvdx_cmd->priority < best->priority ||
+		      (msvdx_cmd->priority == best->priority &&
+		       msvdx_cmd->deadline_ns < best->deadline_ns)))) {
+			best = msvdx_cmd;
+			best_aged = aged;
+		}
+	}
+
+	if (best_aged)
+		msvdx_priv->msvdx_aged++;
+
+	return best;
+}
+
 static int psb_msvdx_dequeue_send(struct drm_device *dev)
 {
 	struct drm_psb_private *dev_priv = dev->dev_private;
 	struct psb_msvdx_cmd_queue *msvdx_cmd = NULL;
 	int ret = 0;
 	struct msvdx_private *msvdx_priv = dev_priv->msvdx_private;
+	struct psb_video_ctx *ctx;
 	unsigned long irq_flags;
+	u64 now, queue_ns;
 
 	spin_lock_irqsave(&msvdx_priv->msvdx_lock, irq_flags);
+	/* After the lock, so no command queued meanwhile is younger than now */
+	now = psb_msvdx_now_ns();
 	if (list_empty(&msvdx_priv->msvdx_queue)) {
 		PSB_DEBUG_GENERAL("MSVDXQUE: msvdx list empty.\n");
 		msvdx_priv->msvdx_busy = 0;
@@ -54,9 +150,24 @@ static int psb_msvdx_dequeue_send(struct drm_device *dev)
 		return -EINVAL;
 	}
 
-	msvdx_cmd = list_first_entry(&msvdx_priv->msvdx_queue,
-				     struct psb_msvdx_cmd_queue, head);
+	msvdx_cmd = psb_msvdx_pick_cmd(msvdx_priv, now);
+	msvdx_priv->msvdx_sent_ooo = msvdx_cmd !=
+		list_first_entry(&msvdx_priv->msvdx_queue,
+				 struct psb_msvdx_cmd_queue, head);
+	if (msvdx_priv->msvdx_sent_ooo)
+		msvdx_priv->msvdx_overtakes++;
 	list_del(&msvdx_cmd->head);
+
+	ctx = msvdx_cmd->ctx;
+	psb_msvdx_mark_sent(msvdx_priv, ctx, msvdx_cmd->sequence,
+			    msvdx_cmd->deadline_ns, now);
+	if (ctx) {
+		queue_ns = now - msvdx_cmd->queue_ns;
+		ctx->queued--;
+		ctx->stats.queue_ns += queue_ns;
+		if (queue_ns > ctx->stats.max_queue_ns)
+			ctx->stats.max_queue_ns = queue_ns;
+	}
 	spin_unlock_irqrestore(&msvdx_priv->msvdx_lock, irq_flags);
 
 	PSB_DEBUG_GENERAL("MSVDXQUE: Queue has id %08x\n", msvdx_cmd->sequence);
@@ -109,7 +220,7 @@ static int psb_msvdx_map_command(struct drm_device *dev,
 			return -EINVAL;
 		uint32_t cur_cmd_size = MEMIO_READ_FIELD(cmd, FWRK_GENMSG_SIZE);
 		uint32_t cur_cmd_id = MEMIO_READ_FIELD(cmd, FWRK_GENMSG_ID);
-		uint32_t mmu_ptd = 0, msvdx_mmu_invalid = 0;
+		uint32_t mmu_ptd = 0;
 		unsigned long irq_flags;
 
 		PSB_DEBUG_GENERAL("cmd start at %08x cur_cmd_size = %d"
@@ -142,22 +253,8 @@ static int psb_msvdx_map_command(struct drm_device *dev,
 			else
 				MEMIO_WRITE_FIELD(cmd, FW_VA_RENDER_FENCE_VALUE, sequence);
 
+			/* MMU invalidate is left to psb_msvdx_send() */
 			mmu_ptd = psb_get_default_pd_addr(dev_priv->mmu);
-			msvdx_mmu_invalid = atomic_cmpxchg(&dev_priv->msvdx_mmu_invaldc,
-							   1, 0);
-			if (msvdx_mmu_invalid == 1) {
-				if (!(IS_MDFLD(dev) && IS_FW_UPDATED))
-					mmu_ptd |= 1;
-				else {
-					uint32_t flags;
-					flags = MEMIO_READ_FIELD(cmd, FW_DEVA_DECODE_FLAGS);
-					flags |= FW_DEVA_INVALIDATE_MMU;
-					MEMIO_WRITE_FIELD(cmd, FW_DEVA_DECODE_FLAGS, flags);
-					psb_gl3_global_invalidation(dev);
-				}
-
-				PSB_DEBUG_GENERAL("MSVDX:Set MMU invalidate\n");
-			}
 
 			/* PTD */
 			if (IS_MDFLD(dev) && IS_FW_UPDATED) {
@@ -184,17 +281,6 @@ static int psb_msvdx_map_command(struct drm_device *dev,
 			deblock_msg = (FW_VA_DEBLOCK_MSG *)cmd;
 
 			mmu_ptd = psb_get_default_pd_addr(dev_priv->mmu);
-			msvdx_mmu_invalid = atomic_cmpxchg(&dev_priv->msvdx_mmu_invaldc,
-							   1, 0);
-			if (msvdx_mmu_invalid == 1) {
-				uint32_t flags;
-				flags = deblock_msg->flags;
-				flags |= FW_DEVA_INVALIDATE_MMU;
-				deblock_msg->flags = flags;
-
-				PSB_DEBUG_GENERAL("MSVDX:Set MMU invalidate\n");
-			}
-
 
 			deblock_msg->header.bits.msg_type = cur_cmd_id - VA_MSGID_DEBLOCK_MFLD + VA_MSGID_DEBLOCK; /* patch to right cmd type */
 			deblock_msg->header.bits.msg_fence = (uint16_t)(sequence & 0xffff);
@@ -243,7 +329,8 @@ out:
 int psb_submit_video_cmdbuf(struct drm_device *dev,
 			    struct ttm_buffer_object *cmd_buffer,
 			    unsigned long cmd_offset, unsigned long cmd_size,
-			    struct ttm_fence_object *fence)
+			    struct ttm_fence_object *fence,
+			    struct psb_video_ctx *video_ctx)
 {
 	struct drm_psb_private *dev_priv = dev->dev_private;
 	uint32_t sequence =  dev_priv->sequence[PSB_ENGINE_VIDEO];
@@ -301,7 +388,19 @@ int psb_submit_video_cmdbuf(struct drm_device *dev,
 	}
 
 	if (!msvdx_priv->msvdx_busy) {
+		u64 now = psb_msvdx_now_ns();
+		u64 deadline_ns = now;
+
+		if (video_ctx) {
+			deadline_ns += (u64) video_ctx->frame_period_us *
+				       NSEC_PER_USEC;
+			video_ctx->stats.submitted++;
+		}
+
 		msvdx_priv->msvdx_busy = 1;
+		msvdx_priv->msvdx_sent_ooo = 0;
+		psb_msvdx_mark_sent(msvdx_priv, video_ctx, sequence,
+				    deadline_ns, now);
 		spin_unlock_irqrestore(&msvdx_priv->msvdx_lock, irq_flags);
 		PSB_DEBUG_GENERAL("MSVDX: commit command to HW,seq=0x%08x\n",
 				  sequence);
@@ -338,7 +437,7 @@ int psb_submit_video_cmdbuf(struct drm_device *dev,
 		msvdx_cmd->cmd_size = cmd_size;
 		msvdx_cmd->sequence = sequence;
 		spin_lock_irqsave(&msvdx_priv->msvdx_lock, irq_flags);
-		list_add_tail(&msvdx_cmd->head, &msvdx_priv->msvdx_queue);
+		psb_msvdx_queue_cmd(msvdx_priv, msvdx_cmd, video_ctx);
 		spin_unlock_irqrestore(&msvdx_priv->msvdx_lock, irq_flags);
 		if (!msvdx_priv->msvdx_busy) {
 			msvdx_priv->msvdx_busy = 1;
@@ -358,6 +457,8 @@ int psb_cmdbuf_video(struct drm_file *priv,
 		     struct psb_ttm_fence_rep *fence_arg)
 {
 	struct drm_device *dev = priv->minor->dev;
+	struct drm_psb_private *dev_priv = dev->dev_private;
+	struct psb_video_ctx *video_ctx = dev_priv->msvdx_ctx;
 	struct ttm_fence_object *fence;
 	int ret;
 
@@ -365,9 +466,12 @@ int psb_cmdbuf_video(struct drm_file *priv,
 	 * Check this. Doesn't seem right. Have fencing done AFTER command
 	 * submission and make sure drm_psb_idle idles the MSVDX completely.
 	 */
+	if (video_ctx && video_ctx->filp != priv->filp)
+		video_ctx = NULL;
+
 	ret =
 		psb_submit_video_cmdbuf(dev, cmd_buffer, arg->cmdbuf_offset,
-					arg->cmdbuf_size, NULL);
+					arg->cmdbuf_size, NULL, video_ctx);
 	if (ret)
 		return ret;
 
@@ -387,6 +491,39 @@ int psb_cmdbuf_video(struct drm_file *priv,
 }
 
 
+/*
+ * Flag a pending MMU invalidate in a render or deblock message about to
+ * go to the h/w. This must not be done when a command is queued: a
+ * command queued later may be sent first and run with a stale TLB.
+ */
+static void psb_msvdx_set_mmu_invalidate(struct drm_device *dev, void *cmd,
+					 uint32_t cmd_id)
+{
+	struct drm_psb_private *dev_priv = dev->dev_private;
+	uint32_t flags;
+
+	if (cmd_id != VA_MSGID_RENDER && cmd_id != VA_MSGID_DEBLOCK &&
+	    cmd_id != VA_MSGID_OOLD)
+		return;
+
+	if (atomic_cmpxchg(&dev_priv->msvdx_mmu_invaldc, 1, 0) != 1)
+		return;
+
+	if (cmd_id != VA_MSGID_RENDER) {
+		((FW_VA_DEBLOCK_MSG *)cmd)->flags |= FW_DEVA_INVALIDATE_MMU;
+	} else if (!(IS_MDFLD(dev) && IS_FW_UPDATED)) {
+		MEMIO_WRITE_FIELD(cmd, FW_VA_RENDER_MMUPTD,
+				  MEMIO_READ_FIELD(cmd, FW_VA_RENDER_MMUPTD) | 1);
+	} else {
+		flags = MEMIO_READ_FIELD(cmd, FW_DEVA_DECODE_FLAGS);
+		flags |= FW_DEVA_INVALIDATE_MMU;
+		MEMIO_WRITE_FIELD(cmd, FW_DEVA_DECODE_FLAGS, flags);
+		psb_gl3_global_invalidation(dev);
+	}
+
+	PSB_DEBUG_GENERAL("MSVDX:Set MMU invalidate\n");
+}
+
 static int psb_msvdx_send(struct drm_device *dev, void *cmd,
 			  unsigned long cmd_size)
 {
@@ -403,6 +540,8 @@ static int psb_msvdx_send(struct drm_device *dev, void *cmd,
 			goto out;
 		}
 
+		psb_msvdx_set_mmu_invalidate(dev, cmd, cur_cmd_id);
+
 		/* Send the message to h/w */
 		ret = psb_mtx_send(dev_priv, cmd);
 		if (ret) {
@@ -535,6 +674,77 @@ out:
 /*
  * MSVDX MTX interrupt
  */
+/*
+ * Fences retire in sequence order, but a command that overtook queued
+ * ones completes ahead of them: signal its own fence and hold the
+ * retire point just below the oldest command still queued.
+ */
+static void psb_msvdx_retire(struct drm_device *dev, uint32_t fence,
+			     int done)
+{
+	struct drm_psb_private *dev_priv = dev->dev_private;
+	struct msvdx_private *msvdx_priv = dev_priv->msvdx_private;
+	struct psb_msvdx_cmd_queue *oldest;
+	struct psb_video_ctx *ctx;
+	uint32_t retire = fence;
+	unsigned long irq_flags;
+	u64 now, decode_ns;
+
+	spin_lock_irqsave(&msvdx_priv->msvdx_lock, irq_flags);
+	if (!list_empty(&msvdx_priv->msvdx_queue)) {
+		oldest = list_first_entry(&msvdx_priv->msvdx_queue,
+					  struct psb_msvdx_cmd_queue, head);
+		if ((int32_t)(oldest->sequence - fence) < 0)
+			retire = oldest->sequence - 1;
+	}
+
+	ctx = msvdx_priv->msvdx_sent_ctx;
+	if (done && ctx) {
+		now = psb_msvdx_now_ns();
+		decode_ns = now - msvdx_priv->msvdx_sent_ns;
+		ctx->stats.completed++;
+		ctx->stats.decode_ns += decode_ns;
+		if (decode_ns > ctx->stats.max_decode_ns)
+			ctx->stats.max_decode_ns = decode_ns;
+		if (ctx->frame_period_us &&
+		    now > msvdx_priv->msvdx_sent_deadline_ns)
+			ctx->stats.deadline_misses++;
+	}
+	if (done)
+		msvdx_priv->msvdx_sent_ctx = NULL;
+	spin_unlock_irqrestore(&msvdx_priv->msvdx_lock, irq_flags);
+
+	msvdx_priv->msvdx_current_sequence = retire;
+
+	if (retire != fence)
+		psb_fence_signal_sequence(dev, PSB_ENGINE_VIDEO, fence,
+					  _PSB_FENCE_TYPE_EXE, 0);
+	psb_fence_handler(dev, PSB_ENGINE_VIDEO);
+}
+
+/*
+ * Fail the fence of the command on the h/w. If it had overtaken queued
+ * commands only its own fence is failed here, the queued ones are left
+ * to psb_msvdx_flush_cmd_queue().
+ */
+void psb_msvdx_fence_error(struct drm_device *dev, uint32_t sequence,
+			   int error)
+{
+	struct drm_psb_private *dev_priv = dev->dev_private;
+	struct msvdx_private *msvdx_priv = dev_priv->msvdx_private;
+
+	if (msvdx_priv->msvdx_sent_ooo &&
+	    sequence == msvdx_priv->msvdx_sent_sequence) {
+		psb_fence_signal_sequence(dev, PSB_ENGINE_VIDEO, sequence,
+					  _PSB_FENCE_TYPE_EXE, error);
+		return;
+	}
+
+	msvdx_priv->msvdx_current_sequence = sequence;
+	psb_fence_error(dev, PSB_ENGINE_VIDEO, sequence,
+			_PSB_FENCE_TYPE_EXE, error);
+}
+
 static void psb_msvdx_mtx_interrupt(struct drm_device *dev)
 {
 	struct drm_psb_private *dev_priv =
@@ -651,22 +861,22 @@ loop: /* just for coding style check */
 			msvdx_priv->msvdx_needs_reset = 1;
 
 		if (msg_id == VA_MSGID_CMD_HW_PANIC) {
-			diff = msvdx_priv->msvdx_current_sequence
-			       - dev_priv->sequence[PSB_ENGINE_VIDEO];
-
-			if (diff > 0x0FFFFFFF)
-				msvdx_priv->msvdx_current_sequence++;
+			if (msvdx_priv->msvdx_sent_ooo) {
+				fence = msvdx_priv->msvdx_sent_sequence;
+			} else {
+				diff = msvdx_priv->msvdx_current_sequence
+				       - dev_priv->sequence[PSB_ENGINE_VIDEO];
+
+				if (diff > 0x0FFFFFFF)
+					msvdx_priv->msvdx_current_sequence++;
+				fence = msvdx_priv->msvdx_current_sequence;
+			}
 
 			PSB_DEBUG_GENERAL("MSVDX: Fence ID missing, "
-					  "assuming %08x\n",
-					  msvdx_priv->msvdx_current_sequence);
-		} else {
-			msvdx_priv->msvdx_current_sequence = fence;
+					  "assuming %08x\n", fence);
 		}
 
-		psb_fence_error(dev, PSB_ENGINE_VIDEO,
-				msvdx_priv->msvdx_current_sequence,
-				_PSB_FENCE_TYPE_EXE, DRM_CMD_FAILED);
+		psb_msvdx_fence_error(dev, fence, DRM_CMD_FAILED);
 
 		/* Flush the command queue */
 		psb_msvdx_flush_cmd_queue(dev);
@@ -691,9 +901,7 @@ loop: /* just for coding style check */
 				  "FenceID: %08x, flags: 0x%x\n",
 				  fence, flags);
 
-		msvdx_priv->msvdx_current_sequence = fence;
-
-		psb_fence_handler(dev, PSB_ENGINE_VIDEO);
+		psb_msvdx_retire(dev, fence, flags & FW_VA_RENDER_HOST_INT);
 
 		if (flags & FW_VA_RENDER_HOST_INT) {
 			/*Now send the next command from the msvdx cmd queue */
@@ -864,9 +1072,25 @@ int psb_check_msvdx_idle(struct drm_device *dev)
 }
 
 
+/* drop references to a context that is going away, called with msvdx_lock held */
+static void psb_msvdx_forget_ctx(struct msvdx_private *msvdx_priv,
+				 struct psb_video_ctx *ctx)
+{
+	struct psb_msvdx_cmd_queue *msvdx_cmd;
+
+	list_for_each_entry(msvdx_cmd, &msvdx_priv->msvdx_queue, head) {
+		if (msvdx_cmd->ctx == ctx)
+			msvdx_cmd->ctx = NULL;
+	}
+	if (msvdx_priv->msvdx_sent_ctx == ctx)
+		msvdx_priv->msvdx_sent_ctx = NULL;
+}
+
 int psb_remove_videoctx(struct drm_psb_private *dev_priv, struct file *filp)
 {
 	struct psb_video_ctx *pos, *n;
+	struct msvdx_private *msvdx_priv = dev_priv->msvdx_private;
+	unsigned long irq_flags;
 	/* iterate to query all ctx to if there is DRM running*/
 	ied_enabled = 0;
 
@@ -904,7 +1128,11 @@ int psb_remove_videoctx(struct drm_psb_private *dev_priv, struct file *filp)
 			if (dev_priv->last_msvdx_ctx == pos)
 				dev_priv->last_msvdx_ctx = NULL;
 
+			spin_lock_irqsave(&msvdx_priv->msvdx_lock, irq_flags);
+			psb_msvdx_forget_ctx(msvdx_priv, pos);
 			list_del(&pos->head);
+			spin_unlock_irqrestore(&msvdx_priv->msvdx_lock,
+					       irq_flags);
 			kfree(pos);
 		} else {
 			if (pos->ctx_type & VA_RT_FORMAT_PROTECTED)
@@ -955,6 +1183,8 @@ int lnc_video_getparam(struct drm_device *dev, void *data,
 	struct psb_video_ctx *video_ctx = NULL;
 	uint32_t rar_ci_info[2];
 	struct msvdx_private *msvdx_priv = dev_priv->msvdx_private;
+	struct drm_video_priority_arg priority_arg;
+	unsigned long irq_flags;
 
 	switch (arg->key) {
 	case LNC_VIDEO_GETPARAM_RAR_INFO:
@@ -985,7 +1215,7 @@ int lnc_video_getparam(struct drm_device *dev, void *data,
 		/* add video decode/encode context */
 		ret = copy_from_user(&ctx_type, (void __user *)((unsigned long)arg->value),
 				     sizeof(ctx_type));
-		video_ctx = kmalloc(sizeof(struct psb_video_ctx), GFP_KERNEL);
+		video_ctx = kzalloc(sizeof(struct psb_video_ctx), GFP_KERNEL);
 		if (video_ctx == NULL) {
 			ret = -ENOMEM;
 			break;
@@ -993,7 +1223,10 @@ int lnc_video_getparam(struct drm_device *dev, void *data,
 		INIT_LIST_HEAD(&video_ctx->head);
 		video_ctx->ctx_type = ctx_type;
 		video_ctx->filp = file_priv->filp;
+		video_ctx->priority = PSB_VIDEO_PRIORITY_NORMAL;
+		spin_lock_irqsave(&msvdx_priv->msvdx_lock, irq_flags);
 		list_add(&video_ctx->head, &dev_priv->video_ctx);
+		spin_unlock_irqrestore(&msvdx_priv->msvdx_lock, irq_flags);
 
 		if (IS_MDFLD(dev_priv->dev) &&
 				(VAEntrypointEncSlice ==
@@ -1012,6 +1245,34 @@ int lnc_video_getparam(struct drm_device *dev, void *data,
 	case IMG_VIDEO_RM_CONTEXT:
 		psb_remove_videoctx(dev_priv, file_priv->filp);
 		break;
+	case IMG_VIDEO_SET_PRIORITY:
+		ret = copy_from_user(&priority_arg,
+				(void __user *)((unsigned long)arg->value),
+				sizeof(priority_arg));
+		if (ret)
+			break;
+		if (priority_arg.priority >= PSB_VIDEO_PRIORITY_NUM)
+			return -EINVAL;
+
+		/* applies to the decode contexts of this file */
+		spin_lock_irqsave(&msvdx_priv->msvdx_lock, irq_flags);
+		list_for_each_entry(video_ctx, &dev_priv->video_ctx, head) {
+			int entrypoint = video_ctx->ctx_type & 0xff;
+
+			if (video_ctx->filp != file_priv->filp ||
+			    entrypoint == VAEntrypointEncSlice ||
+			    entrypoint == VAEntrypointEncPicture)
+				continue;
+			video_ctx->priority = priority_arg.priority;
+			video_ctx->frame_period_us =
+				priority_arg.frame_period_us;
+		}
+		spin_unlock_irqrestore(&msvdx_priv->msvdx_lock, irq_flags);
+
+		PSB_DEBUG_GENERAL("Video: set priority %u, frame period %uus\n",
+				  priority_arg.priority,
+				  priority_arg.frame_period_us);
+		break;
 	case IMG_VIDEO_DECODE_STATUS:
 		ret = copy_to_user((void __user *)((unsigned long)arg->value),
 					   &msvdx_priv->fw_status, sizeof(msvdx_priv->fw_status));
@@ -1114,6 +1375,58 @@ int lnc_video_getparam(struct drm_device *dev, void *data,
 	return 0;
 }
 
+static inline unsigned long long psb_msvdx_ns_to_us(u64 ns, uint32_t count)
+{
+	if (count == 0)
+		return 0;
+	return div_u64(div_u64(ns, count), NSEC_PER_USEC);
+}
+
+int psb_msvdx_sched_show(struct seq_file *seq, void *v)
+{
+	struct drm_minor *minor = (struct drm_minor *) seq->private;
+	struct drm_psb_private *dev_priv = minor->dev->dev_private;
+	struct msvdx_private *msvdx_priv = dev_priv->msvdx_private;
+	struct psb_video_ctx *pos;
+	struct psb_video_ctx_stats *stats;
+	unsigned long irq_flags;
+
+	if (msvdx_priv == NULL)
+		return 0;
+
+	spin_lock_irqsave(&msvdx_priv->msvdx_lock, irq_flags);
+	seq_printf(seq, "overtakes %u, aged %u\n",
+		   msvdx_priv->msvdx_overtakes, msvdx_priv->msvdx_aged);
+	seq_printf(seq, "profile entry prio period_us queued submitted "
+		   "completed missed queue_avg_us queue_max_us "
+		   "decode_avg_us decode_max_us\n");
+
+	list_for_each_entry(pos, &dev_priv->video_ctx, head) {
+		int entrypoint = pos->ctx_type & 0xff;
+
+		if (entrypoint == VAEntrypointEncSlice ||
+		    entrypoint == VAEntrypointEncPicture)
+			continue;
+
+		stats = &pos->stats;
+		seq_printf(seq, "%7d %5d %4d %9u %6u %9u %9u %6u "
+			   "%12llu %12llu %13llu %13llu\n",
+			   (pos->ctx_type >> 8) & 0xff, entrypoint,
+			   pos->priority, pos->frame_period_us, pos->queued,
+			   stats->submitted, stats->completed,
+			   stats->deadline_misses,
+			   psb_msvdx_ns_to_us(stats->queue_ns,
+					      stats->submitted),
+			   psb_msvdx_ns_to_us(stats->max_queue_ns, 1),
+			   psb_msvdx_ns_to_us(stats->decode_ns,
+					      stats->completed),
+			   psb_msvdx_ns_to_us(stats->max_decode_ns, 1));
+	}
+	spin_unlock_irqrestore(&msvdx_priv->msvdx_lock, irq_flags);
+
+	return 0;
+}
+
 inline int psb_try_power_down_msvdx(struct drm_device *dev)
 {
 	ospm_apm_power_down_msvdx(dev);
@@ -83,6 +83,9 @@ int psb_msvdx_reset(struct drm_psb_private *dev_priv);
 uint32_t psb_get_default_pd_addr(struct psb_mmu_driver *driver);
 int psb_mtx_send(struct drm_psb_private *dev_priv, const void *pvMsg);
 void psb_msvdx_flush_cmd_queue(struct drm_device *dev);
+void psb_msvdx_fence_error(struct drm_device *dev, uint32_t sequence,
+			   int error);
+int psb_msvdx_sched_show(struct seq_file *seq, void *v);
 void psb_msvdx_lockup(struct drm_psb_private *dev_priv,
 		      int *msvdx_lockup, int *msvdx_idle);
 int psb_setup_fw(struct drm_device *dev);
@@ -769,6 +772,18 @@ struct msvdx_private {
 	struct mutex msvdx_mutex;
 	struct list_head msvdx_queue;
 	int msvdx_busy;
+
+	/*
+	 * the command on the h/w; sent_ooo is set when it overtook older
+	 * queued commands, so its fence must be signalled on its own
+	 */
+	struct psb_video_ctx *msvdx_sent_ctx;
+	uint32_t msvdx_sent_sequence;
+	int msvdx_sent_ooo;
+	u64 msvdx_sent_ns;
+	u64 msvdx_sent_deadline_ns;
+	uint32_t msvdx_overtakes;
+	uint32_t msvdx_aged;
 	int msvdx_fw_loaded;
 	void *msvdx_fw;
 	int msvdx_fw_size;
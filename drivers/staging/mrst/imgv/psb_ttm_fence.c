@@ -203,6 +203,54 @@ void ttm_fence_handler(struct ttm_fence_device *fdev, uint32_t fence_class,
 		wake_up_all(&fc->fence_queue);
 }
 
+void ttm_fence_signal_sequence(struct ttm_fence_device *fdev,
+			       uint32_t fence_class, uint32_t sequence,
+			       uint32_t type, uint32_t error)
+{
+	int wake = 0;
+	uint32_t new_type;
+	struct ttm_fence_class_manager *fc = &fdev->fence_class[fence_class];
+	const struct ttm_fence_driver *driver = ttm_fence_driver_from_dev(fdev);
+	struct ttm_fence_object *fence, *next;
+
+	list_for_each_entry_safe(fence, next, &fc->ring, ring) {
+		if (fence->sequence != sequence)
+			continue;
+
+		if (error) {
+			fence->info.error = error;
+			fence->info.signaled_types = fence->fence_type;
+			list_del_init(&fence->ring);
+			wake = 1;
+			continue;
+		}
+
+		new_type = (fence->info.signaled_types |
+			    (type & fence->fence_type)) ^
+			   fence->info.signaled_types;
+
+		if (new_type) {
+			fence->info.signaled_types |= new_type;
+
+			if (unlikely(driver->signaled))
+				driver->signaled(fence);
+
+			if (driver->needed_flush)
+				fc->pending_flush |=
+					driver->needed_flush(fence);
+
+			if (new_type & fence->waiting_types)
+				wake = 1;
+		}
+
+		if (!(fence->fence_type & ~fence->info.signaled_types))
+			list_del_init(&fence->ring);
+	}
+
+	if (wake)
+		wake_up_all(&fc->fence_queue);
+}
+
 static void ttm_fence_unring(struct ttm_fence_object *fence)
 {
 	struct ttm_fence_class_manager *fc = ttm_fence_fc(fence);
@@ -254,6 +254,27 @@ ttm_fence_handler(struct ttm_fence_device *fdev,
 		  uint32_t fence_class,
 		  uint32_t sequence, uint32_t type, uint32_t error);
 
+/**
+ * ttm_fence_signal_sequence - signal a single fence.
+ *
+ * @fdev:        Pointer to the fence device.
+ * @fence_class: Fence class that signals.
+ * @sequence:    Sequence of the fence to signal.
+ * @type:        Types that signal.
+ * @error:       Error from the engine.
+ *
+ * Like ttm_fence_handler, but only touches fences with exactly @sequence
+ * and leaves earlier ones alone. For engines that may complete commands
+ * out of submission order; ttm_fence_handler is still used to retire
+ * everything up to the oldest command that has not completed.
+ * Same locking rules as ttm_fence_handler.
+ */
+
+extern void
+ttm_fence_signal_sequence(struct ttm_fence_device *fdev,
+			  uint32_t fence_class, uint32_t sequence,
+			  uint32_t type, uint32_t error);
+
 /**
  * ttm_fence_driver_from_dev
  *
@@ -3713,6 +3713,31 @@ _SetDispatchTableEntry(IMG_UINT32 ui32Index,
 	ui32PrevIndex = ui32Index;
 }
 
+IMG_VOID
+_SetDispatchTableEntryConcurrent(IMG_UINT32 ui32Index,
+								 IMG_UINT32 ui32InSize,
+								 IMG_UINT32 ui32OutSize)
+{
+	if (ui32Index >= BRIDGE_DISPATCH_TABLE_ENTRY_COUNT ||
+		!g_BridgeDispatchTable[ui32Index].pfFunction)
+	{
+		PVR_DPF((PVR_DBG_ERROR, "%s: No dispatch table entry at index %u",
+				 __FUNCTION__, ui32Index));
+		return;
+	}
+
+	
+	if (ui32InSize > PVRSRV_MAX_BRIDGE_CONCURRENT_SIZE ||
+		ui32OutSize > PVRSRV_MAX_BRIDGE_CONCURRENT_SIZE)
+	{
+		PVR_DPF((PVR_DBG_ERROR, "%s: Bridge index %u arguments too large (%u/%u), "
+				 "leaving it serialised", __FUNCTION__, ui32Index, ui32InSize, ui32OutSize));
+		return;
+	}
+
+	g_BridgeDispatchTable[ui32Index].bConcurrent = IMG_TRUE;
+}
+
 static IMG_INT
 PVRSRVInitSrvConnectBW(IMG_UINT32 ui32BridgeID,
 					   IMG_VOID *psBridgeIn,
@@ -4779,6 +4804,19 @@ CommonBridgeInit(IMG_VOID)
 	SetDispatchTableEntry(PVRSRV_BRIDGE_ALLOC_SYNC_INFO, PVRSRVAllocSyncInfoBW);
 	SetDispatchTableEntry(PVRSRV_BRIDGE_FREE_SYNC_INFO, PVRSRVFreeSyncInfoBW);
 
+#if !defined(PDUMP)
+	
+	SetDispatchTableEntryConcurrent(PVRSRV_BRIDGE_SYNC_OPS_FLUSH_TO_TOKEN,
+									PVRSRV_BRIDGE_IN_SYNC_OPS_FLUSH_TO_TOKEN,
+									PVRSRV_BRIDGE_RETURN);
+	SetDispatchTableEntryConcurrent(PVRSRV_BRIDGE_SYNC_OPS_FLUSH_TO_MOD_OBJ,
+									PVRSRV_BRIDGE_IN_SYNC_OPS_FLUSH_TO_MOD_OBJ,
+									PVRSRV_BRIDGE_RETURN);
+	SetDispatchTableEntryConcurrent(PVRSRV_BRIDGE_SYNC_OPS_FLUSH_TO_DELTA,
+									PVRSRV_BRIDGE_IN_SYNC_OPS_FLUSH_TO_DELTA,
+									PVRSRV_BRIDGE_RETURN);
+#endif
+
 #if defined (SUPPORT_SGX)
 	SetSGXDispatchTableEntry();
 #endif
@@ -4809,11 +4847,13 @@ CommonBridgeInit(IMG_VOID)
 	return PVRSRV_OK;
 }
 
-IMG_INT BridgedDispatchKM(PVRSRV_PER_PROCESS_DATA * psPerProc,
-					  PVRSRV_BRIDGE_PACKAGE   * psBridgePackageKM)
+static IMG_INT DoBridgedDispatchKM(PVRSRV_PER_PROCESS_DATA * psPerProc,
+								   PVRSRV_BRIDGE_PACKAGE   * psBridgePackageKM,
+								   IMG_VOID   * psBridgeIn,
+								   IMG_VOID   * psBridgeOut,
+								   IMG_UINT32   ui32MaxInSize,
+								   IMG_UINT32   ui32MaxOutSize)
 {
-	IMG_VOID   * psBridgeIn;
-	IMG_VOID   * psBridgeOut;
 	BridgeWrapperFunction pfBridgeHandler;
 	IMG_UINT32   ui32BridgeID = psBridgePackageKM->ui32BridgeID;
 	IMG_INT      err          = -EFAULT;
@@ -4870,17 +4910,8 @@ IMG_INT BridgedDispatchKM(PVRSRV_PER_PROCESS_DATA * psPerProc,
 #if defined(__linux__)
 	{
 		
-		SYS_DATA *psSysData;
-
-		SysAcquireData(&psSysData);
-
-		
-		psBridgeIn = ((ENV_DATA *)psSysData->pvEnvSpecificData)->pvBridgeData;
-		psBridgeOut = (IMG_PVOID)((IMG_PBYTE)psBridgeIn + PVRSRV_MAX_BRIDGE_IN_SIZE);
-
-		
-		if((psBridgePackageKM->ui32InBufferSize > PVRSRV_MAX_BRIDGE_IN_SIZE) || 
-			(psBridgePackageKM->ui32OutBufferSize > PVRSRV_MAX_BRIDGE_OUT_SIZE))
+		if((psBridgePackageKM->ui32InBufferSize > ui32MaxInSize) || 
+			(psBridgePackageKM->ui32OutBufferSize > ui32MaxOutSize))
 		{
 			goto return_fault;
 		}
@@ -4909,6 +4940,8 @@ IMG_INT BridgedDispatchKM(PVRSRV_PER_PROCESS_DATA * psPerProc,
 #else
 	psBridgeIn  = psBridgePackageKM->pvParamIn;
 	psBridgeOut = psBridgePackageKM->pvParamOut;
+	PVR_UNREFERENCED_PARAMETER(ui32MaxInSize);
+	PVR_UNREFERENCED_PARAMETER(ui32MaxOutSize);
 #endif
 
 	if(ui32BridgeID >= (BRIDGE_DISPATCH_TABLE_ENTRY_COUNT))
@@ -4948,3 +4981,51 @@ return_fault:
 	return err;
 }
 
+IMG_INT BridgedDispatchKM(PVRSRV_PER_PROCESS_DATA * psPerProc,
+					  PVRSRV_BRIDGE_PACKAGE   * psBridgePackageKM)
+{
+	IMG_VOID   * psBridgeIn = IMG_NULL;
+	IMG_VOID   * psBridgeOut = IMG_NULL;
+#if defined(__linux__)
+	SYS_DATA *psSysData;
+
+	SysAcquireData(&psSysData);
+
+	
+	psBridgeIn = ((ENV_DATA *)psSysData->pvEnvSpecificData)->pvBridgeData;
+	psBridgeOut = (IMG_PVOID)((IMG_PBYTE)psBridgeIn + PVRSRV_MAX_BRIDGE_IN_SIZE);
+#endif
+
+	return DoBridgedDispatchKM(psPerProc, psBridgePackageKM,
+							   psBridgeIn, psBridgeOut,
+							   PVRSRV_MAX_BRIDGE_IN_SIZE,
+							   PVRSRV_MAX_BRIDGE_OUT_SIZE);
+}
+
+IMG_BOOL BridgedIsConcurrentKM(IMG_UINT32 ui32BridgeID)
+{
+	if(ui32BridgeID >= (BRIDGE_DISPATCH_TABLE_ENTRY_COUNT))
+	{
+		return IMG_FALSE;
+	}
+
+	return g_BridgeDispatchTable[ui32BridgeID].bConcurrent;
+}
+
+IMG_INT BridgedDispatchConcurrentKM(PVRSRV_PER_PROCESS_DATA * psPerProc,
+							PVRSRV_BRIDGE_PACKAGE   * psBridgePackageKM)
+{
+	
+	IMG_UINT64 aui64BridgeIn[PVRSRV_MAX_BRIDGE_CONCURRENT_SIZE / sizeof(IMG_UINT64)];
+	IMG_UINT64 aui64BridgeOut[PVRSRV_MAX_BRIDGE_CONCURRENT_SIZE / sizeof(IMG_UINT64)];
+
+	OSMemSet(aui64BridgeIn, 0, sizeof(aui64BridgeIn));
+	/* Handlers may not fill in all of it, don't copy stack contents out */
+	OSMemSet(aui64BridgeOut, 0, sizeof(aui64BridgeOut));
+
+	return DoBridgedDispatchKM(psPerProc, psBridgePackageKM,
+							   aui64BridgeIn, aui64BridgeOut,
+							   sizeof(aui64BridgeIn),
+							   sizeof(aui64BridgeOut));
+}
+
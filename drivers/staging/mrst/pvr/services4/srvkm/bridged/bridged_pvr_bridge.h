@@ -158,12 +158,18 @@ typedef IMG_INT (*BridgeWrapperFunction)(IMG_UINT32 ui32BridgeID,
 typedef struct _PVRSRV_BRIDGE_DISPATCH_TABLE_ENTRY
 {
 	BridgeWrapperFunction pfFunction; 
+	IMG_BOOL bConcurrent; 
 #if defined(DEBUG_BRIDGE_KM)
 	const IMG_CHAR *pszIOCName; 
 	const IMG_CHAR *pszFunctionName; 
 	IMG_UINT32 ui32CallCount; 
 	IMG_UINT32 ui32CopyFromUserTotalBytes; 
 	IMG_UINT32 ui32CopyToUserTotalBytes; 
+	IMG_UINT32 ui32ConcurrentCount; 
+	IMG_UINT32 ui32ContendedCount; 
+	IMG_UINT64 ui64LockWaitNs; 
+	IMG_UINT64 ui64CallNs; 
+	IMG_UINT64 ui64MaxCallNs; 
 #endif
 }PVRSRV_BRIDGE_DISPATCH_TABLE_ENTRY;
 
@@ -198,6 +204,22 @@ _SetDispatchTableEntry(IMG_UINT32 ui32Index,
 #define SetDispatchTableEntry(ui32Index, pfFunction) \
 	_SetDispatchTableEntry(PVRSRV_GET_BRIDGE_ID(ui32Index), #ui32Index, (BridgeWrapperFunction)pfFunction, #pfFunction)
 
+/*
+ * Calls marked concurrent only look up handles in the caller's own handle
+ * base and read sync data, so the OS layer may run them under a per-process
+ * lock instead of the global bridge lock.  Their in/out structures are
+ * marshalled through a small on-stack buffer rather than the shared one.
+ */
+#define PVRSRV_MAX_BRIDGE_CONCURRENT_SIZE	64
+
+IMG_VOID
+_SetDispatchTableEntryConcurrent(IMG_UINT32 ui32Index,
+								 IMG_UINT32 ui32InSize,
+								 IMG_UINT32 ui32OutSize);
+
+#define SetDispatchTableEntryConcurrent(ui32Index, InType, OutType) \
+	_SetDispatchTableEntryConcurrent(PVRSRV_GET_BRIDGE_ID(ui32Index), sizeof(InType), sizeof(OutType))
+
 #define DISPATCH_TABLE_GAP_THRESHOLD 5
 
 #if defined(DEBUG)
@@ -224,6 +246,11 @@ PVRSRV_ERROR CommonBridgeInit(IMG_VOID);
 IMG_INT BridgedDispatchKM(PVRSRV_PER_PROCESS_DATA * psPerProc,
 					  PVRSRV_BRIDGE_PACKAGE   * psBridgePackageKM);
 
+IMG_BOOL BridgedIsConcurrentKM(IMG_UINT32 ui32BridgeID);
+
+IMG_INT BridgedDispatchConcurrentKM(PVRSRV_PER_PROCESS_DATA * psPerProc,
+							PVRSRV_BRIDGE_PACKAGE   * psBridgePackageKM);
+
 #if defined (__cplusplus)
 }
 #endif
@@ -3722,6 +3722,11 @@ IMG_VOID SetSGXDispatchTableEntry(IMG_VOID)
 	SetDispatchTableEntry(PVRSRV_BRIDGE_SGX_READREGISTRYDWORD, DummyBW);
 
 	SetDispatchTableEntry(PVRSRV_BRIDGE_SGX_2DQUERYBLTSCOMPLETE, SGX2DQueryBlitsCompleteBW);
+#if !defined(PDUMP)
+	SetDispatchTableEntryConcurrent(PVRSRV_BRIDGE_SGX_2DQUERYBLTSCOMPLETE,
+									PVRSRV_BRIDGE_IN_2DQUERYBLTSCOMPLETE,
+									PVRSRV_BRIDGE_RETURN);
+#endif
 
 #if defined(TRANSFER_QUEUE)
 	SetDispatchTableEntry(PVRSRV_BRIDGE_SGX_SUBMITTRANSFER, SGXSubmitTransferBW);
@@ -31,15 +31,22 @@
 #include "hash.h"
 #include "osfunc.h"
 #include "mm.h"
-
 #define PRIVATE_MAX(a,b) ((a)>(b)?(a):(b))
 
-#define	KEY_TO_INDEX(pHash, key, uSize) \
-	((pHash)->pfnHashFunc((pHash)->uKeySize, (key), (uSize)) % (uSize))
+#define	KEY_HASH(pHash, key) \
+	((pHash)->pfnHashFunc((pHash)->uKeySize, (key), (pHash)->uSize))
 
 #define	KEY_COMPARE(pHash, pKey1, pKey2) \
 	((pHash)->pfnKeyComp((pHash)->uKeySize, (pKey1), (pKey2)))
 
+/*
+ * Old table chains moved to the new table on each insert or remove while a
+ * resize is in progress.  Growing starts when the count reaches half the
+ * new size, so the old table is always drained long before the next
+ * resize is due and no single call ever rehashes the whole table.
+ */
+#define HASH_MIGRATE_CHAINS	4
+
 struct _BUCKET_
 {
 	
@@ -48,6 +55,9 @@ struct _BUCKET_
 	
 	IMG_UINTPTR_T v;
 
+	/* full hash of k, so rehashing and mismatches never touch the key */
+	IMG_UINT32 uHash;
+
 	
 	IMG_UINTPTR_T k[];		 
 };
@@ -75,8 +85,25 @@ struct _HASH_TABLE_
 
 	
 	HASH_KEY_COMP *pfnKeyComp;
+
+	/* table being drained into ppBucketTable, IMG_NULL if not resizing */
+	BUCKET **ppOldTable;
+	IMG_UINT32 uOldSize;
+
+	/* old table chains below this index have been moved */
+	IMG_UINT32 uMigrateIndex;
+
+	/* HASH_Iterate in progress, table must not be resized */
+	IMG_UINT32 uIterating;
 };
 
+#ifdef DEBUG
+static HASH_LOOKUP_STATS gsLookupStats;
+#define HASH_STAT_INC(field)	(gsLookupStats.field++)
+#else
+#define HASH_STAT_INC(field)
+#endif
+
 IMG_UINT32
 HASH_Func_Default (IMG_SIZE_T uKeySize, IMG_VOID *pKey, IMG_UINT32 uHashTabLen)
 {
@@ -127,8 +154,8 @@ HASH_Key_Comp_Default (IMG_SIZE_T uKeySize, IMG_VOID *pKey1, IMG_VOID *pKey2)
 	return IMG_TRUE;
 }
 
-static PVRSRV_ERROR
-_ChainInsert (HASH_TABLE *pHash, BUCKET *pBucket, BUCKET **ppBucketTable, IMG_UINT32 uSize)
+static IMG_VOID
+_ChainInsert (BUCKET *pBucket, BUCKET **ppBucketTable, IMG_UINT32 uSize)
 {
 	IMG_UINT32 uIndex;
 
@@ -136,43 +163,39 @@ _ChainInsert (HASH_TABLE *pHash, BUCKET *pBucket, BUCKET **ppBucketTable, IMG_UI
 	PVR_ASSERT (ppBucketTable != IMG_NULL);
 	PVR_ASSERT (uSize != 0);
 
-	if ((pBucket == IMG_NULL) || (ppBucketTable == IMG_NULL) || (uSize == 0))
-	{
-		PVR_DPF((PVR_DBG_ERROR, "_ChainInsert: invalid parameter"));
-		return PVRSRV_ERROR_INVALID_PARAMS;
-	}
-
-	uIndex = KEY_TO_INDEX(pHash, pBucket->k, uSize);	 
+	uIndex = pBucket->uHash % uSize;
 	pBucket->pNext = ppBucketTable[uIndex];
 	ppBucketTable[uIndex] = pBucket;
-
-	return PVRSRV_OK;
 }
 
-static PVRSRV_ERROR
-_Rehash (HASH_TABLE *pHash,
-	 BUCKET **ppOldTable, IMG_UINT32 uOldSize,
-         BUCKET **ppNewTable, IMG_UINT32 uNewSize)
+static IMG_VOID
+_MigrateChains (HASH_TABLE *pHash, IMG_UINT32 uChains)
 {
-	IMG_UINT32 uIndex;
-	for (uIndex=0; uIndex< uOldSize; uIndex++)
-    {
-		BUCKET *pBucket;
-		pBucket = ppOldTable[uIndex];
+	if (pHash->ppOldTable == IMG_NULL)
+		return;
+
+	while (uChains-- > 0 && pHash->uMigrateIndex < pHash->uOldSize)
+	{
+		BUCKET *pBucket = pHash->ppOldTable[pHash->uMigrateIndex];
+
+		pHash->ppOldTable[pHash->uMigrateIndex++] = IMG_NULL;
 		while (pBucket != IMG_NULL)
 		{
-			PVRSRV_ERROR eError;
 			BUCKET *pNextBucket = pBucket->pNext;
-			eError = _ChainInsert (pHash, pBucket, ppNewTable, uNewSize);
-			if (eError != PVRSRV_OK)
-			{
-				PVR_DPF((PVR_DBG_ERROR, "_Rehash: call to _ChainInsert failed"));
-				return eError;
-			}
+			_ChainInsert (pBucket, pHash->ppBucketTable, pHash->uSize);
 			pBucket = pNextBucket;
 		}
-    }
-	return PVRSRV_OK;
+		HASH_STAT_INC(ui32MigratedChains);
+	}
+
+	if (pHash->uMigrateIndex == pHash->uOldSize)
+	{
+		OSFreeMem (PVRSRV_PAGEABLE_SELECT, sizeof(BUCKET *)*pHash->uOldSize, pHash->ppOldTable, IMG_NULL);
+		
+		pHash->ppOldTable = IMG_NULL;
+		pHash->uOldSize = 0;
+		pHash->uMigrateIndex = 0;
+	}
 }
 
 static IMG_BOOL
@@ -183,6 +206,9 @@ _Resize (HASH_TABLE *pHash, IMG_UINT32 uNewSize, IMG_BOOL bNoWait)
 		BUCKET **ppNewTable;
         IMG_UINT32 uIndex;
 
+		if (pHash->ppOldTable != IMG_NULL || pHash->uIterating != 0)
+			return IMG_FALSE;
+
 		PVR_DPF ((PVR_DBG_MESSAGE,
                   "HASH_Resize: oldsize=0x%x  newsize=0x%x  count=0x%x  nowait=%d",
 				pHash->uSize, uNewSize, pHash->uCount, bNoWait));
@@ -204,19 +230,72 @@ _Resize (HASH_TABLE *pHash, IMG_UINT32 uNewSize, IMG_BOOL bNoWait)
         for (uIndex=0; uIndex<uNewSize; uIndex++)
             ppNewTable[uIndex] = IMG_NULL;
 
-        if (_Rehash (pHash, pHash->ppBucketTable, pHash->uSize, ppNewTable, uNewSize) != PVRSRV_OK)
-		{
-			return IMG_FALSE;
-		}
+		pHash->ppOldTable = pHash->ppBucketTable;
+		pHash->uOldSize = pHash->uSize;
+		pHash->uMigrateIndex = 0;
 
-        OSFreeMem (PVRSRV_PAGEABLE_SELECT, sizeof(BUCKET *)*pHash->uSize, pHash->ppBucketTable, IMG_NULL);
-        
         pHash->ppBucketTable = ppNewTable;
         pHash->uSize = uNewSize;
+
+		HASH_STAT_INC(ui32Resizes);
+		_MigrateChains (pHash, HASH_MIGRATE_CHAINS);
     }
     return IMG_TRUE;
 }
 
+static IMG_VOID
+_RecordLookup (IMG_UINT32 uDepth, IMG_BOOL bFound)
+{
+#ifdef DEBUG
+	if (uDepth >= HASH_LOOKUP_DEPTH_SLOTS)
+		uDepth = HASH_LOOKUP_DEPTH_SLOTS - 1;
+	HASH_STAT_INC(aui32Depth[uDepth]);
+	if (!bFound)
+		HASH_STAT_INC(ui32Misses);
+#else
+	PVR_UNREFERENCED_PARAMETER(uDepth);
+	PVR_UNREFERENCED_PARAMETER(bFound);
+#endif
+}
+
+/*
+ * Returns the link pointing at the bucket for pKey, or IMG_NULL.  While a
+ * resize is in progress the key may still sit in the old table.
+ */
+static BUCKET **
+_FindBucket (HASH_TABLE *pHash, IMG_VOID *pKey)
+{
+	IMG_UINT32 uHash = KEY_HASH(pHash, pKey);
+	IMG_UINT32 uDepth = 0;
+	BUCKET **ppBucket;
+
+	for (ppBucket = &(pHash->ppBucketTable[uHash % pHash->uSize]); *ppBucket != IMG_NULL; ppBucket = &((*ppBucket)->pNext))
+	{
+		uDepth++;
+		if ((*ppBucket)->uHash == uHash && KEY_COMPARE(pHash, (*ppBucket)->k, pKey))
+		{
+			_RecordLookup (uDepth, IMG_TRUE);
+			return ppBucket;
+		}
+	}
+
+	if (pHash->ppOldTable != IMG_NULL)
+	{
+		for (ppBucket = &(pHash->ppOldTable[uHash % pHash->uOldSize]); *ppBucket != IMG_NULL; ppBucket = &((*ppBucket)->pNext))
+		{
+			uDepth++;
+			if ((*ppBucket)->uHash == uHash && KEY_COMPARE(pHash, (*ppBucket)->k, pKey))
+			{
+				_RecordLookup (uDepth, IMG_TRUE);
+				return ppBucket;
+			}
+		}
+	}
+
+	_RecordLookup (uDepth, IMG_FALSE);
+	return IMG_NULL;
+}
+
 
 HASH_TABLE * HASH_Create_Extended (IMG_UINT32 uInitialLen, IMG_SIZE_T uKeySize, HASH_FUNC *pfnHashFunc, HASH_KEY_COMP *pfnKeyComp)
 {
@@ -239,6 +318,10 @@ HASH_TABLE * HASH_Create_Extended (IMG_UINT32 uInitialLen, IMG_SIZE_T uKeySize,
 	pHash->uKeySize = (IMG_UINT32)uKeySize;
 	pHash->pfnHashFunc = pfnHashFunc;
 	pHash->pfnKeyComp = pfnKeyComp;
+	pHash->ppOldTable = IMG_NULL;
+	pHash->uOldSize = 0;
+	pHash->uMigrateIndex = 0;
+	pHash->uIterating = 0;
 
 	OSAllocMem(PVRSRV_PAGEABLE_SELECT,
                   sizeof (BUCKET *) * pHash->uSize,
@@ -276,6 +359,11 @@ HASH_Delete (HASH_TABLE *pHash)
 			PVR_DPF ((PVR_DBG_ERROR, "HASH_Delete: leak detected in hash table!"));
 			PVR_DPF ((PVR_DBG_ERROR, "Likely Cause: client drivers not freeing alocations before destroying devmemcontext"));
 		}
+		if (pHash->ppOldTable != IMG_NULL)
+		{
+			OSFreeMem(PVRSRV_PAGEABLE_SELECT, sizeof(BUCKET *)*pHash->uOldSize, pHash->ppOldTable, IMG_NULL);
+			pHash->ppOldTable = IMG_NULL;
+		}
 		OSFreeMem(PVRSRV_PAGEABLE_SELECT, sizeof(BUCKET *)*pHash->uSize, pHash->ppBucketTable, IMG_NULL);
 		pHash->ppBucketTable = IMG_NULL;
 		OSFreeMem(PVRSRV_PAGEABLE_SELECT, sizeof(HASH_TABLE), pHash, IMG_NULL);
@@ -322,13 +410,10 @@ HASH_Insert_Extended_Internal (HASH_TABLE *pHash, IMG_VOID *pKey, IMG_UINTPTR_T
 	pBucket->v = v;
 	 
 	OSMemCopy(pBucket->k, pKey, pHash->uKeySize);
-	if (_ChainInsert (pHash, pBucket, pHash->ppBucketTable, pHash->uSize) != PVRSRV_OK)
-	{
-		OSFreeMem(PVRSRV_PAGEABLE_SELECT,
-				  sizeof(BUCKET) + pHash->uKeySize,
-				  pBucket, IMG_NULL);
-		return IMG_FALSE;
-	}
+	pBucket->uHash = KEY_HASH(pHash, pBucket->k);
+
+	_MigrateChains (pHash, HASH_MIGRATE_CHAINS);
+	_ChainInsert (pBucket, pHash->ppBucketTable, pHash->uSize);
 
 	pHash->uCount++;
 
@@ -376,7 +461,6 @@ IMG_UINTPTR_T
 HASH_Remove_Extended(HASH_TABLE *pHash, IMG_VOID *pKey)
 {
 	BUCKET **ppBucket;
-	IMG_UINT32 uIndex;
 
 	PVR_DPF ((PVR_DBG_MESSAGE, "HASH_Remove_Extended: Hash=0x%x, pKey=0x%x",
 			(IMG_UINTPTR_T)pHash, (IMG_UINTPTR_T)pKey));
@@ -389,39 +473,36 @@ HASH_Remove_Extended(HASH_TABLE *pHash, IMG_VOID *pKey)
 		return 0;
 	}
 
-	uIndex = KEY_TO_INDEX(pHash, pKey, pHash->uSize);
+	_MigrateChains (pHash, HASH_MIGRATE_CHAINS);
 
-	for (ppBucket = &(pHash->ppBucketTable[uIndex]); *ppBucket != IMG_NULL; ppBucket = &((*ppBucket)->pNext))
+	ppBucket = _FindBucket (pHash, pKey);
+	if (ppBucket != IMG_NULL)
 	{
-		 
-		if (KEY_COMPARE(pHash, (*ppBucket)->k, pKey))
-		{
-			BUCKET *pBucket = *ppBucket;
-			IMG_UINTPTR_T v = pBucket->v;
-			(*ppBucket) = pBucket->pNext;
+		BUCKET *pBucket = *ppBucket;
+		IMG_UINTPTR_T v = pBucket->v;
+		(*ppBucket) = pBucket->pNext;
 
-			OSFreeMem(PVRSRV_PAGEABLE_SELECT, sizeof(BUCKET) + pHash->uKeySize, pBucket, IMG_NULL);
-			
+		OSFreeMem(PVRSRV_PAGEABLE_SELECT, sizeof(BUCKET) + pHash->uKeySize, pBucket, IMG_NULL);
+		
 
-			pHash->uCount--;
+		pHash->uCount--;
 
-			
-			if (pHash->uSize > (pHash->uCount << 2) &&
-                pHash->uSize > pHash->uMinimumSize)
-            {
-                
-
-				_Resize (pHash,
-                         PRIVATE_MAX (pHash->uSize >> 1,
-                                      pHash->uMinimumSize),
-                         IMG_FALSE);
-            }
-
-			PVR_DPF ((PVR_DBG_MESSAGE,
-                      "HASH_Remove_Extended: Hash=0x%x, pKey=0x%x = 0x%x",
-                      (IMG_UINTPTR_T)pHash, (IMG_UINTPTR_T)pKey, v));
-			return v;
-		}
+		
+		if (pHash->uSize > (pHash->uCount << 2) &&
+            pHash->uSize > pHash->uMinimumSize)
+        {
+            
+
+			_Resize (pHash,
+                     PRIVATE_MAX (pHash->uSize >> 1,
+                                  pHash->uMinimumSize),
+                     IMG_FALSE);
+        }
+
+		PVR_DPF ((PVR_DBG_MESSAGE,
+                  "HASH_Remove_Extended: Hash=0x%x, pKey=0x%x = 0x%x",
+                  (IMG_UINTPTR_T)pHash, (IMG_UINTPTR_T)pKey, v));
+		return v;
 	}
 	PVR_DPF ((PVR_DBG_MESSAGE,
               "HASH_Remove_Extended: Hash=0x%x, pKey=0x%x = 0x0 !!!!",
@@ -442,7 +523,6 @@ IMG_UINTPTR_T
 HASH_Retrieve_Extended (HASH_TABLE *pHash, IMG_VOID *pKey)
 {
 	BUCKET **ppBucket;
-	IMG_UINT32 uIndex;
 
 	PVR_DPF ((PVR_DBG_MESSAGE, "HASH_Retrieve_Extended: Hash=0x%x, pKey=0x%x",
 			(IMG_UINTPTR_T)pHash, (IMG_UINTPTR_T)pKey));
@@ -455,21 +535,15 @@ HASH_Retrieve_Extended (HASH_TABLE *pHash, IMG_VOID *pKey)
 		return 0;
 	}
 
-	uIndex = KEY_TO_INDEX(pHash, pKey, pHash->uSize);
-
-	for (ppBucket = &(pHash->ppBucketTable[uIndex]); *ppBucket != IMG_NULL; ppBucket = &((*ppBucket)->pNext))
+	ppBucket = _FindBucket (pHash, pKey);
+	if (ppBucket != IMG_NULL)
 	{
-		 
-		if (KEY_COMPARE(pHash, (*ppBucket)->k, pKey))
-		{
-			BUCKET *pBucket = *ppBucket;
-			IMG_UINTPTR_T v = pBucket->v;
+		IMG_UINTPTR_T v = (*ppBucket)->v;
 
-			PVR_DPF ((PVR_DBG_MESSAGE,
-                      "HASH_Retrieve: Hash=0x%x, pKey=0x%x = 0x%x",
-                      (IMG_UINTPTR_T)pHash, (IMG_UINTPTR_T)pKey, v));
-			return v;
-		}
+		PVR_DPF ((PVR_DBG_MESSAGE,
+                  "HASH_Retrieve: Hash=0x%x, pKey=0x%x = 0x%x",
+                  (IMG_UINTPTR_T)pHash, (IMG_UINTPTR_T)pKey, v));
+		return v;
 	}
 	PVR_DPF ((PVR_DBG_MESSAGE,
               "HASH_Retrieve: Hash=0x%x, pKey=0x%x = 0x0 !!!!",
@@ -488,28 +562,43 @@ HASH_Retrieve (HASH_TABLE *pHash, IMG_UINTPTR_T k)
 PVRSRV_ERROR
 HASH_Iterate(HASH_TABLE *pHash, HASH_pfnCallback pfnCallback)
 {
+	PVRSRV_ERROR eError = PVRSRV_OK;
 	IMG_UINT32 uIndex;
-	for (uIndex=0; uIndex < pHash->uSize; uIndex++)
+
+	/* callbacks may remove entries, so finish any resize and hold off new ones */
+	_MigrateChains (pHash, pHash->uOldSize);
+
+	pHash->uIterating++;
+	for (uIndex=0; uIndex < pHash->uSize && eError == PVRSRV_OK; uIndex++)
 	{
 		BUCKET *pBucket;
 		pBucket = pHash->ppBucketTable[uIndex];
 		while (pBucket != IMG_NULL)
 		{
-			PVRSRV_ERROR eError;
 			BUCKET *pNextBucket = pBucket->pNext;
-			
+
 			eError = pfnCallback((IMG_UINTPTR_T) ((IMG_VOID *) *(pBucket->k)), (IMG_UINTPTR_T) pBucket->v);
 
 			
 			if (eError != PVRSRV_OK)
-				return eError;
+				break;
 
 			pBucket = pNextBucket;
 		}
 	}
-	return PVRSRV_OK;
+	pHash->uIterating--;
+
+	return eError;
 }
 
+#ifdef DEBUG
+IMG_VOID
+HASH_GetLookupStats (HASH_LOOKUP_STATS *psStats)
+{
+	OSMemCopy(psStats, &gsLookupStats, sizeof(*psStats));
+}
+#endif
+
 #ifdef HASH_TRACE
 IMG_VOID
 HASH_Dump (HASH_TABLE *pHash)
@@ -538,6 +627,7 @@ HASH_Dump (HASH_TABLE *pHash)
 
 	PVR_TRACE(("hash table: uMinimumSize=%d  size=%d  count=%d",
 			pHash->uMinimumSize, pHash->uSize, pHash->uCount));
-	PVR_TRACE(("  empty=%d  max=%d", uEmptyCount, uMaxLength));
+	PVR_TRACE(("  empty=%d  max=%d  resizing=%d",
+			uEmptyCount, uMaxLength, pHash->ppOldTable != IMG_NULL));
 }
 #endif
@@ -132,6 +132,9 @@ struct _RA_ARENA_
 	
 	BT *aHeadFree [FREE_TABLE_LIMIT];
 
+	/* bit n set when aHeadFree[n] is non-empty */
+	IMG_UINT32 uFreeBitmap;
+
 	
 	BT *pHeadSegment;
 	BT *pTailSegment;
@@ -212,6 +215,9 @@ _RequestAllocFail (IMG_VOID *_h,
 static IMG_UINT32
 pvr_log2 (IMG_SIZE_T n)
 {
+#ifdef __linux__
+	return (n > 1) ? (IMG_UINT32)(fls(n) - 1) : 0;
+#else
 	IMG_UINT32 l = 0;
 	n>>=1;
 	while (n>0)
@@ -220,6 +226,7 @@ pvr_log2 (IMG_SIZE_T n)
 		l++;
 	}
 	return l;
+#endif
 }
 
 static PVRSRV_ERROR
@@ -380,6 +387,7 @@ _FreeListInsert (RA_ARENA *pArena, BT *pBT)
 	if (pArena->aHeadFree[uIndex] != IMG_NULL)
 		pArena->aHeadFree[uIndex]->pPrevFree = pBT;
 	pArena->aHeadFree [uIndex] = pBT;
+	pArena->uFreeBitmap |= 1U << uIndex;
 }
 
 static IMG_VOID
@@ -393,6 +401,30 @@ _FreeListRemove (RA_ARENA *pArena, BT *pBT)
 		pArena->aHeadFree[uIndex] = pBT->pNextFree;
 	else
 		pBT->pPrevFree->pNextFree = pBT->pNextFree;
+	if (pArena->aHeadFree[uIndex] == IMG_NULL)
+		pArena->uFreeBitmap &= ~(1U << uIndex);
+}
+
+/* first non-empty free list at or above uIndex, FREE_TABLE_LIMIT if none */
+static IMG_UINT32
+_FreeListNextIndex (RA_ARENA *pArena, IMG_UINT32 uIndex)
+{
+	IMG_UINT32 uMask;
+
+	if (uIndex >= FREE_TABLE_LIMIT)
+		return FREE_TABLE_LIMIT;
+
+	uMask = pArena->uFreeBitmap & ~((1U << uIndex) - 1);
+	if (uMask == 0)
+		return FREE_TABLE_LIMIT;
+
+#ifdef __linux__
+	return (IMG_UINT32)__ffs(uMask);
+#else
+	while ((uMask & (1U << uIndex)) == 0)
+		uIndex++;
+	return uIndex;
+#endif
 }
 
 static BT *
@@ -612,6 +644,7 @@ _FreeBT (RA_ARENA *pArena, BT *pBT, IMG_BOOL bFreeBackingStore)
 		
 #ifdef RA_STATS
 		pArena->sStatistics.uFreeSegmentCount--;
+		pArena->sStatistics.uCoalesceCount++;
 #endif
 	}
 
@@ -628,6 +661,7 @@ _FreeBT (RA_ARENA *pArena, BT *pBT, IMG_BOOL bFreeBackingStore)
 		
 #ifdef RA_STATS
 		pArena->sStatistics.uFreeSegmentCount--;
+		pArena->sStatistics.uCoalesceCount++;
 #endif
 	}
 
@@ -686,6 +720,148 @@ _FreeBT (RA_ARENA *pArena, BT *pBT, IMG_BOOL bFreeBackingStore)
 }
 
 
+static BT *
+_FreeListSearch (RA_ARENA *pArena,
+				 IMG_UINT32 uIndex,
+				 IMG_SIZE_T uSize,
+				 IMG_UINT32 uFlags,
+				 IMG_UINT32 uAlignment,
+				 IMG_UINT32 uAlignmentOffset,
+				 IMG_UINTPTR_T *pAlignedBase)
+{
+	BT *pBT;
+
+	for (pBT = pArena->aHeadFree[uIndex]; pBT != IMG_NULL; pBT = pBT->pNextFree)
+	{
+		IMG_UINTPTR_T aligned_base;
+
+		if (uAlignment>1)
+			aligned_base = (pBT->base + uAlignmentOffset + uAlignment - 1) / uAlignment * uAlignment - uAlignmentOffset;
+		else
+			aligned_base = pBT->base;
+		PVR_DPF ((PVR_DBG_MESSAGE,
+				  "RA_AttemptAllocAligned: pBT-base=0x%x "
+				  "pBT-size=0x%x alignedbase=0x%x size=0x%x",
+				pBT->base, pBT->uSize, aligned_base, uSize));
+
+		if (pBT->base + pBT->uSize >= aligned_base + uSize)
+		{
+			if(!pBT->psMapping || pBT->psMapping->ui32Flags == uFlags)
+			{
+				*pAlignedBase = aligned_base;
+				return pBT;
+			}
+			else
+			{
+				PVR_DPF ((PVR_DBG_MESSAGE,
+						"AttemptAllocAligned: mismatch in flags. Import has %x, request was %x", pBT->psMapping->ui32Flags, uFlags));
+			}
+		}
+	}
+
+	return IMG_NULL;
+}
+
+static IMG_BOOL
+_AllocFromFreeBT (RA_ARENA *pArena,
+				  BT *pBT,
+				  IMG_UINTPTR_T aligned_base,
+				  IMG_SIZE_T uSize,
+				  BM_MAPPING **ppsMapping,
+				  IMG_UINTPTR_T *base)
+{
+	_FreeListRemove (pArena, pBT);
+
+	PVR_ASSERT (pBT->type == btt_free);
+
+#ifdef RA_STATS
+	pArena->sStatistics.uLiveSegmentCount++;
+	pArena->sStatistics.uFreeSegmentCount--;
+	pArena->sStatistics.uFreeResourceCount-=pBT->uSize;
+#endif
+
+	
+	if (aligned_base > pBT->base)
+	{
+		BT *pNeighbour;
+		pNeighbour = _SegmentSplit (pArena, pBT, (IMG_SIZE_T)(aligned_base - pBT->base));
+		
+		if (pNeighbour==IMG_NULL)
+		{
+			PVR_DPF ((PVR_DBG_ERROR,"_AttemptAllocAligned: Front split failed"));
+			
+			_FreeListInsert (pArena, pBT);
+			return IMG_FALSE;
+		}
+
+		_FreeListInsert (pArena, pBT);
+#ifdef RA_STATS
+		pArena->sStatistics.uFreeSegmentCount++;
+		pArena->sStatistics.uFreeResourceCount+=pBT->uSize;
+#endif
+		pBT = pNeighbour;
+	}
+
+	
+	if (pBT->uSize > uSize)
+	{
+		BT *pNeighbour;
+		pNeighbour = _SegmentSplit (pArena, pBT, uSize);
+		
+		if (pNeighbour==IMG_NULL)
+		{
+			PVR_DPF ((PVR_DBG_ERROR,"_AttemptAllocAligned: Back split failed"));
+			
+			_FreeListInsert (pArena, pBT);
+			return IMG_FALSE;
+		}
+
+		_FreeListInsert (pArena, pNeighbour);
+#ifdef RA_STATS
+		pArena->sStatistics.uFreeSegmentCount++;
+		pArena->sStatistics.uFreeResourceCount+=pNeighbour->uSize;
+#endif
+	}
+
+	pBT->type = btt_live;
+
+#if defined(VALIDATE_ARENA_TEST)
+	if (pBT->eResourceType == IMPORTED_RESOURCE_TYPE)
+	{
+		pBT->eResourceSpan = IMPORTED_RESOURCE_SPAN_LIVE;
+	}
+	else if (pBT->eResourceType == NON_IMPORTED_RESOURCE_TYPE)
+	{
+		pBT->eResourceSpan = RESOURCE_SPAN_LIVE;
+	}
+	else
+	{
+		PVR_DPF ((PVR_DBG_ERROR,"_AttemptAllocAligned ERROR: pBT->eResourceType unrecognized"));
+		PVR_DBG_BREAK;
+	}
+#endif
+	if (!HASH_Insert (pArena->pSegmentHash, pBT->base, (IMG_UINTPTR_T) pBT))
+	{
+		_FreeBT (pArena, pBT, IMG_FALSE);
+		return IMG_FALSE;
+	}
+
+	if (ppsMapping!=IMG_NULL)
+		*ppsMapping = pBT->psMapping;
+
+	*base = pBT->base;
+
+	return IMG_TRUE;
+}
+
+/*
+ * Free segments are kept on power-of-two size class lists with a bitmap
+ * of the non-empty ones.  Every segment in a class above the request's
+ * own one is big enough, so the first non-empty such class is found
+ * with one bit scan and normally satisfies the request from its head.
+ * The request's own class holds segments both smaller and larger than
+ * the request and is only searched when the bigger classes cannot help.
+ */
 static IMG_BOOL
 _AttemptAllocAligned (RA_ARENA *pArena,
 					  IMG_SIZE_T uSize,
@@ -696,6 +872,10 @@ _AttemptAllocAligned (RA_ARENA *pArena,
 					  IMG_UINTPTR_T *base)
 {
 	IMG_UINT32 uIndex;
+	IMG_UINT32 uFitIndex;
+	IMG_UINTPTR_T aligned_base;
+	BT *pBT;
+
 	PVR_ASSERT (pArena!=IMG_NULL);
 	if (pArena == IMG_NULL)
 	{
@@ -707,145 +887,42 @@ _AttemptAllocAligned (RA_ARENA *pArena,
 		uAlignmentOffset %= uAlignment;
 
 	
-
 	uIndex = pvr_log2 (uSize);
+	uFitIndex = (((IMG_SIZE_T)1 << uIndex) < uSize) ? uIndex + 1 : uIndex;
 
-#if 0
-	
-	if (1u<<uIndex < uSize)
-		uIndex++;
-#endif
-
-	while (uIndex < FREE_TABLE_LIMIT && pArena->aHeadFree[uIndex]==IMG_NULL)
-		uIndex++;
-
-	while (uIndex < FREE_TABLE_LIMIT)
+	for (uFitIndex = _FreeListNextIndex (pArena, uFitIndex);
+		 uFitIndex < FREE_TABLE_LIMIT;
+		 uFitIndex = _FreeListNextIndex (pArena, uFitIndex + 1))
 	{
-		if (pArena->aHeadFree[uIndex]!=IMG_NULL)
+		pBT = _FreeListSearch (pArena, uFitIndex, uSize, uFlags,
+							   uAlignment, uAlignmentOffset, &aligned_base);
+		if (pBT != IMG_NULL)
 		{
-			
-			BT *pBT;
-
-			pBT = pArena->aHeadFree [uIndex];
-			while (pBT!=IMG_NULL)
-			{
-				IMG_UINTPTR_T aligned_base;
-
-				if (uAlignment>1)
-					aligned_base = (pBT->base + uAlignmentOffset + uAlignment - 1) / uAlignment * uAlignment - uAlignmentOffset;
-				else
-					aligned_base = pBT->base;
-				PVR_DPF ((PVR_DBG_MESSAGE,
-						  "RA_AttemptAllocAligned: pBT-base=0x%x "
-						  "pBT-size=0x%x alignedbase=0x%x size=0x%x",
-						pBT->base, pBT->uSize, aligned_base, uSize));
-
-				if (pBT->base + pBT->uSize >= aligned_base + uSize)
-				{
-					if(!pBT->psMapping || pBT->psMapping->ui32Flags == uFlags)
-					{
-						_FreeListRemove (pArena, pBT);
-
-						PVR_ASSERT (pBT->type == btt_free);
-
 #ifdef RA_STATS
-						pArena->sStatistics.uLiveSegmentCount++;
-						pArena->sStatistics.uFreeSegmentCount--;
-						pArena->sStatistics.uFreeResourceCount-=pBT->uSize;
+			pArena->sStatistics.uFitClassAllocs++;
 #endif
+			return _AllocFromFreeBT (pArena, pBT, aligned_base, uSize, ppsMapping, base);
+		}
+	}
 
-						
-						if (aligned_base > pBT->base)
-						{
-							BT *pNeighbour;
-							pNeighbour = _SegmentSplit (pArena, pBT, (IMG_SIZE_T)(aligned_base - pBT->base));
-							
-							if (pNeighbour==IMG_NULL)
-							{
-								PVR_DPF ((PVR_DBG_ERROR,"_AttemptAllocAligned: Front split failed"));
-								
-								_FreeListInsert (pArena, pBT);
-								return IMG_FALSE;
-							}
-
-							_FreeListInsert (pArena, pBT);
-	#ifdef RA_STATS
-							pArena->sStatistics.uFreeSegmentCount++;
-							pArena->sStatistics.uFreeResourceCount+=pBT->uSize;
-	#endif
-							pBT = pNeighbour;
-						}
-
-						
-						if (pBT->uSize > uSize)
-						{
-							BT *pNeighbour;
-							pNeighbour = _SegmentSplit (pArena, pBT, uSize);
-							
-							if (pNeighbour==IMG_NULL)
-							{
-								PVR_DPF ((PVR_DBG_ERROR,"_AttemptAllocAligned: Back split failed"));
-								
-								_FreeListInsert (pArena, pBT);
-								return IMG_FALSE;
-							}
-
-							_FreeListInsert (pArena, pNeighbour);
-	#ifdef RA_STATS
-							pArena->sStatistics.uFreeSegmentCount++;
-							pArena->sStatistics.uFreeResourceCount+=pNeighbour->uSize;
-	#endif
-						}
-
-						pBT->type = btt_live;
-
-#if defined(VALIDATE_ARENA_TEST)
-						if (pBT->eResourceType == IMPORTED_RESOURCE_TYPE)
-						{
-							pBT->eResourceSpan = IMPORTED_RESOURCE_SPAN_LIVE;
-						}
-						else if (pBT->eResourceType == NON_IMPORTED_RESOURCE_TYPE)
-						{
-							pBT->eResourceSpan = RESOURCE_SPAN_LIVE;
-						}
-						else
-						{
-							PVR_DPF ((PVR_DBG_ERROR,"_AttemptAllocAligned ERROR: pBT->eResourceType unrecognized"));
-							PVR_DBG_BREAK;
-						}
+	
+	if (((IMG_SIZE_T)1 << uIndex) < uSize && (pArena->uFreeBitmap & (1U << uIndex)))
+	{
+		pBT = _FreeListSearch (pArena, uIndex, uSize, uFlags,
+							   uAlignment, uAlignmentOffset, &aligned_base);
+		if (pBT != IMG_NULL)
+		{
+#ifdef RA_STATS
+			pArena->sStatistics.uSplitClassAllocs++;
 #endif
-						if (!HASH_Insert (pArena->pSegmentHash, pBT->base, (IMG_UINTPTR_T) pBT))
-						{
-							_FreeBT (pArena, pBT, IMG_FALSE);
-							return IMG_FALSE;
-						}
-
-						if (ppsMapping!=IMG_NULL)
-							*ppsMapping = pBT->psMapping;
-
-						*base = pBT->base;
-
-						return IMG_TRUE;
-					}
-					else
-					{
-						PVR_DPF ((PVR_DBG_MESSAGE,
-								"AttemptAllocAligned: mismatch in flags. Import has %x, request was %x", pBT->psMapping->ui32Flags, uFlags));
-
-					}
-				}
-				pBT = pBT->pNextFree;
-			}
-
+			return _AllocFromFreeBT (pArena, pBT, aligned_base, uSize, ppsMapping, base);
 		}
-		uIndex++;
 	}
 
 	return IMG_FALSE;
 }
 
 
-
 RA_ARENA *
 RA_Create (IMG_CHAR *name,
 		   IMG_UINTPTR_T base,
@@ -884,6 +961,7 @@ RA_Create (IMG_CHAR *name,
 	pArena->pImportHandle = pImportHandle;
 	for (i=0; i<FREE_TABLE_LIMIT; i++)
 		pArena->aHeadFree[i] = IMG_NULL;
+	pArena->uFreeBitmap = 0;
 	pArena->pHeadSegment = IMG_NULL;
 	pArena->pTailSegment = IMG_NULL;
 	pArena->uQuantum = uQuantum;
@@ -898,6 +976,9 @@ RA_Create (IMG_CHAR *name,
 	pArena->sStatistics.uCumulativeFrees = 0;
 	pArena->sStatistics.uImportCount = 0;
 	pArena->sStatistics.uExportCount = 0;
+	pArena->sStatistics.uCoalesceCount = 0;
+	pArena->sStatistics.uFitClassAllocs = 0;
+	pArena->sStatistics.uSplitClassAllocs = 0;
 #endif
 
 #if defined(CONFIG_PROC_FS) && defined(DEBUG)
@@ -990,6 +1071,7 @@ RA_Delete (RA_ARENA *pArena)
 
 	for (uIndex=0; uIndex<FREE_TABLE_LIMIT; uIndex++)
 		pArena->aHeadFree[uIndex] = IMG_NULL;
+	pArena->uFreeBitmap = 0;
 
 	while (pArena->pHeadSegment != IMG_NULL)
 	{
@@ -1568,6 +1650,15 @@ static void RA_ProcSeqShowInfo(struct seq_file *sfile, void* el)
 	case 10:
 		seq_printf(sfile, "export count\t\t%u\n", pArena->sStatistics.uExportCount);
 		break;
+	case 11:
+		seq_printf(sfile, "coalesce count\t\t%u\n", pArena->sStatistics.uCoalesceCount);
+		break;
+	case 12:
+		seq_printf(sfile, "fit class allocs\t%u\n", pArena->sStatistics.uFitClassAllocs);
+		break;
+	case 13:
+		seq_printf(sfile, "split class allocs\t%u\n", pArena->sStatistics.uSplitClassAllocs);
+		break;
 #endif
 	}
 
@@ -1576,7 +1667,7 @@ static void RA_ProcSeqShowInfo(struct seq_file *sfile, void* el)
 static void* RA_ProcSeqOff2ElementInfo(struct seq_file * sfile, loff_t off)
 {
 #ifdef RA_STATS
-	if(off <= 9)
+	if(off <= 12)
 #else
 	if(off <= 1)
 #endif
@@ -1629,6 +1720,7 @@ PVRSRV_ERROR RA_GetStats(RA_ARENA *pArena,
 	IMG_CHAR 	*pszStr = *ppszStr;
 	IMG_UINT32 	ui32StrLen = *pui32StrLen;
 	IMG_INT32	i32Count;
+	IMG_UINT32	uIndex;
 	BT 			*pBT;
 
 	CHECK_SPACE(ui32StrLen);
@@ -1678,6 +1770,44 @@ PVRSRV_ERROR RA_GetStats(RA_ARENA *pArena,
 	i32Count = OSSNPrintf(pszStr, 100, "export count\t\t%u\n", pArena->sStatistics.uExportCount);
 	UPDATE_SPACE(pszStr, i32Count, ui32StrLen);
 
+	CHECK_SPACE(ui32StrLen);
+	i32Count = OSSNPrintf(pszStr, 100, "coalesce count\t\t%u\n", pArena->sStatistics.uCoalesceCount);
+	UPDATE_SPACE(pszStr, i32Count, ui32StrLen);
+
+	CHECK_SPACE(ui32StrLen);
+	i32Count = OSSNPrintf(pszStr, 100, "fit class allocs\t%u\n", pArena->sStatistics.uFitClassAllocs);
+	UPDATE_SPACE(pszStr, i32Count, ui32StrLen);
+
+	CHECK_SPACE(ui32StrLen);
+	i32Count = OSSNPrintf(pszStr, 100, "split class allocs\t%u\n", pArena->sStatistics.uSplitClassAllocs);
+	UPDATE_SPACE(pszStr, i32Count, ui32StrLen);
+
+	CHECK_SPACE(ui32StrLen);
+	i32Count = OSSNPrintf(pszStr, 100, "  free lists:\n");
+	UPDATE_SPACE(pszStr, i32Count, ui32StrLen);
+
+	for (uIndex = _FreeListNextIndex(pArena, 0);
+		 uIndex < FREE_TABLE_LIMIT;
+		 uIndex = _FreeListNextIndex(pArena, uIndex + 1))
+	{
+		IMG_UINT32 uSegments = 0;
+		IMG_SIZE_T uBytes = 0;
+		IMG_SIZE_T uLargest = 0;
+
+		for (pBT = pArena->aHeadFree[uIndex]; pBT != IMG_NULL; pBT = pBT->pNextFree)
+		{
+			uSegments++;
+			uBytes += pBT->uSize;
+			if (pBT->uSize > uLargest)
+				uLargest = pBT->uSize;
+		}
+
+		CHECK_SPACE(ui32StrLen);
+		i32Count = OSSNPrintf(pszStr, 100, "\tclass 2^%u: segments=%u size=0x%x largest=0x%x\n",
+							  uIndex, uSegments, uBytes, uLargest);
+		UPDATE_SPACE(pszStr, i32Count, ui32StrLen);
+	}
+
 	CHECK_SPACE(ui32StrLen);
 	i32Count = OSSNPrintf(pszStr, 100, "  segment Chain:\n");
 	UPDATE_SPACE(pszStr, i32Count, ui32StrLen);
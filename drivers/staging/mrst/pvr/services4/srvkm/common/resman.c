@@ -674,6 +674,7 @@ static PVRSRV_ERROR FreeResourceByCriteria(PRESMAN_CONTEXT	psResManContext,
 {
 	PRESMAN_ITEM	psCurItem;
 	PVRSRV_ERROR	eError = PVRSRV_OK;
+	IMG_HANDLE		hBridgeLock;
 
 	
 	
@@ -692,10 +693,10 @@ static PVRSRV_ERROR FreeResourceByCriteria(PRESMAN_CONTEXT	psResManContext,
 			if (eError == PVRSRV_ERROR_RETRY)
 			{
 				RELEASE_SYNC_OBJ;
-				OSReleaseBridgeLock();
+				hBridgeLock = OSReleaseBridgeLock();
 				
 				OSSleepms(MAX_CLEANUP_TIME_WAIT_US/1000);
-				OSReacquireBridgeLock();
+				OSReacquireBridgeLock(hBridgeLock);
 				ACQUIRE_SYNC_OBJ;
 			}
 		} while (eError == PVRSRV_ERROR_RETRY);
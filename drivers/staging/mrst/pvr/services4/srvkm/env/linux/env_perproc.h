@@ -29,6 +29,7 @@
 
 #include <linux/list.h>
 #include <linux/proc_fs.h>
+#include <linux/rwsem.h>
 
 #include "services.h"
 #include "handle.h"
@@ -37,6 +38,8 @@ typedef struct _PVRSRV_ENV_PER_PROCESS_DATA_
 {
 	IMG_HANDLE hBlockAlloc;
 	struct proc_dir_entry *psProcDir;
+	/* read by concurrent bridge calls, written by all others */
+	struct rw_semaphore sBridgeLock;
 #if defined(SUPPORT_DRI_DRM) && defined(PVR_SECURE_DRM_AUTH_EXPORT)
 	struct list_head sDRMAuthListHead;
 #endif
@@ -255,6 +255,7 @@ PVRSRV_ERROR LinuxEventObjectSignal(IMG_HANDLE hOSEventObjectList)
 PVRSRV_ERROR LinuxEventObjectWait(IMG_HANDLE hOSEventObject, IMG_UINT32 ui32MSTimeout)
 {
 	IMG_UINT32 ui32TimeStamp;
+	IMG_HANDLE hBridgeLock;
 	DEFINE_WAIT(sWait);
 
 	PVRSRV_LINUX_EVENT_OBJECT *psLinuxEventObject = (PVRSRV_LINUX_EVENT_OBJECT *) hOSEventObject;
@@ -271,11 +272,11 @@ PVRSRV_ERROR LinuxEventObjectWait(IMG_HANDLE hOSEventObject, IMG_UINT32 ui32MSTi
 			break;
 		}
 
-		LinuxUnLockMutex(&gPVRSRVLock);		
+		hBridgeLock = LinuxReleaseBridgeLock();
 
 		ui32TimeOutJiffies = (IMG_UINT32)schedule_timeout((IMG_INT32)ui32TimeOutJiffies);
 		
-		LinuxLockMutex(&gPVRSRVLock);
+		LinuxReacquireBridgeLock(hBridgeLock);
 #if defined(DEBUG)
 		psLinuxEventObject->ui32Stats++;
 #endif			
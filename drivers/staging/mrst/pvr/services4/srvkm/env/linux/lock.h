@@ -29,4 +29,7 @@
 
 extern PVRSRV_LINUX_MUTEX gPVRSRVLock;
 
+IMG_HANDLE LinuxReleaseBridgeLock(IMG_VOID);
+IMG_VOID LinuxReacquireBridgeLock(IMG_HANDLE hBridgeLock);
+
 #endif 
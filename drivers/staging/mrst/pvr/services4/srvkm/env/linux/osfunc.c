@@ -3221,14 +3221,14 @@ IMG_UINT32 OSAtomicRead(IMG_PVOID pvRefCount)
 	return (IMG_UINT32) atomic_read(&psRefCount->RefCount);
 }
 
-IMG_VOID OSReleaseBridgeLock(IMG_VOID)
+IMG_HANDLE OSReleaseBridgeLock(IMG_VOID)
 {
-       LinuxUnLockMutex(&gPVRSRVLock);
+       return LinuxReleaseBridgeLock();
 }
 
-IMG_VOID OSReacquireBridgeLock(IMG_VOID)
+IMG_VOID OSReacquireBridgeLock(IMG_HANDLE hBridgeLock)
 {
-       LinuxLockMutex(&gPVRSRVLock);
+       LinuxReacquireBridgeLock(hBridgeLock);
 }
 
 typedef struct _OSTime
@@ -56,6 +56,7 @@ PVRSRV_ERROR OSPerProcessPrivateDataInit(IMG_HANDLE *phOsPrivateData)
 	OSMemSet(psEnvPerProc, 0, sizeof(*psEnvPerProc));
 
 	psEnvPerProc->hBlockAlloc = hBlockAlloc;
+	init_rwsem(&psEnvPerProc->sBridgeLock);
 
 	
 	LinuxMMapPerProcessConnect(psEnvPerProc);
@@ -37,6 +37,9 @@ typedef struct
 	
 	IMG_UINT32 ui32OpenPID;
 
+	/* per-process data of the opener, pinned by the open reference */
+	struct _PVRSRV_PER_PROCESS_DATA_ *psPerProc;
+
 	
 #if defined (SUPPORT_SID_INTERFACE)
 	IMG_SID hKernelMemInfo;
@@ -51,6 +51,7 @@
 #include "linkage.h"
 
 #include "lists.h"
+#include "hash.h"
 
 static struct proc_dir_entry * dir;
 
@@ -86,6 +87,7 @@ static struct proc_dir_entry* g_pProcSysNodes;
 
 #ifdef DEBUG
 static struct proc_dir_entry* g_pProcDebugLevel;
+static struct proc_dir_entry* g_pProcHashStats;
 #endif
 
 #ifdef PVR_MANUAL_POWER_CONTROL
@@ -95,6 +97,10 @@ static struct proc_dir_entry* g_pProcPowerLevel;
 
 static void ProcSeqShowVersion(struct seq_file *sfile,void* el);
 
+#ifdef DEBUG
+static void ProcSeqShowHashStats(struct seq_file *sfile,void* el);
+#endif
+
 static void ProcSeqShowSysNodes(struct seq_file *sfile,void* el);
 static void* ProcSeqOff2ElementSysNodes(struct seq_file * sfile, loff_t off);
 
@@ -613,6 +619,14 @@ IMG_INT CreateProcEntries(IMG_VOID)
         return -ENOMEM;
     }
 
+	g_pProcHashStats = CreateProcReadEntrySeq("hash_stats", NULL, NULL, ProcSeqShowHashStats, ProcSeq1ElementHeaderOff2Element, NULL);
+	if(!g_pProcHashStats)
+    {
+        PVR_DPF((PVR_DBG_ERROR, "CreateProcEntries: couldn't make /proc/%s/hash_stats", PVRProcDirRoot));
+
+        return -ENOMEM;
+    }
+
 #ifdef PVR_MANUAL_POWER_CONTROL
 	g_pProcPowerLevel = CreateProcEntrySeq("power_control", NULL, NULL,
 											ProcSeqShowPowerLevel,
@@ -684,6 +698,7 @@ IMG_VOID RemoveProcEntries(IMG_VOID)
 {
 #ifdef DEBUG
 	RemoveProcEntrySeq( g_pProcDebugLevel );
+	RemoveProcEntrySeq( g_pProcHashStats );
 #ifdef PVR_MANUAL_POWER_CONTROL
 	RemoveProcEntrySeq( g_pProcPowerLevel );
 #endif 
@@ -726,6 +741,33 @@ static void ProcSeqShowVersion(struct seq_file *sfile,void* el)
 	seq_printf( sfile, "System Version String: %s\n", pszSystemVersionString);
 }
 
+#ifdef DEBUG
+static void ProcSeqShowHashStats(struct seq_file *sfile,void* el)
+{
+	HASH_LOOKUP_STATS sStats;
+	IMG_UINT32 i;
+
+	if(el == PVR_PROC_SEQ_START_TOKEN)
+	{
+		seq_printf(sfile, "Depth Lookups\n");
+		return;
+	}
+
+	HASH_GetLookupStats(&sStats);
+
+	for (i = 0; i < HASH_LOOKUP_DEPTH_SLOTS; i++)
+	{
+		seq_printf(sfile, "%s%-4u %u\n",
+				   (i == HASH_LOOKUP_DEPTH_SLOTS - 1) ? ">=" : "",
+				   i, sStats.aui32Depth[i]);
+	}
+
+	seq_printf(sfile, "Misses: %u\n", sStats.ui32Misses);
+	seq_printf(sfile, "Resizes: %u\n", sStats.ui32Resizes);
+	seq_printf(sfile, "Migrated chains: %u\n", sStats.ui32MigratedChains);
+}
+#endif
+
 static const IMG_CHAR *deviceTypeToString(PVRSRV_DEVICE_TYPE deviceType)
 {
     switch (deviceType)
@@ -24,11 +24,16 @@
  *
  ******************************************************************************/
 
+#include <linux/rwsem.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+
 #include "img_defs.h"
 #include "services.h"
 #include "pvr_bridge.h"
 #include "perproc.h"
 #include "mutex.h"
+#include "lock.h"
 #include "syscommon.h"
 #include "pvr_debug.h"
 #include "proc.h"
@@ -37,13 +42,11 @@
 #include "pvr_bridge_km.h"
 #include "refcount.h"
 #include "buffer_manager.h"
+#include "env_perproc.h"
 
 #if defined(SUPPORT_DRI_DRM)
 #include <drm/drmP.h>
 #include "pvr_drm.h"
-#if defined(PVR_SECURE_DRM_AUTH_EXPORT)
-#include "env_perproc.h"
-#endif
 #endif
 
 #if defined(SUPPORT_VGX)
@@ -72,12 +75,85 @@ static void ProcSeqStartstopBridgeStats(struct seq_file *sfile,IMG_BOOL start);
 
 #endif
 
-extern PVRSRV_LINUX_MUTEX gPVRSRVLock;
-
 #if defined(SUPPORT_MEMINFO_IDS)
 static IMG_UINT64 ui64Stamp;
 #endif 
 
+/*
+ * Per-process bridge lock held for writing by the current owner of
+ * gPVRSRVLock, if any.  Protected by gPVRSRVLock.
+ *
+ * Calls flagged concurrent in the dispatch table only take their process'
+ * lock for reading; every other call takes gPVRSRVLock and then the lock
+ * of the process it runs for, for writing.
+ */
+static struct rw_semaphore *g_psBridgeProcessLock;
+
+#if defined(DEBUG_BRIDGE_KM)
+static DEFINE_SPINLOCK(g_sBridgeStatsLock);
+
+static IMG_VOID BridgeRecordCallStats(IMG_UINT32 ui32BridgeID,
+									  IMG_BOOL bConcurrent,
+									  IMG_BOOL bContended,
+									  ktime_t sStart,
+									  ktime_t sLocked)
+{
+	PVRSRV_BRIDGE_DISPATCH_TABLE_ENTRY *psEntry;
+	IMG_UINT64 ui64CallNs;
+
+	if (ui32BridgeID >= BRIDGE_DISPATCH_TABLE_ENTRY_COUNT)
+	{
+		return;
+	}
+
+	psEntry = &g_BridgeDispatchTable[ui32BridgeID];
+	ui64CallNs = ktime_to_ns(ktime_sub(ktime_get(), sStart));
+
+	spin_lock(&g_sBridgeStatsLock);
+	if (bConcurrent)
+	{
+		psEntry->ui32ConcurrentCount++;
+	}
+	if (bContended)
+	{
+		psEntry->ui32ContendedCount++;
+	}
+	psEntry->ui64LockWaitNs += ktime_to_ns(ktime_sub(sLocked, sStart));
+	psEntry->ui64CallNs += ui64CallNs;
+	if (ui64CallNs > psEntry->ui64MaxCallNs)
+	{
+		psEntry->ui64MaxCallNs = ui64CallNs;
+	}
+	spin_unlock(&g_sBridgeStatsLock);
+}
+#endif
+
+IMG_HANDLE LinuxReleaseBridgeLock(IMG_VOID)
+{
+	struct rw_semaphore *psBridgeProcessLock = g_psBridgeProcessLock;
+
+	if (psBridgeProcessLock != IMG_NULL)
+	{
+		g_psBridgeProcessLock = IMG_NULL;
+		up_write(psBridgeProcessLock);
+	}
+	LinuxUnLockMutex(&gPVRSRVLock);
+
+	return (IMG_HANDLE)psBridgeProcessLock;
+}
+
+IMG_VOID LinuxReacquireBridgeLock(IMG_HANDLE hBridgeLock)
+{
+	struct rw_semaphore *psBridgeProcessLock = (struct rw_semaphore *)hBridgeLock;
+
+	LinuxLockMutex(&gPVRSRVLock);
+	if (psBridgeProcessLock != IMG_NULL)
+	{
+		down_write(psBridgeProcessLock);
+		g_psBridgeProcessLock = psBridgeProcessLock;
+	}
+}
+
 PVRSRV_ERROR
 LinuxBridgeInit(IMG_VOID)
 {
@@ -148,6 +224,8 @@ static void* ProcSeqNextBridgeStats(struct seq_file *sfile,void* el,loff_t off)
 static void ProcSeqShowBridgeStats(struct seq_file *sfile,void* el)
 {
 	PVRSRV_BRIDGE_DISPATCH_TABLE_ENTRY *psEntry = (	PVRSRV_BRIDGE_DISPATCH_TABLE_ENTRY*)el;
+	IMG_UINT32 ui32ConcurrentCount, ui32ContendedCount;
+	IMG_UINT64 ui64LockWaitNs, ui64CallNs, ui64MaxCallNs;
 
 	if(el == PVR_PROC_SEQ_START_TOKEN) 
 	{
@@ -156,7 +234,7 @@ static void ProcSeqShowBridgeStats(struct seq_file *sfile,void* el)
 						  "Total number of bytes copied via copy_from_user = %u\n"
 						  "Total number of bytes copied via copy_to_user = %u\n"
 						  "Total number of bytes copied via copy_*_user = %u\n\n"
-						  "%-45s | %-40s | %10s | %20s | %10s\n",
+						  "%-45s | %-40s | %10s | %20s | %10s | %10s | %10s | %14s | %14s | %14s\n",
 						  g_BridgeGlobalStats.ui32IOCTLCount,
 						  g_BridgeGlobalStats.ui32TotalCopyFromUserBytes,
 						  g_BridgeGlobalStats.ui32TotalCopyToUserBytes,
@@ -165,18 +243,40 @@ static void ProcSeqShowBridgeStats(struct seq_file *sfile,void* el)
 						  "Wrapper Function",
 						  "Call Count",
 						  "copy_from_user Bytes",
-						  "copy_to_user Bytes"
+						  "copy_to_user Bytes",
+						  "Concurrent",
+						  "Contended",
+						  "Lock Wait us",
+						  "Total us",
+						  "Max us"
 						 );
 		return;
 	}
 
+	spin_lock(&g_sBridgeStatsLock);
+	ui32ConcurrentCount = psEntry->ui32ConcurrentCount;
+	ui32ContendedCount = psEntry->ui32ContendedCount;
+	ui64LockWaitNs = psEntry->ui64LockWaitNs;
+	ui64CallNs = psEntry->ui64CallNs;
+	ui64MaxCallNs = psEntry->ui64MaxCallNs;
+	spin_unlock(&g_sBridgeStatsLock);
+
+	do_div(ui64LockWaitNs, NSEC_PER_USEC);
+	do_div(ui64CallNs, NSEC_PER_USEC);
+	do_div(ui64MaxCallNs, NSEC_PER_USEC);
+
 	seq_printf(sfile,
-				   "%-45s   %-40s   %-10u   %-20u   %-10u\n",
+				   "%-45s   %-40s   %-10u   %-20u   %-10u   %-10u   %-10u   %-14llu   %-14llu   %-14llu\n",
 				   psEntry->pszIOCName,
 				   psEntry->pszFunctionName,
 				   psEntry->ui32CallCount,
 				   psEntry->ui32CopyFromUserTotalBytes,
-				   psEntry->ui32CopyToUserTotalBytes);
+				   psEntry->ui32CopyToUserTotalBytes,
+				   ui32ConcurrentCount,
+				   ui32ContendedCount,
+				   ui64LockWaitNs,
+				   ui64CallNs,
+				   ui64MaxCallNs);
 }
 
 #endif 
@@ -198,9 +298,14 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 	PVRSRV_BRIDGE_PACKAGE *psBridgePackageKM;
 	IMG_UINT32 ui32PID = OSGetCurrentProcessIDKM();
 	PVRSRV_PER_PROCESS_DATA *psPerProc;
+	PVRSRV_ENV_PER_PROCESS_DATA *psEnvPerProc;
+	PVRSRV_FILE_PRIVATE_DATA *psPrivateData = PRIVATE_DATA(pFile);
+	IMG_BOOL bContended = IMG_FALSE;
 	IMG_INT err = -EFAULT;
-
-	LinuxLockMutex(&gPVRSRVLock);
+#if defined(DEBUG_BRIDGE_KM)
+	ktime_t sStart = ktime_get();
+	ktime_t sLocked;
+#endif
 
 #if defined(SUPPORT_DRI_DRM)
 	psBridgePackageKM = (PVRSRV_BRIDGE_PACKAGE *)arg;
@@ -215,7 +320,7 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 		PVR_DPF((PVR_DBG_ERROR, "%s: Received invalid pointer to function arguments",
 				 __FUNCTION__));
 
-		goto unlock_and_return;
+		return err;
 	}
 	
 	
@@ -225,11 +330,56 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 					  sizeof(PVRSRV_BRIDGE_PACKAGE))
 	  != PVRSRV_OK)
 	{
-		goto unlock_and_return;
+		return err;
 	}
 #endif
 
 	cmd = psBridgePackageKM->ui32BridgeID;
+
+	/*
+	 * Calls that only read from the caller's own handle base skip
+	 * gPVRSRVLock when the file was opened by the calling process and
+	 * carries no exported MemInfo; anything else takes the exclusive path.
+	 */
+	psPerProc = psPrivateData->psPerProc;
+	if(BridgedIsConcurrentKM(PVRSRV_GET_BRIDGE_ID(cmd)) &&
+	   psPerProc != IMG_NULL &&
+	   psPerProc->ui32PID == ui32PID &&
+	   psPerProc->hPerProcData == psBridgePackageKM->hKernelServices &&
+	   !psPrivateData->hKernelMemInfo)
+	{
+		psEnvPerProc = (PVRSRV_ENV_PER_PROCESS_DATA *)PVRSRVProcessPrivateData(psPerProc);
+		if(psEnvPerProc != IMG_NULL)
+		{
+			if(!down_read_trylock(&psEnvPerProc->sBridgeLock))
+			{
+				bContended = IMG_TRUE;
+				down_read(&psEnvPerProc->sBridgeLock);
+			}
+#if defined(DEBUG_BRIDGE_KM)
+			sLocked = ktime_get();
+#endif
+
+			psBridgePackageKM->ui32BridgeID = PVRSRV_GET_BRIDGE_ID(cmd);
+			err = BridgedDispatchConcurrentKM(psPerProc, psBridgePackageKM);
+
+			up_read(&psEnvPerProc->sBridgeLock);
+#if defined(DEBUG_BRIDGE_KM)
+			BridgeRecordCallStats(psBridgePackageKM->ui32BridgeID, IMG_TRUE,
+								  bContended, sStart, sLocked);
+#endif
+			return err;
+		}
+	}
+
+	if(LinuxIsLockedMutex(&gPVRSRVLock))
+	{
+		bContended = IMG_TRUE;
+	}
+	LinuxLockMutex(&gPVRSRVLock);
+#if defined(DEBUG_BRIDGE_KM)
+	sLocked = ktime_get();
+#endif
 	
 	if(cmd != PVRSRV_BRIDGE_CONNECT_SERVICES)
 	{
@@ -266,14 +416,26 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 		}
 	}
 
+	psEnvPerProc = (PVRSRV_ENV_PER_PROCESS_DATA *)PVRSRVProcessPrivateData(psPerProc);
+	if(psEnvPerProc != IMG_NULL)
+	{
+		if(!down_write_trylock(&psEnvPerProc->sBridgeLock))
+		{
+			bContended = IMG_TRUE;
+			down_write(&psEnvPerProc->sBridgeLock);
+		}
+		g_psBridgeProcessLock = &psEnvPerProc->sBridgeLock;
+	}
+#if defined(DEBUG_BRIDGE_KM)
+	sLocked = ktime_get();
+#endif
+
 	psBridgePackageKM->ui32BridgeID = PVRSRV_GET_BRIDGE_ID(psBridgePackageKM->ui32BridgeID);
 
 	switch(cmd)
 	{
 		case PVRSRV_BRIDGE_EXPORT_DEVICEMEM_2:
 		{
-			PVRSRV_FILE_PRIVATE_DATA *psPrivateData = PRIVATE_DATA(pFile);
-
 			if(psPrivateData->hKernelMemInfo)
 			{
 				PVR_DPF((PVR_DBG_ERROR, "%s: Can only export one MemInfo "
@@ -288,7 +450,6 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 		{
 			PVRSRV_BRIDGE_IN_MAP_DEV_MEMORY *psMapDevMemIN =
 				(PVRSRV_BRIDGE_IN_MAP_DEV_MEMORY *)psBridgePackageKM->pvParamIn;
-			PVRSRV_FILE_PRIVATE_DATA *psPrivateData = PRIVATE_DATA(pFile);
 
 			if(!psPrivateData->hKernelMemInfo)
 			{
@@ -308,8 +469,6 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 
 		default:
 		{
-			PVRSRV_FILE_PRIVATE_DATA *psPrivateData = PRIVATE_DATA(pFile);
-
 			if(psPrivateData->hKernelMemInfo)
 			{
 				PVR_DPF((PVR_DBG_ERROR, "%s: Import/Export handle tried "
@@ -326,9 +485,8 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 		case PVRSRV_BRIDGE_MAP_DEV_MEMORY:
 		case PVRSRV_BRIDGE_MAP_DEVICECLASS_MEMORY:
 		{
-			PVRSRV_FILE_PRIVATE_DATA *psPrivateData;
+			PVRSRV_FILE_PRIVATE_DATA *psAuthPrivateData;
 			int authenticated = pFile->authenticated;
-			PVRSRV_ENV_PER_PROCESS_DATA *psEnvPerProc;
 
 			if (authenticated)
 			{
@@ -344,9 +502,9 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 				goto unlock_and_return;
 			}
 
-			list_for_each_entry(psPrivateData, &psEnvPerProc->sDRMAuthListHead, sDRMAuthListItem)
+			list_for_each_entry(psAuthPrivateData, &psEnvPerProc->sDRMAuthListHead, sDRMAuthListItem)
 			{
-				struct drm_file *psDRMFile = psPrivateData->psDRMFile;
+				struct drm_file *psDRMFile = psAuthPrivateData->psDRMFile;
 
 				if (pFile->master == psDRMFile->master)
 				{
@@ -381,7 +539,6 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 		{
 			PVRSRV_BRIDGE_OUT_EXPORTDEVICEMEM *psExportDeviceMemOUT =
 				(PVRSRV_BRIDGE_OUT_EXPORTDEVICEMEM *)psBridgePackageKM->pvParamOut;
-			PVRSRV_FILE_PRIVATE_DATA *psPrivateData = PRIVATE_DATA(pFile);
 			IMG_HANDLE hMemInfo;
 			PVRSRV_KERNEL_MEM_INFO *psKernelMemInfo;
 
@@ -431,7 +588,6 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 		{
 			PVRSRV_BRIDGE_OUT_MAP_DEV_MEMORY *psMapDeviceMemoryOUT =
 				(PVRSRV_BRIDGE_OUT_MAP_DEV_MEMORY *)psBridgePackageKM->pvParamOut;
-			PVRSRV_FILE_PRIVATE_DATA *psPrivateData = PRIVATE_DATA(pFile);
 			if (put_user(psPrivateData->ui64Stamp, &psMapDeviceMemoryOUT->sDstClientMemInfo.ui64Stamp) != 0)
 			{
 				err = -EFAULT;
@@ -458,6 +614,15 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 	}
 
 unlock_and_return:
+	if(g_psBridgeProcessLock != IMG_NULL)
+	{
+		up_write(g_psBridgeProcessLock);
+		g_psBridgeProcessLock = IMG_NULL;
+	}
 	LinuxUnLockMutex(&gPVRSRVLock);
+#if defined(DEBUG_BRIDGE_KM)
+	BridgeRecordCallStats(PVRSRV_GET_BRIDGE_ID(cmd), IMG_FALSE,
+						  bContended, sStart, sLocked);
+#endif
 	return err;
 }
@@ -34,11 +34,32 @@
 extern "C" {
 #endif
 
+/*
+ * The hash is computed once per entry and reused across resizes, so it
+ * must not depend on uHashTabLen.
+ */
 typedef IMG_UINT32 HASH_FUNC(IMG_SIZE_T uKeySize, IMG_VOID *pKey, IMG_UINT32 uHashTabLen);
 typedef IMG_BOOL HASH_KEY_COMP(IMG_SIZE_T uKeySize, IMG_VOID *pKey1, IMG_VOID *pKey2);
 
 typedef struct _HASH_TABLE_ HASH_TABLE;
 
+#ifdef DEBUG
+#define HASH_LOOKUP_DEPTH_SLOTS	8
+
+/*
+ * counters summed over all hash tables, debug builds only: they are bumped
+ * without a lock, so concurrent lookups may lose counts
+ */
+typedef struct _HASH_LOOKUP_STATS_
+{
+	/* lookups by entries compared, the last slot counts deeper ones too */
+	IMG_UINT32 aui32Depth[HASH_LOOKUP_DEPTH_SLOTS];
+	IMG_UINT32 ui32Misses;
+	IMG_UINT32 ui32Resizes;
+	IMG_UINT32 ui32MigratedChains;
+} HASH_LOOKUP_STATS;
+#endif
+
 typedef PVRSRV_ERROR (*HASH_pfnCallback) (
 	IMG_UINTPTR_T k,
 	IMG_UINTPTR_T v
@@ -70,6 +91,10 @@ IMG_UINTPTR_T HASH_Retrieve (HASH_TABLE *pHash, IMG_UINTPTR_T k);
 
 PVRSRV_ERROR HASH_Iterate(HASH_TABLE *pHash, HASH_pfnCallback pfnCallback);
 
+#ifdef DEBUG
+IMG_VOID HASH_GetLookupStats (HASH_LOOKUP_STATS *psStats);
+#endif
+
 #ifdef HASH_TRACE
 IMG_VOID HASH_Dump (HASH_TABLE *pHash);
 #endif
@@ -631,19 +631,19 @@ IMG_BOOL OSTimeHasTimePassed(IMG_PVOID pvData);
 IMG_VOID OSTimeDestroy(IMG_PVOID pvData);
 
 #if defined(__linux__)
-IMG_VOID OSReleaseBridgeLock(IMG_VOID);
-IMG_VOID OSReacquireBridgeLock(IMG_VOID);
+IMG_HANDLE OSReleaseBridgeLock(IMG_VOID);
+IMG_VOID OSReacquireBridgeLock(IMG_HANDLE hBridgeLock);
 #else
 
 #ifdef INLINE_IS_PRAGMA
 #pragma inline(OSReleaseBridgeLock)
 #endif
-static INLINE IMG_VOID OSReleaseBridgeLock(IMG_VOID) { }
+static INLINE IMG_HANDLE OSReleaseBridgeLock(IMG_VOID) { return IMG_NULL; }
 
 #ifdef INLINE_IS_PRAGMA
 #pragma inline(OSReacquireBridgeLock)
 #endif
-static INLINE IMG_VOID OSReacquireBridgeLock(IMG_VOID) { }
+static INLINE IMG_VOID OSReacquireBridgeLock(IMG_HANDLE hBridgeLock) { PVR_UNREFERENCED_PARAMETER(hBridgeLock); }
 
 #endif
 
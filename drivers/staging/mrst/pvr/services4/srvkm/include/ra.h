@@ -67,6 +67,15 @@ struct _RA_STATISTICS_
 
     
     IMG_SIZE_T uExportCount;
+
+    /* free segments merged into a neighbour as it was freed */
+    IMG_SIZE_T uCoalesceCount;
+
+    /* allocations served from a size class where every segment fits */
+    IMG_SIZE_T uFitClassAllocs;
+
+    /* allocations that had to search the request's own size class */
+    IMG_SIZE_T uSplitClassAllocs;
 };
 typedef struct _RA_STATISTICS_ RA_STATISTICS;
 
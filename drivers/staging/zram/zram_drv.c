@@ -28,10 +28,13 @@
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/rbtree.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/wait.h>
 
 #include "zram_drv.h"
 
@@ -89,18 +92,19 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
-static int page_zero_filled(void *ptr)
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
 			return 0;
 	}
 
+	*element = page[0];
 	return 1;
 }
 
@@ -133,56 +137,382 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+static void zram_strm_free(struct zram_strm *strm)
+{
+	kfree(strm->workmem);
+	free_pages((unsigned long)strm->buffer, 1);
+	kfree(strm);
+}
+
+static struct zram_strm *zram_strm_alloc(gfp_t flags)
+{
+	struct zram_strm *strm;
+
+	strm = kmalloc(sizeof(*strm), flags);
+	if (!strm)
+		return NULL;
+
+	strm->workmem = kmalloc(LZO1X_MEM_COMPRESS, flags);
+	/*
+	 * Allocate 2 pages since LZO may expand an incompressible
+	 * page beyond PAGE_SIZE.
+	 */
+	strm->buffer = (void *)__get_free_pages(flags, 1);
+	if (!strm->workmem || !strm->buffer) {
+		zram_strm_free(strm);
+		return NULL;
+	}
+
+	return strm;
+}
+
+/*
+ * Get an idle compression stream, allocating a new one if the pool
+ * has not yet reached max_strm. Otherwise, sleep until another writer
+ * releases its stream. There is always at least one stream allocated
+ * for an initialized device so a failed allocation here just means
+ * waiting for it.
+ */
+static struct zram_strm *zram_strm_find(struct zram *zram)
+{
+	struct zram_strm *strm;
+
+	while (1) {
+		spin_lock(&zram->strm_lock);
+		if (!list_empty(&zram->idle_strm)) {
+			strm = list_entry(zram->idle_strm.next,
+					struct zram_strm, list);
+			list_del(&strm->list);
+			spin_unlock(&zram->strm_lock);
+			return strm;
+		}
+
+		if (zram->avail_strm >= zram->max_strm) {
+			spin_unlock(&zram->strm_lock);
+			zram_stat64_inc(zram, &zram->stats.strm_waits);
+			wait_event(zram->strm_wait,
+				!list_empty(&zram->idle_strm));
+			continue;
+		}
+
+		zram->avail_strm++;
+		spin_unlock(&zram->strm_lock);
+
+		strm = zram_strm_alloc(GFP_NOIO);
+		if (strm)
+			return strm;
+
+		spin_lock(&zram->strm_lock);
+		zram->avail_strm--;
+		spin_unlock(&zram->strm_lock);
+		zram_stat64_inc(zram, &zram->stats.strm_waits);
+		wait_event(zram->strm_wait, !list_empty(&zram->idle_strm));
+	}
+}
+
+static void zram_strm_release(struct zram *zram, struct zram_strm *strm)
+{
+	spin_lock(&zram->strm_lock);
+	if (zram->avail_strm <= zram->max_strm) {
+		list_add(&strm->list, &zram->idle_strm);
+		spin_unlock(&zram->strm_lock);
+		wake_up(&zram->strm_wait);
+		return;
+	}
+
+	/* max_strm was lowered while this stream was in use */
+	zram->avail_strm--;
+	spin_unlock(&zram->strm_lock);
+	zram_strm_free(strm);
+}
+
+void zram_set_max_streams(struct zram *zram, int num_strm)
+{
+	struct zram_strm *strm;
+
+	spin_lock(&zram->strm_lock);
+	zram->max_strm = num_strm;
+	/* Never drop the last stream of an initialized device */
+	while (zram->avail_strm > num_strm && zram->avail_strm > 1 &&
+			!list_empty(&zram->idle_strm)) {
+		strm = list_entry(zram->idle_strm.next,
+				struct zram_strm, list);
+		list_del(&strm->list);
+		zram->avail_strm--;
+		spin_unlock(&zram->strm_lock);
+		zram_strm_free(strm);
+		spin_lock(&zram->strm_lock);
+	}
+	spin_unlock(&zram->strm_lock);
+}
+
+static void zram_strm_destroy_all(struct zram *zram)
+{
+	struct zram_strm *strm;
+
+	while (!list_empty(&zram->idle_strm)) {
+		strm = list_entry(zram->idle_strm.next,
+				struct zram_strm, list);
+		list_del(&strm->list);
+		zram_strm_free(strm);
+	}
+	zram->avail_strm = 0;
+}
+
+static u32 zram_dedup_checksum(void *mem)
+{
+	return jhash2(mem, PAGE_SIZE / sizeof(u32), 0);
+}
+
+/*
+ * Check whether the object of entry decompresses to the same content
+ * as mem, using buf as scratch space.
+ */
+static int zram_dedup_match(struct zram *zram, struct zram_entry *entry,
+				void *mem, void *buf)
+{
+	int ret;
+	size_t clen = PAGE_SIZE;
+	unsigned char *cmem;
+
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	ret = lzo1x_decompress_safe(cmem, entry->len, buf, &clen);
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	return ret == LZO_E_OK && clen == PAGE_SIZE &&
+		!memcmp(mem, buf, PAGE_SIZE);
+}
+
+/*
+ * Drop a reference to entry. Returns the zsmalloc handle to free if
+ * this was the last one, 0 otherwise.
+ */
+static unsigned long zram_dedup_put(struct zram *zram,
+				struct zram_entry *entry)
+{
+	unsigned long handle;
+
+	spin_lock(&zram->dedup_lock);
+	if (--entry->refcount) {
+		spin_unlock(&zram->dedup_lock);
+		return 0;
+	}
+	rb_erase(&entry->rb_node, &zram->dedup_tree);
+	spin_unlock(&zram->dedup_lock);
+
+	handle = entry->handle;
+	kfree(entry);
+
+	return handle;
+}
+
+/*
+ * Leftmost entry with this checksum at or after node, or the leftmost
+ * one in the tree when node is NULL. Caller must hold dedup_lock.
+ */
+static struct zram_entry *zram_dedup_next(struct zram *zram,
+				struct rb_node *node, u32 checksum)
+{
+	struct zram_entry *entry, *match = NULL;
+
+	if (node) {
+		node = rb_next(node);
+		if (!node)
+			return NULL;
+		entry = rb_entry(node, struct zram_entry, rb_node);
+		return entry->checksum == checksum ? entry : NULL;
+	}
+
+	node = zram->dedup_tree.rb_node;
+	while (node) {
+		entry = rb_entry(node, struct zram_entry, rb_node);
+		if (checksum < entry->checksum) {
+			node = node->rb_left;
+		} else if (checksum > entry->checksum) {
+			node = node->rb_right;
+		} else {
+			match = entry;
+			node = node->rb_left;
+		}
+	}
+
+	return match;
+}
+
+/*
+ * Drop the reference zram_dedup_get() took on a candidate that did not
+ * match. If the page using it was freed in the meantime this was the
+ * last reference, and zram_free_page() has already accounted that
+ * release as a duplicate going away, so correct the stats here.
+ */
+static void zram_dedup_put_candidate(struct zram *zram,
+				struct zram_entry *entry)
+{
+	size_t len = entry->len;
+	unsigned long handle;
+
+	handle = zram_dedup_put(zram, entry);
+	if (!handle)
+		return;
+
+	zs_free(zram->mem_pool, handle);
+	zram_stat64_sub(zram, &zram->stats.compr_size, len);
+	zram_stat64_add(zram, &zram->stats.dedup_saved, len);
+	write_lock(&zram->table_lock);
+	zram_stat_inc(&zram->stats.pages_dedup);
+	write_unlock(&zram->table_lock);
+}
+
+/*
+ * Look for an already stored page with the same content as mem and
+ * take a reference to it. buf must be able to hold PAGE_SIZE bytes.
+ * Candidates are pinned with a reference and compared without holding
+ * dedup_lock, so writers only serialise on the tree walk itself.
+ */
+static struct zram_entry *zram_dedup_get(struct zram *zram, void *mem,
+				u32 checksum, void *buf)
+{
+	struct zram_entry *entry, *next;
+
+	spin_lock(&zram->dedup_lock);
+	entry = zram_dedup_next(zram, NULL, checksum);
+	if (entry)
+		entry->refcount++;
+	spin_unlock(&zram->dedup_lock);
+
+	/* Checksums may collide, so compare content of every candidate */
+	while (entry) {
+		if (zram_dedup_match(zram, entry, mem, buf))
+			return entry;
+
+		/* Our reference keeps entry in the tree */
+		spin_lock(&zram->dedup_lock);
+		next = zram_dedup_next(zram, &entry->rb_node, checksum);
+		if (next)
+			next->refcount++;
+		spin_unlock(&zram->dedup_lock);
+
+		zram_dedup_put_candidate(zram, entry);
+		entry = next;
+	}
+
+	return NULL;
+}
+
+static struct zram_entry *zram_dedup_insert(struct zram *zram,
+				unsigned long handle, size_t len, u32 checksum)
+{
+	struct rb_node **p, *parent = NULL;
+	struct zram_entry *entry, *tmp;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO);
+	if (!entry)
+		return NULL;
+
+	entry->checksum = checksum;
+	entry->len = len;
+	entry->refcount = 1;
+	entry->handle = handle;
+
+	spin_lock(&zram->dedup_lock);
+	p = &zram->dedup_tree.rb_node;
+	while (*p) {
+		parent = *p;
+		tmp = rb_entry(parent, struct zram_entry, rb_node);
+		if (checksum < tmp->checksum)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&entry->rb_node, parent, p);
+	rb_insert_color(&entry->rb_node, &zram->dedup_tree);
+	spin_unlock(&zram->dedup_lock);
+
+	return entry;
+}
+
+/*
+ * zsmalloc handle of a compressed page.
+ */
+static unsigned long zram_obj_handle(struct zram *zram, u32 index)
+{
+	unsigned long handle = zram->table[index].handle;
+
+	if (zram->use_dedup)
+		return ((struct zram_entry *)handle)->handle;
+
+	return handle;
+}
+
+/*
+ * Caller must hold table_lock for writing.
+ */
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	u32 clen;
-	void *obj;
-
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	unsigned long handle = zram->table[index].handle;
 
-	if (unlikely(!page)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
+	/*
+	 * No memory is allocated for same element filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		if (!handle)
 			zram_stat_dec(&zram->stats.pages_zero);
-		}
+		zram_stat_dec(&zram->stats.pages_same);
+		zram->table[index].handle = 0;
 		return;
 	}
 
+	if (unlikely(!handle))
+		return;
+
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		clen = PAGE_SIZE;
-		__free_page(page);
+		__free_page((struct page *)handle);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
 		zram_stat_dec(&zram->stats.pages_expand);
+		zram_stat64_sub(zram, &zram->stats.compr_size, clen);
 		goto out;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
-
-	xv_free(zram->mem_pool, page, offset);
+	clen = zram->table[index].size;
 	if (clen <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
 
-out:
+	if (zram->use_dedup) {
+		handle = zram_dedup_put(zram, (struct zram_entry *)handle);
+		if (!handle) {
+			/* Object is still used by other pages */
+			zram_stat_dec(&zram->stats.pages_dedup);
+			zram_stat64_sub(zram, &zram->stats.dedup_saved, clen);
+			goto out;
+		}
+	}
+
+	zs_free(zram->mem_pool, handle);
 	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
+
+out:
 	zram_stat_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+	zram->table[index].handle = 0;
+	zram->table[index].size = 0;
 }
 
-static void handle_zero_page(struct page *page)
+static void handle_same_page(struct page *page, unsigned long element)
 {
-	void *user_mem;
+	unsigned int pos;
+	unsigned long *user_mem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	memset(user_mem, 0, PAGE_SIZE);
+	if (!element) {
+		memset(user_mem, 0, PAGE_SIZE);
+	} else {
+		for (pos = 0; pos != PAGE_SIZE / sizeof(*user_mem); pos++)
+			user_mem[pos] = element;
+	}
 	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
@@ -194,12 +524,11 @@ static void handle_uncompressed_page(struct zram *zram,
 	unsigned char *user_mem, *cmem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
+	cmem = kmap_atomic((struct page *)zram->table[index].handle, KM_USER1);
 
 	memcpy(user_mem, cmem, PAGE_SIZE);
-	kunmap_atomic(user_mem, KM_USER0);
 	kunmap_atomic(cmem, KM_USER1);
+	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
 }
@@ -217,23 +546,28 @@ static void zram_read(struct zram *zram, struct bio *bio)
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
 		size_t clen;
+		unsigned long handle;
 		struct page *page;
-		struct zobj_header *zheader;
 		unsigned char *user_mem, *cmem;
 
 		page = bvec->bv_page;
 
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			handle_zero_page(page);
+		read_lock(&zram->table_lock);
+
+		if (zram_test_flag(zram, index, ZRAM_SAME)) {
+			handle = zram->table[index].handle;
+			read_unlock(&zram->table_lock);
+			handle_same_page(page, handle);
 			index++;
 			continue;
 		}
 
 		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
+		if (unlikely(!zram->table[index].handle)) {
+			read_unlock(&zram->table_lock);
 			pr_debug("Read before write: sector=%lu, size=%u",
 				(ulong)(bio->bi_sector), bio->bi_size);
-			handle_zero_page(page);
+			handle_same_page(page, 0);
 			index++;
 			continue;
 		}
@@ -241,6 +575,7 @@ static void zram_read(struct zram *zram, struct bio *bio)
 		/* Page is stored uncompressed since it's incompressible */
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 			handle_uncompressed_page(zram, page, index);
+			read_unlock(&zram->table_lock);
 			index++;
 			continue;
 		}
@@ -248,16 +583,15 @@ static void zram_read(struct zram *zram, struct bio *bio)
 		user_mem = kmap_atomic(page, KM_USER0);
 		clen = PAGE_SIZE;
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+		handle = zram_obj_handle(zram, index);
+		cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
 
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
+		ret = lzo1x_decompress_safe(cmem, zram->table[index].size,
+					user_mem, &clen);
 
+		zs_unmap_object(zram->mem_pool, handle);
 		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
+		read_unlock(&zram->table_lock);
 
 		/* Should NEVER happen. Return bio error if it does. */
 		if (unlikely(ret != LZO_E_OK)) {
@@ -279,6 +613,12 @@ out:
 	bio_io_error(bio);
 }
 
+/*
+ * Pages are compressed using a stream from the per-device pool, so
+ * writers on different CPUs compress in parallel. table_lock is only
+ * taken to publish the result, after the object has been allocated
+ * and filled.
+ */
 static void zram_write(struct zram *zram, struct bio *bio)
 {
 	int i;
@@ -290,42 +630,65 @@ static void zram_write(struct zram *zram, struct bio *bio)
 
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		u32 offset;
 		size_t clen;
-		struct zobj_header *zheader;
+		u32 checksum = 0;
+		int dedup_hit = 0;
+		unsigned long handle, element;
+		struct zram_strm *strm;
+		struct zram_entry *entry;
 		struct page *page, *page_store;
 		unsigned char *user_mem, *cmem, *src;
 
 		page = bvec->bv_page;
-		src = zram->compress_buffer;
-
-		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
-		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
-
-		mutex_lock(&zram->lock);
 
 		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
+		if (page_same_filled(user_mem, &element)) {
 			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
+			write_lock(&zram->table_lock);
+			/*
+			 * System overwrites unused sectors. Free memory
+			 * associated with this sector now.
+			 */
+			zram_free_page(zram, index);
+			zram->table[index].handle = element;
+			zram_set_flag(zram, index, ZRAM_SAME);
+			zram_stat_inc(&zram->stats.pages_same);
+			if (!element)
+				zram_stat_inc(&zram->stats.pages_zero);
+			write_unlock(&zram->table_lock);
 			index++;
 			continue;
 		}
+		kunmap_atomic(user_mem, KM_USER0);
+
+		/* May sleep, so must not be called with the page mapped */
+		strm = zram_strm_find(zram);
+		src = strm->buffer;
+
+		if (zram->use_dedup) {
+			/* Comparing candidates may sleep, so use kmap() */
+			user_mem = kmap(page);
+			checksum = zram_dedup_checksum(user_mem);
+			entry = zram_dedup_get(zram, user_mem, checksum, src);
+			kunmap(page);
+			if (entry) {
+				zram_strm_release(zram, strm);
+				handle = (unsigned long)entry;
+				clen = entry->len;
+				dedup_hit = 1;
+				goto memstore;
+			}
+		}
+
+		user_mem = kmap_atomic(page, KM_USER0);
 
 		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+					strm->workmem);
 
 		kunmap_atomic(user_mem, KM_USER0);
 
 		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
+			zram_strm_release(zram, strm);
 			pr_err("Compression failed! err=%d\n", ret);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
@@ -337,10 +700,11 @@ static void zram_write(struct zram *zram, struct bio *bio)
 		 * errors which has side effect of hanging the system.
 		 */
 		if (unlikely(clen > max_zpage_size)) {
+			zram_strm_release(zram, strm);
+
 			clen = PAGE_SIZE;
 			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
 			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
 				pr_info("Error allocating memory for "
 					"incompressible page: %u\n", index);
 				zram_stat64_inc(zram,
@@ -348,52 +712,71 @@ static void zram_write(struct zram *zram, struct bio *bio)
 				goto out;
 			}
 
-			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
+			handle = (unsigned long)page_store;
 			src = kmap_atomic(page, KM_USER0);
+			cmem = kmap_atomic(page_store, KM_USER1);
+			memcpy(cmem, src, clen);
+			kunmap_atomic(cmem, KM_USER1);
+			kunmap_atomic(src, KM_USER0);
 			goto memstore;
 		}
 
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
+		handle = zs_malloc(zram->mem_pool, clen,
+				GFP_NOIO | __GFP_HIGHMEM);
+		if (!handle) {
+			zram_strm_release(zram, strm);
 			pr_info("Error allocating memory for compressed "
 				"page: %u, size=%zu\n", index, clen);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
 		}
 
-memstore:
-		zram->table[index].offset = offset;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
-
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
+		cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
+		memcpy(cmem, src, clen);
+		zs_unmap_object(zram->mem_pool, handle);
+		zram_strm_release(zram, strm);
+
+		if (zram->use_dedup) {
+			entry = zram_dedup_insert(zram, handle, clen, checksum);
+			if (!entry) {
+				zs_free(zram->mem_pool, handle);
+				pr_info("Error allocating dedup entry for "
+					"page: %u\n", index);
+				zram_stat64_inc(zram,
+					&zram->stats.failed_writes);
+				goto out;
+			}
+			handle = (unsigned long)entry;
 		}
-#endif
 
-		memcpy(cmem, src, clen);
+memstore:
+		write_lock(&zram->table_lock);
 
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+		/*
+		 * System overwrites unused sectors. Free memory associated
+		 * with this sector now.
+		 */
+		zram_free_page(zram, index);
+
+		zram->table[index].handle = handle;
+		zram->table[index].size = clen;
 
 		/* Update stats */
-		zram_stat64_add(zram, &zram->stats.compr_size, clen);
+		if (unlikely(clen == PAGE_SIZE)) {
+			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+			zram_stat_inc(&zram->stats.pages_expand);
+		}
+		if (dedup_hit) {
+			zram_stat_inc(&zram->stats.pages_dedup);
+			zram_stat64_add(zram, &zram->stats.dedup_saved, clen);
+		} else {
+			zram_stat64_add(zram, &zram->stats.compr_size, clen);
+		}
 		zram_stat_inc(&zram->stats.pages_stored);
 		if (clen <= PAGE_SIZE / 2)
 			zram_stat_inc(&zram->stats.good_compress);
 
-		mutex_unlock(&zram->lock);
+		write_unlock(&zram->table_lock);
 		index++;
 	}
 
@@ -453,6 +836,25 @@ static int zram_make_request(struct request_queue *queue, struct bio *bio)
 	return 0;
 }
 
+/*
+ * Release sparsely used allocator pages by migrating their objects.
+ * Returns the number of pages freed.
+ */
+unsigned long zram_compact(struct zram *zram)
+{
+	unsigned long pages_freed = 0;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		pages_freed = zs_compact(zram->mem_pool);
+		zram_stat64_add(zram, &zram->stats.pages_compacted,
+				pages_freed);
+	}
+	mutex_unlock(&zram->init_lock);
+
+	return pages_freed;
+}
+
 void zram_reset_device(struct zram *zram)
 {
 	size_t index;
@@ -461,33 +863,17 @@ void zram_reset_device(struct zram *zram)
 	zram->init_done = 0;
 
 	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	zram_strm_destroy_all(zram);
 
 	/* Free all pages that are still in this zram device */
-	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
-
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
-
-		if (!page)
-			continue;
-
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
-		else
-			xv_free(zram->mem_pool, page, offset);
-	}
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++)
+		zram_free_page(zram, index);
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
 	/* Reset stats */
@@ -501,6 +887,7 @@ int zram_init_device(struct zram *zram)
 {
 	int ret;
 	size_t num_pages;
+	struct zram_strm *strm;
 
 	mutex_lock(&zram->init_lock);
 
@@ -511,19 +898,18 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
+	/*
+	 * Allocate one compression stream up front; more are added on
+	 * demand by concurrent writers, up to max_strm.
+	 */
+	strm = zram_strm_alloc(GFP_KERNEL);
+	if (!strm) {
+		pr_err("Error allocating compression stream!\n");
 		ret = -ENOMEM;
 		goto fail;
 	}
+	list_add(&strm->list, &zram->idle_strm);
+	zram->avail_strm = 1;
 
 	num_pages = zram->disksize >> PAGE_SHIFT;
 	zram->table = vzalloc(num_pages * sizeof(*zram->table));
@@ -540,7 +926,7 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool(GFP_KERNEL);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -566,7 +952,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	write_lock(&zram->table_lock);
 	zram_free_page(zram, index);
+	write_unlock(&zram->table_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -579,9 +967,16 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	rwlock_init(&zram->table_lock);
+	spin_lock_init(&zram->dedup_lock);
+	zram->dedup_tree = RB_ROOT;
+
+	spin_lock_init(&zram->strm_lock);
+	INIT_LIST_HEAD(&zram->idle_strm);
+	init_waitqueue_head(&zram->strm_wait);
+	zram->max_strm = num_online_cpus();
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -17,8 +17,11 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/rbtree.h>
+#include <linux/wait.h>
 
-#include "xvmalloc.h"
+#include "zsmalloc.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,18 +29,6 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
@@ -51,8 +42,8 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
  * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ *   ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * otherwise, zs_malloc() would always return failure.
  */
 
 /*-- End of configurable params */
@@ -68,8 +59,11 @@ enum zram_pageflags {
 	/* Page is stored uncompressed */
 	ZRAM_UNCOMPRESSED,
 
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/*
+	 * Page consists entirely of one repeated unsigned long,
+	 * which is stored in table[page_no].handle.
+	 */
+	ZRAM_SAME,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -78,12 +72,29 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
+	/*
+	 * zsmalloc handle of the compressed object or, for pages
+	 * stored uncompressed, the struct page holding them.
+	 */
+	unsigned long handle;
+	u16 size;	/* object size (excluding header) */
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
 } __attribute__((aligned(4)));
 
+/*
+ * With deduplication enabled, table[].handle of compressed pages
+ * points to one of these instead of the zsmalloc object, so that
+ * pages with identical content can share a single object.
+ */
+struct zram_entry {
+	struct rb_node rb_node;	/* in zram->dedup_tree, keyed by checksum */
+	u32 checksum;		/* of the uncompressed page */
+	u16 len;		/* compressed size */
+	int refcount;		/* table entries and pending lookups */
+	unsigned long handle;	/* zsmalloc handle */
+};
+
 struct zram_stats {
 	u64 compr_size;		/* compressed size of pages stored */
 	u64 num_reads;		/* failed + successful */
@@ -92,20 +103,48 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
+	u64 strm_waits;		/* writes that waited for a free
+				 * compression stream */
+	u64 pages_compacted;	/* pages freed by allocator compaction */
 	u32 pages_zero;		/* no. of zero filled pages */
+	u32 pages_same;		/* no. of same element filled pages
+				 * (including zero filled ones) */
+	u32 pages_dedup;	/* no. of pages sharing another page's
+				 * compressed object */
+	u64 dedup_saved;	/* compressed bytes saved by dedup */
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
 };
 
+/*
+ * Compression context: LZO working memory plus a buffer large
+ * enough to hold the (possibly expanded) compressed page.
+ */
+struct zram_strm {
+	void *workmem;
+	void *buffer;
+	struct list_head list;
+};
+
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	rwlock_t table_lock;	/* protect table entries and 32-bit stats */
+
+	/* Pool of compression streams shared by concurrent writers */
+	spinlock_t strm_lock;	/* protect idle_strm and avail_strm */
+	struct list_head idle_strm;
+	wait_queue_head_t strm_wait;
+	int avail_strm;		/* streams allocated, idle or in use */
+	int max_strm;		/* upper limit on avail_strm */
+
+	/* Content based deduplication of compressed pages */
+	int use_dedup;		/* cannot change once initialized */
+	spinlock_t dedup_lock;	/* protect dedup_tree and refcounts */
+	struct rb_root dedup_tree;
+
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -128,5 +167,7 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
+extern void zram_set_max_streams(struct zram *zram, int num_strm);
+extern unsigned long zram_compact(struct zram *zram);
 
 #endif
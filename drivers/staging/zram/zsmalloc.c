@@ -0,0 +1,656 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * Objects are grouped by size into size classes, ZS_SIZE_CLASS_DELTA
+ * bytes apart. Each class allocates its objects from zspages: groups
+ * of up to ZS_MAX_PAGES_PER_ZSPAGE pages, chosen per class so that
+ * the tail left over after the last object is as small as possible.
+ * Objects are laid out back to back over the whole zspage, so an
+ * object can start in one page and end in the next; zs_map_object()
+ * hides this by bouncing such objects through a per-cpu buffer.
+ *
+ * Users only ever see opaque handles. Each handle points to a small
+ * descriptor recording where the object currently lives, which allows
+ * zs_compact() to move objects out of sparsely used zspages and
+ * release them.
+ */
+
+#ifdef CONFIG_ZRAM_DEBUG
+#define DEBUG
+#endif
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+static void pin_handle(struct zs_handle *handle)
+{
+	bit_spin_lock(HANDLE_PIN, &handle->flags);
+}
+
+static int trypin_handle(struct zs_handle *handle)
+{
+	return bit_spin_trylock(HANDLE_PIN, &handle->flags);
+}
+
+static void unpin_handle(struct zs_handle *handle)
+{
+	bit_spin_unlock(HANDLE_PIN, &handle->flags);
+}
+
+static int get_size_class_index(size_t size)
+{
+	if (size <= ZS_MIN_ALLOC_SIZE)
+		return 0;
+
+	return DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE, ZS_SIZE_CLASS_DELTA);
+}
+
+/*
+ * Find the number of pages per zspage which wastes the least space
+ * at the end of the zspage for the given object size.
+ */
+static unsigned int get_pages_per_zspage(unsigned int class_size)
+{
+	unsigned int i, max_usedpc = 0, max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		unsigned int zspage_size, waste, usedpc;
+
+		zspage_size = i * PAGE_SIZE;
+		waste = zspage_size % class_size;
+		usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	unsigned int inuse = zspage->inuse;
+	unsigned int max_objs = class->objs_per_zspage;
+
+	if (!inuse)
+		return ZS_EMPTY;
+	if (inuse == max_objs)
+		return ZS_FULL;
+	if (inuse * ZS_ALMOST_FULL_DEN <= max_objs * ZS_ALMOST_FULL_NUM)
+		return ZS_ALMOST_EMPTY;
+
+	return ZS_ALMOST_FULL;
+}
+
+/*
+ * Move zspage to the fullness list matching its current usage.
+ * Empty zspages are unlinked; the caller is expected to free them
+ * once the class lock is dropped. Called with class->lock held.
+ */
+static enum fullness_group fix_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	enum fullness_group newfg;
+
+	newfg = get_fullness_group(class, zspage);
+	if (newfg == zspage->fullness)
+		return newfg;
+
+	if (newfg == ZS_EMPTY)
+		list_del_init(&zspage->list);
+	else
+		list_move(&zspage->list, &class->fullness_list[newfg]);
+	zspage->fullness = newfg;
+
+	return newfg;
+}
+
+/*
+ * Allocation prefers almost full zspages so that almost empty ones
+ * have a chance to drain completely.
+ */
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	struct list_head *head;
+
+	head = &class->fullness_list[ZS_ALMOST_FULL];
+	if (list_empty(head))
+		head = &class->fullness_list[ZS_ALMOST_EMPTY];
+	if (list_empty(head))
+		return NULL;
+
+	return list_first_entry(head, struct zspage, list);
+}
+
+static void free_zspage(struct zs_pool *pool, struct zspage *zspage)
+{
+	struct size_class *class = zspage->class;
+	unsigned int i;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		if (zspage->pages[i])
+			__free_page(zspage->pages[i]);
+	}
+	kfree(zspage);
+
+	atomic_long_sub(class->pages_per_zspage, &pool->pages_allocated);
+}
+
+static struct zspage *alloc_zspage(struct zs_pool *pool,
+				struct size_class *class, gfp_t flags)
+{
+	unsigned int i;
+	struct zspage *zspage;
+
+	zspage = kzalloc(sizeof(*zspage), flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class = class;
+	zspage->fullness = ZS_EMPTY;
+	atomic_long_add(class->pages_per_zspage, &pool->pages_allocated);
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(flags);
+		if (unlikely(!zspage->pages[i])) {
+			free_zspage(pool, zspage);
+			return NULL;
+		}
+	}
+
+	return zspage;
+}
+
+static void obj_location(struct size_class *class, struct zspage *zspage,
+			unsigned int obj_idx, struct page **page,
+			unsigned long *offset)
+{
+	unsigned long off = (unsigned long)obj_idx * class->size;
+
+	*page = zspage->pages[off >> PAGE_SHIFT];
+	*offset = off & ~PAGE_MASK;
+}
+
+/*
+ * Copy len bytes starting at byte off of zspage to/from buf,
+ * crossing page boundaries as required.
+ */
+static void zspage_copy(struct zspage *zspage, unsigned long off,
+			void *buf, size_t len, int to_zspage)
+{
+	while (len) {
+		struct page *page = zspage->pages[off >> PAGE_SHIFT];
+		unsigned long poff = off & ~PAGE_MASK;
+		size_t n = min_t(size_t, len, PAGE_SIZE - poff);
+		char *addr;
+
+		addr = kmap_atomic(page, KM_USER1);
+		if (to_zspage)
+			memcpy(addr + poff, buf, n);
+		else
+			memcpy(buf, addr + poff, n);
+		kunmap_atomic(addr, KM_USER1);
+
+		buf += n;
+		off += n;
+		len -= n;
+	}
+}
+
+/*
+ * Take a free slot of zspage for handle and record the handle in the
+ * object header. Called with class->lock held.
+ */
+static unsigned int obj_alloc(struct size_class *class, struct zspage *zspage,
+			struct zs_handle *handle)
+{
+	unsigned int obj_idx;
+	unsigned long offset;
+	struct page *page;
+	unsigned long *head;
+
+	obj_idx = find_first_zero_bit(zspage->used, class->objs_per_zspage);
+	BUG_ON(obj_idx >= class->objs_per_zspage);
+
+	__set_bit(obj_idx, zspage->used);
+	zspage->inuse++;
+	class->objs_inuse++;
+
+	/* Object offsets are aligned, so the header never straddles pages */
+	obj_location(class, zspage, obj_idx, &page, &offset);
+	head = kmap_atomic(page, KM_USER0) + offset;
+	*head = (unsigned long)handle;
+	kunmap_atomic(head, KM_USER0);
+
+	handle->zspage = zspage;
+	handle->obj_idx = obj_idx;
+
+	return obj_idx;
+}
+
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			unsigned int obj_idx)
+{
+	/* Catch double free bugs */
+	BUG_ON(!test_bit(obj_idx, zspage->used));
+
+	__clear_bit(obj_idx, zspage->used);
+	zspage->inuse--;
+	class->objs_inuse--;
+}
+
+/**
+ * zs_create_pool - Creates an allocation pool to work from.
+ * @flags: allocation flags used for pool metadata
+ *
+ * This function must be called before anything when using
+ * the zsmalloc allocator.
+ *
+ * On success, a pointer to the newly created pool is returned,
+ * otherwise NULL.
+ */
+struct zs_pool *zs_create_pool(gfp_t flags)
+{
+	int i, cpu;
+	u32 ovhd_size;
+	struct zs_pool *pool;
+
+	ovhd_size = roundup(sizeof(*pool), PAGE_SIZE);
+	pool = kzalloc(ovhd_size, flags);
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < ZS_NR_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class = &pool->size_class[i];
+
+		spin_lock_init(&class->lock);
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage *
+					PAGE_SIZE / class->size;
+		for (fg = 0; fg < __NR_ZS_FULLNESS_GROUPS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+	}
+
+	pool->map_area = alloc_percpu(struct zs_map_area);
+	if (!pool->map_area)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		struct zs_map_area *area = per_cpu_ptr(pool->map_area, cpu);
+
+		area->vm_buf = kmalloc(ZS_MAX_ALLOC_SIZE, flags);
+		if (!area->vm_buf)
+			goto fail;
+	}
+
+	return pool;
+
+fail:
+	zs_destroy_pool(pool);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i, cpu;
+
+	for (i = 0; i < ZS_NR_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class = &pool->size_class[i];
+
+		for (fg = ZS_ALMOST_EMPTY; fg < __NR_ZS_FULLNESS_GROUPS; fg++) {
+			struct zspage *zspage, *tmp;
+
+			list_for_each_entry_safe(zspage, tmp,
+					&class->fullness_list[fg], list) {
+				pr_info("Freeing non-empty zspage of class "
+					"size %u\n", class->size);
+				list_del(&zspage->list);
+				free_zspage(pool, zspage);
+			}
+		}
+	}
+
+	if (pool->map_area) {
+		for_each_possible_cpu(cpu)
+			kfree(per_cpu_ptr(pool->map_area, cpu)->vm_buf);
+		free_percpu(pool->map_area);
+	}
+
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+/**
+ * zs_malloc - Allocate block of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ * @flags: allocation flags used for new zspages
+ *
+ * On success, handle to the allocated object is returned,
+ * otherwise 0.
+ *
+ * Allocation requests with size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * will fail.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t flags)
+{
+	struct zs_handle *handle;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE))
+		return 0;
+
+	handle = kzalloc(sizeof(*handle), flags & ~__GFP_HIGHMEM);
+	if (!handle)
+		return 0;
+
+	class = &pool->size_class[get_size_class_index(size + ZS_HANDLE_SIZE)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(pool, class, flags);
+		if (unlikely(!zspage)) {
+			kfree(handle);
+			return 0;
+		}
+
+		spin_lock(&class->lock);
+		class->nr_zspages++;
+	}
+
+	obj_alloc(class, zspage, handle);
+	fix_fullness_group(class, zspage);
+	spin_unlock(&class->lock);
+
+	return (unsigned long)handle;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long obj)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct size_class *class;
+	struct zspage *zspage;
+	enum fullness_group fg;
+
+	if (unlikely(!handle))
+		return;
+
+	/* Pinning keeps zs_compact() from moving the object under us */
+	pin_handle(handle);
+	zspage = handle->zspage;
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	obj_free(class, zspage, handle->obj_idx);
+	fg = fix_fullness_group(class, zspage);
+	if (fg == ZS_EMPTY)
+		class->nr_zspages--;
+	spin_unlock(&class->lock);
+
+	unpin_handle(handle);
+	kfree(handle);
+
+	if (fg == ZS_EMPTY)
+		free_zspage(pool, zspage);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @obj: handle returned from zs_malloc
+ * @mm: how the object is going to be accessed
+ *
+ * Before using an object allocated from zs_malloc, it must be mapped
+ * using this function. When done with the object, it must be unmapped
+ * using zs_unmap_object.
+ *
+ * The object stays pinned, and preemption disabled, until it is
+ * unmapped. Only one object can be mapped at a time on each cpu.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long obj,
+			enum zs_mapmode mm)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct zs_map_area *area;
+	struct size_class *class;
+	struct zspage *zspage;
+	unsigned long off;
+
+	BUG_ON(!handle);
+
+	pin_handle(handle);
+	zspage = handle->zspage;
+	class = zspage->class;
+	off = (unsigned long)handle->obj_idx * class->size + ZS_HANDLE_SIZE;
+
+	area = this_cpu_ptr(pool->map_area);
+	area->vm_mm = mm;
+
+	if ((off & ~PAGE_MASK) + class->size - ZS_HANDLE_SIZE <= PAGE_SIZE) {
+		/* this object is contained entirely within a page */
+		area->vm_addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT],
+						KM_USER1);
+		return area->vm_addr + (off & ~PAGE_MASK);
+	}
+
+	/* this object spans two pages */
+	area->vm_addr = NULL;
+	if (mm != ZS_MM_WO)
+		zspage_copy(zspage, off, area->vm_buf,
+				class->size - ZS_HANDLE_SIZE, 0);
+
+	return area->vm_buf;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long obj)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct zs_map_area *area;
+	struct size_class *class;
+	struct zspage *zspage;
+	unsigned long off;
+
+	BUG_ON(!handle);
+
+	zspage = handle->zspage;
+	class = zspage->class;
+	area = this_cpu_ptr(pool->map_area);
+
+	if (area->vm_addr) {
+		kunmap_atomic(area->vm_addr, KM_USER1);
+	} else if (area->vm_mm != ZS_MM_RO) {
+		off = (unsigned long)handle->obj_idx * class->size +
+			ZS_HANDLE_SIZE;
+		zspage_copy(zspage, off, area->vm_buf,
+				class->size - ZS_HANDLE_SIZE, 1);
+	}
+
+	unpin_handle(handle);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/*
+ * Compaction can only free a zspage if the free slots spread over
+ * the other zspages of the class add up to at least one zspage.
+ */
+static int zs_can_compact(struct size_class *class)
+{
+	unsigned long obj_wasted;
+
+	obj_wasted = class->nr_zspages * class->objs_per_zspage -
+			class->objs_inuse;
+
+	return obj_wasted >= class->objs_per_zspage;
+}
+
+/*
+ * Pick a zspage other than src to receive migrated objects,
+ * preferring the fullest ones.
+ */
+static struct zspage *find_dst_zspage(struct size_class *class,
+				struct zspage *src)
+{
+	int fg;
+	struct zspage *zspage;
+
+	for (fg = ZS_ALMOST_FULL; fg >= ZS_ALMOST_EMPTY; fg--) {
+		list_for_each_entry(zspage, &class->fullness_list[fg], list) {
+			if (zspage != src)
+				return zspage;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Move as many objects as possible out of src. Objects which are
+ * currently mapped or being freed are left where they are. Returns
+ * the number of objects migrated. Called with class->lock held.
+ */
+static unsigned long migrate_zspage(struct zs_pool *pool,
+				struct size_class *class, struct zspage *src)
+{
+	unsigned int obj_idx;
+	unsigned long nr_migrated = 0;
+	struct zs_map_area *area = this_cpu_ptr(pool->map_area);
+
+	for_each_set_bit(obj_idx, src->used, class->objs_per_zspage) {
+		struct zs_handle *handle;
+		struct zspage *dst;
+		unsigned long off;
+
+		off = (unsigned long)obj_idx * class->size;
+		zspage_copy(src, off, &handle, sizeof(handle), 0);
+		if (!trypin_handle(handle))
+			continue;
+
+		dst = find_dst_zspage(class, src);
+		if (!dst) {
+			unpin_handle(handle);
+			break;
+		}
+
+		/*
+		 * We hold class->lock, so nobody else can be using this
+		 * cpu's bounce buffer.
+		 */
+		zspage_copy(src, off, area->vm_buf, class->size, 0);
+		obj_alloc(class, dst, handle);
+		zspage_copy(dst, (unsigned long)handle->obj_idx * class->size,
+				area->vm_buf, class->size, 1);
+		fix_fullness_group(class, dst);
+
+		obj_free(class, src, obj_idx);
+		unpin_handle(handle);
+		nr_migrated++;
+	}
+
+	return nr_migrated;
+}
+
+/**
+ * zs_compact - Release sparsely used zspages.
+ * @pool: pool to compact
+ *
+ * For every size class, objects of almost empty zspages are moved
+ * into other zspages of the same class until no more zspages can be
+ * freed this way.
+ *
+ * Returns the number of pages freed.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	int i;
+	unsigned long pages_freed = 0;
+
+	for (i = ZS_NR_SIZE_CLASSES - 1; i >= 0; i--) {
+		struct size_class *class = &pool->size_class[i];
+
+		while (1) {
+			struct zspage *src;
+			struct list_head *head;
+			unsigned long nr_migrated;
+			enum fullness_group fg;
+
+			spin_lock(&class->lock);
+			head = &class->fullness_list[ZS_ALMOST_EMPTY];
+			if (!zs_can_compact(class) || list_empty(head)) {
+				spin_unlock(&class->lock);
+				break;
+			}
+
+			/* Allocation takes from the head, drain the tail */
+			src = list_entry(head->prev, struct zspage, list);
+			nr_migrated = migrate_zspage(pool, class, src);
+			fg = fix_fullness_group(class, src);
+			if (fg == ZS_EMPTY)
+				class->nr_zspages--;
+			spin_unlock(&class->lock);
+
+			atomic_long_add(nr_migrated, &pool->objs_migrated);
+
+			if (fg != ZS_EMPTY)
+				break;
+
+			pages_freed += class->pages_per_zspage;
+			free_zspage(pool, src);
+			cond_resched();
+		}
+	}
+
+	return pages_freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+/*
+ * Returns total memory used by allocator (userdata + metadata)
+ */
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+u64 zs_get_num_migrated(struct zs_pool *pool)
+{
+	return atomic_long_read(&pool->objs_migrated);
+}
+EXPORT_SYMBOL_GPL(zs_get_num_migrated);
@@ -0,0 +1,120 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+/* User configurable params */
+
+/*
+ * A zspage is a group of up to ZS_MAX_PAGES_PER_ZSPAGE 0-order pages
+ * that is carved into objects of a single size class. Objects may
+ * straddle the boundary between two pages of the same zspage, which
+ * is what lets sizes like 3/4 PAGE_SIZE pack without waste.
+ */
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+/* Size classes are separated by this many bytes: 16 for 4k pages */
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/* End of user params */
+
+/*
+ * Each object starts with a back-reference to its handle so that
+ * compaction can find and update the handle when it moves the object.
+ */
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
+
+#define ZS_NR_SIZE_CLASSES	((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) \
+					/ ZS_SIZE_CLASS_DELTA + 1)
+#define ZS_MAX_OBJS_PER_ZSPAGE	(ZS_MAX_PAGES_PER_ZSPAGE * PAGE_SIZE \
+					/ ZS_MIN_ALLOC_SIZE)
+
+/*
+ * A zspage with more than 3/4 of its objects in use is considered
+ * almost full. Allocation prefers almost full zspages while
+ * compaction drains almost empty ones.
+ */
+#define ZS_ALMOST_FULL_NUM	3
+#define ZS_ALMOST_FULL_DEN	4
+
+enum fullness_group {
+	ZS_EMPTY,
+	ZS_ALMOST_EMPTY,
+	ZS_ALMOST_FULL,
+	ZS_FULL,
+	__NR_ZS_FULLNESS_GROUPS,
+};
+
+/* Flags for zs_handle */
+enum handleflags {
+	HANDLE_PIN,	/* object is mapped or being migrated */
+	__NR_HANDLEFLAGS,
+};
+
+struct size_class;
+
+struct zspage {
+	struct list_head list;		/* in class fullness list */
+	struct size_class *class;
+	enum fullness_group fullness;
+	unsigned int inuse;		/* no. of allocated objects */
+	unsigned long used[BITS_TO_LONGS(ZS_MAX_OBJS_PER_ZSPAGE)];
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+};
+
+/*
+ * zs_malloc() returns a pointer to one of these, cast to unsigned
+ * long, so that objects can be moved without the user noticing.
+ */
+struct zs_handle {
+	unsigned long flags;
+	struct zspage *zspage;
+	unsigned int obj_idx;
+};
+
+struct size_class {
+	spinlock_t lock;
+	unsigned int size;		/* object size including header */
+	unsigned int pages_per_zspage;
+	unsigned int objs_per_zspage;
+	unsigned long nr_zspages;
+	unsigned long objs_inuse;
+	struct list_head fullness_list[__NR_ZS_FULLNESS_GROUPS];
+};
+
+/*
+ * Per-cpu buffer used to present objects that straddle two pages
+ * as one contiguous chunk of memory.
+ */
+struct zs_map_area {
+	char *vm_buf;
+	void *vm_addr;			/* kmap_atomic address, if any */
+	enum zs_mapmode vm_mm;
+};
+
+struct zs_pool {
+	struct size_class size_class[ZS_NR_SIZE_CLASSES];
+	struct zs_map_area __percpu *map_area;
+	atomic_long_t pages_allocated;	/* stats */
+	atomic_long_t objs_migrated;
+};
+
+#endif
@@ -28,6 +28,7 @@
 
 #include <linux/types.h>
 #include <linux/file.h>
+#include <linux/fs.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
 
@@ -49,11 +50,33 @@
 #define STATE_CANCELED              3   /* transaction canceled by host */
 #define STATE_ERROR                 4   /* error from completion routine */
 
-/* number of tx and rx requests to allocate */
-#define TX_REQ_MAX 4
-#define RX_REQ_MAX 2
+/* limits for the number of tx and rx requests to allocate */
+#define MTP_TX_REQ_MAX 32
+#define MTP_RX_REQ_MAX 8
 #define INTR_REQ_MAX 5
 
+/*
+ * Bulk request size and queue depth.  Bigger, deeper queues keep the
+ * controller busy while send_file_work and receive_file_work are in
+ * vfs_read/vfs_write; if the buffers can't be allocated at bind time we
+ * fall back to MTP_BULK_BUFFER_SIZE.
+ */
+static unsigned int mtp_tx_req_len = 65536;
+module_param(mtp_tx_req_len, uint, S_IRUGO);
+MODULE_PARM_DESC(mtp_tx_req_len, "MTP bulk IN request buffer size");
+
+static unsigned int mtp_tx_reqs = 8;
+module_param(mtp_tx_reqs, uint, S_IRUGO);
+MODULE_PARM_DESC(mtp_tx_reqs, "MTP bulk IN request count");
+
+static unsigned int mtp_rx_req_len = 65536;
+module_param(mtp_rx_req_len, uint, S_IRUGO);
+MODULE_PARM_DESC(mtp_rx_req_len, "MTP bulk OUT request buffer size");
+
+static unsigned int mtp_rx_reqs = 4;
+module_param(mtp_rx_reqs, uint, S_IRUGO);
+MODULE_PARM_DESC(mtp_rx_reqs, "MTP bulk OUT request count");
+
 /* ID for Microsoft MTP OS String */
 #define MTP_OS_STRING_ID   0xEE
 
@@ -91,8 +114,15 @@ struct mtp_dev {
 	wait_queue_head_t read_wq;
 	wait_queue_head_t write_wq;
 	wait_queue_head_t intr_wq;
-	struct usb_request *rx_req[RX_REQ_MAX];
-	int rx_done;
+	struct usb_request *rx_req[MTP_RX_REQ_MAX];
+	/* completed rx requests not yet consumed */
+	atomic_t rx_done;
+
+	/* request sizes and counts actually allocated at bind time */
+	unsigned int tx_req_len;
+	unsigned int tx_reqs;
+	unsigned int rx_req_len;
+	unsigned int rx_reqs;
 
 	/* for processing MTP_SEND_FILE, MTP_RECEIVE_FILE and
 	 * MTP_SEND_FILE_WITH_HEADER ioctls on a work queue
@@ -361,7 +391,7 @@ static void mtp_complete_out(struct usb_ep *ep, struct usb_request *req)
 {
 	struct mtp_dev *dev = _mtp_dev;
 
-	dev->rx_done = 1;
+	atomic_inc(&dev->rx_done);
 	if (req->status != 0)
 		dev->state = STATE_ERROR;
 
@@ -420,17 +450,38 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	dev->ep_intr = ep;
 
 	/* now allocate requests for our endpoints */
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_in, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+	dev->tx_req_len = max(mtp_tx_req_len, (unsigned)MTP_BULK_BUFFER_SIZE);
+	dev->tx_reqs = clamp(mtp_tx_reqs, 2U, (unsigned)MTP_TX_REQ_MAX);
+retry_tx_alloc:
+	for (i = 0; i < dev->tx_reqs; i++) {
+		req = mtp_request_new(dev->ep_in, dev->tx_req_len);
+		if (!req) {
+			if (dev->tx_req_len == MTP_BULK_BUFFER_SIZE)
+				goto fail;
+			while ((req = mtp_req_get(dev, &dev->tx_idle)))
+				mtp_request_free(req, dev->ep_in);
+			dev->tx_req_len = MTP_BULK_BUFFER_SIZE;
+			goto retry_tx_alloc;
+		}
 		req->complete = mtp_complete_in;
 		mtp_req_put(dev, &dev->tx_idle, req);
 	}
-	for (i = 0; i < RX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_out, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+
+	dev->rx_req_len = max(mtp_rx_req_len, (unsigned)MTP_BULK_BUFFER_SIZE);
+	dev->rx_reqs = clamp(mtp_rx_reqs, 2U, (unsigned)MTP_RX_REQ_MAX);
+retry_rx_alloc:
+	for (i = 0; i < dev->rx_reqs; i++) {
+		req = mtp_request_new(dev->ep_out, dev->rx_req_len);
+		if (!req) {
+			if (dev->rx_req_len == MTP_BULK_BUFFER_SIZE)
+				goto fail;
+			while (i--) {
+				mtp_request_free(dev->rx_req[i], dev->ep_out);
+				dev->rx_req[i] = NULL;
+			}
+			dev->rx_req_len = MTP_BULK_BUFFER_SIZE;
+			goto retry_rx_alloc;
+		}
 		req->complete = mtp_complete_out;
 		dev->rx_req[i] = req;
 	}
@@ -460,7 +511,7 @@ static ssize_t mtp_read(struct file *fp, char __user *buf,
 
 	DBG(cdev, "mtp_read(%d)\n", count);
 
-	if (count > MTP_BULK_BUFFER_SIZE)
+	if (count > dev->rx_req_len)
 		return -EINVAL;
 
 	/* we will block until we're online */
@@ -485,7 +536,7 @@ requeue_req:
 	/* queue a request */
 	req = dev->rx_req[0];
 	req->length = count;
-	dev->rx_done = 0;
+	atomic_set(&dev->rx_done, 0);
 	ret = usb_ep_queue(dev->ep_out, req, GFP_KERNEL);
 	if (ret < 0) {
 		r = -EIO;
@@ -495,7 +546,8 @@ requeue_req:
 	}
 
 	/* wait for a request to complete */
-	ret = wait_event_interruptible(dev->read_wq, dev->rx_done);
+	ret = wait_event_interruptible(dev->read_wq,
+				       atomic_read(&dev->rx_done));
 	if (ret < 0) {
 		r = ret;
 		usb_ep_dequeue(dev->ep_out, req);
@@ -580,8 +632,8 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 		if (xfer && copy_from_user(req->buf, buf, xfer)) {
@@ -630,6 +682,7 @@ static void send_file_work(struct work_struct *data) {
 	int xfer, ret, hdr_size;
 	int r = 0;
 	int sendZLP = 0;
+	unsigned int ra_pages;
 
 	/* read our parameters */
 	smp_rmb();
@@ -639,6 +692,15 @@ static void send_file_work(struct work_struct *data) {
 
 	DBG(cdev, "send_file_work(%lld %lld)\n", offset, count);
 
+	/*
+	 * Let readahead stay a full tx queue ahead of us, so the next
+	 * chunks are being read from storage while the queued ones are
+	 * on the wire, rather than each vfs_read() waiting on the media.
+	 */
+	ra_pages = filp->f_ra.ra_pages;
+	filp->f_ra.ra_pages = max_t(unsigned int, ra_pages,
+		(dev->tx_reqs * dev->tx_req_len) >> PAGE_CACHE_SHIFT);
+
 	if (dev->xfer_send_header) {
 		hdr_size = sizeof(struct mtp_data_header);
 		count += hdr_size;
@@ -672,8 +734,8 @@ static void send_file_work(struct work_struct *data) {
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 
@@ -715,6 +777,8 @@ static void send_file_work(struct work_struct *data) {
 	if (req)
 		mtp_req_put(dev, &dev->tx_idle, req);
 
+	filp->f_ra.ra_pages = ra_pages;
+
 	DBG(cdev, "send_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
@@ -726,11 +790,11 @@ static void receive_file_work(struct work_struct *data)
 {
 	struct mtp_dev	*dev = container_of(data, struct mtp_dev, receive_file_work);
 	struct usb_composite_dev *cdev = dev->cdev;
-	struct usb_request *read_req = NULL, *write_req = NULL;
+	struct usb_request *req;
 	struct file *filp;
 	loff_t offset;
-	int64_t count;
-	int ret, cur_buf = 0;
+	int64_t count, queue_count;
+	int ret, i, head = 0, tail = 0, queued = 0;
 	int r = 0;
 
 	/* read our parameters */
@@ -741,62 +805,74 @@ static void receive_file_work(struct work_struct *data)
 
 	DBG(cdev, "receive_file_work(%lld)\n", count);
 
-	while (count > 0 || write_req) {
-		if (count > 0) {
-			/* queue a request */
-			read_req = dev->rx_req[cur_buf];
-			cur_buf = (cur_buf + 1) % RX_REQ_MAX;
-
-			read_req->length = (count > MTP_BULK_BUFFER_SIZE
-					? MTP_BULK_BUFFER_SIZE : count);
-			dev->rx_done = 0;
-			ret = usb_ep_queue(dev->ep_out, read_req, GFP_KERNEL);
+	/*
+	 * Keep every rx request queued, and write out the oldest one as it
+	 * completes while the host fills the others.  OUT requests complete
+	 * in the order they were queued, so rx_req[head] is always the next
+	 * one to finish.
+	 */
+	atomic_set(&dev->rx_done, 0);
+	queue_count = count;
+	while (count > 0) {
+		while (queued < dev->rx_reqs && queue_count > 0) {
+			req = dev->rx_req[tail];
+			req->length = min_t(int64_t, queue_count,
+					    dev->rx_req_len);
+			ret = usb_ep_queue(dev->ep_out, req, GFP_KERNEL);
 			if (ret < 0) {
 				r = -EIO;
 				dev->state = STATE_ERROR;
-				break;
+				goto done;
 			}
+			tail = (tail + 1) % dev->rx_reqs;
+			queued++;
+			/* for 0xFFFFFFFF we read until we get a short packet */
+			if (count != 0xFFFFFFFF)
+				queue_count -= req->length;
 		}
 
-		if (write_req) {
-			DBG(cdev, "rx %p %d\n", write_req, write_req->actual);
-			ret = vfs_write(filp, write_req->buf, write_req->actual,
-				&offset);
-			DBG(cdev, "vfs_write %d\n", ret);
-			if (ret != write_req->actual) {
-				r = -EIO;
-				dev->state = STATE_ERROR;
-				break;
-			}
-			write_req = NULL;
+		/* wait for the oldest read to complete */
+		req = dev->rx_req[head];
+		ret = wait_event_interruptible(dev->read_wq,
+			atomic_read(&dev->rx_done) || dev->state != STATE_BUSY);
+		if (dev->state == STATE_CANCELED) {
+			r = -ECANCELED;
+			goto done;
+		}
+		if (!atomic_read(&dev->rx_done)) {
+			r = ret ? ret : -EIO;
+			goto done;
+		}
+		atomic_dec(&dev->rx_done);
+		head = (head + 1) % dev->rx_reqs;
+		queued--;
+
+		if (count != 0xFFFFFFFF)
+			count -= req->actual;
+		if (req->actual < req->length) {
+			/* short packet is used to signal EOF for sizes > 4 gig */
+			DBG(cdev, "got short packet\n");
+			count = 0;
 		}
 
-		if (read_req) {
-			/* wait for our last read to complete */
-			ret = wait_event_interruptible(dev->read_wq,
-				dev->rx_done || dev->state != STATE_BUSY);
-			if (dev->state == STATE_CANCELED) {
-				r = -ECANCELED;
-				if (!dev->rx_done)
-					usb_ep_dequeue(dev->ep_out, read_req);
-				break;
-			}
-			/* if xfer_file_length is 0xFFFFFFFF, then we read until
-			 * we get a zero length packet
-			 */
-			if (count != 0xFFFFFFFF)
-				count -= read_req->actual;
-			if (read_req->actual < read_req->length) {
-				/* short packet is used to signal EOF for sizes > 4 gig */
-				DBG(cdev, "got short packet\n");
-				count = 0;
-			}
-
-			write_req = read_req;
-			read_req = NULL;
+		DBG(cdev, "rx %p %d\n", req, req->actual);
+		ret = vfs_write(filp, req->buf, req->actual, &offset);
+		DBG(cdev, "vfs_write %d\n", ret);
+		if (ret != req->actual) {
+			r = -EIO;
+			dev->state = STATE_ERROR;
+			break;
 		}
 	}
 
+done:
+	/* take back any reads still queued after a short packet or error */
+	for (i = 0; i < queued; i++)
+		usb_ep_dequeue(dev->ep_out,
+			       dev->rx_req[(head + i) % dev->rx_reqs]);
+	wait_event(dev->read_wq, atomic_read(&dev->rx_done) >= queued ||
+		   dev->state == STATE_OFFLINE);
+
 	DBG(cdev, "receive_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
@@ -1114,8 +1190,10 @@ mtp_function_unbind(struct usb_configuration *c, struct usb_function *f)
 
 	while ((req = mtp_req_get(dev, &dev->tx_idle)))
 		mtp_request_free(req, dev->ep_in);
-	for (i = 0; i < RX_REQ_MAX; i++)
+	for (i = 0; i < dev->rx_reqs; i++) {
 		mtp_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
 	while ((req = mtp_req_get(dev, &dev->intr_idle)))
 		mtp_request_free(req, dev->ep_intr);
 	dev->state = STATE_OFFLINE;
@@ -1222,6 +1300,7 @@ static int mtp_setup(void)
 	init_waitqueue_head(&dev->intr_wq);
 	atomic_set(&dev->open_excl, 0);
 	atomic_set(&dev->ioctl_excl, 0);
+	atomic_set(&dev->rx_done, 0);
 	INIT_LIST_HEAD(&dev->tx_idle);
 	INIT_LIST_HEAD(&dev->intr_idle);
 
@@ -1160,6 +1160,7 @@ err_sighand:
 	unlock_task_sighand(task, &flags);
 err_task_lock:
 	task_unlock(task);
+	lowmem_adj_index_update(task);
 	put_task_struct(task);
 out:
 	return err < 0 ? err : count;
@@ -1295,6 +1296,7 @@ err_sighand:
 	unlock_task_sighand(task, &flags);
 err_task_lock:
 	task_unlock(task);
+	lowmem_adj_index_update(task);
 	put_task_struct(task);
 out:
 	return err < 0 ? err : count;
@@ -42,6 +42,19 @@ enum ion_heap_type {
 #define ION_HEAP_SYSTEM_CONTIG_MASK	(1 << ION_HEAP_TYPE_SYSTEM_CONTIG)
 #define ION_HEAP_CARVEOUT_MASK		(1 << ION_HEAP_TYPE_CARVEOUT)
 
+/**
+ * allocation flags - the lower bits of the flags passed to ion_alloc are the
+ * mask of heap ids to allocate from (ION_HEAP_ID_MASK, so heap ids are limited
+ * to 0..30), the top bit is reserved for:
+ *
+ * ION_FLAG_CACHED	map the buffer cached to userspace, the CPU writes
+ *			are then only visible to devices after ION_IOC_SYNC.
+ *			Only heaps backed by pages honour this, heaps that
+ *			can't are skipped.
+ */
+#define ION_FLAG_CACHED			(1U << 31)
+#define ION_HEAP_ID_MASK		(~ION_FLAG_CACHED)
+
 #ifdef __KERNEL__
 struct ion_device;
 struct ion_heap;
@@ -285,6 +298,24 @@ struct ion_custom_data {
 	unsigned long arg;
 };
 
+/**
+ * struct ion_sync_data - a range of a buffer to sync
+ * @fd:		a file descriptor from ION_IOC_SHARE or ION_IOC_MAP
+ * @dir:	ION_SYNC_FOR_DEVICE before handing the range to a device,
+ *		ION_SYNC_FOR_CPU before reading what a device wrote there
+ * @offset:	start of the range in bytes
+ * @len:	length of the range in bytes
+ */
+struct ion_sync_data {
+	int fd;
+	unsigned int dir;
+	size_t offset;
+	size_t len;
+};
+
+#define ION_SYNC_FOR_DEVICE	0
+#define ION_SYNC_FOR_CPU	1
+
 #define ION_IOC_MAGIC		'I'
 
 /**
@@ -341,4 +372,14 @@ struct ion_custom_data {
  */
 #define ION_IOC_CUSTOM		_IOWR(ION_IOC_MAGIC, 6, struct ion_custom_data)
 
+/**
+ * DOC: ION_IOC_SYNC - sync a cached buffer for a device or the CPU
+ *
+ * Takes an ion_sync_data struct.  Syncing for the device only writes back
+ * the pages the CPU touched through a userspace mapping since the last
+ * sync, syncing for the CPU invalidates the whole range.  A no-op for
+ * buffers allocated without ION_FLAG_CACHED.
+ */
+#define ION_IOC_SYNC		_IOWR(ION_IOC_MAGIC, 7, struct ion_sync_data)
+
 #endif /* _LINUX_ION_H */
@@ -70,6 +70,30 @@ extern unsigned long badness(struct task_struct *p, struct mem_cgroup *mem,
 
 extern struct task_struct *find_lock_task_mm(struct task_struct *p);
 
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+/*
+ * The lowmemorykiller keeps processes indexed by oom_adj. Everything but
+ * lowmem_adj_index_update() expects tasklist_lock to be write-locked.
+ */
+extern void lowmem_adj_index_add(struct task_struct *p);
+extern void lowmem_adj_index_del(struct task_struct *p);
+extern void lowmem_adj_index_replace(struct task_struct *old,
+				     struct task_struct *new);
+extern void lowmem_adj_index_update(struct task_struct *p);
+
+static inline void lowmem_adj_index_init(struct task_struct *p)
+{
+	INIT_HLIST_NODE(&p->lowmem_adj_node);
+}
+#else
+static inline void lowmem_adj_index_add(struct task_struct *p) { }
+static inline void lowmem_adj_index_del(struct task_struct *p) { }
+static inline void lowmem_adj_index_replace(struct task_struct *old,
+					    struct task_struct *new) { }
+static inline void lowmem_adj_index_update(struct task_struct *p) { }
+static inline void lowmem_adj_index_init(struct task_struct *p) { }
+#endif
+
 /* sysctls */
 extern int sysctl_oom_dump_tasks;
 extern int sysctl_oom_kill_allocating_task;
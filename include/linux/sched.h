@@ -1351,6 +1351,10 @@ struct task_struct {
 	/* PID/PID hash table linkage. */
 	struct pid_link pids[PIDTYPE_MAX];
 	struct list_head thread_group;
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+	/* processes only, in the lowmemorykiller's oom_adj index */
+	struct hlist_node lowmem_adj_node;
+#endif
 
 	struct completion *vfork_done;		/* for vfork() */
 	int __user *set_child_tid;		/* CLONE_CHILD_SETTID */
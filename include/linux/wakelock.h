@@ -18,6 +18,7 @@
 
 #include <linux/list.h>
 #include <linux/ktime.h>
+#include <linux/rbtree.h>
 
 /* A wake_lock prevents the system from entering suspend or other low power
  * states when active. If the type is set to WAKE_LOCK_SUSPEND, the wake_lock
@@ -32,9 +33,13 @@ enum {
 	WAKE_LOCK_TYPE_COUNT
 };
 
+/* hold time buckets: <1ms, then powers of two up to 16s, then the rest */
+#define WAKE_LOCK_HIST_BUCKETS	16
+
 struct wake_lock {
 #ifdef CONFIG_HAS_WAKELOCK
 	struct list_head    link;
+	struct rb_node      expire_node;
 	int                 flags;
 	const char         *name;
 	unsigned long       expires;
@@ -49,6 +54,8 @@ struct wake_lock {
 		ktime_t         last_time;
 		ktime_t         last_unlock_time;
 		ktime_t         background_locked_time;
+		int             abort_count;
+		unsigned int    hold_hist[WAKE_LOCK_HIST_BUCKETS];
 	} stat;
 #endif
 #endif
@@ -0,0 +1,40 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ashmem
+
+#if !defined(_TRACE_ASHMEM_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_ASHMEM_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(ashmem_shrink,
+
+	TP_PROTO(unsigned long nr_to_scan, unsigned long freed_bytes,
+		 int nr_truncates, u64 latency_ns),
+
+	TP_ARGS(nr_to_scan, freed_bytes, nr_truncates, latency_ns),
+
+	TP_STRUCT__entry(
+		__field(unsigned long,	nr_to_scan)
+		__field(unsigned long,	freed_bytes)
+		__field(int,		nr_truncates)
+		__field(u64,		latency_ns)
+	),
+
+	TP_fast_assign(
+		__entry->nr_to_scan = nr_to_scan;
+		__entry->freed_bytes = freed_bytes;
+		__entry->nr_truncates = nr_truncates;
+		__entry->latency_ns = latency_ns;
+	),
+
+	TP_printk("nr_to_scan=%lu, freed_bytes=%lu, nr_truncates=%d, latency_ns=%llu",
+		__entry->nr_to_scan,
+		__entry->freed_bytes,
+		__entry->nr_truncates,
+		__entry->latency_ns)
+);
+
+#endif /* _TRACE_ASHMEM_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
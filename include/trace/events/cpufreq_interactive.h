@@ -0,0 +1,133 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cpufreq_interactive
+
+#if !defined(_TRACE_CPUFREQ_INTERACTIVE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_CPUFREQ_INTERACTIVE_H
+
+#include <linux/tracepoint.h>
+
+#ifndef _TRACE_CPUFREQ_INTERACTIVE_REASONS
+#define _TRACE_CPUFREQ_INTERACTIVE_REASONS
+/* why a sample picked its target, or why it was not applied yet */
+#define INTERACTIVE_REASON_LOAD			0	/* target_loads */
+#define INTERACTIVE_REASON_HISPEED		1	/* load spike */
+#define INTERACTIVE_REASON_MAXSPEED		2	/* spike above hispeed */
+#define INTERACTIVE_REASON_BOOST		3	/* input boost floor */
+#define INTERACTIVE_REASON_HISPEED_DELAY	4	/* above_hispeed_delay */
+#define INTERACTIVE_REASON_MIN_SAMPLE_TIME	5	/* min_sample_time */
+#endif
+
+DECLARE_EVENT_CLASS(set,
+	TP_PROTO(u32 cpu_id, unsigned long targfreq,
+		 unsigned long actualfreq),
+	TP_ARGS(cpu_id, targfreq, actualfreq),
+
+	TP_STRUCT__entry(
+		__field(u32,		cpu_id)
+		__field(unsigned long,	targfreq)
+		__field(unsigned long,	actualfreq)
+	),
+
+	TP_fast_assign(
+		__entry->cpu_id = (u32) cpu_id;
+		__entry->targfreq = targfreq;
+		__entry->actualfreq = actualfreq;
+	),
+
+	TP_printk("cpu=%u targ=%lu actual=%lu",
+		__entry->cpu_id, __entry->targfreq,
+		__entry->actualfreq)
+);
+
+DEFINE_EVENT(set, cpufreq_interactive_up,
+	TP_PROTO(u32 cpu_id, unsigned long targfreq,
+		 unsigned long actualfreq),
+	TP_ARGS(cpu_id, targfreq, actualfreq)
+);
+
+DEFINE_EVENT(set, cpufreq_interactive_down,
+	TP_PROTO(u32 cpu_id, unsigned long targfreq,
+		 unsigned long actualfreq),
+	TP_ARGS(cpu_id, targfreq, actualfreq)
+);
+
+DECLARE_EVENT_CLASS(loadeval,
+	TP_PROTO(unsigned long cpu_id, unsigned long load,
+		 unsigned long curactual, unsigned long curtarg,
+		 unsigned long newtarg, unsigned int reason),
+	TP_ARGS(cpu_id, load, curactual, curtarg, newtarg, reason),
+
+	TP_STRUCT__entry(
+		__field(unsigned long,	cpu_id)
+		__field(unsigned long,	load)
+		__field(unsigned long,	curactual)
+		__field(unsigned long,	curtarg)
+		__field(unsigned long,	newtarg)
+		__field(unsigned int,	reason)
+	),
+
+	TP_fast_assign(
+		__entry->cpu_id = cpu_id;
+		__entry->load = load;
+		__entry->curactual = curactual;
+		__entry->curtarg = curtarg;
+		__entry->newtarg = newtarg;
+		__entry->reason = reason;
+	),
+
+	TP_printk("cpu=%lu load=%lu actual=%lu cur=%lu targ=%lu reason=%s",
+		__entry->cpu_id, __entry->load, __entry->curactual,
+		__entry->curtarg, __entry->newtarg,
+		__print_symbolic(__entry->reason,
+			{ INTERACTIVE_REASON_LOAD,	"load" },
+			{ INTERACTIVE_REASON_HISPEED,	"hispeed" },
+			{ INTERACTIVE_REASON_MAXSPEED,	"maxspeed" },
+			{ INTERACTIVE_REASON_BOOST,	"boost" },
+			{ INTERACTIVE_REASON_HISPEED_DELAY, "hispeed_delay" },
+			{ INTERACTIVE_REASON_MIN_SAMPLE_TIME,
+							"min_sample_time" }))
+);
+
+DEFINE_EVENT(loadeval, cpufreq_interactive_target,
+	TP_PROTO(unsigned long cpu_id, unsigned long load,
+		 unsigned long curactual, unsigned long curtarg,
+		 unsigned long newtarg, unsigned int reason),
+	TP_ARGS(cpu_id, load, curactual, curtarg, newtarg, reason)
+);
+
+DEFINE_EVENT(loadeval, cpufreq_interactive_already,
+	TP_PROTO(unsigned long cpu_id, unsigned long load,
+		 unsigned long curactual, unsigned long curtarg,
+		 unsigned long newtarg, unsigned int reason),
+	TP_ARGS(cpu_id, load, curactual, curtarg, newtarg, reason)
+);
+
+DEFINE_EVENT(loadeval, cpufreq_interactive_notyet,
+	TP_PROTO(unsigned long cpu_id, unsigned long load,
+		 unsigned long curactual, unsigned long curtarg,
+		 unsigned long newtarg, unsigned int reason),
+	TP_ARGS(cpu_id, load, curactual, curtarg, newtarg, reason)
+);
+
+TRACE_EVENT(cpufreq_interactive_boost,
+	TP_PROTO(unsigned long freq, unsigned long duration_us),
+	TP_ARGS(freq, duration_us),
+
+	TP_STRUCT__entry(
+		__field(unsigned long,	freq)
+		__field(unsigned long,	duration_us)
+	),
+
+	TP_fast_assign(
+		__entry->freq = freq;
+		__entry->duration_us = duration_us;
+	),
+
+	TP_printk("freq=%lu duration_us=%lu",
+		__entry->freq, __entry->duration_us)
+);
+
+#endif /* _TRACE_CPUFREQ_INTERACTIVE_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
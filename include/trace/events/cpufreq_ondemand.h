@@ -0,0 +1,53 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cpufreq_ondemand
+
+#if !defined(_TRACE_CPUFREQ_ONDEMAND_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_CPUFREQ_ONDEMAND_H
+
+#include <linux/tracepoint.h>
+
+#ifndef _TRACE_CPUFREQ_ONDEMAND_REASONS
+#define _TRACE_CPUFREQ_ONDEMAND_REASONS
+#define ONDEMAND_REASON_UP	0	/* above up_threshold, go to max */
+#define ONDEMAND_REASON_DOWN	1	/* below up_threshold - differential */
+#define ONDEMAND_REASON_HOLD	2	/* inside the hysteresis band */
+#define ONDEMAND_REASON_MIN	3	/* already at policy->min */
+#endif
+
+TRACE_EVENT(cpufreq_ondemand_sample,
+
+	TP_PROTO(u32 cpu_id, unsigned int load, unsigned int curfreq,
+		 unsigned int targfreq, unsigned int reason),
+
+	TP_ARGS(cpu_id, load, curfreq, targfreq, reason),
+
+	TP_STRUCT__entry(
+		__field(u32,		cpu_id)
+		__field(unsigned int,	load)
+		__field(unsigned int,	curfreq)
+		__field(unsigned int,	targfreq)
+		__field(unsigned int,	reason)
+	),
+
+	TP_fast_assign(
+		__entry->cpu_id = cpu_id;
+		__entry->load = load;
+		__entry->curfreq = curfreq;
+		__entry->targfreq = targfreq;
+		__entry->reason = reason;
+	),
+
+	TP_printk("cpu=%u load=%u actual=%u targ=%u reason=%s",
+		__entry->cpu_id, __entry->load, __entry->curfreq,
+		__entry->targfreq,
+		__print_symbolic(__entry->reason,
+			{ ONDEMAND_REASON_UP,	"up" },
+			{ ONDEMAND_REASON_DOWN,	"down" },
+			{ ONDEMAND_REASON_HOLD,	"hold" },
+			{ ONDEMAND_REASON_MIN,	"min" }))
+);
+
+#endif /* _TRACE_CPUFREQ_ONDEMAND_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -0,0 +1,46 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM lowmemorykiller
+
+#if !defined(_TRACE_LOWMEMORYKILLER_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_LOWMEMORYKILLER_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(lowmem_select,
+
+	TP_PROTO(int min_adj, int adj, pid_t pid, int tasksize,
+		 int scanned, u64 latency_ns),
+
+	TP_ARGS(min_adj, adj, pid, tasksize, scanned, latency_ns),
+
+	TP_STRUCT__entry(
+		__field(int,	min_adj)
+		__field(int,	adj)
+		__field(pid_t,	pid)
+		__field(int,	tasksize)
+		__field(int,	scanned)
+		__field(u64,	latency_ns)
+	),
+
+	TP_fast_assign(
+		__entry->min_adj = min_adj;
+		__entry->adj = adj;
+		__entry->pid = pid;
+		__entry->tasksize = tasksize;
+		__entry->scanned = scanned;
+		__entry->latency_ns = latency_ns;
+	),
+
+	TP_printk("min_adj=%d, adj=%d, pid=%d, tasksize=%d, scanned=%d, latency_ns=%llu",
+		__entry->min_adj,
+		__entry->adj,
+		__entry->pid,
+		__entry->tasksize,
+		__entry->scanned,
+		__entry->latency_ns)
+);
+
+#endif /* _TRACE_LOWMEMORYKILLER_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
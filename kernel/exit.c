@@ -71,6 +71,8 @@ static void __unhash_process(struct task_struct *p, bool group_dead)
 		list_del_init(&p->sibling);
 		__this_cpu_dec(process_counts);
 	}
+	/* not only if group_dead, an old leader after exec is unindexed */
+	lowmem_adj_index_del(p);
 	list_del_rcu(&p->thread_group);
 }
 
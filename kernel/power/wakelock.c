@@ -51,6 +51,17 @@ module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 static DEFINE_SPINLOCK(list_lock);
 static LIST_HEAD(inactive_locks);
 static struct list_head active_wake_locks[WAKE_LOCK_TYPE_COUNT];
+
+/*
+ * has_wake_lock() is called from the idle and freezer paths, so it must
+ * not walk active_wake_locks.  Active locks without a timeout are only
+ * counted, and locks with a timeout are also kept in a tree sorted by
+ * expiry with the first one cached.  The lists are still maintained for
+ * the stats and debug output.
+ */
+static int active_count[WAKE_LOCK_TYPE_COUNT];
+static struct rb_root expire_tree[WAKE_LOCK_TYPE_COUNT];
+static struct rb_node *expire_first[WAKE_LOCK_TYPE_COUNT];
 static int current_event_num;
 struct workqueue_struct *suspend_work_queue;
 struct wake_lock main_wake_lock;
@@ -134,6 +145,28 @@ static int print_lock_stat(struct seq_file *m, struct wake_lock *lock)
 		     ktime_to_ns(lock->stat.last_time));
 }
 
+static int print_lock_hist(struct seq_file *m, struct wake_lock *lock)
+{
+	int i;
+
+	seq_printf(m, "\"%s\"\t%d\t%d", lock->name, lock->stat.wakeup_count,
+		   lock->stat.abort_count);
+	for (i = 0; i < WAKE_LOCK_HIST_BUCKETS; i++)
+		seq_printf(m, "\t%u", lock->stat.hold_hist[i]);
+	return seq_putc(m, '\n');
+}
+
+static int wakelock_hist_headers(struct seq_file *m)
+{
+	int i;
+
+	seq_printf(m, "name\twake_count\tabort_count");
+	for (i = 0; i < WAKE_LOCK_HIST_BUCKETS - 1; i++)
+		seq_printf(m, "\t<%dms", 1 << i);
+	seq_printf(m, "\t>=%dms\n", 1 << (WAKE_LOCK_HIST_BUCKETS - 2));
+	return 0;
+}
+
 static int wakelock_stat_headers(struct seq_file *m)
 {
 	seq_printf(m, "name\tcount\texpire_count\twake_count\tactive_since"
@@ -196,6 +229,47 @@ static int wakelock_seq_show(struct seq_file *m, void *v)
 	return ret;
 }
 
+static int wakelock_hist_seq_show(struct seq_file *m, void *v)
+{
+	if (v == SEQ_START_TOKEN)
+		return wakelock_hist_headers(m);
+
+	/* m->private is our own copy, the stat fields need no locking */
+	return print_lock_hist(m, m->private);
+}
+
+static int hold_hist_bucket(ktime_t duration)
+{
+	s64 ms = ktime_to_ms(duration);
+
+	if (ms <= 0)
+		return 0;
+	if (ms >= 1 << (WAKE_LOCK_HIST_BUCKETS - 2))
+		return WAKE_LOCK_HIST_BUCKETS - 1;
+	return fls((int)ms);
+}
+
+/*
+ * Charge a suspend that was refused to every suspend lock still holding
+ * it off.  This walks the active list, but only on the abort path.
+ */
+static void blame_suspend_abort_locked(void)
+{
+	struct wake_lock *lock;
+
+	list_for_each_entry(lock, &active_wake_locks[WAKE_LOCK_SUSPEND], link)
+		lock->stat.abort_count++;
+}
+
+static void blame_suspend_abort(void)
+{
+	unsigned long irqflags;
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	blame_suspend_abort_locked();
+	spin_unlock_irqrestore(&list_lock, irqflags);
+}
+
 static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 {
 	ktime_t duration;
@@ -246,6 +320,7 @@ static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 	lock->stat.total_time = ktime_add(lock->stat.total_time, duration);
 	if (ktime_to_ns(duration) > ktime_to_ns(lock->stat.max_time))
 		lock->stat.max_time = duration;
+	lock->stat.hold_hist[hold_hist_bucket(duration)]++;
 	lock->stat.last_time = ktime_get();
 	if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
 		duration = ktime_sub(now, last_sleep_time_update);
@@ -282,12 +357,69 @@ static void update_sleep_wait_stats_locked(int done)
 }
 #endif
 
+static void expire_tree_insert(struct wake_lock *lock, int type)
+{
+	struct rb_node **p = &expire_tree[type].rb_node;
+	struct rb_node *parent = NULL;
+	struct wake_lock *entry;
+	bool leftmost = true;
+
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct wake_lock, expire_node);
+		if (time_before(lock->expires, entry->expires)) {
+			p = &parent->rb_left;
+		} else {
+			p = &parent->rb_right;
+			leftmost = false;
+		}
+	}
+	if (leftmost)
+		expire_first[type] = &lock->expire_node;
+	rb_link_node(&lock->expire_node, parent, p);
+	rb_insert_color(&lock->expire_node, &expire_tree[type]);
+}
+
+static void expire_tree_erase(struct wake_lock *lock, int type)
+{
+	if (expire_first[type] == &lock->expire_node)
+		expire_first[type] = rb_next(&lock->expire_node);
+	rb_erase(&lock->expire_node, &expire_tree[type]);
+}
+
+/*
+ * Caller must acquire the list_lock spinlock, and call these with the
+ * flags and expires of the lock as they are (or will be) while it is
+ * accounted as active.
+ */
+static void active_lock_add(struct wake_lock *lock)
+{
+	int type = lock->flags & WAKE_LOCK_TYPE_MASK;
+
+	if (lock->flags & WAKE_LOCK_AUTO_EXPIRE)
+		expire_tree_insert(lock, type);
+	else
+		active_count[type]++;
+}
+
+static void active_lock_del(struct wake_lock *lock)
+{
+	int type = lock->flags & WAKE_LOCK_TYPE_MASK;
+
+	if (!(lock->flags & WAKE_LOCK_ACTIVE))
+		return;
+	if (lock->flags & WAKE_LOCK_AUTO_EXPIRE)
+		expire_tree_erase(lock, type);
+	else
+		active_count[type]--;
+}
 
 static void expire_wake_lock(struct wake_lock *lock)
 {
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_unlock_stat_locked(lock, 1);
 #endif
+	active_lock_del(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -335,21 +467,23 @@ static void print_active_locks(int type)
 
 static long has_wake_lock_locked(int type)
 {
-	struct wake_lock *lock, *n;
-	long max_timeout = 0;
+	struct wake_lock *lock;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
-	list_for_each_entry_safe(lock, n, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout <= 0)
-				expire_wake_lock(lock);
-			else if (timeout > max_timeout)
-				max_timeout = timeout;
-		} else
-			return -1;
+	while (expire_first[type]) {
+		lock = rb_entry(expire_first[type], struct wake_lock,
+				expire_node);
+		if ((long)(lock->expires - jiffies) > 0)
+			break;
+		expire_wake_lock(lock);
 	}
-	return max_timeout;
+	if (active_count[type])
+		return -1;
+	if (!expire_first[type])
+		return 0;
+	lock = rb_entry(rb_last(&expire_tree[type]), struct wake_lock,
+			expire_node);
+	return lock->expires - jiffies;
 }
 
 long has_wake_lock(int type)
@@ -416,6 +550,9 @@ static void suspend(struct work_struct *work)
 	if (has_wake_lock(WAKE_LOCK_SUSPEND) || !alarm_pm_wake_check()) {
 		if (debug_mask & DEBUG_SUSPEND)
 			pr_info("suspend: abort suspend\n");
+#ifdef CONFIG_WAKELOCK_STAT
+		blame_suspend_abort();
+#endif
 		return;
 	}
 
@@ -487,6 +624,8 @@ static int power_suspend_late(struct device *dev)
 {
 	int ret = has_wake_lock(WAKE_LOCK_SUSPEND) ? -EAGAIN : 0;
 #ifdef CONFIG_WAKELOCK_STAT
+	if (ret)
+		blame_suspend_abort();
 	wait_for_wakeup = !ret;
 	if (longest_background_lock && longest_background_lock->flags
 			& WAKE_LOCK_INITIALIZED) {
@@ -553,6 +692,8 @@ void wake_lock_init(struct wake_lock *lock, int type, const char *name)
 	lock->stat.last_time = ktime_set(0, 0);
 	lock->stat.last_unlock_time = ktime_set(0, 0);
 	lock->stat.background_locked_time = ktime_set(0, 0);
+	lock->stat.abort_count = 0;
+	memset(lock->stat.hold_hist, 0, sizeof(lock->stat.hold_hist));
 #endif
 	lock->flags = (type & WAKE_LOCK_TYPE_MASK) | WAKE_LOCK_INITIALIZED;
 
@@ -569,9 +710,12 @@ void wake_lock_destroy(struct wake_lock *lock)
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_lock_destroy name=%s\n", lock->name);
 	spin_lock_irqsave(&list_lock, irqflags);
-	lock->flags &= ~WAKE_LOCK_INITIALIZED;
+	active_lock_del(lock);
+	lock->flags &= ~(WAKE_LOCK_INITIALIZED | WAKE_LOCK_ACTIVE);
 #ifdef CONFIG_WAKELOCK_STAT
 	if (lock->stat.count) {
+		int i;
+
 		deleted_wake_locks.stat.count += lock->stat.count;
 		deleted_wake_locks.stat.expire_count += lock->stat.expire_count;
 		deleted_wake_locks.stat.total_time =
@@ -583,6 +727,10 @@ void wake_lock_destroy(struct wake_lock *lock)
 		deleted_wake_locks.stat.max_time =
 			ktime_add(deleted_wake_locks.stat.max_time,
 				  lock->stat.max_time);
+		deleted_wake_locks.stat.abort_count += lock->stat.abort_count;
+		for (i = 0; i < WAKE_LOCK_HIST_BUCKETS; i++)
+			deleted_wake_locks.stat.hold_hist[i] +=
+				lock->stat.hold_hist[i];
 	}
 #endif
 	list_del(&lock->link);
@@ -615,6 +763,7 @@ static void wake_lock_internal(
 	}
 	wakeup_time = ktime_get();
 #endif
+	active_lock_del(lock);
 	if (!(lock->flags & WAKE_LOCK_ACTIVE)) {
 		lock->flags |= WAKE_LOCK_ACTIVE;
 #ifdef CONFIG_WAKELOCK_STAT
@@ -637,6 +786,7 @@ static void wake_lock_internal(
 		lock->flags &= ~WAKE_LOCK_AUTO_EXPIRE;
 		list_add(&lock->link, &active_wake_locks[type]);
 	}
+	active_lock_add(lock);
 	if (type == WAKE_LOCK_SUSPEND) {
 		current_event_num++;
 #ifdef CONFIG_WAKELOCK_STAT
@@ -691,6 +841,7 @@ void wake_unlock(struct wake_lock *lock)
 #endif
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_unlock: %s\n", lock->name);
+	active_lock_del(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -735,7 +886,15 @@ static const struct seq_operations wakelock_seq_ops = {
 	.show  = wakelock_seq_show,
 };
 
-static int wakelock_stats_open(struct inode *inode, struct file *file)
+static const struct seq_operations wakelock_hist_seq_ops = {
+	.start = wakelock_seq_start,
+	.next  = wakelock_seq_next,
+	.stop  = wakelock_seq_stop,
+	.show  = wakelock_hist_seq_show,
+};
+
+static int wakelock_seq_open(struct file *file,
+			     const struct seq_operations *ops)
 {
 	int ret;
 	struct seq_file *m;
@@ -745,7 +904,7 @@ static int wakelock_stats_open(struct inode *inode, struct file *file)
 	if (!lock)
 		return -ENOMEM;
 
-	ret = seq_open(file, &wakelock_seq_ops);
+	ret = seq_open(file, ops);
 	if (ret) {
 		kfree(lock);
 		return ret;
@@ -756,6 +915,16 @@ static int wakelock_stats_open(struct inode *inode, struct file *file)
 	return ret;
 }
 
+static int wakelock_stats_open(struct inode *inode, struct file *file)
+{
+	return wakelock_seq_open(file, &wakelock_seq_ops);
+}
+
+static int wakelock_hist_open(struct inode *inode, struct file *file)
+{
+	return wakelock_seq_open(file, &wakelock_hist_seq_ops);
+}
+
 static int wakelock_stats_release(struct inode *inode, struct file *file)
 {
 	struct seq_file *m = file->private_data;
@@ -771,6 +940,14 @@ static const struct file_operations wakelock_stats_fops = {
 	.llseek = seq_lseek,
 	.release = wakelock_stats_release,
 };
+
+static const struct file_operations wakelock_hist_fops = {
+	.owner = THIS_MODULE,
+	.open = wakelock_hist_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = wakelock_stats_release,
+};
 #endif
 
 static int __init wakelocks_init(void)
@@ -778,8 +955,10 @@ static int __init wakelocks_init(void)
 	int ret;
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++)
+	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++) {
 		INIT_LIST_HEAD(&active_wake_locks[i]);
+		expire_tree[i] = RB_ROOT;
+	}
 
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_lock_init(&deleted_wake_locks, WAKE_LOCK_SUSPEND,
@@ -812,6 +991,7 @@ static int __init wakelocks_init(void)
 
 #ifdef CONFIG_WAKELOCK_STAT
 	proc_create("wakelocks", S_IRUGO, NULL, &wakelock_stats_fops);
+	proc_create("wakelock_histograms", S_IRUGO, NULL, &wakelock_hist_fops);
 	register_early_suspend(&power_early_suspend_desc);
 	wakeup_time = ktime_get();
 	longest = 0;
@@ -838,6 +1018,7 @@ err_platform_device_register:
 static void  __exit wakelocks_exit(void)
 {
 #ifdef CONFIG_WAKELOCK_STAT
+	remove_proc_entry("wakelock_histograms", NULL);
 	remove_proc_entry("wakelocks", NULL);
 #endif
 	destroy_workqueue(suspend_work_queue);
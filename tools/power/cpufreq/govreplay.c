@@ -0,0 +1,612 @@
+/*
+ * govreplay -- replay a recorded CPU load trace through the interactive
+ * and ondemand cpufreq governor decision logic, and compare the resulting
+ * policies on energy vs. latency offline.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Input is either the text of /sys/kernel/debug/tracing/trace with the
+ * cpufreq_interactive and/or cpufreq_ondemand events enabled, or plain
+ * "time_us demand_khz" lines.  Each sample gives the demand over the
+ * interval that ended at its timestamp; demand is load times the
+ * frequency the CPU actually ran at, so it is clipped at the speed that
+ * was in effect when the trace was recorded.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <limits.h>
+
+#define MAX_FREQS		32
+#define MAX_TARGET_LOADS	(2 * MAX_FREQS + 1)
+
+struct sample {
+	double t_us;
+	double demand;		/* kHz worth of work */
+};
+
+struct boost {
+	double t_us;
+	unsigned int freq;
+	double duration_us;
+};
+
+static struct sample *samples;
+static int nsamples, samples_alloc;
+static struct boost *boosts;
+static int nboosts, boosts_alloc;
+
+static unsigned int freqs[MAX_FREQS];
+static double power[MAX_FREQS];		/* mW at 100% busy */
+static int nfreqs;
+static double idle_power = 20;		/* mW */
+static int have_power;
+
+static int filter_cpu;
+static double quantum_us = 1000;
+static int verbose;
+
+/* interactive tunables, same names and defaults as the sysfs ones */
+static unsigned int target_loads[MAX_TARGET_LOADS] = { 90 };
+static int ntarget_loads = 1;
+static unsigned int hispeed_freq;
+static unsigned int go_maxspeed_load = 95;
+static double above_hispeed_delay = 20000;
+static double min_sample_time = 20000;
+static double timer_rate = 10000;
+
+/* ondemand tunables */
+static unsigned int up_threshold = 80;
+static unsigned int down_differential = 10;
+static unsigned int sampling_down_factor = 1;
+static double sampling_rate = 10000;
+
+struct result {
+	const char *name;
+	double energy;			/* mJ */
+	double wall_us;
+	double saturated_us;		/* time with work left over */
+	double backlog_sum;		/* sum of backlog_us * quantum_us */
+	double backlog_max;		/* us of work at fmax */
+	unsigned long transitions;
+	double residency[MAX_FREQS];	/* us */
+};
+
+/*
+ * Per-run CPU state: the governor only gets to see busy and wall time,
+ * the same as it would from the idle accounting in the kernel.
+ */
+struct cpu {
+	int idx;			/* current entry in freqs[] */
+	double backlog;			/* kHz*us of work not yet done */
+	double busy, wall;		/* since the last governor sample */
+	double busy_chg, wall_chg;	/* since the last frequency change */
+	double now;
+	int next_sample;
+	int next_boost;
+	double boost_until;
+	unsigned int boost_freq;
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+"usage: govreplay [-v] [-c cpu] [-f freq,...] [-p mW,...] [-i idle_mW]\n"
+"                 [-q quantum_us] [-g interactive|ondemand|both]\n"
+"                 [-t tunable=value]... [trace]\n");
+	exit(1);
+}
+
+static void *grow(void *p, int *alloc, size_t size)
+{
+	*alloc = *alloc ? *alloc * 2 : 1024;
+	p = realloc(p, *alloc * size);
+	if (!p) {
+		perror("realloc");
+		exit(1);
+	}
+	return p;
+}
+
+static void add_sample(double t_us, double demand)
+{
+	if (nsamples && t_us <= samples[nsamples - 1].t_us)
+		return;
+	if (nsamples == samples_alloc)
+		samples = grow(samples, &samples_alloc, sizeof(*samples));
+	samples[nsamples].t_us = t_us;
+	samples[nsamples].demand = demand;
+	nsamples++;
+}
+
+static void add_boost(double t_us, unsigned int freq, double duration_us)
+{
+	if (nboosts == boosts_alloc)
+		boosts = grow(boosts, &boosts_alloc, sizeof(*boosts));
+	boosts[nboosts].t_us = t_us;
+	boosts[nboosts].freq = freq;
+	boosts[nboosts].duration_us = duration_us;
+	nboosts++;
+}
+
+static void add_freq(unsigned int freq)
+{
+	int i, j;
+
+	for (i = 0; i < nfreqs; i++)
+		if (freqs[i] >= freq)
+			break;
+	if (i < nfreqs && freqs[i] == freq)
+		return;
+	if (nfreqs == MAX_FREQS) {
+		fprintf(stderr, "too many frequencies\n");
+		exit(1);
+	}
+	for (j = nfreqs; j > i; j--)
+		freqs[j] = freqs[j - 1];
+	freqs[i] = freq;
+	nfreqs++;
+}
+
+/* returns the value of " name=" in an ftrace line, or -1 */
+static long field(const char *line, const char *name)
+{
+	const char *p = line;
+	size_t len = strlen(name);
+
+	while ((p = strstr(p, name)) != NULL) {
+		if ((p == line || p[-1] == ' ') && p[len] == '=')
+			return strtol(p + len + 1, NULL, 10);
+		p += len;
+	}
+	return -1;
+}
+
+/* the "secs.usecs:" stamp right before the event name */
+static double stamp(const char *line, const char *event)
+{
+	const char *p = event;
+
+	while (p > line && p[-1] == ' ')
+		p--;
+	if (p > line && p[-1] == ':')
+		p--;
+	while (p > line && (isdigit(p[-1]) || p[-1] == '.'))
+		p--;
+	return strtod(p, NULL) * 1e6;
+}
+
+static void parse(FILE *in, int collect_freqs)
+{
+	char line[1024];
+	const char *ev;
+	long cpu, load, actual, freq, dur;
+	double t, d;
+
+	while (fgets(line, sizeof(line), in)) {
+		if ((ev = strstr(line, "cpufreq_interactive_boost:"))) {
+			freq = field(line, "freq");
+			dur = field(line, "duration_us");
+			if (freq > 0 && dur > 0)
+				add_boost(stamp(line, ev), freq, dur);
+			continue;
+		}
+		ev = strstr(line, "cpufreq_interactive_target:");
+		if (!ev)
+			ev = strstr(line, "cpufreq_interactive_already:");
+		if (!ev)
+			ev = strstr(line, "cpufreq_interactive_notyet:");
+		if (!ev)
+			ev = strstr(line, "cpufreq_ondemand_sample:");
+		if (ev) {
+			cpu = field(line, "cpu");
+			load = field(line, "load");
+			actual = field(line, "actual");
+			if (cpu != filter_cpu || load < 0 || actual <= 0)
+				continue;
+			if (collect_freqs)
+				add_freq(actual);
+			add_sample(stamp(line, ev), (double)load * actual / 100);
+			continue;
+		}
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%lf B %ld %ld", &t, &freq, &dur) == 3)
+			add_boost(t, freq, dur);
+		else if (sscanf(line, "%lf %lf", &t, &d) == 2)
+			add_sample(t, d);
+	}
+}
+
+static void parse_list(const char *arg, int is_power)
+{
+	char *s = strdup(arg), *tok, *save = NULL;
+	int n = 0;
+
+	for (tok = strtok_r(s, ", ", &save); tok;
+	     tok = strtok_r(NULL, ", ", &save)) {
+		if (is_power) {
+			if (n == MAX_FREQS)
+				break;
+			power[n++] = strtod(tok, NULL);
+		} else {
+			add_freq(strtoul(tok, NULL, 10));
+		}
+	}
+	if (is_power)
+		have_power = n;
+	free(s);
+}
+
+static void parse_target_loads(const char *arg)
+{
+	char *s = strdup(arg), *tok, *save = NULL;
+	int n = 0;
+
+	for (tok = strtok_r(s, " :", &save); tok;
+	     tok = strtok_r(NULL, " :", &save)) {
+		if (n == MAX_TARGET_LOADS)
+			break;
+		target_loads[n++] = strtoul(tok, NULL, 10);
+	}
+	if (!(n & 1)) {
+		fprintf(stderr, "target_loads: expected load [freq:load]...\n");
+		exit(1);
+	}
+	ntarget_loads = n;
+	free(s);
+}
+
+static void parse_tunable(char *arg)
+{
+	char *val = strchr(arg, '=');
+
+	if (!val)
+		usage();
+	*val++ = '\0';
+
+	if (!strcmp(arg, "target_loads"))
+		parse_target_loads(val);
+	else if (!strcmp(arg, "hispeed_freq"))
+		hispeed_freq = strtoul(val, NULL, 10);
+	else if (!strcmp(arg, "go_maxspeed_load"))
+		go_maxspeed_load = strtoul(val, NULL, 10);
+	else if (!strcmp(arg, "above_hispeed_delay"))
+		above_hispeed_delay = strtod(val, NULL);
+	else if (!strcmp(arg, "min_sample_time"))
+		min_sample_time = strtod(val, NULL);
+	else if (!strcmp(arg, "timer_rate"))
+		timer_rate = strtod(val, NULL);
+	else if (!strcmp(arg, "up_threshold"))
+		up_threshold = strtoul(val, NULL, 10);
+	else if (!strcmp(arg, "down_differential"))
+		down_differential = strtoul(val, NULL, 10);
+	else if (!strcmp(arg, "sampling_down_factor"))
+		sampling_down_factor = strtoul(val, NULL, 10);
+	else if (!strcmp(arg, "sampling_rate"))
+		sampling_rate = strtod(val, NULL);
+	else {
+		fprintf(stderr, "unknown tunable %s\n", arg);
+		exit(1);
+	}
+}
+
+/* cpufreq_frequency_table_target() on the sorted table */
+static int relation_l(double target)
+{
+	int i;
+
+	for (i = 0; i < nfreqs; i++)
+		if (freqs[i] >= target)
+			return i;
+	return nfreqs - 1;
+}
+
+static int relation_h(double target)
+{
+	int i;
+
+	for (i = nfreqs - 1; i >= 0; i--)
+		if (freqs[i] <= target)
+			return i;
+	return 0;
+}
+
+static unsigned int freq_to_targetload(unsigned int freq)
+{
+	int i;
+
+	for (i = 0; i < ntarget_loads - 1 && freq >= target_loads[i+1]; i += 2)
+		;
+	return target_loads[i];
+}
+
+/* same search as choose_freq() in cpufreq_interactive.c */
+static unsigned int choose_freq(unsigned int cur, double loadadjfreq)
+{
+	unsigned int freq = cur;
+	unsigned int prevfreq, freqmin = 0, freqmax = UINT_MAX;
+
+	do {
+		prevfreq = freq;
+		freq = freqs[relation_l(loadadjfreq / freq_to_targetload(freq))];
+
+		if (freq > prevfreq) {
+			freqmin = prevfreq;
+			if (freq >= freqmax) {
+				freq = freqs[relation_h(freqmax - 1)];
+				if (freq == freqmin) {
+					freq = freqmax;
+					break;
+				}
+			}
+		} else if (freq < prevfreq) {
+			freqmax = prevfreq;
+			if (freq <= freqmin) {
+				freq = freqs[relation_l(freqmin + 1)];
+				if (freq == freqmax)
+					break;
+			}
+		}
+	} while (freq != prevfreq);
+
+	return freq;
+}
+
+static double demand_at(struct cpu *c)
+{
+	while (c->next_sample < nsamples &&
+	       samples[c->next_sample].t_us < c->now)
+		c->next_sample++;
+	if (c->next_sample == nsamples)
+		return 0;
+	return samples[c->next_sample].demand;
+}
+
+static void replay_boosts(struct cpu *c)
+{
+	while (c->next_boost < nboosts && boosts[c->next_boost].t_us <= c->now) {
+		c->boost_until = boosts[c->next_boost].t_us +
+			boosts[c->next_boost].duration_us;
+		c->boost_freq = boosts[c->next_boost].freq;
+		c->next_boost++;
+	}
+}
+
+/* run one quantum at the current frequency */
+static void step(struct cpu *c, struct result *r)
+{
+	double cap = (double)freqs[c->idx] * quantum_us;
+	double done, busy;
+
+	c->backlog += demand_at(c) * quantum_us;
+	done = c->backlog < cap ? c->backlog : cap;
+	c->backlog -= done;
+	busy = done / cap * quantum_us;
+
+	c->busy += busy;
+	c->wall += quantum_us;
+	c->busy_chg += busy;
+	c->wall_chg += quantum_us;
+
+	r->energy += (busy * power[c->idx] +
+		      (quantum_us - busy) * idle_power) / 1e6;
+	r->wall_us += quantum_us;
+	r->residency[c->idx] += quantum_us;
+	if (c->backlog > 0)
+		r->saturated_us += quantum_us;
+	busy = c->backlog / freqs[nfreqs - 1];
+	r->backlog_sum += busy * quantum_us;
+	if (busy > r->backlog_max)
+		r->backlog_max = busy;
+
+	c->now += quantum_us;
+}
+
+static void set_freq(struct cpu *c, struct result *r, int idx)
+{
+	if (idx == c->idx)
+		return;
+	c->idx = idx;
+	c->busy_chg = c->wall_chg = 0;
+	r->transitions++;
+}
+
+static void run_interactive(struct result *r)
+{
+	struct cpu c = { .idx = nfreqs - 1 };
+	unsigned int hispeed = hispeed_freq ? hispeed_freq : freqs[nfreqs - 1];
+	unsigned int target, new_freq, cur_load, chg_load;
+	double end = samples[nsamples - 1].t_us;
+	double next = timer_rate, hispeed_validate = 0, freq_change = 0;
+
+	c.now = samples[0].t_us;
+	next += c.now;
+	while (c.now < end) {
+		replay_boosts(&c);
+		step(&c, r);
+		if (c.now < next)
+			continue;
+		next = c.now + timer_rate;
+
+		target = freqs[c.idx];
+		cur_load = c.wall ? 100 * c.busy / c.wall : 0;
+		chg_load = c.wall_chg ? 100 * c.busy_chg / c.wall_chg : 0;
+		c.busy = c.wall = 0;
+		if (chg_load > cur_load)
+			cur_load = chg_load;
+
+		if (cur_load >= go_maxspeed_load)
+			new_freq = target < hispeed ? hispeed :
+						     freqs[nfreqs - 1];
+		else
+			new_freq = choose_freq(target,
+					       (double)cur_load * target);
+
+		if (target >= hispeed && new_freq > target &&
+		    c.now - hispeed_validate < above_hispeed_delay)
+			continue;
+		hispeed_validate = c.now;
+
+		if (c.now < c.boost_until && new_freq < c.boost_freq)
+			new_freq = c.boost_freq;
+
+		new_freq = freqs[relation_h(new_freq)];
+		if (new_freq == target)
+			continue;
+		if (new_freq < target && c.now - freq_change < min_sample_time)
+			continue;
+
+		if (verbose)
+			printf("interactive %.0f load=%u %u -> %u\n",
+			       c.now, cur_load, target, new_freq);
+		set_freq(&c, r, relation_h(new_freq));
+		freq_change = c.now;
+	}
+}
+
+static void run_ondemand(struct result *r)
+{
+	struct cpu c = { .idx = nfreqs - 1 };
+	unsigned int cur, load, rate_mult = 1;
+	double end = samples[nsamples - 1].t_us;
+	double next, freq_next;
+	int idx;
+
+	c.now = samples[0].t_us;
+	next = c.now + sampling_rate;
+	while (c.now < end) {
+		step(&c, r);
+		if (c.now < next)
+			continue;
+
+		cur = freqs[c.idx];
+		load = c.wall ? 100 * c.busy / c.wall : 0;
+		c.busy = c.wall = 0;
+		idx = c.idx;
+
+		if (load > up_threshold) {
+			if (c.idx < nfreqs - 1)
+				rate_mult = sampling_down_factor;
+			idx = nfreqs - 1;
+		} else if (c.idx && load < up_threshold - down_differential) {
+			freq_next = (double)load * cur /
+				(up_threshold - down_differential);
+			rate_mult = 1;
+			idx = relation_l(freq_next);
+		}
+		next = c.now + sampling_rate * rate_mult;
+
+		if (verbose && idx != c.idx)
+			printf("ondemand %.0f load=%u %u -> %u\n",
+			       c.now, load, cur, freqs[idx]);
+		set_freq(&c, r, idx);
+	}
+}
+
+static void report(struct result *r)
+{
+	int i;
+
+	printf("%-12s energy %.1f mJ  avg %.1f mW  saturated %.2f%%  "
+	       "backlog avg %.3f ms max %.3f ms  transitions %lu\n",
+	       r->name, r->energy, r->energy * 1e6 / r->wall_us,
+	       100 * r->saturated_us / r->wall_us,
+	       r->backlog_sum / r->wall_us / 1000, r->backlog_max / 1000,
+	       r->transitions);
+	for (i = 0; i < nfreqs; i++)
+		printf("%12u %6.2f%%\n", freqs[i],
+		       100 * r->residency[i] / r->wall_us);
+}
+
+int main(int argc, char **argv)
+{
+	struct result r;
+	const char *gov = "both";
+	FILE *in = stdin;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "vc:f:p:i:q:g:t:")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose++;
+			break;
+		case 'c':
+			filter_cpu = strtol(optarg, NULL, 10);
+			break;
+		case 'f':
+			parse_list(optarg, 0);
+			break;
+		case 'p':
+			parse_list(optarg, 1);
+			break;
+		case 'i':
+			idle_power = strtod(optarg, NULL);
+			break;
+		case 'q':
+			quantum_us = strtod(optarg, NULL);
+			break;
+		case 'g':
+			gov = optarg;
+			break;
+		case 't':
+			parse_tunable(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind < argc) {
+		in = fopen(argv[optind], "r");
+		if (!in) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+	/* without -f, use the frequencies seen in the trace */
+	parse(in, !nfreqs);
+
+	if (nsamples < 2) {
+		fprintf(stderr, "not enough samples for cpu %d\n", filter_cpu);
+		return 1;
+	}
+	if (!nfreqs) {
+		fprintf(stderr, "no frequency table, use -f\n");
+		return 1;
+	}
+	if (have_power && have_power != nfreqs) {
+		fprintf(stderr, "-p needs one value per frequency\n");
+		return 1;
+	}
+	/* without -p, dynamic power ~ f * V^2 with V ~ f, 1W at fmax */
+	for (i = 0; !have_power && i < nfreqs; i++) {
+		double f = (double)freqs[i] / freqs[nfreqs - 1];
+
+		power[i] = 1000 * f * f * f;
+	}
+
+	if (strcmp(gov, "ondemand")) {
+		memset(&r, 0, sizeof(r));
+		r.name = "interactive";
+		run_interactive(&r);
+		report(&r);
+	}
+	if (strcmp(gov, "interactive")) {
+		memset(&r, 0, sizeof(r));
+		r.name = "ondemand";
+		run_ondemand(&r);
+		report(&r);
+	}
+	return 0;
+}